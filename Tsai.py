@@ -18,7 +18,7 @@ class CalibrationError(Exception):
                 return str(self.value)
 
 
-class CameraParameters:
+class CameraParameters(pytsai.CameraModel):
 
         """
         Utility class for camera parameters.
@@ -26,6 +26,12 @@ class CameraParameters:
         This class can be used as an input and output to the L{calibrate}
         method.  It functions as a mapping type between camera parameters
         (stored as strings), and their values (numbers).
+
+        The 28 camera parameters are held natively by the base class
+        C{pytsai.CameraModel}, which also provides the mapping methods and
+        the single point transforms L{world2image}, L{image2world},
+        L{world2camera} and L{camera2world}; the extension reads them
+        without looking up any keys.  Other keys are kept as attributes.
         """
         
         def __init__(self, existing=None, **keywords):
@@ -52,13 +58,7 @@ class CameraParameters:
                                         - M{sx = 1.0}
                 """
                 
-                # initially create all parameters, setting them to 0.0
-                parms = ['Ncx', 'Nfx', 'dx', 'dy', 'dpx', 'dpy', 'Cx', 'Cy',
-                         'sx', 'f', 'kappa1', 'p1', 'p2', 'Tx', 'Ty', 'Tz',
-                         'Rx', 'Ry', 'Rz', 'r1', 'r2', 'r3', 'r4', 'r5',
-                         'r6', 'r7', 'r8', 'r9']
-                def createParam(x): self[x]=0.0
-                list(map(createParam, parms)) #map() function returns iterator in python 3. This is a workaround.
+                # all parameters start out as 0.0 (see pytsai.CameraModel)
 
                 # copy an existing map if one was provided
                 if existing is not None:
@@ -187,62 +187,73 @@ class CameraParameters:
                 """
                 return 2.0 * math.atan2(self.Ncx * self.dx, 2.0 * self.f);
 
-        def world2image(self, coord):
+        def world2imageArray(self, coords, out=None):
                 """
-                Converts from world coordinates to image coordinates.  The
-                conversion is based upon the camera's current parameters.
+                Converts an array of world coordinates to image coordinates,
+                as L{world2image} does for a single point.  The conversion
+                runs in C over the whole array.
+
+                @param coords: A C-contiguous float64 array (such as a NumPy
+                        array) of shape M{(N, 3)}, with one M{(xw, yw, zw)}
+                        row per point.
 
-                @param coord: A 3-member sequence containing the world
-                        coordinates M{(xw, yw, zw)}.
+                @param out: An optional writable C-contiguous float64 array of
+                        shape M{(N, 2)} to hold the result.
 
-                @return: A 2-member sequence containing the image coordinates
-                        M{(xi, yi)}.
+                @return: The array of image coordinates M{(xi, yi)}, of shape
+                        M{(N, 2)}.  This is out if it was given; otherwise it
+                        is a new memoryview, which numpy.asarray() wraps
+                        without copying.
                 """
-                return pytsai._pytsai_wc2ic(coord, self)
+                return pytsai._pytsai_wc2ic_array(coords, self, out)
 
-        def image2world(self, coord):
+        def image2worldArray(self, coords, out=None):
                 """
-                Converts from image coordinates to world coordinates.  The
-                conversion is based upon the camera's current parameters.
+                Converts an array of image coordinates to world coordinates,
+                as L{image2world} does for a single point.
 
-                @param coord: A 3-member sequence containing the image
-                        coordinates and the depth coordinate in the world
-                        M{(xi, yi, zw)}.
+                @param coords: A C-contiguous float64 array of shape
+                        M{(N, 3)}, with one M{(xi, yi, zw)} row per point.
 
-                @return: A 3-member sequence containing the world coordinates
-                        M{(xw, yw, zw)}.
+                @param out: An optional writable C-contiguous float64 array of
+                        shape M{(N, 3)} to hold the result.  It may be coords.
+
+                @return: The array of world coordinates M{(xw, yw, zw)}, of
+                        shape M{(N, 3)}; see L{world2imageArray}.
                 """
-                return pytsai._pytsai_ic2wc(coord, self)
+                return pytsai._pytsai_ic2wc_array(coords, self, out)
 
-        def world2camera(self, coord):
+        def world2cameraArray(self, coords, out=None):
                 """
-                Converts from world coordinates to camera coordinates.  The
-                conversion is based upon the camera's current parameters.
+                Converts an array of world coordinates to camera coordinates,
+                as L{world2camera} does for a single point.
+
+                @param coords: A C-contiguous float64 array of shape
+                        M{(N, 3)}, with one M{(xw, yw, zw)} row per point.
 
-                @param coord: A 3-member sequence containing the world
-                        coordinates M{(xw, yw, zw)}.
+                @param out: An optional writable C-contiguous float64 array of
+                        shape M{(N, 3)} to hold the result.  It may be coords.
 
-                @return: A 3-member sequence containing the camera coordinates
-                        M{(xc, yc, zc)}.
+                @return: The array of camera coordinates M{(xc, yc, zc)}, of
+                        shape M{(N, 3)}; see L{world2imageArray}.
                 """
-                xw, yw, zw = coord
-                xc = self.r1 * xw + self.r2 * yw + self.r3 * zw + self.Tx
-                yc = self.r4 * xw + self.r5 * yw + self.r6 * zw + self.Ty
-                zc = self.r7 * xw + self.r8 * yw + self.r9 * zw + self.Tz
-                return (xc, yc, zc)
+                return pytsai._pytsai_wc2cc_array(coords, self, out)
 
-        def camera2world(self, coord):
+        def camera2worldArray(self, coords, out=None):
                 """
-                Converts from camera coordinates to world coordinates.  The
-                conversion is based upon the camera's current parameters.
+                Converts an array of camera coordinates to world coordinates,
+                as L{camera2world} does for a single point.
+
+                @param coords: A C-contiguous float64 array of shape
+                        M{(N, 3)}, with one M{(xc, yc, zc)} row per point.
 
-                @param coord: A 3-member sequence containing the camera
-                        coordinates M{(xc, yc, zc)}.
+                @param out: An optional writable C-contiguous float64 array of
+                        shape M{(N, 3)} to hold the result.  It may be coords.
 
-                @return: A 3-member sequence containing the world
-                        coordinates M{(xw, yw, zw)}.
+                @return: The array of world coordinates M{(xw, yw, zw)}, of
+                        shape M{(N, 3)}; see L{world2imageArray}.
                 """
-                return pytsai._pytsai_cc2wc(coord, self)
+                return pytsai._pytsai_cc2wc_array(coords, self, out)
 
         def removeRadialDistortion(self, coord, type='sensor'):
                 """
@@ -264,7 +275,8 @@ class CameraParameters:
                         Xfd,Yfd = coord
                         Xd = self.dpx * (Xfd - self.Cx) / self.sx
                         Yd = self.dpy * (Yfd - self.Cy)
-                        Xu,Yu = removeDistortion((Xd,Yd), 'sensor')
+                        Xu,Yu = self.removeRadialDistortion((Xd,Yd),
+                                                            'sensor')
                         Xfu = Xu*self.sx/self.dpx + self.Cx
                         Yfu = Yu/self.dpy + self.Cy
                         return (Xfu, Yfu)
@@ -292,7 +304,8 @@ class CameraParameters:
                         Xfu,Yfu = coord
                         Xu = self.dpx * (Xfu - self.Cx) / self.sx
                         Yu = self.dpy * (Yfu - self.Cy)
-                        Xd,Yd = addDistortion((Xu, Yu), 'sensor')
+                        Xd,Yd = self.addRadialDistortion((Xu, Yu),
+                                                         'sensor')
                         Xfd = Xd*self.sx/self.dpx + self.Cx
                         Yfd = Yd/self.dpy + self.Cy
                         return (Xfd,Yfd)
@@ -321,21 +334,6 @@ class CameraParameters:
                 asp = float(xres) / float(yres) #test with this - maybe its yres/xres
                 cam.lens = 16.0 / (asp * math.tan(self.getFOVx() / 2.0))
 
-        def iterkeys(self):
-                """
-                Iterates over the keys of the mapping.
-                """
-                return self.__dict__.iterkeys()
-        def __getitem__(self, key):
-                return self.__dict__[key]
-        def __setitem__(self, key, value):
-                self.__dict__[key] = value
-        def __delitem__(self, key):
-                del self.__dict__[key]
-        def __iter__(self):
-                return self.iterkeys()
-        def __contains__(self, item):
-                return (item in self.__dict__)
         def __str__(self):
                 str = 'CameraParameters:\n'
                 parms = ['Ncx', 'Nfx', 'dx', 'dy', 'dpx', 'dpy', 'Cx', 'Cy',
@@ -382,6 +380,14 @@ def calibrate(target_type, optimization_type, calibration_data, camera_params,
                           calibration points.
                         - M{(xi, yi)} are corresponding 2D image space 
                           coordinates of the calibration points.
+                The points may also be given, without conversion to Python
+                objects, as:
+                        - a C-contiguous float64 array (such as a NumPy
+                          array) of shape M{(N, 5)}, laid out as above.
+                        - a dictionary with keys C{'xw'}, C{'yw'}, C{'zw'},
+                          C{'Xf'} and C{'Yf'} mapping to C-contiguous 1-D
+                          float64 arrays of length M{N}, which are read in
+                          place.
         @param camera_params: A dictionary mapping camera parameter names
                 (stored as strings) to their values (which should be
                 numbers).  The class L{CameraParameters} is a utility class
@@ -395,18 +401,16 @@ def calibrate(target_type, optimization_type, calibration_data, camera_params,
                 camera space origin or the camera space y axis.
         """
 
-        # add an origin offset to the camera position
+        # the origin offset is currently disabled (see the end of this
+        # function), so the calibration data is passed on untouched; arrays
+        # then reach the extension without being copied
         #xo,yo,zo = origin_offset
-        xo,yo,zo = 0.0,0.0,0.0
-        def addOfs(c):
-                return (c[0]+xo, c[1]+yo, c[2]+zo, c[3], c[4])
-        ofsCalData = list(map(addOfs, calibration_data))
 
         # perform camera calibration
         if target_type == 'coplanar' and optimization_type == 'three-param':
                 try:
                         cp = pytsai._pytsai_coplanar_calibration(
-                                ofsCalData, camera_params)
+                                calibration_data, camera_params)
                 except RuntimeError as runtimeError:
                         raise CalibrationError(str(runtimeError))
                         
@@ -414,21 +418,21 @@ def calibrate(target_type, optimization_type, calibration_data, camera_params,
              optimization_type == 'three-param':
                 try:
                         cp = pytsai._pytsai_noncoplanar_calibration(
-                                ofsCalData, camera_params)
+                                calibration_data, camera_params)
                 except RuntimeError as runtimeError:
                         raise CalibrationError(str(runtimeError))
 
         elif target_type == 'coplanar' and optimization_type == 'full':
                 try:
                         cp = pytsai._pytsai_coplanar_calibration_fo(
-                                ofsCalData, camera_params)
+                                calibration_data, camera_params)
                 except RuntimeError as runtimeError:
                         raise CalibrationError(str(runtimeError))
 
         elif target_type == 'noncoplanar' and optimization_type == 'full':
                 try:
                         cp = pytsai._pytsai_noncoplanar_calibration_fo(
-                                ofsCalData, camera_params)
+                                calibration_data, camera_params)
                 except RuntimeError as runtimeError:
                         raise CalibrationError(str(runtimeError))
 
@@ -448,3 +452,368 @@ def calibrate(target_type, optimization_type, calibration_data, camera_params,
         # return the calculated camera parameters
         return ccp
         
+
+def recalibrate(target_type, calibration_data, camera_params, max_error=0.0):
+        """
+        Recalibrates a camera that has drifted since an earlier calibration,
+        such as by thermal expansion.  Only the full optimization of
+        L{calibrate} is run, starting from the earlier result instead of
+        from scratch.  If the optimization fails, does not converge within
+        100 evaluations or ends with a median image error of the points
+        above M{max_error}, the camera is instead calibrated from scratch as
+        by L{calibrate} with C{'full'}.
+
+        This is not always faster than calibrating afresh.  The full
+        optimization is ill-conditioned, most of all for a coplanar target,
+        and from a drifted start it can take longer than the whole
+        calibration.  The limit on its evaluations keeps a warm start that
+        falls back to roughly twice the cost of a cold calibration.
+
+        @param target_type: C{'coplanar'} or C{'noncoplanar'}, as for
+                L{calibrate}.
+
+        @param calibration_data: The new calibration points, as for
+                L{calibrate}.
+
+        @param camera_params: The L{CameraParameters} of the earlier
+                calibration (or any mapping with the same keys).
+
+        @param max_error: The largest median image error, in pixels, of an
+                accepted warm start.  0 (the default) accepts 1 pixel.
+
+        @return: The recalibrated L{CameraParameters}.
+        """
+        if target_type == 'coplanar':
+                recalibration = pytsai._pytsai_coplanar_recalibration
+        elif target_type == 'noncoplanar':
+                recalibration = pytsai._pytsai_noncoplanar_recalibration
+        else:
+                raise CalibrationError('Unknown target_type=\'%s\'' %
+                                       target_type)
+
+        try:
+                cp = recalibration(calibration_data, camera_params,
+                                   float(max_error))
+        except (RuntimeError, ValueError) as error:
+                raise CalibrationError(str(error))
+        return CameraParameters(cp)
+
+
+class PoseTracker:
+
+        """
+        Follows the pose of a calibrated camera through a stream of frames,
+        such as for augmented reality or robot navigation.  The intrinsic
+        parameters of the camera are held fixed, and each frame's pose is
+        refined from the last one's, which for a few hundred points takes
+        some tens of microseconds.  If the refinement fails or the median
+        image error of the points it ends with is above M{max_error}, the
+        pose is instead estimated afresh, as it is for the first frame.
+        The tracker's storage is reused from frame to frame.
+
+        A tracker must not be updated by two threads at once.
+        """
+
+        def __init__(self, camera_params, max_error=0.0):
+                """
+                @param camera_params: The calibrated L{CameraParameters} of
+                        the camera (or any mapping with the same keys).
+
+                @param max_error: The largest median image error, in pixels,
+                        of a refined pose.  0 (the default) accepts 1 pixel.
+                """
+                try:
+                        self._tracker = pytsai._pytsai_pose_tracker(
+                                camera_params, float(max_error))
+                except (RuntimeError, ValueError) as error:
+                        raise CalibrationError(str(error))
+
+                # whether the last update estimated its pose afresh
+                self.estimated_afresh = False
+
+        def update(self, calibration_data):
+                """
+                Finds the pose of the camera in a new frame.
+
+                @param calibration_data: The points seen in the frame, as
+                        for L{calibrate}.
+
+                @return: The pose M{(Rx, Ry, Rz, Tx, Ty, Tz)}.
+                """
+                try:
+                        (pose, self.estimated_afresh) = \
+                                pytsai._pytsai_track_pose(self._tracker,
+                                                          calibration_data)
+                except (RuntimeError, ValueError) as error:
+                        raise CalibrationError(str(error))
+                return pose
+
+        def reset(self):
+                """
+                Makes the next update estimate its pose afresh, such as
+                after a cut in the stream.
+                """
+                try:
+                        pytsai._pytsai_reset_pose_tracker(self._tracker)
+                except RuntimeError as error:
+                        raise CalibrationError(str(error))
+
+        def camera_parameters(self):
+                """
+                @return: The L{CameraParameters} of the camera in the pose
+                        of the last update.
+                """
+                try:
+                        cp = pytsai._pytsai_pose_tracker_camera(self._tracker)
+                except RuntimeError as error:
+                        raise CalibrationError(str(error))
+                return CameraParameters(cp)
+
+
+def estimate_poses(calibration_data, offsets, camera_params, nthreads=0,
+                   chain=False, max_error=0.0):
+        """
+        Estimates the pose of a calibrated camera in every frame of a
+        capture sequence at once, such as offline over a long recording.
+        The intrinsic parameters of the camera are held fixed.  The frames
+        are solved in parallel on native threads, in blocks of consecutive
+        frames, and other Python threads are free to run meanwhile.
+
+        @param calibration_data: The points of all of the frames, one frame
+                after the other, in any of the forms accepted by
+                L{calibrate}.  An (N, 5) array is read without copying.
+
+        @param offsets: A sequence of one more integer than there are
+                frames: frame M{i} holds the points M{offsets[i]} up to
+                M{offsets[i+1]}.  It starts at 0 and ends at the number of
+                points.
+
+        @param camera_params: The calibrated L{CameraParameters} of the
+                camera (or any mapping with the same keys).
+
+        @param nthreads: The number of threads to use.  If this is zero or
+                less, one thread per processor is used.
+
+        @param chain: If true, the frames are taken to be in temporal order,
+                and each one's pose is refined from the pose of the frame
+                before it as by L{PoseTracker}, which is much cheaper; the
+                first frame of each block is still estimated afresh, so the
+                results depend slightly on M{nthreads}.
+
+        @param max_error: The largest median image error, in pixels, of a
+                refined pose when M{chain} is set, as for L{PoseTracker}.
+
+        @return: An array with one row per frame, of shape
+                M{(len(offsets) - 1, 6)} (a memoryview; wrap it with
+                C{numpy.asarray} to get a NumPy array), holding the pose
+                M{(Rx, Ry, Rz, Tx, Ty, Tz)} of the frame.  The row of a
+                frame whose pose cannot be estimated is NaNs.
+        """
+        try:
+                return pytsai._pytsai_extrinsic_batch(calibration_data,
+                        offsets, camera_params, nthreads, int(bool(chain)),
+                        float(max_error))
+        except (RuntimeError, ValueError) as error:
+                raise CalibrationError(str(error))
+
+
+def calibrate_many(jobs, nthreads=0):
+        """
+        Calibrates many cameras at once.  The calibrations run in parallel on
+        native threads, and other Python threads are free to run meanwhile.
+
+        @param jobs: A sequence of calibration jobs, each a tuple
+                M{(target_type, optimization_type, calibration_data,
+                camera_params)} whose members are as for L{calibrate}.
+
+        @param nthreads: The number of threads to use.  If this is zero or
+                less, one thread per processor is used.
+
+        @return: A list of L{CameraParameters}, one for each job, in order.
+        """
+        jobs = [ (target_type, optimization_type, calibration_data,
+                  camera_params) for (target_type, optimization_type,
+                  calibration_data, camera_params) in jobs ]
+        try:
+                cps = pytsai._pytsai_calibrate_many(jobs, nthreads)
+        except (RuntimeError, ValueError) as error:
+                raise CalibrationError(str(error))
+        return [ CameraParameters(cp) for cp in cps ]
+
+
+def calibrate_views(calibration_data, camera_params):
+        """
+        Calibrates a camera from several views of a coplanar target, such as
+        a checkerboard photographed in different positions.  The views share
+        the intrinsic parameters M{f}, M{kappa1}, M{Cx}, M{Cy} and M{sx},
+        while each has its own position and orientation of the target.
+        Every view is first calibrated on its own as by L{calibrate} with
+        C{'three-param'}, and then all of the parameters are optimized
+        together, at a cost that grows linearly with the number of views.
+
+        @param calibration_data: A sequence of at least two sets of
+                calibration points, one for each view, each in any of the
+                forms accepted by L{calibrate}.  All of the z-values must be
+                zero.  (A single view of a plane cannot tell M{sx} from
+                M{f}; calibrate it with L{calibrate} instead, which holds
+                M{sx} fixed.)
+
+        @param camera_params: A dictionary mapping camera parameter names to
+                their values, as for L{calibrate}.  The image center and
+                M{sx} given are the starting point of the optimization.
+
+        @return: A list of L{CameraParameters}, one for each view, in order.
+                They have the same intrinsic parameters, and the extrinsic
+                parameters of their views.
+        """
+        try:
+                cps = pytsai._pytsai_coplanar_calibration_views(
+                        list(calibration_data), camera_params)
+        except (RuntimeError, ValueError) as error:
+                raise CalibrationError(str(error))
+        return [ CameraParameters(cp) for cp in cps ]
+
+
+def calibrate_rig(calibration_data, camera_params):
+        """
+        Calibrates a rig of cameras fixed to one another, from their views of
+        the same target in several poses.  Each camera has its own intrinsic
+        parameters and its own place in the world, which is that of the
+        target in its first pose; each later pose of the target is shared by
+        all of the cameras that see it.  Every camera is first calibrated on
+        its own, in parallel if L{set_residual_threads} has started threads,
+        and then all of the parameters are optimized together.
+
+        @param calibration_data: A sequence with an entry for each camera,
+                each a sequence with an entry for each pose of the target:
+                the calibration points of the camera's view of that pose, in
+                any of the forms accepted by L{calibrate}, or C{None} if the
+                camera did not see it.  A camera whose views are all coplanar
+                is first calibrated as by L{calibrate_views}, or as by
+                L{calibrate} with C{'full'} if it has only one.  The views must
+                link every camera and pose to the first pose.
+
+        @param camera_params: A dictionary mapping camera parameter names to
+                their values, as for L{calibrate}, or a sequence of such
+                dictionaries, one for each camera.
+
+        @return: A tuple M{(cameras, poses)}: a list of L{CameraParameters},
+                one for each camera, placing it in the world, and a list of
+                M{(Rx, Ry, Rz, Tx, Ty, Tz)} tuples, one for each pose, that
+                carry the target in that pose into the world.
+        """
+        calibration_data = [ list(camera) for camera in calibration_data ]
+        if hasattr(camera_params, 'keys'):
+                camera_params = [ camera_params ] * len(calibration_data)
+        try:
+                cps, poses = pytsai._pytsai_rig_calibration(
+                        calibration_data, list(camera_params))
+        except (RuntimeError, ValueError) as error:
+                raise CalibrationError(str(error))
+        return ([ CameraParameters(cp) for cp in cps ], poses)
+
+
+def set_residual_threads(nthreads=0, min_chunk=0):
+        """
+        Lets L{calibrate} spread the evaluation of the calibration error
+        over a persistent pool of native threads.  This only pays off for
+        large calibrations (many thousands of points); smaller ones, and the
+        calibrations of L{calibrate_many}, keep running on a single thread.
+        If several threads call L{calibrate} at once, only one of them uses
+        the pool at a time.
+
+        @param nthreads: The number of threads to use.  If this is zero or
+                less, one thread per processor is used; one turns the
+                threads off again.
+
+        @param min_chunk: The fewest calibration points handed to a thread
+                at a time.  If this is zero, the library's default is used.
+        """
+        try:
+                pytsai._pytsai_set_residual_threads(nthreads, min_chunk)
+        except ValueError as error:
+                raise CalibrationError(str(error))
+
+
+def set_jacobian_mode(mode):
+        """
+        Chooses how the optimization stages of L{calibrate} and
+        L{calibrate_many} hold the Jacobian of the calibration error.  The
+        default, C{'dense'}, stores one row per calibration point.
+        C{'streamed'} folds the rows into a small triangular factor as they
+        are computed, so the memory the optimizer needs no longer grows with
+        the number of points; the results agree with the dense ones to
+        rounding.
+
+        @param mode: C{'dense'} or C{'streamed'}.
+        """
+        try:
+                pytsai._pytsai_set_jacobian_mode(mode)
+        except ValueError as error:
+                raise CalibrationError(str(error))
+
+
+def set_ransac(threshold=0.0, confidence=0.99, max_hypotheses=0):
+        """
+        Makes the linear stages of L{calibrate} and L{calibrate_many} robust
+        to mislabelled calibration points.  With a positive threshold, the
+        radial alignment constraint is fitted by LO-RANSAC instead of by least
+        squares over every point: minimal samples of the points are solved
+        and scored in parallel on the residual threads (see
+        L{set_residual_threads}), and the points more than C{threshold}
+        pixels from the best fit's radial lines are left out of the rest of
+        the linear stages.  The search stops once it has drawn a sample of
+        inliers with the given confidence, judged from the best inlier ratio
+        so far.  The optimization stages still use every point.
+
+        @param threshold: inlier threshold in pixels; 0 (the default) turns
+                the robust fit off.
+        @param confidence: confidence in (0, 1) at which the search stops.
+        @param max_hypotheses: most samples to draw; 0 picks a default.
+        """
+        try:
+                pytsai._pytsai_set_ransac(float(threshold), float(confidence),
+                        int(max_hypotheses))
+        except ValueError as error:
+                raise CalibrationError(str(error))
+
+
+def set_robust_loss(loss='squared', scale=0.0):
+        """
+        Chooses the loss the optimization stages of L{calibrate} and
+        L{calibrate_many} minimize.  C{'squared'}, the default, is plain
+        least squares.  The robust losses C{'huber'}, C{'cauchy'} and
+        C{'tukey'} limit the pull of points with large errors, such as
+        mislabelled ones: every stage is run by iteratively reweighted least
+        squares, with weights fixed during each run and updated from its
+        errors until they settle.  C{'huber'} suits moderately heavy-tailed
+        errors; as it still gives gross outliers a pull that grows with
+        their error, mislabelled points call for C{'cauchy'} or
+        C{'tukey'}.  C{'tukey'} ignores gross outliers entirely, but needs
+        a reasonable starting point (see L{set_ransac}).  A stage stops at
+        its best run once a run raises the median error of the points, and
+        the calibration raises L{CalibrationError} if a run does not
+        converge or leaves f non-positive or a parameter not finite.
+
+        @param loss: C{'squared'}, C{'huber'}, C{'cauchy'} or C{'tukey'}.
+        @param scale: scale of the loss in pixels, the error around which
+                points start to count for less; 0 (the default) estimates it
+                from the median error of each run.
+        """
+        try:
+                pytsai._pytsai_set_robust_loss(loss, float(scale))
+        except ValueError as error:
+                raise CalibrationError(str(error))
+
+
+def simd_level():
+        """
+        Names the instruction set the calibration kernels were picked for
+        when the module was imported: C{'scalar'}, C{'sse2'}, C{'avx2'},
+        C{'avx512'} or C{'neon'}.  The best one the processor supports is
+        used, unless the environment variable C{PYTSAI_SIMD} names a lower
+        one, which is handy for benchmarking.
+
+        @return: The name of the instruction set.
+        """
+        return pytsai._pytsai_simd_level()
@@ -1,24 +1,40 @@
 #!/usr/bin/env python
 
-from distutils.core import *
+import os
+# setuptools, unlike distutils (gone from Python 3.12), honours python_requires
+from setuptools import setup, Extension
 
 pytsai_ext = Extension(
         'pytsai', [
         'src/pytsai.c',
         'src/errors.c',
+        'src/tsai/cal_batch.c',
+        'src/tsai/cal_cpu.c',
         'src/tsai/cal_eval.c',
+        'src/tsai/cal_jac.c',
         'src/tsai/cal_main.c',
+        'src/tsai/cal_ransac.c',
+        'src/tsai/cal_rig.c',
+        'src/tsai/cal_robust.c',
+        'src/tsai/cal_simd.c',
         'src/tsai/cal_tran.c',
+        'src/tsai/cal_views.c',
         'src/tsai/ecalmain.c',
         'src/minpack/dpmpar.c',
         'src/minpack/enorm.c',
         'src/minpack/fdjac2.c',
+        'src/minpack/lmder.c',
         'src/minpack/lmdif.c',
         'src/minpack/lmpar.c',
+        'src/minpack/lmstr.c',
         'src/minpack/qrfac.c',
         'src/minpack/qrsolv.c',
-        'src/matrix/matrix.c'
-])
+        'src/matrix/matrix.c',
+        'src/pool/pool.c'
+],
+libraries=([] if os.name == 'nt' else ['pthread']),
+# the vector kernels match the scalar ones only if a * b + c is not fused
+extra_compile_args=([] if os.name == 'nt' else ['-ffp-contract=off']))
 #extra_compile_args=['-O2', '-Wall', '-pedantic', '-std=c99',
 #'-W', '-Wunreachable-code'])
 
@@ -30,6 +46,7 @@ setup(
         author_email = 'j.merritt@pgrad.unimelb.edu.au, csega@mailbox.hu',
         keywords = "tsai automatic calibration python blender",
 		url = "https://github.com/Csega/pyTsai",   # project home page, if any
+        python_requires = '>=3.9',
         ext_modules = [ pytsai_ext ],
         py_modules = [ 'Tsai' ]
 )
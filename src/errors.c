@@ -32,43 +32,43 @@
  *      pytsai_raise("some error");                                          *
  *      return 0;                                                            *
  *                                                                           *
+ * The error state lives in the calibration context (ctx->err) rather than  *
+ * in globals, so that independent calibrations can run concurrently.       *
+ *                                                                           *
  * To trap errors for the Python wrapper, the following is the template:     *
- *      pytsai_clear();                                                      *
+ *      pytsai_clear(&ctx->err);                                             *
  *      --- perform C-library calls here ---                                 *
- *      if (pytsai_haserror())                                               *
+ *      if (pytsai_haserror(&ctx->err))                                      *
  *              --- raise Python exception ---                               *
  \***************************************************************************/
 
 #include <string.h>
 #include "errors.h"
 
-/* true / false error flag */
-int pytsai_error;
-/* character array to store an error string */
-char pytsai_string[ERROR_BUFFER_SIZE];
-
 /**
  * Clears the error flag.
  */
-void pytsai_clear()
+void pytsai_clear(struct pytsai_errors *e)
 {
-        pytsai_error = 0;
+        e->error = 0;
+        e->string[0] = '\0';
 }
 
 /**
  * Sets the error flag and stores an error message.
  */
-void pytsai_raise(char *message)
+void pytsai_raise(struct pytsai_errors *e, char *message)
 {
-        pytsai_error = 1;
-        strncpy(pytsai_string, message, ERROR_BUFFER_SIZE-1);
+        e->error = 1;
+        strncpy(e->string, message, ERROR_BUFFER_SIZE-1);
+        e->string[ERROR_BUFFER_SIZE-1] = '\0';
 }
 
 /**
  * Returns non-zero if the error flag has been set.
  */
-int pytsai_haserror()
+int pytsai_haserror(struct pytsai_errors *e)
 {
-        return pytsai_error;
+        return e->error;
 }
 
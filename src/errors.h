@@ -26,14 +26,17 @@
 /* Size of the buffer containing any error string. */
 #define ERROR_BUFFER_SIZE 1024
 
-/* Storage of error quantities. */
-extern int pytsai_error;        /* true / false error flag  */
-extern char pytsai_string[];    /* error description string */
+/* Storage of error quantities.  Each calibration context carries its own
+ * copy, so that errors raised by one calibration cannot clobber another. */
+struct pytsai_errors {
+        int error;                        /* true / false error flag  */
+        char string[ERROR_BUFFER_SIZE];   /* error description string */
+};
 
 /* Error methods. */
-void pytsai_clear();
-void pytsai_raise(char *message);
-int pytsai_haserror();
+void pytsai_clear(struct pytsai_errors *e);
+void pytsai_raise(struct pytsai_errors *e, char *message);
+int pytsai_haserror(struct pytsai_errors *e);
 
 #endif /* ERRORS_H */
 
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <math.h>
+#include <float.h>
 #include "matrix.h"
 
 #define  FALSE 0
@@ -422,78 +423,199 @@ double    matinvert (a)
 
 
 /*
-   Solve the overconstrained linear system   Ma = b   using a least
-   squares error (pseudo inverse) approach.
+   Start an empty least squares problem in n unknowns (n is at most
+   LSQ_MAX_COLUMNS).
+*/
+void      lsq_init (sys, n)
+    lsqsys   *sys;
+    int       n;
+{
+    int       j,
+              k;
+
+    sys->n = n;
+    for (j = 0; j < n; j++) {
+	for (k = 0; k <= n; k++)
+	    sys->R[j][k] = 0.0;
+	sys->norm2[j] = 0.0;
+    }
+}
+
+
+/*
+   Add the equation   row . a = rhs   to a least squares problem.  The row
+   is folded into the triangular factor with Givens rotations, so the
+   factor is always that of the QR decomposition of the rows added so far
+   and M^T M is never formed.
+*/
+void      lsq_add_row (sys, row, rhs)
+    lsqsys   *sys;
+    double   *row,
+              rhs;
+{
+    int       j,
+              k,
+              n = sys->n;
+
+    double    x[LSQ_MAX_COLUMNS + 1],
+              c,
+              s,
+              h,
+              t;
+
+    for (j = 0; j < n; j++) {
+	x[j] = row[j];
+	sys->norm2[j] += row[j] * row[j];
+    }
+    x[n] = rhs;
+
+    for (j = 0; j < n; j++) {
+	if (x[j] == 0.0)
+	    continue;
+
+	h = hypot (sys->R[j][j], x[j]);
+	c = sys->R[j][j] / h;
+	s = x[j] / h;
+	sys->R[j][j] = h;
+
+	for (k = j + 1; k <= n; k++) {
+	    t = sys->R[j][k];
+	    sys->R[j][k] = c * t + s * x[k];
+	    x[k] = c * x[k] - s * t;
+	}
+    }
+}
+
+
+/*
+   Solve a least squares problem by back substitution, leaving the
+   solution in a[0..n-1].  Returns -1 if M is rank deficient: some column
+   lies (to within rounding) in the span of the ones before it.  The test is
+   relative to each column's own norm, so it does not depend on the units
+   of the unknowns.
+*/
+int       lsq_solve (sys, a)
+    lsqsys   *sys;
+    double   *a;
+{
+    int       j,
+              k,
+              n = sys->n;
+
+    double    sum;
+
+    for (j = 0; j < n; j++)
+	if (!(fabs (sys->R[j][j]) > 1e-12 * sqrt (sys->norm2[j])))
+	    return (-1);
+
+    for (j = n - 1; j >= 0; j--) {
+	sum = sys->R[j][n];
+	for (k = j + 1; k < n; k++)
+	    sum -= sys->R[j][k] * a[k];
+	a[j] = sum / sys->R[j][j];
+    }
+
+    return (0);
+}
+
+
+/*
+   Solve the overconstrained linear system   Ma = b   in the least squares
+   sense, by streaming the rows of M through an lsqsys.  M may have at most
+   LSQ_MAX_COLUMNS columns.
 */
 int       solve_system (M, a, b)
     dmat      M,
               a,
               b;
 {
-    dmat      Mt,
-              MtM,
-              Mdag;
+    lsqsys    sys;
+
+    double    row[LSQ_MAX_COLUMNS],
+              x[LSQ_MAX_COLUMNS];
+
+    int       i,
+              j,
+              n = M.ub2 - M.lb2 + 1;
 
     if ((M.ub1 - M.lb1) < (M.ub2 - M.lb2)) {
 	fprintf (stderr, "solve_system: matrix M has more columns than rows\n");
 	return (-1);
     }
 
-    Mt = newdmat (M.lb2, M.ub2, M.lb1, M.ub1, &errno);
-    if (errno) {
-	fprintf (stderr, "solve_system: unable to allocate matrix M_transpose\n");
+    if (n > LSQ_MAX_COLUMNS) {
+	fprintf (stderr, "solve_system: matrix M has too many columns\n");
 	return (-1);
     }
 
-    transpose (M, Mt);
-    if (errno) {
-	fprintf (stderr, "solve_system: unable to transpose matrix M\n");
-	return (-1);
+    lsq_init (&sys, n);
+    for (i = M.lb1; i <= M.ub1; i++) {
+	for (j = 0; j < n; j++)
+	    row[j] = M.el[i][M.lb2 + j];
+	lsq_add_row (&sys, row, b.el[b.lb1 + i - M.lb1][b.lb2]);
     }
 
-    MtM = newdmat (M.lb2, M.ub2, M.lb2, M.ub2, &errno);
-    if (errno) {
-	fprintf (stderr, "solve_system: unable to allocate matrix M_transpose_M\n");
+    if (lsq_solve (&sys, x)) {
+	fprintf (stderr, "solve_system: matrix M is rank deficient\n");
 	return (-1);
     }
 
-    matmul (Mt, M, MtM);
-    if (errno) {
-	fprintf (stderr, "solve_system: unable to compute matrix product of M_transpose and M\n");
-	return (-1);
-    }
+    for (j = 0; j < n; j++)
+	a.el[a.lb1 + j][a.lb2] = x[j];
 
-    if (fabs (matinvert (MtM)) < 0.001) {
-	fprintf (stderr, "solve_system: determinant of matrix M_transpose_M is too small\n");
-	return (-1);
-    }
+    return (0);
+}
 
-    if (errno) {
-	fprintf (stderr, "solve_system: error during matrix inversion\n");
-	return (-1);
-    }
 
-    Mdag = newdmat (M.lb2, M.ub2, M.lb1, M.ub1, &errno);
-    if (errno) {
-	fprintf (stderr, "solve_system: unable to allocate matrix M_diag\n");
-	return (-1);
-    }
+/*
+   Solve the symmetric positive definite system   A x = b   in place by
+   Cholesky factorization.  A is an n by n array stored by rows, of which
+   only the lower triangle is read; it is overwritten by the factor.  b is
+   overwritten by the solution x.  Nothing is allocated, which makes this
+   the routine to use on normal equations (M^T M) a = M^T b that have been
+   accumulated by the caller.  Returns 0 on success and -1 if A is not
+   (numerically) positive definite.
+*/
+int       solve_normal_equations (A, b, n)
+    double   *A,
+             *b;
+    int       n;
+{
+    int       i,
+              j,
+              k;
 
-    matmul (MtM, Mt, Mdag);
-    if (errno) {
-	fprintf (stderr, "solve_system: unable to compute matrix product of M_transpose_M and M_transpose\n");
-	return (-1);
-    }
+    double    sum;
 
-    matmul (Mdag, b, a);
-    if (errno) {
-	fprintf (stderr, "solve_system: unable to compute matrix product of M_diag and b\n");
-	return (-1);
+    for (j = 0; j < n; j++) {
+	sum = A[j * n + j];
+	for (k = 0; k < j; k++)
+	    sum -= A[j * n + k] * A[j * n + k];
+	if (!(sum > DBL_EPSILON * fabs (A[j * n + j])))
+	    return (-1);
+	A[j * n + j] = sqrt (sum);
+
+	for (i = j + 1; i < n; i++) {
+	    sum = A[i * n + j];
+	    for (k = 0; k < j; k++)
+		sum -= A[i * n + k] * A[j * n + k];
+	    A[i * n + j] = sum / A[j * n + j];
+	}
     }
 
-    freemat (Mt);
-    freemat (MtM);
-    freemat (Mdag);
+    /* forward substitution with L, then back substitution with L^T */
+    for (i = 0; i < n; i++) {
+	sum = b[i];
+	for (k = 0; k < i; k++)
+	    sum -= A[i * n + k] * b[k];
+	b[i] = sum / A[i * n + i];
+    }
+    for (i = n - 1; i >= 0; i--) {
+	sum = b[i];
+	for (k = i + 1; k < n; k++)
+	    sum -= A[k * n + i] * b[k];
+	b[i] = sum / A[i * n + i];
+    }
 
     return 0;
 }
@@ -20,6 +20,18 @@ typedef struct {
     double  **el;
 } dmat;
 
+/* A linear least squares problem  Ma = b  with at most LSQ_MAX_COLUMNS
+ * unknowns, reduced row by row to the triangular system  Ra = Q^T b  (see
+ * lsq_add_row in matrix.c).  It lives wherever the caller puts it, so
+ * solving needs no heap storage however many rows M has. */
+#define LSQ_MAX_COLUMNS 8
+
+typedef struct {
+    int       n;
+    double    R[LSQ_MAX_COLUMNS][LSQ_MAX_COLUMNS + 1];	/* [R | Q^T b] */
+    double    norm2[LSQ_MAX_COLUMNS];	/* squared norms of M's columns */
+} lsqsys;
+
 void      print_mat ();
 dmat      newdmat ();
 int       matmul ();
@@ -27,6 +39,10 @@ int       matcopy ();
 int       transpose ();
 double    matinvert ();
 int       solve_system ();
+int       solve_normal_equations ();
+void      lsq_init ();
+void      lsq_add_row ();
+int       lsq_solve ();
 
 #define freemat(m) free((m).mat_sto) ; free((m).el)
 
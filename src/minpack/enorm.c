@@ -24,9 +24,9 @@ doublereal *x;
     double sqrt();
 
     /* Local variables */
-    static doublereal xabs, x1max, x3max;
-    static integer i;
-    static doublereal s1, s2, s3, agiant, floatn;
+    doublereal xabs, x1max, x3max;
+    integer i;
+    doublereal s1, s2, s3, agiant, floatn;
 
 /*     ********** */
 
@@ -4,18 +4,20 @@
 */
 
 #include "f2c.h"
+#include "../pool/pool.h"
 
 /* Table of constant values */
 
 static integer c__1 = 1;
 
 /* Subroutine */ int fdjac2_(fcn, m, n, x, fvec, fjac, ldfjac, iflag, epsfcn, 
-	wa)
+	wa, p)
 /* Subroutine */ int (*fcn) ();
 integer *m, *n;
 doublereal *x, *fvec, *fjac;
 integer *ldfjac, *iflag;
 doublereal *epsfcn, *wa;
+void *p;
 {
     /* Initialized data */
 
@@ -28,11 +30,11 @@ doublereal *epsfcn, *wa;
     double sqrt();
 
     /* Local variables */
-    static doublereal temp, h;
-    static integer i, j;
-    static doublereal epsmch;
+    doublereal temp, h;
+    integer i, j;
+    doublereal epsmch;
     extern doublereal dpmpar_();
-    static doublereal eps;
+    doublereal eps;
 
 /*     ********** */
 
@@ -44,7 +46,7 @@ doublereal *epsfcn, *wa;
 
 /*     the subroutine statement is */
 
-/*       subroutine fdjac2(fcn,m,n,x,fvec,fjac,ldfjac,iflag,epsfcn,wa) */
+/*       subroutine fdjac2(fcn,m,n,x,fvec,fjac,ldfjac,iflag,epsfcn,wa,p) */
 
 /*     where */
 
@@ -97,6 +99,8 @@ doublereal *epsfcn, *wa;
 
 /*       wa is a work array of length m. */
 
+/*       p is a pointer to user data, passed unchanged to fcn. */
+
 /*     subprograms called */
 
 /*       user-supplied ...... fcn */
@@ -132,7 +136,7 @@ doublereal *epsfcn, *wa;
 	    h = eps;
 	}
 	x[j] = temp + h;
-	(*fcn)(m, n, &x[1], &wa[1], iflag);
+	(*fcn)(m, n, &x[1], &wa[1], iflag, p);
 	if (*iflag < 0) {
 	    goto L30;
 	}
@@ -151,3 +155,114 @@ L30:
 
 } /* fdjac2_ */
 
+
+
+/*     pytsai: a version of fdjac2 that evaluates the n perturbed */
+/*     columns at the same time, one task per column on the worker */
+/*     pool (see pool.c).  fcn must be reentrant: column j calls it */
+/*     with its own copy of x and with its own user data pcol[j], */
+/*     and writes the perturbed functions straight into column j */
+/*     of fjac.  The result is the same as that of fdjac2, column */
+/*     for column, provided fcn gives the same result for every */
+/*     pcol[j] as it would for p.  Additional arguments: */
+
+/*       xwa is a work array of length n*n. */
+
+/*       iwa is an integer work array of length n. */
+
+/*       pcol is an array of n pointers to user data, pcol[j] */
+/*         passed unchanged to fcn for column j+1. */
+
+/*       pool is the worker pool to run the columns on. */
+
+/*     on return iflag is the first negative iflag of any column, */
+/*     if there is one. */
+
+struct fdjac2_columns {
+    int (*fcn) ();
+    integer *m, *n;
+    doublereal *x, *fvec, *fjac;
+    integer ldfjac;
+    doublereal eps;
+    doublereal *xwa;
+    integer *iwa;
+    void **pcol;
+};
+
+static void fdjac2_column(arg, index)
+void *arg;
+int index;
+{
+    struct fdjac2_columns *cols = (struct fdjac2_columns *) arg;
+    doublereal temp, h, *xj, *wa;
+    integer i, j = index;
+
+    xj = cols->xwa + j * *cols->n;
+    wa = cols->fjac + j * cols->ldfjac;
+    for (i = 0; i < *cols->n; ++i) {
+	xj[i] = cols->x[i];
+    }
+    temp = xj[j];
+    h = cols->eps * abs(temp);
+    if (h == 0.) {
+	h = cols->eps;
+    }
+    xj[j] = temp + h;
+    (*cols->fcn)(cols->m, cols->n, xj, wa, &cols->iwa[j], cols->pcol[j]);
+    if (cols->iwa[j] < 0) {
+	return;
+    }
+    for (i = 0; i < *cols->m; ++i) {
+	wa[i] = (wa[i] - cols->fvec[i]) / h;
+    }
+}
+
+/* Subroutine */ int fdjac2_pool_(fcn, m, n, x, fvec, fjac, ldfjac, iflag, 
+	epsfcn, xwa, iwa, pcol, pool)
+/* Subroutine */ int (*fcn) ();
+integer *m, *n;
+doublereal *x, *fvec, *fjac;
+integer *ldfjac, *iflag;
+doublereal *epsfcn, *xwa;
+integer *iwa;
+void **pcol;
+struct worker_pool *pool;
+{
+    /* Builtin functions */
+    double sqrt();
+
+    struct fdjac2_columns cols;
+    doublereal epsmch;
+    extern doublereal dpmpar_();
+    integer j;
+
+    epsmch = dpmpar_(&c__1);
+
+    cols.fcn = fcn;
+    cols.m = m;
+    cols.n = n;
+    cols.x = x;
+    cols.fvec = fvec;
+    cols.fjac = fjac;
+    cols.ldfjac = *ldfjac;
+    cols.eps = sqrt((max(*epsfcn,epsmch)));
+    cols.xwa = xwa;
+    cols.iwa = iwa;
+    cols.pcol = pcol;
+    for (j = 0; j < *n; ++j) {
+	iwa[j] = *iflag;
+    }
+
+    pool_run(pool, (int) *n, fdjac2_column, &cols);
+
+    for (j = 0; j < *n; ++j) {
+	if (iwa[j] < 0) {
+	    *iflag = iwa[j];
+	    break;
+	}
+    }
+    return 0;
+
+/*     last card of subroutine fdjac2_pool. */
+
+} /* fdjac2_pool_ */
@@ -11,7 +11,7 @@ static integer c__1 = 1;
 
 /* Subroutine */ int lmdif_(fcn, m, n, x, fvec, ftol, xtol, gtol, maxfev, 
 	epsfcn, diag, mode, factor, nprint, info, nfev, fjac, ldfjac, ipvt, 
-	qtf, wa1, wa2, wa3, wa4)
+	qtf, wa1, wa2, wa3, wa4, p)
 /* Subroutine */ int (*fcn) ();
 integer *m, *n;
 doublereal *x, *fvec, *ftol, *xtol, *gtol;
@@ -23,6 +23,7 @@ integer *nprint, *info, *nfev;
 doublereal *fjac;
 integer *ldfjac, *ipvt;
 doublereal *qtf, *wa1, *wa2, *wa3, *wa4;
+void *p;
 {
     /* Initialized data */
 
@@ -42,18 +43,18 @@ doublereal *qtf, *wa1, *wa2, *wa3, *wa4;
     double sqrt();
 
     /* Local variables */
-    static integer iter;
-    static doublereal temp, temp1, temp2;
-    static integer i, j, l, iflag;
-    static doublereal delta;
+    integer iter;
+    doublereal temp, temp1, temp2;
+    integer i, j, l, iflag;
+    doublereal delta;
     extern /* Subroutine */ int qrfac_(), lmpar_();
-    static doublereal ratio;
+    doublereal ratio;
     extern doublereal enorm_();
-    static doublereal fnorm, gnorm;
+    doublereal fnorm, gnorm;
     extern /* Subroutine */ int fdjac2_();
-    static doublereal pnorm, xnorm, fnorm1, actred, dirder, epsmch, prered;
+    doublereal pnorm, xnorm, fnorm1, actred, dirder, epsmch, prered;
     extern doublereal dpmpar_();
-    static doublereal par, sum;
+    doublereal par, sum;
 
 /*     ********** */
 
@@ -69,7 +70,7 @@ doublereal *qtf, *wa1, *wa2, *wa3, *wa4;
 
 /*       subroutine lmdif(fcn,m,n,x,fvec,ftol,xtol,gtol,maxfev,epsfcn, */
 /*                        diag,mode,factor,nprint,info,nfev,fjac, */
-/*                        ldfjac,ipvt,qtf,wa1,wa2,wa3,wa4) */
+/*                        ldfjac,ipvt,qtf,wa1,wa2,wa3,wa4,p) */
 
 /*     where */
 
@@ -223,6 +224,11 @@ doublereal *qtf, *wa1, *wa2, *wa3, *wa4;
 
 /*       wa4 is a work array of length m. */
 
+/*       p is a pointer to user data. it is not used by lmdif but is */
+/*         passed unchanged to fcn as an extra trailing argument, */
+/*         fcn(m,n,x,fvec,iflag,p), so that fcn need not rely on */
+/*         global state. */
+
 /*     subprograms called */
 
 /*       user-supplied ...... fcn */
@@ -281,7 +287,7 @@ L20:
 /*     and calculate its norm. */
 
     iflag = 1;
-    (*fcn)(m, n, &x[1], &fvec[1], &iflag);
+    (*fcn)(m, n, &x[1], &fvec[1], &iflag, p);
     *nfev = 1;
     if (iflag < 0) {
 	goto L300;
@@ -301,7 +307,7 @@ L30:
 
     iflag = 2;
     fdjac2_(fcn, m, n, &x[1], &fvec[1], &fjac[fjac_offset], ldfjac, &iflag, 
-	    epsfcn, &wa4[1]);
+	    epsfcn, &wa4[1], p);
     *nfev += *n;
     if (iflag < 0) {
 	goto L300;
@@ -314,7 +320,7 @@ L30:
     }
     iflag = 0;
     if ((iter - 1) % *nprint == 0) {
-	(*fcn)(m, n, &x[1], &fvec[1], &iflag);
+	(*fcn)(m, n, &x[1], &fvec[1], &iflag, p);
     }
     if (iflag < 0) {
 	goto L300;
@@ -470,7 +476,7 @@ L200:
 /*           evaluate the function at x + p and calculate its norm. */
 
     iflag = 1;
-    (*fcn)(m, n, &wa2[1], &wa4[1], &iflag);
+    (*fcn)(m, n, &wa2[1], &wa4[1], &iflag, p);
     ++(*nfev);
     if (iflag < 0) {
 	goto L300;
@@ -626,7 +632,7 @@ L300:
     }
     iflag = 0;
     if (*nprint > 0) {
-	(*fcn)(m, n, &x[1], &fvec[1], &iflag);
+	(*fcn)(m, n, &x[1], &fvec[1], &iflag, p);
     }
     return 0;
 
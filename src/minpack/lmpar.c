@@ -30,19 +30,19 @@ doublereal *diag, *qtb, *delta, *par, *x, *sdiag, *wa1, *wa2;
     double sqrt();
 
     /* Local variables */
-    static doublereal parc, parl;
-    static integer iter;
-    static doublereal temp, paru;
-    static integer i, j, k, l;
-    static doublereal dwarf;
-    static integer nsing;
+    doublereal parc, parl;
+    integer iter;
+    doublereal temp, paru;
+    integer i, j, k, l;
+    doublereal dwarf;
+    integer nsing;
     extern doublereal enorm_();
-    static doublereal gnorm, fp;
+    doublereal gnorm, fp;
     extern doublereal dpmpar_();
-    static doublereal dxnorm;
-    static integer jm1, jp1;
+    doublereal dxnorm;
+    integer jm1, jp1;
     extern /* Subroutine */ int qrsolv_();
-    static doublereal sum;
+    doublereal sum;
 
 /*     ********** */
 
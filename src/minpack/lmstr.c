@@ -0,0 +1,520 @@
+/* lmstr.c -- lmder.c, changed (pytsai) so that the jacobian is never
+   stored: fcn folds its rows into the upper triangle of its qr
+   factorization as it computes them, after the manner of minpack's
+   lmstr.  The solver then only holds an n by n+1 array, whatever m is.
+*/
+
+#include "f2c.h"
+
+/* Table of constant values */
+
+static integer c__1 = 1;
+
+/* Subroutine */ int lmstr_(fcn, m, n, x, fvec, fjac, ldfjac, ftol, xtol, 
+	gtol, maxfev, diag, mode, factor, nprint, info, nfev, njev, ipvt, qtf,
+	 wa1, wa2, wa3, wa4, p)
+/* Subroutine */ int (*fcn) ();
+integer *m, *n;
+doublereal *x, *fvec, *fjac;
+integer *ldfjac;
+doublereal *ftol, *xtol, *gtol;
+integer *maxfev;
+doublereal *diag;
+integer *mode;
+doublereal *factor;
+integer *nprint, *info, *nfev, *njev, *ipvt;
+doublereal *qtf, *wa1, *wa2, *wa3, *wa4;
+void *p;
+{
+    /* Initialized data */
+
+    static doublereal one = 1.;
+    static doublereal p1 = .1;
+    static doublereal p5 = .5;
+    static doublereal p25 = .25;
+    static doublereal p75 = .75;
+    static doublereal p0001 = 1e-4;
+    static doublereal zero = 0.;
+
+    /* System generated locals */
+    integer fjac_dim1, fjac_offset, i__1, i__2;
+    doublereal d__1, d__2, d__3;
+
+    /* Builtin functions */
+    double sqrt();
+
+    /* Local variables */
+    integer iter;
+    doublereal temp, temp1, temp2;
+    integer i, j, l, iflag;
+    logical sing;
+    doublereal delta;
+    extern /* Subroutine */ int qrfac_(), lmpar_();
+    doublereal ratio;
+    extern doublereal enorm_();
+    doublereal fnorm, gnorm;
+    doublereal pnorm, xnorm, fnorm1, actred, dirder, epsmch, prered;
+    extern doublereal dpmpar_();
+    doublereal par, sum;
+
+/*     ********** */
+
+/*     subroutine lmstr */
+
+/*     the purpose of lmstr is to minimize the sum of the squares of */
+/*     m nonlinear functions in n variables by a modification of */
+/*     the levenberg-marquardt algorithm, exactly as lmder does, */
+/*     except that the m by n jacobian is never stored.  instead */
+/*     fcn accumulates the upper triangular matrix r of its qr */
+/*     factorization row by row, for example with givens rotations, */
+/*     which needs only an n by n+1 array. */
+
+/*     the arguments are those of lmder, with these differences. */
+
+/*       fcn is called as for lmder.  if iflag = 2, fcn must fold */
+/*         the rows of the jacobian at x, each with the matching */
+/*         element of fvec, into fjac: on entry fjac is zero; on */
+/*         return its first n columns must hold an upper triangular */
+/*         r with (r transpose)*r = (jacobian transpose)*jacobian, */
+/*         and column n+1 the matching (q transpose)*fvec.  fvec */
+/*         must not be changed. */
+
+/*       fjac is an n by n+1 array (leading dimension ldfjac).  on */
+/*         output its upper n by n triangle holds r, as with lmder. */
+
+/*       ldfjac is a positive integer input variable not less than n. */
+
+/*     the column norms that scale the variables are those of r, */
+/*     which equal those of the jacobian.  if r is singular its */
+/*     columns are pivoted with qrfac, as minpack's lmstr does. */
+
+/*     subprograms called */
+
+/*       user-supplied ...... fcn */
+
+/*       minpack-supplied ... dpmpar,enorm,lmpar,qrfac */
+
+/*       fortran-supplied ... dabs,dmax1,dmin1,dsqrt,mod */
+
+/*     argonne national laboratory. minpack project. march 1980. */
+/*     burton s. garbow, kenneth e. hillstrom, jorge j. more */
+
+/*     ********** */
+    /* Parameter adjustments */
+    --wa4;
+    --wa3;
+    --wa2;
+    --wa1;
+    --qtf;
+    --ipvt;
+    fjac_dim1 = *ldfjac;
+    fjac_offset = fjac_dim1 + 1;
+    fjac -= fjac_offset;
+    --diag;
+    --fvec;
+    --x;
+
+    /* Function Body */
+
+/*     epsmch is the machine precision. */
+
+    epsmch = dpmpar_(&c__1);
+
+    *info = 0;
+    iflag = 0;
+    *nfev = 0;
+    *njev = 0;
+
+/*     check the input parameters for errors. */
+
+    if (*n <= 0 || *m < *n || *ldfjac < *n || *ftol < zero || *xtol < zero || 
+	    *gtol < zero || *maxfev <= 0 || *factor <= zero) {
+	goto L300;
+    }
+    if (*mode != 2) {
+	goto L20;
+    }
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	if (diag[j] <= zero) {
+	    goto L300;
+	}
+/* L10: */
+    }
+L20:
+
+/*     evaluate the function at the starting point */
+/*     and calculate its norm. */
+
+    iflag = 1;
+    (*fcn)(m, n, &x[1], &fvec[1], &fjac[fjac_offset], ldfjac, &iflag, 
+		p);
+    *nfev = 1;
+    if (iflag < 0) {
+	goto L300;
+    }
+    fnorm = enorm_(m, &fvec[1]);
+
+/*     initialize levenberg-marquardt parameter and iteration counter. */
+
+    par = zero;
+    xnorm = zero;
+    iter = 1;
+
+/*     beginning of the outer loop. */
+
+L30:
+
+/*        fold the jacobian matrix into the upper triangle r of */
+/*        its qr factorization and (q transpose)*fvec into */
+/*        column n+1. */
+
+    i__1 = *n + 1;
+    for (j = 1; j <= i__1; ++j) {
+	i__2 = *n;
+	for (i = 1; i <= i__2; ++i) {
+	    fjac[i + j * fjac_dim1] = zero;
+	}
+    }
+    iflag = 2;
+    (*fcn)(m, n, &x[1], &fvec[1], &fjac[fjac_offset], ldfjac, &iflag, p);
+    ++(*njev);
+    if (iflag < 0) {
+	goto L300;
+    }
+
+/*        if requested, call fcn to enable printing of iterates. */
+
+    if (*nprint <= 0) {
+	goto L40;
+    }
+    iflag = 0;
+    if ((iter - 1) % *nprint == 0) {
+	(*fcn)(m, n, &x[1], &fvec[1], &fjac[fjac_offset], ldfjac, &iflag, 
+		p);
+    }
+    if (iflag < 0) {
+	goto L300;
+    }
+L40:
+
+/*        if the jacobian is rank deficient, call qrfac to */
+/*        reorder its columns and update the components of qtf. */
+
+    sing = FALSE_;
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	qtf[j] = fjac[j + (*n + 1) * fjac_dim1];
+	if (fjac[j + j * fjac_dim1] == zero) {
+	    sing = TRUE_;
+	}
+	ipvt[j] = j;
+	wa2[j] = enorm_(&j, &fjac[j * fjac_dim1 + 1]);
+/* L35: */
+    }
+    if (! sing) {
+	goto L45;
+    }
+    qrfac_(n, n, &fjac[fjac_offset], ldfjac, &c__1, &ipvt[1], n, &wa1[1], &
+	    wa2[1], &wa3[1]);
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	if (fjac[j + j * fjac_dim1] == zero) {
+	    goto L38;
+	}
+	sum = zero;
+	i__2 = *n;
+	for (i = j; i <= i__2; ++i) {
+	    sum += fjac[i + j * fjac_dim1] * qtf[i];
+/* L36: */
+	}
+	temp = -sum / fjac[j + j * fjac_dim1];
+	i__2 = *n;
+	for (i = j; i <= i__2; ++i) {
+	    qtf[i] += fjac[i + j * fjac_dim1] * temp;
+/* L37: */
+	}
+L38:
+	fjac[j + j * fjac_dim1] = wa1[j];
+/* L39: */
+    }
+L45:
+
+/*        on the first iteration and if mode is 1, scale according */
+/*        to the norms of the columns of the initial jacobian. */
+
+    if (iter != 1) {
+	goto L80;
+    }
+    if (*mode == 2) {
+	goto L60;
+    }
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	diag[j] = wa2[j];
+	if (wa2[j] == zero) {
+	    diag[j] = one;
+	}
+/* L50: */
+    }
+L60:
+
+/*        on the first iteration, calculate the norm of the scaled x */
+/*        and initialize the step bound delta. */
+
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	wa3[j] = diag[j] * x[j];
+/* L70: */
+    }
+    xnorm = enorm_(n, &wa3[1]);
+    delta = *factor * xnorm;
+    if (delta == zero) {
+	delta = *factor;
+    }
+L80:
+
+/*        compute the norm of the scaled gradient. */
+
+    gnorm = zero;
+    if (fnorm == zero) {
+	goto L170;
+    }
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	l = ipvt[j];
+	if (wa2[l] == zero) {
+	    goto L150;
+	}
+	sum = zero;
+	i__2 = j;
+	for (i = 1; i <= i__2; ++i) {
+	    sum += fjac[i + j * fjac_dim1] * (qtf[i] / fnorm);
+/* L140: */
+	}
+/* Computing MAX */
+	d__2 = gnorm, d__3 = (d__1 = sum / wa2[l], abs(d__1));
+	gnorm = max(d__2,d__3);
+L150:
+/* L160: */
+	;
+    }
+L170:
+
+/*        test for convergence of the gradient norm. */
+
+    if (gnorm <= *gtol) {
+	*info = 4;
+    }
+    if (*info != 0) {
+	goto L300;
+    }
+
+/*        rescale if necessary. */
+
+    if (*mode == 2) {
+	goto L190;
+    }
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+/* Computing MAX */
+	d__1 = diag[j], d__2 = wa2[j];
+	diag[j] = max(d__1,d__2);
+/* L180: */
+    }
+L190:
+
+/*        beginning of the inner loop. */
+
+L200:
+
+/*           determine the levenberg-marquardt parameter. */
+
+    lmpar_(n, &fjac[fjac_offset], ldfjac, &ipvt[1], &diag[1], &qtf[1], &delta,
+	     &par, &wa1[1], &wa2[1], &wa3[1], &wa4[1]);
+
+/*           store the direction p and x + p. calculate the norm of p. */
+
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	wa1[j] = -wa1[j];
+	wa2[j] = x[j] + wa1[j];
+	wa3[j] = diag[j] * wa1[j];
+/* L210: */
+    }
+    pnorm = enorm_(n, &wa3[1]);
+
+/*           on the first iteration, adjust the initial step bound. */
+
+    if (iter == 1) {
+	delta = min(delta,pnorm);
+    }
+
+/*           evaluate the function at x + p and calculate its norm. */
+
+    iflag = 1;
+    (*fcn)(m, n, &wa2[1], &wa4[1], &fjac[fjac_offset], ldfjac, &iflag, p);
+    ++(*nfev);
+    if (iflag < 0) {
+	goto L300;
+    }
+    fnorm1 = enorm_(m, &wa4[1]);
+
+/*           compute the scaled actual reduction. */
+
+    actred = -one;
+    if (p1 * fnorm1 < fnorm) {
+/* Computing 2nd power */
+	d__1 = fnorm1 / fnorm;
+	actred = one - d__1 * d__1;
+    }
+
+/*           compute the scaled predicted reduction and */
+/*           the scaled directional derivative. */
+
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	wa3[j] = zero;
+	l = ipvt[j];
+	temp = wa1[l];
+	i__2 = j;
+	for (i = 1; i <= i__2; ++i) {
+	    wa3[i] += fjac[i + j * fjac_dim1] * temp;
+/* L220: */
+	}
+/* L230: */
+    }
+    temp1 = enorm_(n, &wa3[1]) / fnorm;
+    temp2 = sqrt(par) * pnorm / fnorm;
+/* Computing 2nd power */
+    d__1 = temp1;
+/* Computing 2nd power */
+    d__2 = temp2;
+    prered = d__1 * d__1 + d__2 * d__2 / p5;
+/* Computing 2nd power */
+    d__1 = temp1;
+/* Computing 2nd power */
+    d__2 = temp2;
+    dirder = -(d__1 * d__1 + d__2 * d__2);
+
+/*           compute the ratio of the actual to the predicted */
+/*           reduction. */
+
+    ratio = zero;
+    if (prered != zero) {
+	ratio = actred / prered;
+    }
+
+/*           update the step bound. */
+
+    if (ratio > p25) {
+	goto L240;
+    }
+    if (actred >= zero) {
+	temp = p5;
+    }
+    if (actred < zero) {
+	temp = p5 * dirder / (dirder + p5 * actred);
+    }
+    if (p1 * fnorm1 >= fnorm || temp < p1) {
+	temp = p1;
+    }
+/* Computing MIN */
+    d__1 = delta, d__2 = pnorm / p1;
+    delta = temp * min(d__1,d__2);
+    par /= temp;
+    goto L260;
+L240:
+    if (par != zero && ratio < p75) {
+	goto L250;
+    }
+    delta = pnorm / p5;
+    par = p5 * par;
+L250:
+L260:
+
+/*           test for successful iteration. */
+
+    if (ratio < p0001) {
+	goto L290;
+    }
+
+/*           successful iteration. update x, fvec, and their norms. */
+
+    i__1 = *n;
+    for (j = 1; j <= i__1; ++j) {
+	x[j] = wa2[j];
+	wa2[j] = diag[j] * x[j];
+/* L270: */
+    }
+    i__1 = *m;
+    for (i = 1; i <= i__1; ++i) {
+	fvec[i] = wa4[i];
+/* L280: */
+    }
+    xnorm = enorm_(n, &wa2[1]);
+    fnorm = fnorm1;
+    ++iter;
+L290:
+
+/*           tests for convergence. */
+
+    if (abs(actred) <= *ftol && prered <= *ftol && p5 * ratio <= one) {
+	*info = 1;
+    }
+    if (delta <= *xtol * xnorm) {
+	*info = 2;
+    }
+    if (abs(actred) <= *ftol && prered <= *ftol && p5 * ratio <= one && *info 
+	    == 2) {
+	*info = 3;
+    }
+    if (*info != 0) {
+	goto L300;
+    }
+
+/*           tests for termination and stringent tolerances. */
+
+    if (*nfev >= *maxfev) {
+	*info = 5;
+    }
+    if (abs(actred) <= epsmch && prered <= epsmch && p5 * ratio <= one) {
+	*info = 6;
+    }
+    if (delta <= epsmch * xnorm) {
+	*info = 7;
+    }
+    if (gnorm <= epsmch) {
+	*info = 8;
+    }
+    if (*info != 0) {
+	goto L300;
+    }
+
+/*           end of the inner loop. repeat if iteration unsuccessful. */
+
+    if (ratio < p0001) {
+	goto L200;
+    }
+
+/*        end of the outer loop. */
+
+    goto L30;
+L300:
+
+/*     termination, either normal or user imposed. */
+
+    if (iflag < 0) {
+	*info = iflag;
+    }
+    iflag = 0;
+    if (*nprint > 0) {
+	(*fcn)(m, n, &x[1], &fvec[1], &fjac[fjac_offset], ldfjac, &iflag, 
+		p);
+    }
+    return 0;
+
+/*     last card of subroutine lmstr. */
+
+} /* lmstr_ */
+
@@ -4,3 +4,7 @@
  */
 
 int lmdif_();
+int lmder_();
+int lmstr_();
+int fdjac2_();
+int fdjac2_pool_();
@@ -32,15 +32,15 @@ doublereal *rdiag, *acnorm, *wa;
     double sqrt();
 
     /* Local variables */
-    static integer kmax;
-    static doublereal temp;
-    static integer i, j, k, minmn;
+    integer kmax;
+    doublereal temp;
+    integer i, j, k, minmn;
     extern doublereal enorm_();
-    static doublereal epsmch;
+    doublereal epsmch;
     extern doublereal dpmpar_();
-    static doublereal ajnorm;
-    static integer jp1;
-    static doublereal sum;
+    doublereal ajnorm;
+    integer jp1;
+    doublereal sum;
 
 /*     ********** */
 
@@ -25,13 +25,13 @@ doublereal *diag, *qtb, *x, *sdiag, *wa;
     double sqrt();
 
     /* Local variables */
-    static doublereal temp;
-    static integer i, j, k, l;
-    static doublereal cotan;
-    static integer nsing;
-    static doublereal qtbpj;
-    static integer jp1, kp1;
-    static doublereal tan_, cos_, sin_, sum;
+    doublereal temp;
+    integer i, j, k, l;
+    doublereal cotan;
+    integer nsing;
+    doublereal qtbpj;
+    integer jp1, kp1;
+    doublereal tan_, cos_, sin_, sum;
 
 /*     ********** */
 
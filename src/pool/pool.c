@@ -0,0 +1,334 @@
+/**
+ * pool.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+ /***************************************************************************\
+ * A small persistent pool of native worker threads.                        *
+ *                                                                           *
+ * The pool is created once with pool_new() and then handed batches of      *
+ * independent tasks with pool_run(), which calls task(arg, i) for every     *
+ * i in [0, ntasks) and returns when all of them have finished.  The thread  *
+ * calling pool_run() works on the batch too, so a pool of size 1 spawns no  *
+ * threads at all and simply runs the tasks in order.  Tasks are handed out  *
+ * one index at a time, so uneven task costs balance themselves.             *
+ *                                                                           *
+ * Tasks must not touch Python objects: pool_run() is meant to be called     *
+ * with the GIL released.  A pool must not be used from two threads at once  *
+ * and pool_run() must not be called from inside one of its own tasks.       *
+ * The pool also lends its user a block of scratch memory (pool_scratch())   *
+ * for the tasks' working storage, so that only a caller with a pool pays    *
+ * for the copies its threads work on.                                       *
+ *                                                                           *
+ * POSIX threads are used everywhere except Windows, which uses native       *
+ * threads and condition variables (Vista or later).                         *
+ \***************************************************************************/
+
+#include <stdlib.h>
+#include "pool.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+typedef HANDLE             pool_thread;
+typedef CRITICAL_SECTION   pool_mutex;
+typedef CONDITION_VARIABLE pool_cond;
+
+#define mutex_init(m)       InitializeCriticalSection(m)
+#define mutex_destroy(m)    DeleteCriticalSection(m)
+#define mutex_lock(m)       EnterCriticalSection(m)
+#define mutex_unlock(m)     LeaveCriticalSection(m)
+#define cond_init(c)        InitializeConditionVariable(c)
+#define cond_destroy(c)
+#define cond_wait(c,m)      SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c)   WakeAllConditionVariable(c)
+
+#else
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t          pool_thread;
+typedef pthread_mutex_t    pool_mutex;
+typedef pthread_cond_t     pool_cond;
+
+#define mutex_init(m)       pthread_mutex_init(m, NULL)
+#define mutex_destroy(m)    pthread_mutex_destroy(m)
+#define mutex_lock(m)       pthread_mutex_lock(m)
+#define mutex_unlock(m)     pthread_mutex_unlock(m)
+#define cond_init(c)        pthread_cond_init(c, NULL)
+#define cond_destroy(c)     pthread_cond_destroy(c)
+#define cond_wait(c,m)      pthread_cond_wait(c, m)
+#define cond_broadcast(c)   pthread_cond_broadcast(c)
+
+#endif
+
+
+struct worker_pool {
+        int          nthreads;     /* threads working on a batch, caller included */
+        int          nworkers;     /* threads spawned by the pool */
+        pool_thread *workers;
+
+        pool_mutex   lock;
+        pool_cond    work_ready;   /* signalled when a batch is posted */
+        pool_cond    work_done;    /* signalled when a batch completes */
+
+        /* the batch currently being run (protected by lock) */
+        pool_task    task;
+        void        *arg;
+        int          ntasks;
+        int          next;         /* next index to hand out */
+        int          pending;      /* indices handed out or waiting, not done */
+        int          shutdown;
+
+        /* scratch memory lent to the caller, see pool_scratch() */
+        void        *scratch;
+        size_t       scratch_size;
+};
+
+
+/**
+ * Main loop of a worker thread: sleep until a batch is posted, then keep
+ * taking indices from it until none are left.
+ */
+static void worker_loop(struct worker_pool *pool)
+{
+        pool_task task;
+        void *arg;
+        int index;
+
+        mutex_lock(&pool->lock);
+        for (;;)
+        {
+                while (!pool->shutdown &&
+                       (pool->task == NULL || pool->next >= pool->ntasks))
+                        cond_wait(&pool->work_ready, &pool->lock);
+                if (pool->shutdown)
+                        break;
+
+                task = pool->task;
+                arg = pool->arg;
+                index = pool->next++;
+
+                mutex_unlock(&pool->lock);
+                task(arg, index);
+                mutex_lock(&pool->lock);
+
+                if (--pool->pending == 0)
+                        cond_broadcast(&pool->work_done);
+        }
+        mutex_unlock(&pool->lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID p)
+{
+        worker_loop((struct worker_pool *) p);
+        return 0;
+}
+#else
+static void* worker_main(void *p)
+{
+        worker_loop((struct worker_pool *) p);
+        return NULL;
+}
+#endif
+
+
+/**
+ * Returns the number of online processors, or 1 if it cannot be found.
+ */
+int pool_cpu_count(void)
+{
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (info.dwNumberOfProcessors > 0) ?
+                (int) info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return (n > 0) ? (int) n : 1;
+#else
+        return 1;
+#endif
+}
+
+
+/**
+ * Creates a pool in which nthreads threads (the caller of pool_run()
+ * included) work on each batch.  If nthreads is less than 1, one thread per
+ * online processor is used.  Returns NULL if the pool cannot be created.
+ */
+struct worker_pool* pool_new(int nthreads)
+{
+        struct worker_pool *pool;
+        int i;
+
+        if (nthreads < 1)
+                nthreads = pool_cpu_count();
+
+        pool = (struct worker_pool *) calloc(1, sizeof(struct worker_pool));
+        if (pool == NULL)
+                return NULL;
+
+        pool->nthreads = nthreads;
+        mutex_init(&pool->lock);
+        cond_init(&pool->work_ready);
+        cond_init(&pool->work_done);
+
+        if (nthreads > 1)
+        {
+                pool->workers = (pool_thread *) malloc(
+                        (nthreads - 1) * sizeof(pool_thread));
+                if (pool->workers == NULL)
+                {
+                        pool_free(pool);
+                        return NULL;
+                }
+        }
+
+        for (i = 0; i < nthreads - 1; i++)
+        {
+#ifdef _WIN32
+                pool->workers[i] = CreateThread(NULL, 0, worker_main, pool,
+                        0, NULL);
+                if (pool->workers[i] == NULL)
+                        break;
+#else
+                if (pthread_create(&pool->workers[i], NULL, worker_main,
+                        pool) != 0)
+                        break;
+#endif
+                pool->nworkers++;
+        }
+
+        /* if some threads could not be started, run with those that were */
+        pool->nthreads = pool->nworkers + 1;
+
+        return pool;
+}
+
+
+/**
+ * Returns the number of threads that work on each batch.
+ */
+int pool_size(struct worker_pool *pool)
+{
+        return pool->nthreads;
+}
+
+
+/**
+ * Calls task(arg, i) for each i in [0, ntasks), spread over the pool's
+ * threads, and returns once every call has returned.
+ */
+void pool_run(struct worker_pool *pool, int ntasks, pool_task task,
+        void *arg)
+{
+        int index;
+
+        if (ntasks <= 0)
+                return;
+
+        /* nothing to hand out: run the batch on the calling thread */
+        if (pool->nworkers == 0 || ntasks == 1)
+        {
+                for (index = 0; index < ntasks; index++)
+                        task(arg, index);
+                return;
+        }
+
+        mutex_lock(&pool->lock);
+        pool->task = task;
+        pool->arg = arg;
+        pool->ntasks = ntasks;
+        pool->next = 0;
+        pool->pending = ntasks;
+        cond_broadcast(&pool->work_ready);
+
+        /* work on the batch alongside the workers */
+        while (pool->next < pool->ntasks)
+        {
+                index = pool->next++;
+                mutex_unlock(&pool->lock);
+                task(arg, index);
+                mutex_lock(&pool->lock);
+                pool->pending--;
+        }
+
+        while (pool->pending > 0)
+                cond_wait(&pool->work_done, &pool->lock);
+
+        pool->task = NULL;
+        pool->arg = NULL;
+        mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * Returns a block of at least size bytes belonging to the pool, which the
+ * caller of pool_run() may share out among the tasks of its batches, or
+ * NULL if it cannot be had.  The block is kept from call to call and only
+ * ever grows, losing its contents when it does; it is freed with the pool.
+ */
+void* pool_scratch(struct worker_pool *pool, size_t size)
+{
+        if (size > pool->scratch_size || pool->scratch == NULL)
+        {
+                free(pool->scratch);
+                pool->scratch_size = 0;
+                if ((pool->scratch = malloc(size)) == NULL)
+                        return NULL;
+                pool->scratch_size = size;
+        }
+        return pool->scratch;
+}
+
+
+/**
+ * Stops the pool's threads and releases the pool.
+ */
+void pool_free(struct worker_pool *pool)
+{
+        int i;
+
+        if (pool == NULL)
+                return;
+
+        mutex_lock(&pool->lock);
+        pool->shutdown = 1;
+        cond_broadcast(&pool->work_ready);
+        mutex_unlock(&pool->lock);
+
+        for (i = 0; i < pool->nworkers; i++)
+        {
+#ifdef _WIN32
+                WaitForSingleObject(pool->workers[i], INFINITE);
+                CloseHandle(pool->workers[i]);
+#else
+                pthread_join(pool->workers[i], NULL);
+#endif
+        }
+
+        cond_destroy(&pool->work_done);
+        cond_destroy(&pool->work_ready);
+        mutex_destroy(&pool->lock);
+        free(pool->workers);
+        free(pool->scratch);
+        free(pool);
+}
@@ -0,0 +1,40 @@
+/**
+ * pool.h
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* See the file pool.c for a description. */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* A task is called once for every index in [0, ntasks). */
+typedef void (*pool_task) (void *arg, int index);
+
+struct worker_pool;
+
+int                 pool_cpu_count (void);
+struct worker_pool *pool_new (int nthreads);
+int                 pool_size (struct worker_pool *pool);
+void                pool_run (struct worker_pool *pool, int ntasks,
+                              pool_task task, void *arg);
+void               *pool_scratch (struct worker_pool *pool, size_t size);
+void                pool_free (struct worker_pool *pool);
+
+#endif /* POOL_H */
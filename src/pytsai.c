@@ -19,26 +19,243 @@
  */
 
 #include "Python.h"
+#include <limits.h>
+#include <string.h>
 #include "tsai/cal_main.h"
 #include "errors.h"
+#include "pool/pool.h"
+
+/* the module functions take their arguments as a C array (METH_FASTCALL),
+ * and the camera model type is made for each module from a spec
+ * (PyType_FromModuleAndSpec) */
+#if PY_VERSION_HEX < 0x03090000
+#error "pytsai needs Python 3.9 or later."
+#endif
+
+/**
+ * A METH_FASTCALL function, which is passed its positional arguments as a C
+ * array instead of a tuple, cast for a method table.  Its arguments are
+ * checked and converted by check_arg_count(), parse_double(), parse_int()
+ * and parse_string().
+ */
+#define FASTCALL(function) ((PyCFunction) (void (*)(void)) (function))
+
+/**
+ * Buffers whose memory a calibration context reads in place.  They must stay
+ * acquired until the calibration has finished.
+ */
+#define CALIBRATION_COLUMNS 5
+struct calibration_buffers {
+        Py_buffer views[CALIBRATION_COLUMNS];
+        int nviews;
+};
+
+/**
+ * A camera model (pytsai.CameraModel): the camera parameters and calibration
+ * constants of a camera, held as C doubles, so that a transform or
+ * calibration handed one copies them instead of looking up the 28 keys of a
+ * mapping.  Instances of subclasses (such as Tsai.CameraParameters) may hold
+ * further items in their __dict__.
+ */
+struct camera_model {
+        PyObject_HEAD
+        struct camera_parameters cp;
+        struct calibration_constants cc;
+};
+
+/**
+ * The keys of a camera parameter mapping (see parse_camera_mapping()), and
+ * where each one's value lives in a calibration context and in a camera
+ * model.
+ */
+#define CAMERA_FIELDS \
+        CAMERA_FIELD(cp, Ncx) CAMERA_FIELD(cp, Nfx) \
+        CAMERA_FIELD(cp, dx) CAMERA_FIELD(cp, dy) \
+        CAMERA_FIELD(cp, dpx) CAMERA_FIELD(cp, dpy) \
+        CAMERA_FIELD(cp, Cx) CAMERA_FIELD(cp, Cy) \
+        CAMERA_FIELD(cp, sx) \
+        CAMERA_FIELD(cc, f) CAMERA_FIELD(cc, kappa1) \
+        CAMERA_FIELD(cc, p1) CAMERA_FIELD(cc, p2) \
+        CAMERA_FIELD(cc, Tx) CAMERA_FIELD(cc, Ty) CAMERA_FIELD(cc, Tz) \
+        CAMERA_FIELD(cc, Rx) CAMERA_FIELD(cc, Ry) CAMERA_FIELD(cc, Rz) \
+        CAMERA_FIELD(cc, r1) CAMERA_FIELD(cc, r2) CAMERA_FIELD(cc, r3) \
+        CAMERA_FIELD(cc, r4) CAMERA_FIELD(cc, r5) CAMERA_FIELD(cc, r6) \
+        CAMERA_FIELD(cc, r7) CAMERA_FIELD(cc, r8) CAMERA_FIELD(cc, r9)
+
+struct camera_field {
+        const char *name;
+        size_t context_offset;          /* in struct tsai_context */
+        size_t model_offset;            /* in struct camera_model */
+};
+
+#define CAMERA_FIELD(s, name) FIELD_##name,
+enum camera_field_index { CAMERA_FIELDS };
+#undef CAMERA_FIELD
+#define CAMERA_FIELD(s, name) { #name, offsetof(struct tsai_context, s.name), \
+        offsetof(struct camera_model, s.name) },
+static const struct camera_field camera_fields[] = { CAMERA_FIELDS };
+#undef CAMERA_FIELD
+#define CAMERA_FIELD_COUNT ((Py_ssize_t) (sizeof(camera_fields) / \
+        sizeof(camera_fields[0])))
+#define CAMERA_FIELD_VALUE(base, offset) \
+        (*(double *) ((char *) (base) + (offset)))
+
+/**
+ * The state of the module, of which every interpreter that imports it has
+ * its own (see PEP 489): the camera model type, and the settings and
+ * threads of the calibrations it runs.  Module functions are passed the
+ * module, and camera models find it through their type (see
+ * camera_model_state()).
+ *
+ * camera_field_keys are the names of camera_fields as interned strings, so
+ * that a dictionary of camera parameters is read without building a key
+ * string per lookup.
+ *
+ * residual_pool is the persistent pool that single calibrations split their
+ * residual and Jacobian sweeps over, once enabled with
+ * tsai_set_residual_threads() (see cal_jac.c).  A pool must not run two
+ * batches at once, so a calibration only borrows it while holding
+ * residual_lock (see borrow_residual_pool()), and runs serially if another
+ * calibration has it; residual_pool and residual_min_chunk are only read or
+ * changed with residual_lock held.
+ *
+ * The rest are the settings new calibration contexts take (see
+ * init_context()), only read or changed with settings_lock held, since
+ * without a GIL (see pytsai_slots) threads may change them and start
+ * calibrations at once:
+ *      jacobian_mode - how the Jacobian is handed to MINPACK, as set by
+ *          tsai_set_jacobian_mode() (see cal_main.h).
+ *      ransac_* - the robust fit of the radial alignment constraint, as set
+ *          by tsai_set_ransac() (see cal_ransac.c); a threshold of 0 leaves
+ *          it off.
+ *      robust_loss* - the loss minimized, and its scale, as set by
+ *          tsai_set_robust_loss() (see cal_robust.c).
+ */
+struct module_state {
+        PyTypeObject *camera_model_type;
+        PyObject *camera_field_keys[CAMERA_FIELD_COUNT];
+        struct worker_pool *residual_pool;
+        int residual_min_chunk;
+        PyThread_type_lock residual_lock;
+        PyThread_type_lock settings_lock;
+        enum tsai_jacobian jacobian_mode;
+        double ransac_threshold;
+        double ransac_confidence;
+        int ransac_max_hypotheses;
+        enum tsai_loss robust_loss;
+        double robust_loss_scale;
+};
+
+static PyType_Spec camera_model_spec;
+
+/* A calibration routine from the calibration library. */
+typedef int (*calibration_routine) (struct tsai_context *ctx);
+
+/* A transform of an array of points from the calibration library. */
+typedef void (*array_transform) (struct tsai_context *ctx, int n, double *in,
+        double *out);
 
 /*************************************
  * Forward Declarations of Functions *
  *************************************/
-PyMODINIT_FUNC initpytsai(void);
-static double* parse_calibration_data(PyObject *pyobj, int *size);
-static int parse_camera_mapping(PyObject *obj);
-static PyObject* build_camera_mapping();
-static PyObject* tsai_coplanar_calibration(PyObject *self, PyObject *args);
-static PyObject* tsai_noncoplanar_calibration(PyObject *self, PyObject *args);
-static PyObject* tsai_coplanar_calibration_fo(PyObject *self, PyObject *args);
-static PyObject* tsai_noncoplanar_calibration_fo(PyObject *self, 
-        PyObject *args);
-static PyObject* tsai_wc2ic(PyObject *self, PyObject *args);
-static PyObject* tsai_ic2wc(PyObject *self, PyObject *args);
-static PyObject* tsai_cc2wc(PyObject *self, PyObject *args);
-static PyObject* tsai_add_sensor_coord_distortion(PyObject *self, 
-        PyObject *args);
+static int module_exec(PyObject *module);
+static int module_traverse(PyObject *module, visitproc visit, void *arg);
+static int module_clear(PyObject *module);
+static void module_free(void *module);
+static struct module_state* get_module_state(PyObject *module);
+static struct module_state* camera_model_state(PyTypeObject *type);
+static struct worker_pool* borrow_residual_pool(struct module_state *state,
+        int *min_chunk);
+static void return_residual_pool(struct module_state *state);
+static void init_context(struct module_state *state,
+        struct tsai_context *ctx);
+static void init_camera_context(struct tsai_context *ctx);
+static struct tsai_context* new_context(struct module_state *state);
+static void free_context(struct tsai_context *ctx);
+static int check_arg_count(const char *name, Py_ssize_t nargs,
+        Py_ssize_t min, Py_ssize_t max);
+static int parse_double(PyObject *obj, double *value);
+static int parse_int(PyObject *obj, int *value);
+static const char* parse_string(PyObject *obj);
+static int parse_point(PyObject *obj, double *point, int n);
+static PyObject* new_point_tuple(const double *point, int n);
+static int parse_calibration_data(PyObject *pyobj, struct tsai_context *ctx,
+        struct calibration_buffers *buffers);
+static void release_calibration_buffers(struct calibration_buffers *buffers);
+static int parse_camera_mapping(struct module_state *state, PyObject *obj,
+        struct tsai_context *ctx);
+static PyObject* build_camera_mapping(struct tsai_context *ctx);
+static PyObject* new_camera_dict(char *base, int in_model);
+static const struct camera_field* find_camera_field(PyObject *key);
+static PyObject* camera_model_extra(PyObject *self);
+static PyObject* run_calibration_with(struct module_state *state,
+        PyObject *calibration_data, PyObject *params,
+        calibration_routine routine, double warm_start_max_error);
+static PyObject* run_calibration(PyObject *module, const char *name,
+        PyObject *const *args, Py_ssize_t nargs, calibration_routine routine);
+static PyObject* run_recalibration(PyObject *module, const char *name,
+        PyObject *const *args, Py_ssize_t nargs, calibration_routine routine);
+static PyObject* tsai_coplanar_calibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_noncoplanar_calibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_coplanar_calibration_fo(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_noncoplanar_calibration_fo(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_coplanar_recalibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_noncoplanar_recalibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_pose_tracker(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_track_pose(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_reset_pose_tracker(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_pose_tracker_camera(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_calibrate_many(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static int parse_frame_offsets(PyObject *obj, Py_ssize_t npoints,
+        struct tsai_frames *frames);
+static PyObject* tsai_extrinsic_batch(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_coplanar_calibration_views(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_rig_calibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_set_residual_threads(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_set_jacobian_mode(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_set_ransac(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_set_robust_loss(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_simd_level_name(PyObject *self, PyObject *args);
+static PyObject* tsai_wc2ic(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_ic2wc(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_cc2wc(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_add_sensor_coord_distortion(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static int get_point_buffer(PyObject *obj, Py_buffer *view, int columns,
+        int flags);
+static PyObject* new_point_array(Py_ssize_t n, int columns);
+static PyObject* run_array_transform(PyObject *module, const char *name,
+        PyObject *const *args, Py_ssize_t nargs, int in_columns,
+        int out_columns, array_transform transform);
+static PyObject* tsai_wc2ic_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_ic2wc_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_wc2cc_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
+static PyObject* tsai_cc2wc_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs);
 
 /***********************
  * Module Method Table *
@@ -46,33 +263,117 @@ static PyObject* tsai_add_sensor_coord_distortion(PyObject *self,
 static PyMethodDef TsaiMethods[] = 
 {
 
-        {"_pytsai_coplanar_calibration", tsai_coplanar_calibration,
-         METH_VARARGS, "Low level coplanar calibration routine."},
+        {"_pytsai_coplanar_calibration",
+         FASTCALL(tsai_coplanar_calibration), METH_FASTCALL,
+         "Low level coplanar calibration routine."},
 
-        {"_pytsai_noncoplanar_calibration", tsai_noncoplanar_calibration,
-         METH_VARARGS, "Low level non-coplanar calibration routine."},
+        {"_pytsai_noncoplanar_calibration",
+         FASTCALL(tsai_noncoplanar_calibration), METH_FASTCALL,
+         "Low level non-coplanar calibration routine."},
 
-        {"_pytsai_coplanar_calibration_fo", tsai_coplanar_calibration_fo,
-         METH_VARARGS, 
+        {"_pytsai_coplanar_calibration_fo",
+         FASTCALL(tsai_coplanar_calibration_fo), METH_FASTCALL,
          "Low level coplanar, with full optimization calibration routine."},
 
-        {"_pytsai_noncoplanar_calibration_fo", tsai_noncoplanar_calibration_fo,
-         METH_VARARGS,
+        {"_pytsai_noncoplanar_calibration_fo",
+         FASTCALL(tsai_noncoplanar_calibration_fo), METH_FASTCALL,
          "Low level noncoplanar, with full optimization calibration routine."},
 
-        {"_pytsai_wc2ic", tsai_wc2ic, METH_VARARGS,
+        {"_pytsai_coplanar_recalibration",
+         FASTCALL(tsai_coplanar_recalibration), METH_FASTCALL,
+         "Low level coplanar calibration routine with a warm start."},
+
+        {"_pytsai_noncoplanar_recalibration",
+         FASTCALL(tsai_noncoplanar_recalibration), METH_FASTCALL,
+         "Low level noncoplanar calibration routine with a warm start."},
+
+        {"_pytsai_pose_tracker",
+         FASTCALL(tsai_pose_tracker), METH_FASTCALL,
+         "Low level routine creating a pose tracker for a camera."},
+
+        {"_pytsai_track_pose",
+         FASTCALL(tsai_track_pose), METH_FASTCALL,
+         "Low level routine updating the pose of a pose tracker."},
+
+        {"_pytsai_reset_pose_tracker",
+         FASTCALL(tsai_reset_pose_tracker), METH_FASTCALL,
+         "Low level routine making a pose tracker start afresh."},
+
+        {"_pytsai_pose_tracker_camera",
+         FASTCALL(tsai_pose_tracker_camera), METH_FASTCALL,
+         "Low level routine fetching the camera of a pose tracker."},
+
+        {"_pytsai_calibrate_many",
+         FASTCALL(tsai_calibrate_many), METH_FASTCALL,
+         "Low level routine running many calibrations on native threads."},
+
+        {"_pytsai_extrinsic_batch",
+         FASTCALL(tsai_extrinsic_batch), METH_FASTCALL,
+         "Low level routine estimating the poses of many frames at once."},
+
+        {"_pytsai_coplanar_calibration_views",
+         FASTCALL(tsai_coplanar_calibration_views), METH_FASTCALL,
+         "Low level coplanar calibration from several views."},
+
+        {"_pytsai_rig_calibration",
+         FASTCALL(tsai_rig_calibration), METH_FASTCALL,
+         "Low level calibration of a rig of cameras."},
+
+        {"_pytsai_set_residual_threads",
+         FASTCALL(tsai_set_residual_threads), METH_FASTCALL,
+         "Low level routine setting up threads for residual evaluation."},
+
+        {"_pytsai_set_jacobian_mode",
+         FASTCALL(tsai_set_jacobian_mode), METH_FASTCALL,
+         "Low level routine choosing how the Jacobian is stored."},
+
+        {"_pytsai_set_ransac",
+         FASTCALL(tsai_set_ransac), METH_FASTCALL,
+         "Low level routine setting up the robust initial fit."},
+
+        {"_pytsai_set_robust_loss",
+         FASTCALL(tsai_set_robust_loss), METH_FASTCALL,
+         "Low level routine choosing the loss of the optimization stages."},
+
+        {"_pytsai_simd_level", tsai_simd_level_name, METH_NOARGS,
+         "Low level routine naming the instruction set of the kernels."},
+
+        {"_pytsai_wc2ic",
+         FASTCALL(tsai_wc2ic), METH_FASTCALL,
          "Low level conversion of world coordinates to image coordinates."},
 
-        {"_pytsai_ic2wc", tsai_ic2wc, METH_VARARGS,
+        {"_pytsai_ic2wc",
+         FASTCALL(tsai_ic2wc), METH_FASTCALL,
          "Low level conversion of image coordinates to world coordinates."},
 
-        {"_pytsai_cc2wc", tsai_cc2wc, METH_VARARGS,
+        {"_pytsai_cc2wc",
+         FASTCALL(tsai_cc2wc), METH_FASTCALL,
          "Low level conversion of camera coordinates to world coordinates."},
 
         {"_pytsai_add_sensor_coord_distortion",
-         tsai_add_sensor_coord_distortion, METH_VARARGS,
+         FASTCALL(tsai_add_sensor_coord_distortion), METH_FASTCALL,
          "Low level conversion of undistorted to distorted image coordinates."},
 
+        {"_pytsai_wc2ic_array",
+         FASTCALL(tsai_wc2ic_array), METH_FASTCALL,
+         "Low level conversion of an array of world coordinates to image " \
+         "coordinates."},
+
+        {"_pytsai_ic2wc_array",
+         FASTCALL(tsai_ic2wc_array), METH_FASTCALL,
+         "Low level conversion of an array of image coordinates to world " \
+         "coordinates."},
+
+        {"_pytsai_wc2cc_array",
+         FASTCALL(tsai_wc2cc_array), METH_FASTCALL,
+         "Low level conversion of an array of world coordinates to camera " \
+         "coordinates."},
+
+        {"_pytsai_cc2wc_array",
+         FASTCALL(tsai_cc2wc_array), METH_FASTCALL,
+         "Low level conversion of an array of camera coordinates to world " \
+         "coordinates."},
+
         {NULL, NULL, 0, NULL}
         
 };
@@ -81,49 +382,544 @@ static PyMethodDef TsaiMethods[] =
  * Module Definition   *
  ***********************/
 
+static PyModuleDef_Slot pytsai_slots[] = {
+        {Py_mod_exec, (void *) module_exec},
+#if PY_VERSION_HEX >= 0x030C0000
+        {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#if PY_VERSION_HEX >= 0x030D0000
+        /* each call works on contexts of its own, and the module state is
+         * guarded by its locks, so free-threaded builds need no GIL */
+        {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+        {0, NULL}
+};
+
 static struct PyModuleDef pytsaimodule = {
         PyModuleDef_HEAD_INIT,
         "pytsai",                     /* m_name */
         "Python Tsai method module",  /* m_doc */
-        -1,                           /* m_size */
+        sizeof(struct module_state),  /* m_size */
         TsaiMethods,                  /* m_methods */
-        NULL,                         /* m_reload */
-        NULL,                         /* m_traverse */
-        NULL,                         /* m_clear */
-        NULL,                         /* m_free */
+        pytsai_slots,                 /* m_slots */
+        module_traverse,              /* m_traverse */
+        module_clear,                 /* m_clear */
+        module_free,                  /* m_free */
     };
 
 /****************************
  * Function Implementations *
  ****************************/
 
-//PyMODINIT_FUNC initpytsai(void)
 PyMODINIT_FUNC PyInit_pytsai(void)
 {
-    //(void) Py_InitModule("pytsai", TsaiMethods);
-	return PyModule_Create(&pytsaimodule);
+    return PyModuleDef_Init(&pytsaimodule);
+}
+
+/**
+ * Sets up the state of a new module (see struct module_state), with the
+ * default settings, and adds its camera model type to it.
+ *
+ * The method returns 0 on success and -1 on failure.  If the method fails,
+ * an appropriate exception is raised.
+ */
+static int module_exec(PyObject *module)
+{
+        struct module_state *state = get_module_state(module);
+        Py_ssize_t i;
+
+        /* pick the kernels for this processor (see cal_cpu.c) */
+        (void) tsai_simd_init();
+
+        state->jacobian_mode = TSAI_JACOBIAN_DENSE;
+        state->ransac_threshold = 0.0;
+        state->ransac_confidence = TSAI_RANSAC_CONFIDENCE;
+        state->ransac_max_hypotheses = 0;
+        state->robust_loss = TSAI_LOSS_SQUARED;
+        state->robust_loss_scale = 0.0;
+        state->residual_lock = PyThread_allocate_lock();
+        state->settings_lock = PyThread_allocate_lock();
+        if (state->residual_lock == NULL || state->settings_lock == NULL)
+        {
+                PyErr_NoMemory();
+                return -1;
+        }
+
+        for (i = 0; i < CAMERA_FIELD_COUNT; i++)
+        {
+                state->camera_field_keys[i] =
+                        PyUnicode_InternFromString(camera_fields[i].name);
+                if (state->camera_field_keys[i] == NULL)
+                        return -1;
+        }
+
+        state->camera_model_type = (PyTypeObject *) PyType_FromModuleAndSpec(
+                module, &camera_model_spec, NULL);
+        if (state->camera_model_type == NULL)
+                return -1;
+        return PyModule_AddType(module, state->camera_model_type);
+}
+
+/**
+ * Visits the objects the state of a module holds, for the garbage
+ * collector.
+ */
+static int module_traverse(PyObject *module, visitproc visit, void *arg)
+{
+        struct module_state *state = get_module_state(module);
+
+        Py_VISIT(state->camera_model_type);
+        return 0;
+}
+
+/**
+ * Drops the objects the state of a module holds.
+ */
+static int module_clear(PyObject *module)
+{
+        struct module_state *state = get_module_state(module);
+        Py_ssize_t i;
+
+        Py_CLEAR(state->camera_model_type);
+        for (i = 0; i < CAMERA_FIELD_COUNT; i++)
+                Py_CLEAR(state->camera_field_keys[i]);
+        return 0;
+}
+
+/**
+ * Releases the state of a module when the module goes away: its objects,
+ * the residual pool and the locks.
+ */
+static void module_free(void *module)
+{
+        struct module_state *state = get_module_state((PyObject *) module);
+
+        module_clear((PyObject *) module);
+        if (state->residual_pool != NULL)
+                pool_free(state->residual_pool);
+        state->residual_pool = NULL;
+        if (state->residual_lock != NULL)
+                PyThread_free_lock(state->residual_lock);
+        state->residual_lock = NULL;
+        if (state->settings_lock != NULL)
+                PyThread_free_lock(state->settings_lock);
+        state->settings_lock = NULL;
+}
+
+/**
+ * Returns the state of the module (see struct module_state).
+ */
+static struct module_state* get_module_state(PyObject *module)
+{
+        return (struct module_state *) PyModule_GetState(module);
+}
+
+/**
+ * Finds the state of the module whose camera model type is type, or a base
+ * of it, such as that of Tsai.CameraParameters.
+ *
+ * If the method fails, it returns NULL and raises TypeError.
+ */
+static struct module_state* camera_model_state(PyTypeObject *type)
+{
+        PyObject *module = NULL;
+
+#if PY_VERSION_HEX >= 0x030B0000
+        module = PyType_GetModuleByDef(type, &pytsaimodule);
+#else
+        for (; type != NULL; type = type->tp_base)
+        {
+                if (!PyType_HasFeature(type, Py_TPFLAGS_HEAPTYPE))
+                        continue;
+                module = PyType_GetModule(type);
+                if (module != NULL && PyModule_GetDef(module) == &pytsaimodule)
+                        break;
+                PyErr_Clear();
+                module = NULL;
+        }
+        if (module == NULL)
+                PyErr_SetString(PyExc_TypeError,
+                        "Not a camera model type.");
+#endif
+        return module == NULL ? NULL : get_module_state(module);
+}
+
+/**
+ * Borrows the residual pool of a module for a calibration, if it is enabled
+ * and no other calibration has it, setting *min_chunk to the fewest points
+ * to hand a thread at a time.  It returns NULL if the calibration should run
+ * serially; a pool it returns must be handed back with
+ * return_residual_pool() once the calibration has finished.
+ */
+static struct worker_pool* borrow_residual_pool(struct module_state *state,
+        int *min_chunk)
+{
+        struct worker_pool *pool = NULL;
+
+        *min_chunk = 0;
+        if (!PyThread_acquire_lock(state->residual_lock, NOWAIT_LOCK))
+                return NULL;
+        pool = state->residual_pool;
+        if (pool == NULL)
+                PyThread_release_lock(state->residual_lock);
+        else
+                *min_chunk = state->residual_min_chunk;
+        return pool;
+}
+
+/**
+ * Hands back the residual pool borrowed with borrow_residual_pool().
+ */
+static void return_residual_pool(struct module_state *state)
+{
+        PyThread_release_lock(state->residual_lock);
+}
+
+/**
+ * Sets up a zeroed calibration context in storage the caller provides, such
+ * as a local variable of a call that needs no calibration data storage.
+ * The context takes the settings of the module state: it stores its
+ * Jacobian as jacobian_mode says, fits the radial alignment constraint as
+ * the ransac_ settings say, and minimizes robust_loss.
+ */
+static void init_context(struct module_state *state,
+        struct tsai_context *ctx)
+{
+        memset(ctx, 0, sizeof(struct tsai_context));
+        PyThread_acquire_lock(state->settings_lock, WAIT_LOCK);
+        ctx->jacobian = state->jacobian_mode;
+        ctx->ransac_threshold = state->ransac_threshold;
+        ctx->ransac_confidence = state->ransac_confidence;
+        ctx->ransac_max_hypotheses = state->ransac_max_hypotheses;
+        ctx->loss = state->robust_loss;
+        ctx->loss_scale = state->robust_loss_scale;
+        PyThread_release_lock(state->settings_lock);
+}
+
+/**
+ * Sets up a zeroed calibration context for the transforms, which read its
+ * camera alone and none of the settings of init_context().
+ */
+static void init_camera_context(struct tsai_context *ctx)
+{
+        memset(ctx, 0, sizeof(struct tsai_context));
+}
+
+/**
+ * Allocates a zeroed calibration context (see init_context()).  Each call
+ * into the calibration library works on its own context, so no state is
+ * shared between calls.
+ * The context should be released with free_context().
+ *
+ * If the method fails, it returns NULL and raises MemoryError.
+ */
+static struct tsai_context* new_context(struct module_state *state)
+{
+        struct tsai_context *ctx = NULL;
+
+        ctx = PyMem_Malloc(sizeof(struct tsai_context));
+        if (ctx == NULL)
+        {
+                PyErr_NoMemory();
+                return NULL;
+        }
+        init_context(state, ctx);
+
+        return ctx;
+}
+
+/**
+ * Releases a calibration context allocated by new_context(), along with any
+ * calibration data storage it holds.  ctx may be NULL.
+ */
+static void free_context(struct tsai_context *ctx)
+{
+        if (ctx == NULL)
+                return;
+        tsai_context_release(ctx);
+        PyMem_Free(ctx);
+}
+
+/**
+ * Checks that a METH_FASTCALL function was passed from min to max positional
+ * arguments, as PyArg_ParseTuple() would.
+ *
+ * The method returns 1 on success and 0 on failure.  If the method fails,
+ * TypeError is raised.
+ */
+static int check_arg_count(const char *name, Py_ssize_t nargs,
+        Py_ssize_t min, Py_ssize_t max)
+{
+        Py_ssize_t expected;
+
+        if (nargs >= min && nargs <= max)
+                return 1;
+        expected = nargs < min ? min : max;
+        PyErr_Format(PyExc_TypeError,
+                "%s() takes %s %zd argument%s (%zd given)", name,
+                min == max ? "exactly" : nargs < min ? "at least" : "at most",
+                expected, expected == 1 ? "" : "s", nargs);
+        return 0;
+}
+
+/**
+ * Converts an argument to a C double, as the "d" format of
+ * PyArg_ParseTuple() does.
+ *
+ * The method returns 1 on success and 0 on failure.  If the method fails,
+ * an appropriate exception is raised.
+ */
+static int parse_double(PyObject *obj, double *value)
+{
+        if (PyFloat_CheckExact(obj))
+        {
+                *value = PyFloat_AS_DOUBLE(obj);
+                return 1;
+        }
+        *value = PyFloat_AsDouble(obj);
+        return !(*value == -1.0 && PyErr_Occurred());
+}
+
+/**
+ * Converts an argument to a C int, as the "i" format of PyArg_ParseTuple()
+ * does.
+ *
+ * The method returns 1 on success and 0 on failure.  If the method fails,
+ * an appropriate exception is raised.
+ */
+static int parse_int(PyObject *obj, int *value)
+{
+        long number;
+
+        if (PyFloat_Check(obj))
+        {
+                PyErr_SetString(PyExc_TypeError,
+                        "integer argument expected, got float");
+                return 0;
+        }
+        number = PyLong_AsLong(obj);
+        if (number == -1 && PyErr_Occurred())
+                return 0;
+        if (number > INT_MAX || number < INT_MIN)
+        {
+                PyErr_SetString(PyExc_OverflowError,
+                        "signed integer is out of range for a C int");
+                return 0;
+        }
+        *value = (int) number;
+        return 1;
+}
+
+/**
+ * Converts a str argument to a UTF-8 C string, as the "s" format of
+ * PyArg_ParseTuple() does.  The string belongs to obj.
+ *
+ * If the method fails, it returns NULL and raises TypeError or ValueError.
+ */
+static const char* parse_string(PyObject *obj)
+{
+        const char *string = NULL;
+        Py_ssize_t size;
+
+        if (!PyUnicode_Check(obj))
+        {
+                PyErr_Format(PyExc_TypeError,
+                        "argument must be str, not %.50s",
+                        Py_TYPE(obj)->tp_name);
+                return NULL;
+        }
+        string = PyUnicode_AsUTF8AndSize(obj, &size);
+        if (string != NULL && strlen(string) != (size_t) size)
+        {
+                PyErr_SetString(PyExc_ValueError, "embedded null character");
+                return NULL;
+        }
+        return string;
+}
+
+/**
+ * Checks that a buffer holds native doubles, setting TypeError if not.
+ */
+static int check_double_buffer(Py_buffer *view)
+{
+        const char *format = view->format;
+        const int one = 1;
+        const int little_endian = *(const char *) &one;
+
+        if (format != NULL && (*format == '@' || *format == '=' ||
+                (*format == '<' && little_endian) ||
+                ((*format == '>' || *format == '!') && !little_endian)))
+                format++;
+        if (format == NULL || strcmp(format, "d") != 0 ||
+                view->itemsize != sizeof(double))
+        {
+                PyErr_SetString(PyExc_TypeError,
+                        "Buffers must hold float64 values in native byte " \
+                        "order.");
+                return 0;
+        }
+        return 1;
+}
+
+/**
+ * Releases the buffers acquired by parse_calibration_data().
+ */
+static void release_calibration_buffers(struct calibration_buffers *buffers)
+{
+        while (buffers->nviews > 0)
+                PyBuffer_Release(&buffers->views[--buffers->nviews]);
+}
+
+/**
+ * Reads calibration data from a C-contiguous float64 buffer of shape (N, 5),
+ * one row per point, into the given calibration context.  The rows are
+ * split into the context's column arrays with a single pass over the
+ * buffer.
+ */
+static int parse_calibration_array(PyObject *pyobj, struct tsai_context *ctx)
+{
+        Py_buffer view;
+        const double *row;
+        int i;
+
+        if (PyObject_GetBuffer(pyobj, &view,
+                PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+                return 0;
+        if (!check_double_buffer(&view))
+        {
+                PyBuffer_Release(&view);
+                return 0;
+        }
+        if (view.ndim != 2 || view.shape[1] != CALIBRATION_COLUMNS ||
+                view.shape[0] > INT_MAX)
+        {
+                PyBuffer_Release(&view);
+                PyErr_SetString(PyExc_ValueError,
+                        "Calibration data buffer must have shape (N, 5): " \
+                        "[x,y,z,xi,yi] per point.");
+                return 0;
+        }
+
+        if (tsai_context_reserve(ctx, (int) view.shape[0]) == 0)
+        {
+                PyBuffer_Release(&view);
+                PyErr_NoMemory();
+                return 0;
+        }
+        row = (const double *) view.buf;
+        for (i = 0; i < ctx->cd.point_count; i++)
+        {
+                ctx->cd.xw[i] = row[0];
+                ctx->cd.yw[i] = row[1];
+                ctx->cd.zw[i] = row[2];
+                ctx->cd.Xf[i] = row[3];
+                ctx->cd.Yf[i] = row[4];
+                row += CALIBRATION_COLUMNS;
+        }
+
+        PyBuffer_Release(&view);
+        return 1;
+}
+
+/**
+ * Attaches calibration data held in a dictionary of 1-D float64 buffers,
+ * with keys "xw", "yw", "zw", "Xf" and "Yf", to the given calibration
+ * context.  The buffers are read in place; they are acquired into buffers,
+ * which the caller releases once the calibration has finished.
+ */
+static int parse_calibration_columns(PyObject *pyobj,
+        struct tsai_context *ctx, struct calibration_buffers *buffers)
+{
+        static const char *keys[CALIBRATION_COLUMNS] =
+                { "xw", "yw", "zw", "Xf", "Yf" };
+        double *columns[CALIBRATION_COLUMNS];
+        PyObject *column = NULL;
+        Py_buffer *view = NULL;
+        int i;
+
+        for (i = 0; i < CALIBRATION_COLUMNS; i++)
+        {
+                column = PyDict_GetItemString(pyobj, keys[i]);
+                if (column == NULL)
+                {
+                        PyErr_Format(PyExc_KeyError,
+                                "Calibration data has no \"%s\" column.",
+                                keys[i]);
+                        release_calibration_buffers(buffers);
+                        return 0;
+                }
+                view = &buffers->views[buffers->nviews];
+                if (PyObject_GetBuffer(column, view,
+                        PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+                {
+                        release_calibration_buffers(buffers);
+                        return 0;
+                }
+                buffers->nviews++;
+                if (!check_double_buffer(view))
+                {
+                        release_calibration_buffers(buffers);
+                        return 0;
+                }
+                if (view->ndim != 1 || view->shape[0] > INT_MAX ||
+                        view->shape[0] != buffers->views[0].shape[0])
+                {
+                        PyErr_SetString(PyExc_ValueError,
+                                "Calibration data columns must be 1-D and " \
+                                "of equal length.");
+                        release_calibration_buffers(buffers);
+                        return 0;
+                }
+                columns[i] = (double *) view->buf;
+        }
+
+        if (tsai_context_attach(ctx, (int) buffers->views[0].shape[0],
+                columns[0], columns[1], columns[2], columns[3],
+                columns[4]) == 0)
+        {
+                release_calibration_buffers(buffers);
+                PyErr_NoMemory();
+                return 0;
+        }
+        return 1;
 }
 
 /**
- * Parses calibration data.  The calibration data should be in the form of a
- * sequence of sequences. eg:
- *    [
- *        [ xs, ys, zs, xi, yi ], ...
- *    ]
- * where (xs, ys, zs) are the coordinates of a point in 3D space, and (xi, yi)
- * are the coordinates of the corresponding point in an image.
+ * Parses calibration data into the given calibration context.  The
+ * calibration data may be given in one of three forms:
+ *  - a sequence of sequences, eg:
+ *        [
+ *            [ xs, ys, zs, xi, yi ], ...
+ *        ]
+ *    where (xs, ys, zs) are the coordinates of a point in 3D space, and
+ *    (xi, yi) are the coordinates of the corresponding point in an image.
+ *  - an object supporting the buffer protocol (such as a NumPy array) that
+ *    is a C-contiguous float64 array of shape (N, 5), laid out as above.
+ *  - a dictionary with keys "xw", "yw", "zw", "Xf" and "Yf", mapping to
+ *    C-contiguous 1-D float64 buffers of equal length.  These are read in
+ *    place, without copying.
  *
- * If the method fails, it returns NULL and raises an appropriate exception.  
- * On success, a flat array of doubles will be PyMem_Malloc()'d and filled 
- * with the calibration data:
- *    { xs1, ys1, zs1, xi1, yi1, xs2, ys2, zs2, xi2, yi2, ... }
- * size will be populated with the number of calibration points.
+ * The context's calibration data storage is sized to fit (there is no limit
+ * on the number of points), and the points are written straight into it.
+ * Buffers read in place are recorded in buffers, which must be released
+ * with release_calibration_buffers() after the calibration.
+ *
+ * The method returns 1 on success and 0 on failure.  If the method fails, an
+ * appropriate exception is raised.
  */
-static double* parse_calibration_data(PyObject *pyobj, int *size)
+static int parse_calibration_data(PyObject *pyobj, struct tsai_context *ctx,
+        struct calibration_buffers *buffers)
 {
-        PyObject *subseq = NULL, *sstuple = NULL;
-        int i = 0, ncoords = 0, index = 0;
-        double *array = NULL, xs, ys, zs, xi, yi;
+        PyObject *subseq = NULL;
+        Py_ssize_t ncoords = 0;
+        int i = 0, ok;
+        double row[5];
+
+        /* arrays are read without going through Python objects */
+        if (PyDict_Check(pyobj))
+                return parse_calibration_columns(pyobj, ctx, buffers);
+        if (PyObject_CheckBuffer(pyobj))
+                return parse_calibration_array(pyobj, ctx);
 
         /* check that pyobj is a sequence, and find out its size */
         if (PySequence_Check(pyobj) == 0)
@@ -131,70 +927,61 @@ static double* parse_calibration_data(PyObject *pyobj, int *size)
                 PyErr_SetString(PyExc_TypeError, 
                         "First argument must be a sequence of coordinate " \
                         "sequences.");
-                return NULL;
+                return 0;
         }
         ncoords = PySequence_Size(pyobj);
-        *size = ncoords;
+        if (ncoords < 0)
+                return 0;
+        if (ncoords > INT_MAX)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "Too many calibration points.");
+                return 0;
+        }
 
         /* allocate memory */
-        array = PyMem_Malloc(sizeof(double) * ncoords * 5);
-        if (array == NULL)
-                return NULL;
+        if (tsai_context_reserve(ctx, (int) ncoords) == 0)
+        {
+                PyErr_NoMemory();
+                return 0;
+        }
 
         /* iterate over each sub-sequence within pyobj, performing appropriate
          * checks and fetching data. */
         for (i = 0; i < ncoords; i++)
         {
                 subseq = PySequence_GetItem(pyobj, i);
-                if (PySequence_Check(subseq) == 0)
+                if (subseq == NULL || PySequence_Check(subseq) == 0)
                 {
-                        Py_DECREF(subseq);
-                        PyMem_Free(array);
+                        Py_XDECREF(subseq);
                         PyErr_SetString(PyExc_TypeError,
                                 "First argument must be a sequence of " \
                                 "coordinate sequences.");
-                        return NULL;
+                        return 0;
                 }
-                sstuple = PySequence_Tuple(subseq);
+                ok = parse_point(subseq, row, 5);
                 Py_DECREF(subseq);
-                if (sstuple == NULL)
-                {
-                        Py_DECREF(sstuple);
-                        PyMem_Free(array);
-                        PyErr_SetString(PyExc_TypeError,
-                                "First argument must be a sequence of " \
-                                "coordinate sequences.");
-                        return NULL;
-                }
-                
-                if (!PyArg_ParseTuple(sstuple, "ddddd", &xs, &ys, &zs,
-                        &xi, &yi))
+                if (!ok)
                 {
-                        Py_DECREF(sstuple);
-                        PyMem_Free(array);
                         PyErr_SetString(PyExc_TypeError,
                                 "First argument's coordinate sequences must " \
                                 "contain 5 elements each: [x,y,z,xi,yi]");
-                        return NULL;
+                        return 0;
                 }
-                
-                array[index++] = xs;
-                array[index++] = ys;
-                array[index++] = zs;
-                array[index++] = xi;
-                array[index++] = yi;
 
-                /* printf("xs = %f, ys = %f, zs = %f, xi = %f, yi = %f\n",
-                        xs, ys, zs, xi, yi); */
-
-                Py_DECREF(sstuple);
+                ctx->cd.xw[i] = row[0];
+                ctx->cd.yw[i] = row[1];
+                ctx->cd.zw[i] = row[2];
+                ctx->cd.Xf[i] = row[3];
+                ctx->cd.Yf[i] = row[4];
         }
 
-        return array;
+        return 1;
 }
 
 /**
- * Parses a mapping containing both camera constants and camera parameters.
+ * Parses a mapping containing both camera constants and camera parameters
+ * into the given calibration context.
  * The mapping should contain mappings whose keys are all strings.  The
  * following keys are recognized:
  *  Ncx
@@ -225,31 +1012,26 @@ static double* parse_calibration_data(PyObject *pyobj, int *size)
  *  r7
  *  r8
  *  r9
+ * Keys the mapping lacks are left as they were.  A camera model (see
+ * struct camera_model) is copied whole, without going through the keys.
  * 
  * The method returns 1 on success and 0 on failure.  If the method fails, an
  * appropriate exception is raised.
  */
-#define TSAI_PARSE_ITEM(strx,name) { \
-        mo = PyMapping_GetItemString(obj, #name); \
-        if (mo != NULL) \
-        { \
-                number = PyNumber_Float(mo); \
-                Py_DECREF(mo); \
-                if (number == NULL) \
-                { \
-                        PyErr_SetString(PyExc_TypeError, \
-                                "Camera parameter \"" #name \
-                                "\" should be a number."); \
-                        return 0; \
-                } \
-                strx.name = PyFloat_AsDouble(number); \
-                Py_DECREF(number); \
-        } \
-}
-static int parse_camera_mapping(PyObject *obj)
+static int parse_camera_mapping(struct module_state *state, PyObject *obj,
+        struct tsai_context *ctx)
 {
         PyObject *mo = NULL;
         PyObject *number = NULL;
+        Py_ssize_t i;
+
+        /* a camera model is copied as it is */
+        if (PyObject_TypeCheck(obj, state->camera_model_type))
+        {
+                ctx->cp = ((struct camera_model *) obj)->cp;
+                ctx->cc = ((struct camera_model *) obj)->cc;
+                return 1;
+        }
 
         /* check that we have been passed a mapping */
         if (PyMapping_Check(obj) == 0)
@@ -260,35 +1042,46 @@ static int parse_camera_mapping(PyObject *obj)
                 return 0;
         }
         
-        /* parse all known items */
-        TSAI_PARSE_ITEM(tsai_cp,Ncx);
-        TSAI_PARSE_ITEM(tsai_cp,Nfx);
-        TSAI_PARSE_ITEM(tsai_cp,dx);
-        TSAI_PARSE_ITEM(tsai_cp,dy);
-        TSAI_PARSE_ITEM(tsai_cp,dpx);
-        TSAI_PARSE_ITEM(tsai_cp,dpy);
-        TSAI_PARSE_ITEM(tsai_cp,Cx);
-        TSAI_PARSE_ITEM(tsai_cp,Cy);
-        TSAI_PARSE_ITEM(tsai_cp,sx);
-        TSAI_PARSE_ITEM(tsai_cc,f);
-        TSAI_PARSE_ITEM(tsai_cc,kappa1);
-        TSAI_PARSE_ITEM(tsai_cc,p1);
-        TSAI_PARSE_ITEM(tsai_cc,p2);
-        TSAI_PARSE_ITEM(tsai_cc,Tx);
-        TSAI_PARSE_ITEM(tsai_cc,Ty);
-        TSAI_PARSE_ITEM(tsai_cc,Tz);
-        TSAI_PARSE_ITEM(tsai_cc,Rx);
-        TSAI_PARSE_ITEM(tsai_cc,Ry);
-        TSAI_PARSE_ITEM(tsai_cc,Rz);
-        TSAI_PARSE_ITEM(tsai_cc,r1);
-        TSAI_PARSE_ITEM(tsai_cc,r2);
-        TSAI_PARSE_ITEM(tsai_cc,r3);
-        TSAI_PARSE_ITEM(tsai_cc,r4);
-        TSAI_PARSE_ITEM(tsai_cc,r5);
-        TSAI_PARSE_ITEM(tsai_cc,r6);
-        TSAI_PARSE_ITEM(tsai_cc,r7);
-        TSAI_PARSE_ITEM(tsai_cc,r8);
-        TSAI_PARSE_ITEM(tsai_cc,r9);
+        /* parse all known items; a dictionary is read without calling back
+         * into Python */
+        for (i = 0; i < CAMERA_FIELD_COUNT; i++)
+        {
+                if (PyDict_CheckExact(obj))
+                {
+#if PY_VERSION_HEX >= 0x030D0000
+                        /* a strong reference, in case another thread
+                         * changes the dictionary meanwhile */
+                        (void) PyDict_GetItemRef(obj,
+                                state->camera_field_keys[i], &mo);
+#else
+                        mo = PyDict_GetItemWithError(obj,
+                                state->camera_field_keys[i]);
+                        Py_XINCREF(mo);
+#endif
+                }
+                else
+                        mo = PyObject_GetItem(obj,
+                                state->camera_field_keys[i]);
+                if (mo == NULL)
+                        continue;
+                if (PyFloat_CheckExact(mo))
+                        number = mo;
+                else
+                {
+                        number = PyNumber_Float(mo);
+                        Py_DECREF(mo);
+                }
+                if (number == NULL)
+                {
+                        PyErr_Format(PyExc_TypeError,
+                                "Camera parameter \"%s\" should be a " \
+                                "number.", camera_fields[i].name);
+                        return 0;
+                }
+                CAMERA_FIELD_VALUE(ctx, camera_fields[i].context_offset) =
+                        PyFloat_AS_DOUBLE(number);
+                Py_DECREF(number);
+        }
 
         /* clear any exceptions that may have occurred while trying to fetch
          * keys */
@@ -297,427 +1090,2313 @@ static int parse_camera_mapping(PyObject *obj)
         /* return success */
         return 1;
 }
-#undef TSAI_PARSE_ITEM
+
+/**
+ * Constructs a dictionary of the 28 camera parameters, read from base: a
+ * calibration context or, if in_model is set, a camera model.
+ */
+static PyObject* new_camera_dict(char *base, int in_model)
+{
+        PyObject *mapping = NULL, *value = NULL;
+        Py_ssize_t i;
+
+        mapping = PyDict_New();
+        if (mapping == NULL)
+                return NULL;
+        for (i = 0; i < CAMERA_FIELD_COUNT; i++)
+        {
+                value = PyFloat_FromDouble(CAMERA_FIELD_VALUE(base,
+                        in_model ? camera_fields[i].model_offset :
+                        camera_fields[i].context_offset));
+                if (value == NULL || PyDict_SetItemString(mapping,
+                        camera_fields[i].name, value) != 0)
+                {
+                        Py_XDECREF(value);
+                        Py_DECREF(mapping);
+                        return NULL;
+                }
+                Py_DECREF(value);
+        }
+        return mapping;
+}
 
 /**
  * Constructs a mapping containing all camera parameters.  For parameters that
  * are known, see the parse_camera_mapping() function.
  */
-static PyObject* build_camera_mapping()
-{
-        /* 28 parameters */
-        return Py_BuildValue(
-                "{sdsdsdsdsdsdsdsdsdsd" \
-                 "sdsdsdsdsdsdsdsdsdsd" \
-                 "sdsdsdsdsdsdsdsd}",
-                "Ncx", tsai_cp.Ncx, "Nfx", tsai_cp.Nfx, 
-                "dx", tsai_cp.dx, "dy", tsai_cp.dy, 
-                "dpx", tsai_cp.dpx, "dpy", tsai_cp.dpy,
-                "Cx", tsai_cp.Cx, "Cy", tsai_cp.Cy, 
-                "sx", tsai_cp.sx, 
-                "f", tsai_cc.f, 
-                "kappa1", tsai_cc.kappa1, 
-                "p1", tsai_cc.p1, "p2", tsai_cc.p2, 
-                "Tx", tsai_cc.Tx, "Ty", tsai_cc.Ty, "Tz", tsai_cc.Tz, 
-                "Rx", tsai_cc.Rx, "Ry", tsai_cc.Ry, "Rz", tsai_cc.Rz, 
-                "r1", tsai_cc.r1, "r2", tsai_cc.r2, "r3", tsai_cc.r3, 
-                "r4", tsai_cc.r4, "r5", tsai_cc.r5, "r6", tsai_cc.r6, 
-                "r7", tsai_cc.r7, "r8", tsai_cc.r8, "r9", tsai_cc.r9);
+static PyObject* build_camera_mapping(struct tsai_context *ctx)
+{
+        return new_camera_dict((char *) ctx, 0);
+}
+
+/**
+ * Runs one calibration routine on a set of calibration coordinates (see
+ * parse_calibration_data()) and a dictionary of camera parameters, which
+ * also gives the starting calibration constants of the warm start routines;
+ * warm_start_max_error is their acceptance test (see cal_main.h).
+ * It returns the calibrated camera parameter mapping, or NULL with an
+ * exception set.
+ */
+static PyObject* run_calibration_with(struct module_state *state,
+        PyObject *calibration_data, PyObject *params,
+        calibration_routine routine, double warm_start_max_error)
+{
+        PyObject *result = NULL;
+        struct tsai_context *ctx = NULL;
+        struct calibration_buffers buffers;
+
+        /* allocate a calibration context and clear its error flags */
+        ctx = new_context(state);
+        if (ctx == NULL)
+                return NULL;
+        pytsai_clear(&ctx->err);
+        ctx->warm_start_max_error = warm_start_max_error;
+                
+        /* fetch the calibration data */
+        buffers.nviews = 0;
+        if (parse_calibration_data(calibration_data, ctx, &buffers) == 0)
+        {
+                free_context(ctx);
+                return NULL;
+        }
+
+        /* fetch the camera parameters mapping */
+        if (parse_camera_mapping(state, params, ctx) == 0)
+        {
+                release_calibration_buffers(&buffers);
+                free_context(ctx);
+                return NULL;
+        }
+
+        /* borrow the residual pool, if it is enabled and free */
+        ctx->pool = borrow_residual_pool(state, &ctx->min_chunk);
+
+        /* perform the C call; the context is private to this call, so other
+         * Python threads may run meanwhile */
+        Py_BEGIN_ALLOW_THREADS
+        routine(ctx);
+        Py_END_ALLOW_THREADS
+        if (ctx->pool != NULL)
+                return_residual_pool(state);
+        release_calibration_buffers(&buffers);
+
+        /* check for an error */
+        if (pytsai_haserror(&ctx->err))
+                PyErr_SetString(PyExc_RuntimeError, ctx->err.string);
+        else
+                result = build_camera_mapping(ctx);
+
+        free_context(ctx);
+        return result;
+}
+
+/**
+ * Runs one calibration routine for the Python wrappers below, name being
+ * the wrapper's.  The arguments are:
+ *      1 - set of calibration coordinates (see parse_calibration_data()).
+ *      2 - dictionary of camera parameters.
+ * It returns the calibrated camera parameter mapping, or NULL with an
+ * exception set.
+ */
+static PyObject* run_calibration(PyObject *module, const char *name,
+        PyObject *const *args, Py_ssize_t nargs, calibration_routine routine)
+{
+        if (!check_arg_count(name, nargs, 2, 2))
+                return NULL;
+
+        return run_calibration_with(get_module_state(module), args[0],
+                args[1], routine, 0.0);
+}
+
+/**
+ * Runs one warm start calibration routine for the Python wrappers below,
+ * name being the wrapper's.  The arguments are:
+ *      1 - set of calibration coordinates (see parse_calibration_data()).
+ *      2 - dictionary of camera parameters and calibration constants from
+ *          an earlier calibration, to start from.
+ *      3 - (optional) largest median image error [pix] of the points
+ *          after an accepted warm start; 0 uses the default.
+ * If the warm start is not accepted, the routine falls back on a full
+ * calibration from scratch.  Raises ValueError if the error is negative.
+ */
+static PyObject* run_recalibration(PyObject *module, const char *name,
+        PyObject *const *args, Py_ssize_t nargs, calibration_routine routine)
+{
+        double max_error = 0.0;
+
+        if (!check_arg_count(name, nargs, 2, 3))
+                return NULL;
+        if (nargs > 2 && !parse_double(args[2], &max_error))
+                return NULL;
+        if (max_error < 0)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "The largest warm start error must not be negative.");
+                return NULL;
+        }
+
+        return run_calibration_with(get_module_state(module), args[0],
+                args[1], routine, max_error);
+}
+
+
+/**
+ * Performs coplanar calibration with optimization of f, Tz and kappa1.
+ * The arguments to the function are:
+ *      1 - set of calibration coordinates.
+ *      2 - dictionary of camera parameters.
+ */
+static PyObject* tsai_coplanar_calibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_calibration(self, "_pytsai_coplanar_calibration",
+                args, nargs, coplanar_calibration);
+}
+
+
+/**
+ * Performs non-coplanar calibration with optimization of f, Tz and kappa1.
+ * The arguments to the function are:
+ *      1 - set of calibration coordinates.
+ *      2 - dictionary of camera parameters.
+ */
+static PyObject* tsai_noncoplanar_calibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_calibration(self, "_pytsai_noncoplanar_calibration",
+                args, nargs, noncoplanar_calibration);
+}
+
+
+/**
+ * Performs coplanar calibration with full optimization.
+ * The arguments to the function are:
+ *      1 - set of calibration coordinates.
+ *      2 - dictionary of camera parameters.
+ */
+static PyObject* tsai_coplanar_calibration_fo(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_calibration(self, "_pytsai_coplanar_calibration_fo",
+                args, nargs, coplanar_calibration_with_full_optimization);
+}
+
+
+/**
+ * Performs non-coplanar calibration with full optimization.
+ * The arguments to the function are:
+ *      1 - set of calibration coordinates.
+ *      2 - dictionary of camera parameters.
+ */
+static PyObject* tsai_noncoplanar_calibration_fo(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_calibration(self, "_pytsai_noncoplanar_calibration_fo",
+                args, nargs, noncoplanar_calibration_with_full_optimization);
+}
+
+
+/**
+ * Recalibrates a coplanar camera by full optimization, starting from an
+ * earlier calibration.  See run_recalibration() for the arguments.
+ */
+static PyObject* tsai_coplanar_recalibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_recalibration(self, "_pytsai_coplanar_recalibration",
+                args, nargs, coplanar_calibration_with_warm_start);
+}
+
+
+/**
+ * Recalibrates a non-coplanar camera by full optimization, starting from an
+ * earlier calibration.  See run_recalibration() for the arguments.
+ */
+static PyObject* tsai_noncoplanar_recalibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_recalibration(self, "_pytsai_noncoplanar_recalibration",
+                args, nargs, noncoplanar_calibration_with_warm_start);
+}
+
+
+/**
+ * The state of a pose tracker (see tsai_pose_tracker()), held in a capsule:
+ * the context that keeps the camera and the last pose from frame to frame,
+ * and the lock that keeps two threads from updating it at once.  tracking is
+ * 0 until the first pose has been estimated, and after a reset or a failed
+ * update.
+ */
+#define POSE_TRACKER_NAME "pytsai.PoseTracker"
+struct pose_tracker {
+        struct tsai_context *ctx;
+        PyThread_type_lock lock;
+        int tracking;
+};
+
+/**
+ * Frees a pose tracker when its capsule goes away.
+ */
+static void free_pose_tracker(PyObject *capsule)
+{
+        struct pose_tracker *tracker = NULL;
+
+        tracker = PyCapsule_GetPointer(capsule, POSE_TRACKER_NAME);
+        if (tracker == NULL)
+                return;
+        free_context(tracker->ctx);
+        if (tracker->lock != NULL)
+                PyThread_free_lock(tracker->lock);
+        PyMem_Free(tracker);
+}
+
+/**
+ * Fetches the pose tracker from its capsule, raising TypeError if obj is not
+ * one.
+ */
+static struct pose_tracker* get_pose_tracker(PyObject *obj)
+{
+        if (!PyCapsule_IsValid(obj, POSE_TRACKER_NAME))
+        {
+                PyErr_SetString(PyExc_TypeError,
+                        "First argument must be a pose tracker.");
+                return NULL;
+        }
+        return PyCapsule_GetPointer(obj, POSE_TRACKER_NAME);
+}
+
+/**
+ * Creates a pose tracker for a calibrated camera.  The arguments are:
+ *      1 - dictionary of camera parameters, whose intrinsic parameters are
+ *          held fixed.
+ *      2 - (optional) largest median image error [pix] of the points after
+ *          an accepted update; 0 uses the default.
+ * It returns the tracker, as a capsule.  Raises ValueError if the error is
+ * negative.
+ */
+static PyObject* tsai_pose_tracker(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        PyObject *capsule = NULL;
+        struct pose_tracker *tracker = NULL;
+        double max_error = 0.0;
+
+        if (!check_arg_count("_pytsai_pose_tracker", nargs, 1, 2))
+                return NULL;
+        if (nargs > 1 && !parse_double(args[1], &max_error))
+                return NULL;
+        if (max_error < 0)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "The largest tracking error must not be negative.");
+                return NULL;
+        }
+
+        tracker = PyMem_Malloc(sizeof(struct pose_tracker));
+        if (tracker == NULL)
+                return PyErr_NoMemory();
+        tracker->tracking = 0;
+        tracker->lock = NULL;
+        tracker->ctx = new_context(state);
+        if (tracker->ctx == NULL)
+        {
+                PyMem_Free(tracker);
+                return NULL;
+        }
+        tracker->ctx->warm_start_max_error = max_error;
+        if (parse_camera_mapping(state, args[0], tracker->ctx) == 0)
+        {
+                free_context(tracker->ctx);
+                PyMem_Free(tracker);
+                return NULL;
+        }
+        tracker->lock = PyThread_allocate_lock();
+        if (tracker->lock == NULL)
+        {
+                free_context(tracker->ctx);
+                PyMem_Free(tracker);
+                return PyErr_NoMemory();
+        }
+
+        capsule = PyCapsule_New(tracker, POSE_TRACKER_NAME,
+                free_pose_tracker);
+        if (capsule == NULL)
+        {
+                PyThread_free_lock(tracker->lock);
+                free_context(tracker->ctx);
+                PyMem_Free(tracker);
+        }
+        return capsule;
+}
+
+/**
+ * Updates the pose of a pose tracker for a new frame.  The arguments are:
+ *      1 - the pose tracker.
+ *      2 - set of calibration coordinates (see parse_calibration_data()).
+ * The first frame, and the first after a reset or a failed update, has its
+ * pose estimated afresh (see extrinsic_parameter_estimation()); later ones
+ * refine the last pose (see extrinsic_pose_tracking()).  The context's
+ * storage is reused from frame to frame, so an update of no more points than
+ * an earlier one allocates nothing.  The update runs with the GIL released.
+ * It returns a 2-tuple of the pose (Rx, Ry, Rz, Tx, Ty, Tz) and whether it
+ * was estimated afresh.  Raises RuntimeError if the tracker is being updated
+ * by another thread, or if the pose cannot be estimated.
+ */
+static PyObject* tsai_track_pose(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        struct pose_tracker *tracker = NULL;
+        struct tsai_context *ctx = NULL;
+        struct calibration_buffers buffers;
+        double pose[6];
+        int afresh = 0;
+
+        if (!check_arg_count("_pytsai_track_pose", nargs, 2, 2))
+                return NULL;
+        if ((tracker = get_pose_tracker(args[0])) == NULL)
+                return NULL;
+        if (!PyThread_acquire_lock(tracker->lock, NOWAIT_LOCK))
+        {
+                PyErr_SetString(PyExc_RuntimeError,
+                        "The pose tracker is being updated by another " \
+                        "thread.");
+                return NULL;
+        }
+        ctx = tracker->ctx;
+        pytsai_clear(&ctx->err);
+
+        buffers.nviews = 0;
+        if (parse_calibration_data(args[1], ctx, &buffers) == 0)
+        {
+                PyThread_release_lock(tracker->lock);
+                return NULL;
+        }
+
+        /* borrow the residual pool, if it is enabled and free */
+        ctx->pool = borrow_residual_pool(state, &ctx->min_chunk);
+
+        Py_BEGIN_ALLOW_THREADS
+        if (tracker->tracking)
+                extrinsic_pose_tracking(ctx);
+        else
+                extrinsic_parameter_estimation(ctx);
+        Py_END_ALLOW_THREADS
+        if (ctx->pool != NULL)
+        {
+                return_residual_pool(state);
+                ctx->pool = NULL;
+        }
+        release_calibration_buffers(&buffers);
+
+        /* read the result before another thread may update the tracker */
+        afresh = !tracker->tracking || ctx->warm_start_fallback;
+        tracker->tracking = !pytsai_haserror(&ctx->err);
+        if (!tracker->tracking)
+        {
+                PyErr_SetString(PyExc_RuntimeError, ctx->err.string);
+                PyThread_release_lock(tracker->lock);
+                return NULL;
+        }
+        pose[0] = ctx->cc.Rx;
+        pose[1] = ctx->cc.Ry;
+        pose[2] = ctx->cc.Rz;
+        pose[3] = ctx->cc.Tx;
+        pose[4] = ctx->cc.Ty;
+        pose[5] = ctx->cc.Tz;
+        PyThread_release_lock(tracker->lock);
+
+        return Py_BuildValue("NN", new_point_tuple(pose, 6),
+                PyBool_FromLong(afresh));
+}
+
+/**
+ * Makes a pose tracker estimate the pose of its next frame afresh.  The
+ * argument is the pose tracker.  Raises RuntimeError if the tracker is being
+ * updated by another thread.
+ */
+static PyObject* tsai_reset_pose_tracker(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct pose_tracker *tracker = NULL;
+
+        if (!check_arg_count("_pytsai_reset_pose_tracker", nargs, 1, 1))
+                return NULL;
+        if ((tracker = get_pose_tracker(args[0])) == NULL)
+                return NULL;
+        if (!PyThread_acquire_lock(tracker->lock, NOWAIT_LOCK))
+        {
+                PyErr_SetString(PyExc_RuntimeError,
+                        "The pose tracker is being updated by another " \
+                        "thread.");
+                return NULL;
+        }
+        tracker->tracking = 0;
+        PyThread_release_lock(tracker->lock);
+        Py_RETURN_NONE;
+}
+
+/**
+ * Returns the camera parameter mapping of a pose tracker, with its last
+ * pose.  The argument is the pose tracker.  Raises RuntimeError if the
+ * tracker is being updated by another thread.
+ */
+static PyObject* tsai_pose_tracker_camera(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        PyObject *result = NULL;
+        struct pose_tracker *tracker = NULL;
+
+        if (!check_arg_count("_pytsai_pose_tracker_camera", nargs, 1, 1))
+                return NULL;
+        if ((tracker = get_pose_tracker(args[0])) == NULL)
+                return NULL;
+        if (!PyThread_acquire_lock(tracker->lock, NOWAIT_LOCK))
+        {
+                PyErr_SetString(PyExc_RuntimeError,
+                        "The pose tracker is being updated by another " \
+                        "thread.");
+                return NULL;
+        }
+        result = build_camera_mapping(tracker->ctx);
+        PyThread_release_lock(tracker->lock);
+        return result;
+}
+
+
+/**
+ * A calibration job for tsai_calibrate_many(): the calibration routine to run,
+ * the context it runs on and the buffers the context reads.
+ */
+struct calibration_job {
+        calibration_routine         routine;
+        struct tsai_context        *ctx;
+        struct calibration_buffers  buffers;
+};
+
+/**
+ * Finds the calibration routine for a combination of target type
+ * ('coplanar' or 'noncoplanar') and optimization type ('three-param' or
+ * 'full'), as accepted by Tsai.calibrate().  Returns NULL if the combination
+ * is unknown.
+ */
+static calibration_routine find_calibration_routine(const char *target_type,
+        const char *optimization_type)
+{
+        int full;
+
+        if (strcmp(optimization_type, "three-param") == 0)
+                full = 0;
+        else if (strcmp(optimization_type, "full") == 0)
+                full = 1;
+        else
+                return NULL;
+
+        if (strcmp(target_type, "coplanar") == 0)
+                return full ? coplanar_calibration_with_full_optimization :
+                        coplanar_calibration;
+        else if (strcmp(target_type, "noncoplanar") == 0)
+                return full ? noncoplanar_calibration_with_full_optimization :
+                        noncoplanar_calibration;
+        else
+                return NULL;
+}
+
+/**
+ * Pool task running one calibration job.  Called without the GIL.
+ */
+static void run_calibration_job(void *arg, int index)
+{
+        struct calibration_job *job = (struct calibration_job *) arg + index;
+
+        job->routine(job->ctx);
+}
+
+/**
+ * Performs many independent calibrations on a pool of native threads, with
+ * the GIL released while they run.
+ * The arguments to the function are:
+ *      1 - sequence of jobs, each a 4-tuple (target_type, optimization_type,
+ *          calibration coordinates, dictionary of camera parameters), where
+ *          target_type and optimization_type are as for Tsai.calibrate().
+ *      2 - (optional) number of threads; 0 or less uses one per processor.
+ * It returns a list with the camera parameter mapping of each job, in order.
+ * If any job fails, RuntimeError is raised naming the first failed job.
+ */
+static PyObject* tsai_calibrate_many(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        PyObject *jobs = NULL, *seq = NULL, *job = NULL, *result = NULL;
+        PyObject *calibration_data = NULL, *params = NULL, *mapping = NULL;
+        const char *target_type = NULL, *optimization_type = NULL;
+        struct calibration_job *work = NULL;
+        struct worker_pool *pool = NULL;
+        int i, njobs = 0, nthreads = 0, ok = 0;
+
+        if (!check_arg_count("_pytsai_calibrate_many", nargs, 1, 2))
+                return NULL;
+        jobs = args[0];
+        if (nargs > 1 && !parse_int(args[1], &nthreads))
+                return NULL;
+        seq = PySequence_Fast(jobs,
+                "First argument must be a sequence of calibration jobs.");
+        if (seq == NULL)
+                return NULL;
+        njobs = (int) PySequence_Fast_GET_SIZE(seq);
+
+        work = PyMem_Malloc(sizeof(struct calibration_job) *
+                (njobs > 0 ? njobs : 1));
+        if (work == NULL)
+        {
+                Py_DECREF(seq);
+                return PyErr_NoMemory();
+        }
+        memset(work, 0, sizeof(struct calibration_job) * njobs);
+
+        /* set up every job's context while we still hold the GIL */
+        for (i = 0; i < njobs; i++)
+        {
+                job = PySequence_Fast_GET_ITEM(seq, i);
+                if (!PyTuple_Check(job) || !PyArg_ParseTuple(job, "ssOO",
+                        &target_type, &optimization_type, &calibration_data,
+                        &params))
+                {
+                        PyErr_Format(PyExc_TypeError,
+                                "Job %d must be a tuple (target_type, " \
+                                "optimization_type, calibration_data, " \
+                                "camera_params).", i);
+                        goto done;
+                }
+                work[i].routine = find_calibration_routine(target_type,
+                        optimization_type);
+                if (work[i].routine == NULL)
+                {
+                        PyErr_Format(PyExc_ValueError,
+                                "Job %d: unknown combination of " \
+                                "target_type='%s' and " \
+                                "optimization_type='%s'.", i,
+                                target_type, optimization_type);
+                        goto done;
+                }
+
+                work[i].ctx = new_context(state);
+                if (work[i].ctx == NULL)
+                        goto done;
+                pytsai_clear(&work[i].ctx->err);
+                if (parse_calibration_data(calibration_data, work[i].ctx,
+                        &work[i].buffers) == 0)
+                        goto done;
+                if (parse_camera_mapping(state, params, work[i].ctx) == 0)
+                        goto done;
+        }
+
+        /* run the jobs; no thread needs more than one job */
+        if (nthreads < 1)
+                nthreads = pool_cpu_count();
+        if (nthreads > njobs)
+                nthreads = (njobs > 0) ? njobs : 1;
+        Py_BEGIN_ALLOW_THREADS
+        pool = pool_new(nthreads);
+        if (pool != NULL)
+        {
+                pool_run(pool, njobs, run_calibration_job, work);
+                pool_free(pool);
+                ok = 1;
+        }
+        Py_END_ALLOW_THREADS
+        if (!ok)
+        {
+                PyErr_NoMemory();
+                goto done;
+        }
+
+        /* collect the results */
+        for (i = 0; i < njobs; i++)
+        {
+                if (pytsai_haserror(&work[i].ctx->err))
+                {
+                        PyErr_Format(PyExc_RuntimeError, "Job %d: %s", i,
+                                work[i].ctx->err.string);
+                        goto done;
+                }
+        }
+        result = PyList_New(njobs);
+        if (result == NULL)
+                goto done;
+        for (i = 0; i < njobs; i++)
+        {
+                mapping = build_camera_mapping(work[i].ctx);
+                if (mapping == NULL)
+                {
+                        Py_CLEAR(result);
+                        goto done;
+                }
+                PyList_SET_ITEM(result, i, mapping);
+        }
+
+done:
+        for (i = 0; i < njobs; i++)
+        {
+                release_calibration_buffers(&work[i].buffers);
+                free_context(work[i].ctx);
+        }
+        PyMem_Free(work);
+        Py_DECREF(seq);
+        return result;
+}
+
+
+/**
+ * The number of blocks of frames tsai_extrinsic_batch() splits a batch into
+ * per thread, so that a thread whose frames solve quickly picks up more.
+ */
+#define BATCH_BLOCKS_PER_THREAD 4
+
+/**
+ * Reads the frame offsets of tsai_extrinsic_batch(): a sequence of N + 1
+ * non-decreasing integers, starting at 0 and ending at npoints, frame i
+ * holding the points offset[i] up to offset[i + 1].  The offsets are
+ * allocated with PyMem_Malloc() into frames.
+ *
+ * The method returns 1 on success and 0 on failure.  If the method fails, an
+ * appropriate exception is raised.
+ */
+static int parse_frame_offsets(PyObject *obj, Py_ssize_t npoints,
+        struct tsai_frames *frames)
+{
+        PyObject *seq = NULL;
+        Py_ssize_t i, n, offset;
+
+        seq = PySequence_Fast(obj,
+                "Frame offsets must be a sequence of integers.");
+        if (seq == NULL)
+                return 0;
+        n = PySequence_Fast_GET_SIZE(seq);
+        if (n < 1 || n - 1 > INT_MAX)
+        {
+                Py_DECREF(seq);
+                PyErr_SetString(PyExc_ValueError,
+                        "Frame offsets must hold one more item than there " \
+                        "are frames.");
+                return 0;
+        }
+        frames->count = (int) (n - 1);
+        frames->offset = PyMem_Malloc(sizeof(ptrdiff_t) * n);
+        if (frames->offset == NULL)
+        {
+                Py_DECREF(seq);
+                PyErr_NoMemory();
+                return 0;
+        }
+        for (i = 0; i < n; i++)
+        {
+                offset = PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(seq, i),
+                        PyExc_OverflowError);
+                if (offset == -1 && PyErr_Occurred())
+                        break;
+                if ((i == 0 && offset != 0) ||
+                        (i > 0 && offset < frames->offset[i - 1]) ||
+                        (i == n - 1 && offset != npoints) ||
+                        offset - (i > 0 ? frames->offset[i - 1] : 0) >
+                        INT_MAX)
+                {
+                        PyErr_SetString(PyExc_ValueError,
+                                "Frame offsets must rise from 0 to the " \
+                                "number of points.");
+                        break;
+                }
+                frames->offset[i] = offset;
+        }
+        Py_DECREF(seq);
+        if (i < n)
+        {
+                PyMem_Free(frames->offset);
+                frames->offset = NULL;
+                return 0;
+        }
+        return 1;
+}
+
+/**
+ * Estimates the pose of every frame of a capture sequence of a calibrated
+ * camera, the frames spread over a pool of native threads with the GIL
+ * released (see cal_batch.c).  The arguments to the function are:
+ *      1 - the points of all of the frames, one frame after the other, as a
+ *          set of calibration coordinates (see parse_calibration_data()).
+ *          An (N, 5) buffer is read in place.
+ *      2 - sequence of frame offsets (see parse_frame_offsets()).
+ *      3 - dictionary of camera parameters, whose intrinsic parameters are
+ *          held fixed.
+ *      4 - (optional) number of threads; 0 or less uses one per processor.
+ *      5 - (optional) true to follow each frame from the pose of the frame
+ *          before it (see extrinsic_pose_tracking()).
+ *      6 - (optional) largest median image error [pix] of the points of a
+ *          followed frame; 0 uses the default.
+ * It returns a new array with one row per frame, the pose (Rx, Ry, Rz, Tx,
+ * Ty, Tz) of the frame, NaNs for a frame whose pose cannot be estimated.
+ */
+static PyObject* tsai_extrinsic_batch(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        PyObject *calibration_data = NULL, *offsets = NULL, *params = NULL;
+        PyObject *result = NULL;
+        Py_buffer view, out;
+        struct tsai_context *scratch = NULL, **blocks = NULL;
+        struct calibration_buffers buffers;
+        struct tsai_frames frames;
+        struct worker_pool *pool = NULL;
+        Py_ssize_t npoints;
+        int i, nblocks = 0, nthreads = 0, chain = 0, solved = 0, inplace;
+        double max_error = 0.0;
+
+        if (!check_arg_count("_pytsai_extrinsic_batch", nargs, 3, 6))
+                return NULL;
+        calibration_data = args[0];
+        offsets = args[1];
+        params = args[2];
+        if ((nargs > 3 && !parse_int(args[3], &nthreads)) ||
+                (nargs > 4 && !parse_int(args[4], &chain)) ||
+                (nargs > 5 && !parse_double(args[5], &max_error)))
+                return NULL;
+        if (max_error < 0)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "The largest tracking error must not be negative.");
+                return NULL;
+        }
+
+        /* an (N, 5) buffer is read in place; anything else goes through a
+         * context of its own */
+        buffers.nviews = 0;
+        frames.offset = NULL;
+        inplace = !PyDict_Check(calibration_data) &&
+                PyObject_CheckBuffer(calibration_data);
+        if (inplace)
+        {
+                if (!get_point_buffer(calibration_data, &view,
+                        CALIBRATION_COLUMNS, PyBUF_SIMPLE))
+                        return NULL;
+                npoints = view.shape[0];
+                frames.xw = (double *) view.buf;
+                frames.stride = CALIBRATION_COLUMNS;
+        }
+        else
+        {
+                scratch = new_context(state);
+                if (scratch == NULL)
+                        return NULL;
+                if (parse_calibration_data(calibration_data, scratch,
+                        &buffers) == 0)
+                        goto done;
+                npoints = scratch->cd.point_count;
+                frames.xw = scratch->cd.xw;
+                frames.stride = 1;
+        }
+        frames.yw = inplace ? frames.xw + 1 : scratch->cd.yw;
+        frames.zw = inplace ? frames.xw + 2 : scratch->cd.zw;
+        frames.Xf = inplace ? frames.xw + 3 : scratch->cd.Xf;
+        frames.Yf = inplace ? frames.xw + 4 : scratch->cd.Yf;
+        if (parse_frame_offsets(offsets, npoints, &frames) == 0)
+                goto done;
+
+        /* one context a block, each with its own copy of the camera */
+        if (nthreads < 1)
+                nthreads = pool_cpu_count();
+        nblocks = BATCH_BLOCKS_PER_THREAD * nthreads;
+        if (nblocks > frames.count)
+                nblocks = frames.count;
+        blocks = PyMem_Malloc(sizeof(struct tsai_context *) *
+                (nblocks > 0 ? nblocks : 1));
+        if (blocks == NULL)
+        {
+                PyErr_NoMemory();
+                goto done;
+        }
+        memset(blocks, 0, sizeof(struct tsai_context *) * nblocks);
+        for (i = 0; i < nblocks; i++)
+        {
+                blocks[i] = new_context(state);
+                if (blocks[i] == NULL)
+                        goto done;
+                blocks[i]->warm_start_max_error = max_error;
+                if (parse_camera_mapping(state, params, blocks[i]) == 0)
+                        goto done;
+        }
+
+        result = new_point_array(frames.count, 6);
+        if (result == NULL)
+                goto done;
+        if (PyObject_GetBuffer(result, &out, PyBUF_WRITABLE) != 0)
+        {
+                Py_CLEAR(result);
+                goto done;
+        }
+
+        if (nthreads > nblocks)
+                nthreads = (nblocks > 0) ? nblocks : 1;
+        Py_BEGIN_ALLOW_THREADS
+        pool = nthreads > 1 ? pool_new(nthreads) : NULL;
+        if (nblocks > 0)
+                blocks[0]->pool = pool;
+        if (nthreads == 1 || pool != NULL)
+                solved = extrinsic_parameter_estimation_batch(blocks,
+                        nblocks, &frames, chain, (double *) out.buf);
+        else
+                solved = -1;
+        if (nblocks > 0)
+                blocks[0]->pool = NULL;
+        if (pool != NULL)
+                pool_free(pool);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&out);
+        if (solved < 0)
+        {
+                Py_CLEAR(result);
+                PyErr_NoMemory();
+        }
+
+done:
+        for (i = 0; i < nblocks && blocks != NULL; i++)
+                free_context(blocks[i]);
+        PyMem_Free(blocks);
+        PyMem_Free(frames.offset);
+        if (inplace)
+                PyBuffer_Release(&view);
+        release_calibration_buffers(&buffers);
+        free_context(scratch);
+        return result;
+}
+
+
+/**
+ * Calibrates one camera from several views of a coplanar target, with the
+ * intrinsic parameters shared by the views (see cal_views.c).  Like a single
+ * calibration it may borrow the residual pool, over whose threads the views
+ * are then spread.
+ * The arguments to the function are:
+ *      1 - sequence of at least two sets of calibration coordinates, one for
+ *          each view (see parse_calibration_data()).
+ *      2 - dictionary of camera parameters.
+ * It returns a list with the camera parameter mapping of each view, in
+ * order.  If a view fails, RuntimeError is raised naming the first one.
+ */
+static PyObject* tsai_coplanar_calibration_views(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        PyObject *views = NULL, *seq = NULL, *params = NULL;
+        PyObject *result = NULL, *mapping = NULL;
+        struct tsai_context **ctx = NULL;
+        struct calibration_buffers *buffers = NULL;
+        int i, nviews = 0, min_chunk;
+
+        if (!check_arg_count("_pytsai_coplanar_calibration_views", nargs,
+                2, 2))
+                return NULL;
+        views = args[0];
+        params = args[1];
+        seq = PySequence_Fast(views,
+                "First argument must be a sequence of calibration data sets.");
+        if (seq == NULL)
+                return NULL;
+        nviews = (int) PySequence_Fast_GET_SIZE(seq);
+        if (nviews < 2)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "At least two views are needed.");
+                Py_DECREF(seq);
+                return NULL;
+        }
+
+        ctx = PyMem_Malloc(sizeof(struct tsai_context *) * nviews);
+        buffers = PyMem_Malloc(sizeof(struct calibration_buffers) * nviews);
+        if (ctx == NULL || buffers == NULL)
+        {
+                PyMem_Free(ctx);
+                PyMem_Free(buffers);
+                Py_DECREF(seq);
+                return PyErr_NoMemory();
+        }
+        memset(ctx, 0, sizeof(struct tsai_context *) * nviews);
+        memset(buffers, 0, sizeof(struct calibration_buffers) * nviews);
+
+        /* set up every view's context */
+        for (i = 0; i < nviews; i++)
+        {
+                ctx[i] = new_context(state);
+                if (ctx[i] == NULL)
+                        goto done;
+                pytsai_clear(&ctx[i]->err);
+                if (parse_calibration_data(PySequence_Fast_GET_ITEM(seq, i),
+                        ctx[i], &buffers[i]) == 0)
+                        goto done;
+                if (parse_camera_mapping(state, params, ctx[i]) == 0)
+                        goto done;
+        }
+
+        /* borrow the residual pool, if it is enabled and free */
+        ctx[0]->pool = borrow_residual_pool(state, &min_chunk);
+        for (i = 0; i < nviews; i++)
+                ctx[i]->min_chunk = min_chunk;
+
+        Py_BEGIN_ALLOW_THREADS
+        coplanar_multi_view_calibration(ctx, nviews);
+        Py_END_ALLOW_THREADS
+        if (ctx[0]->pool != NULL)
+                return_residual_pool(state);
+
+        /* collect the results */
+        for (i = 0; i < nviews; i++)
+        {
+                if (pytsai_haserror(&ctx[i]->err))
+                {
+                        PyErr_Format(PyExc_RuntimeError, "View %d: %s", i,
+                                ctx[i]->err.string);
+                        goto done;
+                }
+        }
+        result = PyList_New(nviews);
+        if (result == NULL)
+                goto done;
+        for (i = 0; i < nviews; i++)
+        {
+                mapping = build_camera_mapping(ctx[i]);
+                if (mapping == NULL)
+                {
+                        Py_CLEAR(result);
+                        goto done;
+                }
+                PyList_SET_ITEM(result, i, mapping);
+        }
+
+done:
+        for (i = 0; i < nviews; i++)
+        {
+                release_calibration_buffers(&buffers[i]);
+                free_context(ctx[i]);
+        }
+        PyMem_Free(ctx);
+        PyMem_Free(buffers);
+        Py_DECREF(seq);
+        return result;
+}
+
+
+/**
+ * Calibrates a rig of cameras fixed to one another from their views of a
+ * target in several poses (see cal_rig.c).  Like a single calibration it may
+ * borrow the residual pool, over whose threads the cameras and views are
+ * then spread.
+ * The arguments to the function are:
+ *      1 - sequence with a sequence for each camera, of a set of calibration
+ *          coordinates (see parse_calibration_data()) or None for each pose
+ *          of the target.
+ *      2 - sequence with a dictionary of camera parameters for each camera.
+ * It returns a tuple of a list with the camera parameter mapping of each
+ * camera in the world of the first pose, and a list with the (Rx, Ry, Rz,
+ * Tx, Ty, Tz) of each pose in that world.  If a view fails, RuntimeError is
+ * raised naming the first one.
+ */
+static PyObject* tsai_rig_calibration(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        PyObject *data = NULL, *params = NULL, *seq = NULL, *pseq = NULL;
+        PyObject *row = NULL, *item = NULL, *cameras = NULL, *poses = NULL;
+        PyObject *result = NULL, *mapping = NULL;
+        struct tsai_context **ctx = NULL, *first = NULL;
+        struct calibration_buffers *buffers = NULL;
+        double *extrinsics = NULL;
+        int i, c, k, ncameras = 0, nposes = 0, nviews = 0, ok,
+                min_chunk;
+
+        if (!check_arg_count("_pytsai_rig_calibration", nargs, 2, 2))
+                return NULL;
+        data = args[0];
+        params = args[1];
+        seq = PySequence_Fast(data,
+                "First argument must be a sequence of cameras.");
+        if (seq == NULL)
+                return NULL;
+        pseq = PySequence_Fast(params,
+                "Second argument must be a sequence of camera parameters.");
+        if (pseq == NULL)
+        {
+                Py_DECREF(seq);
+                return NULL;
+        }
+        ncameras = (int) PySequence_Fast_GET_SIZE(seq);
+        if (ncameras < 1 || PySequence_Fast_GET_SIZE(pseq) != ncameras)
+        {
+                PyErr_SetString(PyExc_ValueError, "There must be at least "
+                        "one camera, and parameters for each camera.");
+                goto done;
+        }
+        for (c = 0; c < ncameras; c++)
+        {
+                i = (int) PySequence_Size(PySequence_Fast_GET_ITEM(seq, c));
+                if (i < 0)
+                        goto done;
+                if (c > 0 && i != nposes)
+                {
+                        PyErr_SetString(PyExc_ValueError,
+                                "Every camera must list the same poses.");
+                        goto done;
+                }
+                nposes = i;
+        }
+        if (nposes < 1)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "At least one pose is needed.");
+                goto done;
+        }
+
+        ctx = PyMem_Malloc(sizeof(struct tsai_context *) * ncameras * nposes);
+        buffers = PyMem_Malloc(sizeof(struct calibration_buffers) *
+                ncameras * nposes);
+        extrinsics = PyMem_Malloc(sizeof(double) * 6 * (ncameras + nposes));
+        if (ctx == NULL || buffers == NULL || extrinsics == NULL)
+        {
+                PyErr_NoMemory();
+                goto done;
+        }
+        memset(ctx, 0, sizeof(struct tsai_context *) * ncameras * nposes);
+        memset(buffers, 0, sizeof(struct calibration_buffers) *
+                ncameras * nposes);
+
+        /* set up a context for every view */
+        for (c = 0; c < ncameras; c++)
+        {
+                row = PySequence_Fast(PySequence_Fast_GET_ITEM(seq, c),
+                        "Each camera must be a sequence of poses.");
+                if (row == NULL)
+                        goto done;
+                if (PySequence_Fast_GET_SIZE(row) != nposes)
+                {
+                        PyErr_SetString(PyExc_ValueError,
+                                "Every camera must list the same poses.");
+                        Py_DECREF(row);
+                        goto done;
+                }
+                for (k = 0; k < nposes; k++)
+                {
+                        item = PySequence_Fast_GET_ITEM(row, k);
+                        if (item == Py_None)
+                                continue;
+                        i = c * nposes + k;
+                        ctx[i] = new_context(state);
+                        if (ctx[i] == NULL)
+                                break;
+                        pytsai_clear(&ctx[i]->err);
+                        if (parse_calibration_data(item, ctx[i],
+                                &buffers[i]) == 0)
+                                break;
+                        if (parse_camera_mapping(state,
+                                PySequence_Fast_GET_ITEM(pseq, c),
+                                ctx[i]) == 0)
+                                break;
+                        if (first == NULL)
+                                first = ctx[i];
+                        nviews++;
+                }
+                Py_DECREF(row);
+                if (k < nposes)
+                        goto done;
+        }
+        if (nviews == 0)
+        {
+                PyErr_SetString(PyExc_ValueError, "No views were given.");
+                goto done;
+        }
+
+        /* borrow the residual pool, if it is enabled and free */
+        first->pool = borrow_residual_pool(state, &min_chunk);
+        for (i = 0; i < ncameras * nposes; i++)
+                if (ctx[i] != NULL)
+                        ctx[i]->min_chunk = min_chunk;
+
+        Py_BEGIN_ALLOW_THREADS
+        ok = rig_calibration(ctx, ncameras, nposes, extrinsics,
+                extrinsics + 6 * ncameras);
+        Py_END_ALLOW_THREADS
+        if (first->pool != NULL)
+                return_residual_pool(state);
+
+        if (!ok)
+        {
+                for (i = 0; i < ncameras * nposes; i++)
+                {
+                        if (ctx[i] != NULL && pytsai_haserror(&ctx[i]->err))
+                        {
+                                PyErr_Format(PyExc_RuntimeError,
+                                        "Camera %d, pose %d: %s",
+                                        i / nposes, i % nposes,
+                                        ctx[i]->err.string);
+                                goto done;
+                        }
+                }
+                PyErr_SetString(PyExc_RuntimeError, "Rig calibration failed.");
+                goto done;
+        }
+
+        /* collect the results: each camera placed in the world */
+        cameras = PyList_New(ncameras);
+        poses = PyList_New(nposes);
+        if (cameras == NULL || poses == NULL)
+                goto done;
+        for (c = 0; c < ncameras; c++)
+        {
+                for (k = 0; ctx[c * nposes + k] == NULL; k++)
+                        ;
+                first = ctx[c * nposes + k];
+                first->cc.Rx = extrinsics[6 * c];
+                first->cc.Ry = extrinsics[6 * c + 1];
+                first->cc.Rz = extrinsics[6 * c + 2];
+                first->cc.Tx = extrinsics[6 * c + 3];
+                first->cc.Ty = extrinsics[6 * c + 4];
+                first->cc.Tz = extrinsics[6 * c + 5];
+                apply_RPY_transform(first);
+                mapping = build_camera_mapping(first);
+                if (mapping == NULL)
+                        goto done;
+                PyList_SET_ITEM(cameras, c, mapping);
+        }
+        for (k = 0; k < nposes; k++)
+        {
+                i = 6 * (ncameras + k);
+                item = Py_BuildValue("(dddddd)", extrinsics[i],
+                        extrinsics[i + 1], extrinsics[i + 2],
+                        extrinsics[i + 3], extrinsics[i + 4],
+                        extrinsics[i + 5]);
+                if (item == NULL)
+                        goto done;
+                PyList_SET_ITEM(poses, k, item);
+        }
+        result = Py_BuildValue("(OO)", cameras, poses);
+
+done:
+        if (ctx != NULL)
+        {
+                for (i = 0; i < ncameras * nposes; i++)
+                {
+                        release_calibration_buffers(&buffers[i]);
+                        free_context(ctx[i]);
+                }
+        }
+        PyMem_Free(ctx);
+        PyMem_Free(buffers);
+        PyMem_Free(extrinsics);
+        Py_XDECREF(cameras);
+        Py_XDECREF(poses);
+        Py_DECREF(seq);
+        Py_DECREF(pseq);
+        return result;
+}
+
+
+/**
+ * Sets up the threads that single calibrations split their residual and
+ * Jacobian evaluations over.  The calibrations run by tsai_calibrate_many()
+ * are already parallel and never use them.
+ * The arguments to the function are:
+ *      1 - number of threads; 1 turns the threads off, 0 or less uses one
+ *          per processor.
+ *      2 - (optional) fewest points handed to one thread at a time; 0 uses
+ *          the library's default.
+ * It waits for any calibration using the current threads to finish.
+ */
+static PyObject* tsai_set_residual_threads(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        struct worker_pool *pool = NULL;
+        int nthreads = 0, min_chunk = 0;
+
+        if (!check_arg_count("_pytsai_set_residual_threads", nargs, 1, 2))
+                return NULL;
+        if (!parse_int(args[0], &nthreads) ||
+                (nargs > 1 && !parse_int(args[1], &min_chunk)))
+                return NULL;
+        if (min_chunk < 0)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "min_chunk must not be negative.");
+                return NULL;
+        }
+        if (nthreads < 1)
+                nthreads = pool_cpu_count();
+
+        /* take the pool back from any calibration using it */
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(state->residual_lock, WAIT_LOCK);
+        if (nthreads > 1)
+                pool = pool_new(nthreads);
+        Py_END_ALLOW_THREADS
+
+        if (nthreads > 1 && pool == NULL)
+        {
+                PyThread_release_lock(state->residual_lock);
+                return PyErr_NoMemory();
+        }
+        if (state->residual_pool != NULL)
+                pool_free(state->residual_pool);
+        state->residual_pool = pool;
+        state->residual_min_chunk = min_chunk;
+        PyThread_release_lock(state->residual_lock);
+
+        Py_RETURN_NONE;
+}
+
+
+/**
+ * Chooses how the calibrations started from now on hand the Jacobian of the
+ * calibration error to the optimizer.
+ * The arguments to the function are:
+ *      1 - "dense" to store all of its rows (the default), or "streamed" to
+ *          fold them into a small triangle as they are computed.
+ */
+static PyObject* tsai_set_jacobian_mode(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        const char *mode = NULL;
+        enum tsai_jacobian chosen;
+
+        if (!check_arg_count("_pytsai_set_jacobian_mode", nargs, 1, 1))
+                return NULL;
+        if ((mode = parse_string(args[0])) == NULL)
+                return NULL;
+
+        if (strcmp(mode, "dense") == 0)
+                chosen = TSAI_JACOBIAN_DENSE;
+        else if (strcmp(mode, "streamed") == 0)
+                chosen = TSAI_JACOBIAN_STREAMED;
+        else
+        {
+                PyErr_Format(PyExc_ValueError,
+                        "Unknown Jacobian mode '%s'.", mode);
+                return NULL;
+        }
+
+        PyThread_acquire_lock(state->settings_lock, WAIT_LOCK);
+        state->jacobian_mode = chosen;
+        PyThread_release_lock(state->settings_lock);
+
+        Py_RETURN_NONE;
+}
+
+
+/**
+ * Chooses how the calibrations started from now on make their initial fit
+ * of the radial alignment constraint.
+ * The arguments to the function are:
+ *      1 - the inlier threshold in pixels, or 0 for a least squares fit over
+ *          every point (the default).
+ *      2 - the confidence, between 0 and 1, with which the search should
+ *          have drawn a sample of inliers before it stops.
+ *      3 - the most hypotheses to draw, or 0 for the default.
+ */
+static PyObject* tsai_set_ransac(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        double threshold = 0.0;
+        double confidence = 0.0;
+        int max_hypotheses = 0;
+
+        if (!check_arg_count("_pytsai_set_ransac", nargs, 3, 3))
+                return NULL;
+        if (!parse_double(args[0], &threshold) ||
+                !parse_double(args[1], &confidence) ||
+                !parse_int(args[2], &max_hypotheses))
+                return NULL;
+
+        if (!(threshold >= 0.0))
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "The RANSAC threshold must not be negative.");
+                return NULL;
+        }
+        if (!(confidence > 0.0 && confidence < 1.0))
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "The RANSAC confidence must lie between 0 and 1.");
+                return NULL;
+        }
+        if (max_hypotheses < 0)
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "The number of RANSAC hypotheses must not be "
+                        "negative.");
+                return NULL;
+        }
+
+        PyThread_acquire_lock(state->settings_lock, WAIT_LOCK);
+        state->ransac_threshold = threshold;
+        state->ransac_confidence = confidence;
+        state->ransac_max_hypotheses = max_hypotheses;
+        PyThread_release_lock(state->settings_lock);
+
+        Py_RETURN_NONE;
+}
+
+
+/**
+ * Chooses the loss of the calibration error the optimization stages of the
+ * calibrations started from now on minimize.
+ * The arguments to the function are:
+ *      1 - "squared" for least squares (the default), or one of the robust
+ *          losses "huber", "cauchy" and "tukey".
+ *      2 - the scale of the loss in pixels, or 0 to estimate it from the
+ *          errors.
+ */
+static PyObject* tsai_set_robust_loss(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        const char *loss = NULL;
+        double scale = 0.0;
+        enum tsai_loss chosen;
+
+        if (!check_arg_count("_pytsai_set_robust_loss", nargs, 2, 2))
+                return NULL;
+        if ((loss = parse_string(args[0])) == NULL ||
+                !parse_double(args[1], &scale))
+                return NULL;
+
+        if (strcmp(loss, "squared") == 0)
+                chosen = TSAI_LOSS_SQUARED;
+        else if (strcmp(loss, "huber") == 0)
+                chosen = TSAI_LOSS_HUBER;
+        else if (strcmp(loss, "cauchy") == 0)
+                chosen = TSAI_LOSS_CAUCHY;
+        else if (strcmp(loss, "tukey") == 0)
+                chosen = TSAI_LOSS_TUKEY;
+        else
+        {
+                PyErr_Format(PyExc_ValueError, "Unknown loss '%s'.", loss);
+                return NULL;
+        }
+        if (!(scale >= 0.0))
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "The scale of the loss must not be negative.");
+                return NULL;
+        }
+
+        PyThread_acquire_lock(state->settings_lock, WAIT_LOCK);
+        state->robust_loss = chosen;
+        state->robust_loss_scale = scale;
+        PyThread_release_lock(state->settings_lock);
+
+        Py_RETURN_NONE;
+}
+
+
+/**
+ * Names the instruction set of the kernels picked when the module was
+ * imported: "scalar", "sse2", "avx2", "avx512" or "neon".  The environment
+ * variable PYTSAI_SIMD caps it (see cal_cpu.c).
+ */
+static PyObject* tsai_simd_level_name(PyObject *self, PyObject *args)
+{
+        return Py_BuildValue("s", tsai_simd_level());
+}
+
+
+/**
+ * Converts from world coordinates to image coordinates.
+ * The arguments to the function are:
+ *      1 - world coordinates (3-member sequence) (xw, yw, zw)
+ *      2 - dictionary of camera parameters
+ * It returns a 2-tuple containing (Xf, Yf).
+ */
+static PyObject* tsai_wc2ic(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        double wc[3], ic[2];
+        struct tsai_context ctx;
+
+        /* parse arguments */
+        if (!check_arg_count("_pytsai_wc2ic", nargs, 2, 2))
+                return NULL;
+        if (!parse_point(args[0], wc, 3))
+                return NULL;
+
+        /* fetch the camera parameter mapping */
+        init_camera_context(&ctx);
+        if (parse_camera_mapping(state, args[1], &ctx) == 0)
+                return NULL;
+
+        /* perform the C call */
+        world_coord_to_image_coord(&ctx, wc[0], wc[1], wc[2], &ic[0],
+                &ic[1]);
+
+        /* return the value (Xf, Yf) */
+        return new_point_tuple(ic, 2);
+}
+
+
+/**
+ * Converts from image coordinates (+depth) to world coordinates.
+ * The arguments to the function are:
+ *      1 - image coordinates (3-member sequence) (Xf, Yf, z)
+ *      2 - dictionary of camera parameters
+ * It returns a 3-tuple containing (xw, yw, zw).
+ */
+static PyObject* tsai_ic2wc(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        double ic[3], wc[3];
+        struct tsai_context ctx;
+
+        /* parse arguments */
+        if (!check_arg_count("_pytsai_ic2wc", nargs, 2, 2))
+                return NULL;
+        if (!parse_point(args[0], ic, 3))
+                return NULL;
+
+        /* fetch the camera parameter mapping */
+        init_camera_context(&ctx);
+        if (parse_camera_mapping(state, args[1], &ctx) == 0)
+                return NULL;
+
+        /* perform the C call */
+        image_coord_to_world_coord(&ctx, ic[0], ic[1], ic[2], &wc[0],
+                &wc[1]);
+        wc[2] = ic[2];
+
+        /* return the value (xw, yw, zw) */
+        return new_point_tuple(wc, 3);
+}
+
+
+/**
+ * Converts from camera coordinates to world coordinates.
+ * The arguments to the function are:
+ *      1 - camera coordinates (3-member sequence) (xc, yc, zc)
+ *      2 - dictionary of camera parameters
+ * It returns a 3-tuple containing (xw, yw, zw).
+ */
+static PyObject* tsai_cc2wc(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        double cc[3], wc[3];
+        struct tsai_context ctx;
+
+        /* parse arguments */
+        if (!check_arg_count("_pytsai_cc2wc", nargs, 2, 2))
+                return NULL;
+        if (!parse_point(args[0], cc, 3))
+                return NULL;
+
+        /* fetch the camera parameter mapping */
+        init_camera_context(&ctx);
+        if (parse_camera_mapping(state, args[1], &ctx) == 0)
+                return NULL;
+
+        /* perform the C call */
+        camera_coord_to_world_coord(&ctx, cc[0], cc[1], cc[2], &wc[0],
+                &wc[1], &wc[2]);
+
+        /* return the value (xw, yw, zw) */
+        return new_point_tuple(wc, 3);
+}
+
+
+/**
+ * Adds distortion to un-distorted sensor coordinates, returning distorted
+ * sensor coordinates.  The arguments to this function are:
+ *      1 - Xu
+ *      2 - Yu
+ *      3 - dictionary of camera parameters
+ * It returns a 2-tuple containing (Xd, Yd).
+ */
+static PyObject* tsai_add_sensor_coord_distortion(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        struct module_state *state = get_module_state(self);
+        double Xu, Yu, sensor[2];
+        struct tsai_context ctx;
+
+        /* parse arguments */
+        if (!check_arg_count("_pytsai_add_sensor_coord_distortion", nargs,
+                3, 3))
+                return NULL;
+        if (!parse_double(args[0], &Xu) || !parse_double(args[1], &Yu))
+                return NULL;
+
+        /* fetch the camera parameter mapping */
+        init_camera_context(&ctx);
+        if (parse_camera_mapping(state, args[2], &ctx) == 0)
+                return NULL;
+
+        /* perform the C call */
+        undistorted_to_distorted_sensor_coord(&ctx, Xu, Yu, &sensor[0],
+                &sensor[1]);
+
+        /* return the value (Xd, Yd) */
+        return new_point_tuple(sensor, 2);
+}
+
+
+/**
+ * Acquires a C-contiguous float64 buffer of shape (N, columns) holding one
+ * point per row.  flags are passed on to PyObject_GetBuffer().
+ *
+ * The method returns 1 on success and 0 on failure.  If the method fails, an
+ * appropriate exception is raised.
+ */
+static int get_point_buffer(PyObject *obj, Py_buffer *view, int columns,
+        int flags)
+{
+        if (PyObject_GetBuffer(obj, view, flags | PyBUF_C_CONTIGUOUS |
+                PyBUF_FORMAT) != 0)
+                return 0;
+        if (!check_double_buffer(view))
+        {
+                PyBuffer_Release(view);
+                return 0;
+        }
+        if (view->ndim != 2 || view->shape[1] != columns ||
+                view->shape[0] > INT_MAX)
+        {
+                PyBuffer_Release(view);
+                PyErr_Format(PyExc_ValueError,
+                        "Point buffers must have shape (N, %d).", columns);
+                return 0;
+        }
+        return 1;
+}
+
+/**
+ * Creates a new float64 array of shape (n, columns), as a memoryview over a
+ * bytearray (of shape (0,) if n is 0).  It can be turned into a NumPy array without copying with
+ * numpy.asarray().
+ */
+static PyObject* new_point_array(Py_ssize_t n, int columns)
+{
+        PyObject *storage = NULL, *view = NULL, *array = NULL;
+
+        if (n > PY_SSIZE_T_MAX / (columns * (Py_ssize_t) sizeof(double)))
+                return PyErr_NoMemory();
+        storage = PyByteArray_FromStringAndSize(NULL,
+                n * columns * sizeof(double));
+        if (storage == NULL)
+                return NULL;
+        view = PyMemoryView_FromObject(storage);
+        Py_DECREF(storage);
+        if (view == NULL)
+                return NULL;
+        /* memoryview cannot represent a (0, columns) shape; use (0,) */
+        if (n == 0)
+                array = PyObject_CallMethod(view, "cast", "s", "d");
+        else
+                array = PyObject_CallMethod(view, "cast", "s(nn)", "d", n,
+                        (Py_ssize_t) columns);
+        Py_DECREF(view);
+        return array;
 }
 
 /**
- * Performs coplanar calibration with optimization of f, Tz and kappa1.
- * The arguments to the function are:
- *      1 - set of calibration coordinates.
+ * Runs an array transform for the Python wrappers below, name being the
+ * wrapper's.  The arguments are:
+ *      1 - C-contiguous float64 buffer of shape (N, in_columns).
  *      2 - dictionary of camera parameters.
+ *      3 - (optional) writable C-contiguous float64 buffer of shape
+ *          (N, out_columns) to hold the result.  It may be the input buffer
+ *          if in_columns equals out_columns.
+ * It returns the output buffer: the one given or, if none was given, a new
+ * (N, out_columns) array (see new_point_array()).  The transform runs with
+ * the GIL released.
  */
-static PyObject* tsai_coplanar_calibration(PyObject *self, PyObject *args)
+static PyObject* run_array_transform(PyObject *module, const char *name,
+        PyObject *const *args, Py_ssize_t nargs, int in_columns,
+        int out_columns, array_transform transform)
 {
-        int i, index;
-        PyObject *calibration_data = NULL;
-        PyObject *params = NULL;
-        double *calibration_array = NULL;
-        int ncalibration_coords = 0;
+        struct module_state *state = get_module_state(module);
+        PyObject *points = NULL, *out = NULL;
+        Py_buffer in_view, out_view;
+        struct tsai_context ctx;
 
-        /* clear any error flags */
-        pytsai_clear();
+        if (!check_arg_count(name, nargs, 2, 3))
+                return NULL;
+        points = args[0];
+        if (nargs > 2)
+                out = args[2];
 
-        if (!PyArg_ParseTuple(args, "OO", &calibration_data, &params))
+        /* fetch the camera parameter mapping */
+        init_camera_context(&ctx);
+        if (parse_camera_mapping(state, args[1], &ctx) == 0)
                 return NULL;
-                
-        /* fetch the calibration data */
-        calibration_array = parse_calibration_data(calibration_data,
-                &ncalibration_coords);
-        if (calibration_array == NULL)
+
+        /* fetch the input and output buffers */
+        if (get_point_buffer(points, &in_view, in_columns, PyBUF_SIMPLE) == 0)
                 return NULL;
-        index = 0;
-        tsai_cd.point_count = ncalibration_coords;
-        for (i = 0; i < ncalibration_coords; i++)
+        if ((out == NULL || out == Py_None) && in_view.shape[0] == 0)
         {
-                tsai_cd.xw[i] = calibration_array[index++];
-                tsai_cd.yw[i] = calibration_array[index++];
-                tsai_cd.zw[i] = calibration_array[index++];
-                tsai_cd.Xf[i] = calibration_array[index++];
-                tsai_cd.Yf[i] = calibration_array[index++];
+                PyBuffer_Release(&in_view);
+                return new_point_array(0, out_columns);
         }
-        PyMem_Free(calibration_array);
-
-        /* fetch the camera parameters mapping */
-        if (parse_camera_mapping(params) == 0)
+        if (out == NULL || out == Py_None)
+                out = new_point_array(in_view.shape[0], out_columns);
+        else
+                Py_INCREF(out);
+        if (out == NULL || get_point_buffer(out, &out_view, out_columns,
+                PyBUF_WRITABLE) == 0)
+        {
+                Py_XDECREF(out);
+                PyBuffer_Release(&in_view);
                 return NULL;
-
-        /* perform the C call */
-        coplanar_calibration();
-
-        /* check for an error */
-        if (pytsai_haserror()) {
-                PyErr_SetString(PyExc_RuntimeError, pytsai_string);
+        }
+        if (out_view.shape[0] != in_view.shape[0])
+        {
+                PyErr_SetString(PyExc_ValueError,
+                        "Output buffer must have as many rows as the input.");
+                PyBuffer_Release(&out_view);
+                Py_DECREF(out);
+                PyBuffer_Release(&in_view);
                 return NULL;
-        } else {
-                return build_camera_mapping();
         }
+
+        /* perform the C call */
+        Py_BEGIN_ALLOW_THREADS
+        transform(&ctx, (int) in_view.shape[0], (double *) in_view.buf,
+                (double *) out_view.buf);
+        Py_END_ALLOW_THREADS
+
+        PyBuffer_Release(&out_view);
+        PyBuffer_Release(&in_view);
+        return out;
 }
 
 
 /**
- * Performs non-coplanar calibration with optimization of f, Tz and kappa1.
+ * Converts an array of world coordinates to image coordinates.
  * The arguments to the function are:
- *      1 - set of calibration coordinates.
- *      2 - dictionary of camera parameters.
+ *      1 - world coordinates, an (N, 3) float64 buffer of (xw, yw, zw)
+ *      2 - dictionary of camera parameters
+ *      3 - (optional) (N, 2) float64 buffer for the result
+ * It returns an (N, 2) array of (Xf, Yf).
  */
-static PyObject* tsai_noncoplanar_calibration(PyObject *self, PyObject *args)
+static PyObject* tsai_wc2ic_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
 {
-        int i, index;
-        PyObject *calibration_data = NULL;
-        PyObject *params = NULL;
-        double *calibration_array = NULL;
-        int ncalibration_coords = 0;
-
-        /* clear any error flags */
-        pytsai_clear();
+        return run_array_transform(self, "_pytsai_wc2ic_array", args,
+                nargs,
+                3, 2, world_coord_to_image_coord_array);
+}
 
-        if (!PyArg_ParseTuple(args, "OO", &calibration_data, &params))
-                return NULL;
-                
-        /* fetch the calibration data */
-        calibration_array = parse_calibration_data(calibration_data,
-                &ncalibration_coords);
-        if (calibration_array == NULL)
-                return NULL;
-        index = 0;
-        tsai_cd.point_count = ncalibration_coords;
-        for (i = 0; i < ncalibration_coords; i++)
-        {
-                tsai_cd.xw[i] = calibration_array[index++];
-                tsai_cd.yw[i] = calibration_array[index++];
-                tsai_cd.zw[i] = calibration_array[index++];
-                tsai_cd.Xf[i] = calibration_array[index++];
-                tsai_cd.Yf[i] = calibration_array[index++];
-        }
-        PyMem_Free(calibration_array);
 
-        /* fetch the camera parameters mapping */
-        if (parse_camera_mapping(params) == 0)
-                return NULL;
+/**
+ * Converts an array of image coordinates (+depth) to world coordinates.
+ * The arguments to the function are:
+ *      1 - image coordinates, an (N, 3) float64 buffer of (Xf, Yf, zw)
+ *      2 - dictionary of camera parameters
+ *      3 - (optional) (N, 3) float64 buffer for the result
+ * It returns an (N, 3) array of (xw, yw, zw).
+ */
+static PyObject* tsai_ic2wc_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_array_transform(self, "_pytsai_ic2wc_array", args,
+                nargs,
+                3, 3, image_coord_to_world_coord_array);
+}
 
-        /* perform the C call */
-        noncoplanar_calibration();
 
-        /* check for an error */
-        if (pytsai_haserror()) {
-                PyErr_SetString(PyExc_RuntimeError, pytsai_string);
-                return NULL;
-        } else {
-                return build_camera_mapping();
-        }
+/**
+ * Converts an array of world coordinates to camera coordinates.
+ * The arguments to the function are:
+ *      1 - world coordinates, an (N, 3) float64 buffer of (xw, yw, zw)
+ *      2 - dictionary of camera parameters
+ *      3 - (optional) (N, 3) float64 buffer for the result
+ * It returns an (N, 3) array of (xc, yc, zc).
+ */
+static PyObject* tsai_wc2cc_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
+{
+        return run_array_transform(self, "_pytsai_wc2cc_array", args,
+                nargs,
+                3, 3, world_coord_to_camera_coord_array);
 }
 
 
 /**
- * Performs coplanar calibration with full optimization.
+ * Converts an array of camera coordinates to world coordinates.
  * The arguments to the function are:
- *      1 - set of calibration coordinates.
- *      2 - dictionary of camera parameters.
+ *      1 - camera coordinates, an (N, 3) float64 buffer of (xc, yc, zc)
+ *      2 - dictionary of camera parameters
+ *      3 - (optional) (N, 3) float64 buffer for the result
+ * It returns an (N, 3) array of (xw, yw, zw).
  */
-static PyObject* tsai_coplanar_calibration_fo(PyObject *self, PyObject *args)
+static PyObject* tsai_cc2wc_array(PyObject *self,
+        PyObject *const *args, Py_ssize_t nargs)
 {
-        int i, index;
-        PyObject *calibration_data = NULL;
-        PyObject *params = NULL;
-        double *calibration_array = NULL;
-        int ncalibration_coords = 0;
+        return run_array_transform(self, "_pytsai_cc2wc_array", args,
+                nargs,
+                3, 3, camera_coord_to_world_coord_array);
+}
 
-        /* clear any error flags */
-        pytsai_clear();
 
-        if (!PyArg_ParseTuple(args, "OO", &calibration_data, &params))
-                return NULL;
-                
-        /* fetch the calibration data */
-        calibration_array = parse_calibration_data(calibration_data,
-                &ncalibration_coords);
-        if (calibration_array == NULL)
+
+/**
+ * Finds the camera parameter a mapping key names, or returns NULL (with no
+ * exception set) if it names none.
+ */
+static const struct camera_field* find_camera_field(PyObject *key)
+{
+        const char *name = NULL;
+        Py_ssize_t i;
+
+        if (!PyUnicode_Check(key))
                 return NULL;
-        index = 0;
-        tsai_cd.point_count = ncalibration_coords;
-        for (i = 0; i < ncalibration_coords; i++)
+        name = PyUnicode_AsUTF8(key);
+        if (name == NULL)
         {
-                tsai_cd.xw[i] = calibration_array[index++];
-                tsai_cd.yw[i] = calibration_array[index++];
-                tsai_cd.zw[i] = calibration_array[index++];
-                tsai_cd.Xf[i] = calibration_array[index++];
-                tsai_cd.Yf[i] = calibration_array[index++];
+                PyErr_Clear();
+                return NULL;
         }
-        PyMem_Free(calibration_array);
+        for (i = 0; i < CAMERA_FIELD_COUNT; i++)
+                if (strcmp(name, camera_fields[i].name) == 0)
+                        return &camera_fields[i];
+        return NULL;
+}
 
-        /* fetch the camera parameters mapping */
-        if (parse_camera_mapping(params) == 0)
+/**
+ * Returns a new reference to the __dict__ holding the further items of a
+ * camera model, or NULL if its type has none (with no exception set) or on
+ * failure (with an exception set).
+ */
+static PyObject* camera_model_extra(PyObject *self)
+{
+        if (Py_TYPE(self)->tp_dictoffset == 0)
                 return NULL;
+        return PyObject_GenericGetDict(self, NULL);
+}
 
-        /* perform the C call */
-        coplanar_calibration_with_full_optimization();
+/**
+ * Sets up a calibration context holding the camera of a camera model, for
+ * the transform routines.
+ */
+static void camera_model_context(PyObject *self, struct tsai_context *ctx)
+{
+        memset(ctx, 0, sizeof(struct tsai_context));
+        ctx->cp = ((struct camera_model *) self)->cp;
+        ctx->cc = ((struct camera_model *) self)->cc;
+}
 
-        /* check for an error */
-        if (pytsai_haserror()) {
-                PyErr_SetString(PyExc_RuntimeError, pytsai_string);
-                return NULL;
-        } else {
-                return build_camera_mapping();
+/**
+ * Reads a point of n coordinates from a sequence of numbers.  Tuples and
+ * lists are read in place.
+ *
+ * The method returns 1 on success and 0 on failure.  If the method fails,
+ * TypeError is raised.
+ */
+static int parse_point(PyObject *obj, double *point, int n)
+{
+        PyObject *seq = NULL;
+        int i;
+
+        seq = PySequence_Fast(obj, "");
+        if (seq != NULL && PySequence_Fast_GET_SIZE(seq) == n)
+        {
+                for (i = 0; i < n; i++)
+                        if (!parse_double(PySequence_Fast_GET_ITEM(seq, i),
+                                &point[i]))
+                                break;
+                if (i == n)
+                {
+                        Py_DECREF(seq);
+                        return 1;
+                }
         }
+        Py_XDECREF(seq);
+        PyErr_Format(PyExc_TypeError,
+                "Coordinates must be a %d-member sequence of numbers.", n);
+        return 0;
 }
 
-
 /**
- * Performs non-coplanar calibration with full optimization.
- * The arguments to the function are:
- *      1 - set of calibration coordinates.
- *      2 - dictionary of camera parameters.
+ * Builds a tuple of the n coordinates of a point.
  */
-static PyObject* tsai_noncoplanar_calibration_fo(PyObject *self, 
-        PyObject *args)
+static PyObject* new_point_tuple(const double *point, int n)
 {
-        int i, index;
-        PyObject *calibration_data = NULL;
-        PyObject *params = NULL;
-        double *calibration_array = NULL;
-        int ncalibration_coords = 0;
-
-        /* clear any error flags */
-        pytsai_clear();
+        PyObject *tuple = NULL, *value = NULL;
+        int i;
 
-        if (!PyArg_ParseTuple(args, "OO", &calibration_data, &params))
-                return NULL;
-                
-        /* fetch the calibration data */
-        calibration_array = parse_calibration_data(calibration_data,
-                &ncalibration_coords);
-        if (calibration_array == NULL)
+        tuple = PyTuple_New(n);
+        if (tuple == NULL)
                 return NULL;
-        index = 0;
-        tsai_cd.point_count = ncalibration_coords;
-        for (i = 0; i < ncalibration_coords; i++)
+        for (i = 0; i < n; i++)
         {
-                tsai_cd.xw[i] = calibration_array[index++];
-                tsai_cd.yw[i] = calibration_array[index++];
-                tsai_cd.zw[i] = calibration_array[index++];
-                tsai_cd.Xf[i] = calibration_array[index++];
-                tsai_cd.Yf[i] = calibration_array[index++];
+                value = PyFloat_FromDouble(point[i]);
+                if (value == NULL)
+                {
+                        Py_DECREF(tuple);
+                        return NULL;
+                }
+                PyTuple_SET_ITEM(tuple, i, value);
         }
-        PyMem_Free(calibration_array);
+        return tuple;
+}
 
-        /* fetch the camera parameters mapping */
-        if (parse_camera_mapping(params) == 0)
-                return NULL;
+/**
+ * Frees a camera model, and drops the reference it holds to its type, which
+ * is a heap type.
+ */
+static void camera_model_dealloc(PyObject *self)
+{
+        PyTypeObject *type = Py_TYPE(self);
 
-        /* perform the C call */
-        noncoplanar_calibration_with_full_optimization();
+        type->tp_free(self);
+        Py_DECREF(type);
+}
 
-        /* check for an error */
-        if (pytsai_haserror()) {
-                PyErr_SetString(PyExc_RuntimeError, pytsai_string);
-                return NULL;
-        } else {
-                return build_camera_mapping();
-        }
+/**
+ * CameraModel([params]): copies the camera parameters params holds (a
+ * mapping with the keys of parse_camera_mapping(), or a camera model); the
+ * rest are 0.
+ */
+static int camera_model_init(PyObject *self, PyObject *args, PyObject *kwds)
+{
+        static char *keywords[] = { "params", NULL };
+        PyObject *params = NULL;
+        struct module_state *state = NULL;
+        struct tsai_context ctx;
+
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:CameraModel",
+                keywords, &params))
+                return -1;
+        if (params == NULL || params == Py_None)
+                return 0;
+
+        if ((state = camera_model_state(Py_TYPE(self))) == NULL)
+                return -1;
+        camera_model_context(self, &ctx);
+        if (parse_camera_mapping(state, params, &ctx) == 0)
+                return -1;
+        ((struct camera_model *) self)->cp = ctx.cp;
+        ((struct camera_model *) self)->cc = ctx.cc;
+        return 0;
 }
 
+/**
+ * The number of items of a camera model.
+ */
+static Py_ssize_t camera_model_length(PyObject *self)
+{
+        PyObject *extra = NULL;
+        Py_ssize_t n = CAMERA_FIELD_COUNT;
+
+        extra = camera_model_extra(self);
+        if (extra == NULL)
+                return PyErr_Occurred() ? -1 : n;
+        n += PyDict_Size(extra);
+        Py_DECREF(extra);
+        return n;
+}
 
 /**
- * Converts from world coordinates to image coordinates.
- * The arguments to the function are:
- *      1 - world coordinates (3-tuple)
- *      2 - dictionary of camera parameters
- * It returns a 2-tuple containing (Xf, Yf).
+ * model[key]: a camera parameter, or a further item of a subclass.
  */
-static PyObject* tsai_wc2ic(PyObject *self, PyObject *args)
+static PyObject* camera_model_subscript(PyObject *self, PyObject *key)
 {
-        double xw, yw, zw, Xf, Yf;
-        PyObject *wc = NULL, *params = NULL, *wc2 = NULL;
+        const struct camera_field *field = NULL;
+        PyObject *extra = NULL, *value = NULL;
 
-        /* parse arguments */
-        if (!PyArg_ParseTuple(args, "OO", &wc, &params))
+        field = find_camera_field(key);
+        if (field != NULL)
+                return PyFloat_FromDouble(CAMERA_FIELD_VALUE(self,
+                        field->model_offset));
+
+        extra = camera_model_extra(self);
+        if (extra == NULL && PyErr_Occurred())
                 return NULL;
-        if (!PyTuple_Check(wc))
+        if (extra != NULL)
         {
-                wc2 = PySequence_Tuple(wc);
-                if (wc2 == NULL)
-                {
-                        PyErr_SetString(PyExc_TypeError,
-                                "First argument must be a 3-member sequence.");
-                        return NULL;
-                }
+                value = PyDict_GetItemWithError(extra, key);
+                Py_XINCREF(value);
+                Py_DECREF(extra);
+                if (value != NULL || PyErr_Occurred())
+                        return value;
         }
-        else
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+}
+
+/**
+ * Sets a camera parameter of a camera model to value, which must be a
+ * number; the parameter is left alone if it is not, or if value is NULL
+ * (deletion).
+ */
+static int set_camera_field(PyObject *self, const struct camera_field *field,
+        PyObject *value)
+{
+        double number;
+
+        if (value == NULL)
         {
-                wc2 = wc;
-                Py_INCREF(wc2);
+                PyErr_Format(PyExc_TypeError,
+                        "Camera parameter \"%s\" cannot be deleted.",
+                        field->name);
+                return -1;
         }
-        if (!PyArg_ParseTuple(wc2, "ddd", &xw, &yw, &zw))
+        number = PyFloat_AsDouble(value);
+        if (number == -1.0 && PyErr_Occurred())
         {
-                PyErr_SetString(PyExc_TypeError,
-                        "First argument must be a 3-member sequence.");
-                return NULL;
+                PyErr_Format(PyExc_TypeError,
+                        "Camera parameter \"%s\" should be a number.",
+                        field->name);
+                return -1;
         }
-        Py_DECREF(wc2);
+        CAMERA_FIELD_VALUE(self, field->model_offset) = number;
+        return 0;
+}
 
-        /* fetch the camera parameter mapping */
-        if (parse_camera_mapping(params) == 0)
-                return NULL;
+/**
+ * model[key] = value and del model[key].  Camera parameters must be numbers,
+ * and cannot be deleted; further items are only held by subclasses.
+ */
+static int camera_model_ass_subscript(PyObject *self, PyObject *key,
+        PyObject *value)
+{
+        const struct camera_field *field = NULL;
+        PyObject *extra = NULL;
+        int result;
 
-        /* perform the C call */
-        world_coord_to_image_coord(xw, yw, zw, &Xf, &Yf);
+        field = find_camera_field(key);
+        if (field != NULL)
+                return set_camera_field(self, field, value);
 
-        /* return the value (Xf, Yf) */
-        return Py_BuildValue("dd", Xf, Yf);
+        extra = camera_model_extra(self);
+        if (extra == NULL)
+        {
+                if (!PyErr_Occurred())
+                        PyErr_SetObject(PyExc_KeyError, key);
+                return -1;
+        }
+        if (value == NULL)
+                result = PyDict_DelItem(extra, key);
+        else
+                result = PyDict_SetItem(extra, key, value);
+        Py_DECREF(extra);
+        return result;
 }
 
+/**
+ * key in model.
+ */
+static int camera_model_contains(PyObject *self, PyObject *key)
+{
+        PyObject *extra = NULL;
+        int result;
+
+        if (find_camera_field(key) != NULL)
+                return 1;
+        extra = camera_model_extra(self);
+        if (extra == NULL)
+                return PyErr_Occurred() ? -1 : 0;
+        result = PyDict_Contains(extra, key);
+        Py_DECREF(extra);
+        return result;
+}
 
 /**
- * Converts from image coordinates (+depth) to world coordinates.
- * The arguments to the function are:
- *      1 - image coordinates (3-tuple) (Xf, Yf, z)
- *      2 - dictionary of camera parameters
- * It returns a 2-tuple containing (xw, yw, zw).
+ * Lists the keys (what 0), values (1) or items (2) of a camera model: the
+ * camera parameters in the order of parse_camera_mapping(), then any
+ * further items.
  */
-static PyObject* tsai_ic2wc(PyObject *self, PyObject *args)
+static PyObject* camera_model_list(PyObject *self, int what)
 {
-        double xw, yw, zw, Xf, Yf;
-        PyObject *wc = NULL, *params = NULL, *wc2 = NULL;
+        PyObject *list = NULL, *extra = NULL, *more = NULL, *key = NULL;
+        PyObject *value = NULL, *item = NULL;
+        Py_ssize_t i;
 
-        /* parse arguments */
-        if (!PyArg_ParseTuple(args, "OO", &wc, &params))
+        list = PyList_New(CAMERA_FIELD_COUNT);
+        if (list == NULL)
                 return NULL;
-        if (!PyTuple_Check(wc))
+        for (i = 0; i < CAMERA_FIELD_COUNT; i++)
         {
-                wc2 = PySequence_Tuple(wc);
-                if (wc2 == NULL)
+                key = PyUnicode_FromString(camera_fields[i].name);
+                value = PyFloat_FromDouble(CAMERA_FIELD_VALUE(self,
+                        camera_fields[i].model_offset));
+                if (key == NULL || value == NULL)
+                        item = NULL;
+                else if (what == 0)
+                        item = (Py_INCREF(key), key);
+                else if (what == 1)
+                        item = (Py_INCREF(value), value);
+                else
+                        item = PyTuple_Pack(2, key, value);
+                Py_XDECREF(key);
+                Py_XDECREF(value);
+                if (item == NULL)
                 {
-                        PyErr_SetString(PyExc_TypeError,
-                                "First argument must be a 3-member sequence.");
+                        Py_DECREF(list);
                         return NULL;
                 }
+                PyList_SET_ITEM(list, i, item);
         }
-        else
-        {
-                wc2 = wc;
-                Py_INCREF(wc2);
-        }
-        if (!PyArg_ParseTuple(wc2, "ddd", &Xf, &Yf, &zw))
+
+        extra = camera_model_extra(self);
+        if (extra == NULL)
         {
-                PyErr_SetString(PyExc_TypeError,
-                        "First argument must be a 3-member sequence.");
-                return NULL;
+                if (PyErr_Occurred())
+                        Py_CLEAR(list);
+                return list;
         }
-        Py_DECREF(wc2);
+        more = what == 0 ? PyDict_Keys(extra) : what == 1 ?
+                PyDict_Values(extra) : PyDict_Items(extra);
+        Py_DECREF(extra);
+        if (more == NULL || PyList_SetSlice(list, CAMERA_FIELD_COUNT,
+                CAMERA_FIELD_COUNT, more) != 0)
+                Py_CLEAR(list);
+        Py_XDECREF(more);
+        return list;
+}
 
-        /* fetch the camera parameter mapping */
-        if (parse_camera_mapping(params) == 0)
-                return NULL;
+static PyObject* camera_model_keys(PyObject *self, PyObject *args)
+{
+        return camera_model_list(self, 0);
+}
 
-        /* perform the C call */
-        image_coord_to_world_coord(Xf, Yf, zw, &xw, &yw);
+static PyObject* camera_model_values(PyObject *self, PyObject *args)
+{
+        return camera_model_list(self, 1);
+}
 
-        /* return the value (xw, yw, zw) */
-        return Py_BuildValue("ddd", xw, yw, zw);
+static PyObject* camera_model_items(PyObject *self, PyObject *args)
+{
+        return camera_model_list(self, 2);
 }
 
+/**
+ * iter(model): iterates over the keys.
+ */
+static PyObject* camera_model_iter(PyObject *self)
+{
+        PyObject *keys = NULL, *iter = NULL;
+
+        keys = camera_model_list(self, 0);
+        if (keys == NULL)
+                return NULL;
+        iter = PyObject_GetIter(keys);
+        Py_DECREF(keys);
+        return iter;
+}
 
 /**
- * Converts from camera coordinates to world coordinates.
- * The arguments to the function are:
- *      1 - camera coordinates (3-tuple) (xc, yc, zc)
- *      2 - dictionary of camera parameters
- * It returns a 2-tuple containing (xw, yw, zw).
+ * model.get(key[, default]).
  */
-static PyObject* tsai_cc2wc(PyObject *self, PyObject *args)
+static PyObject* camera_model_get(PyObject *self, PyObject *const *args,
+        Py_ssize_t nargs)
 {
-        double xw, yw, zw, xc, yc, zc;
-        PyObject *cc = NULL, *params = NULL, *cc2 = NULL;
+        PyObject *fallback = Py_None, *value = NULL;
 
-        /* parse arguments */
-        if (!PyArg_ParseTuple(args, "OO", &cc, &params))
+        if (!check_arg_count("get", nargs, 1, 2))
+                return NULL;
+        if (nargs > 1)
+                fallback = args[1];
+        value = camera_model_subscript(self, args[0]);
+        if (value == NULL && PyErr_ExceptionMatches(PyExc_KeyError))
+        {
+                PyErr_Clear();
+                Py_INCREF(fallback);
+                value = fallback;
+        }
+        return value;
+}
+
+/**
+ * Pickles a camera model as a call of its type on the dictionary of its
+ * camera parameters, with its further items as the state.
+ */
+static PyObject* camera_model_reduce(PyObject *self, PyObject *args)
+{
+        PyObject *params = NULL, *extra = NULL;
+
+        params = new_camera_dict((char *) self, 1);
+        if (params == NULL)
                 return NULL;
-        if (!PyTuple_Check(cc))
+        extra = camera_model_extra(self);
+        if (extra == NULL)
         {
-                cc2 = PySequence_Tuple(cc);
-                if (cc2 == NULL)
+                if (PyErr_Occurred())
                 {
-                        PyErr_SetString(PyExc_TypeError,
-                                "First argument must be a 3-member sequence.");
+                        Py_DECREF(params);
                         return NULL;
                 }
+                Py_INCREF(Py_None);
+                extra = Py_None;
         }
-        else
-        {
-                cc2 = cc;
-                Py_INCREF(cc2);
-        }
-        if (!PyArg_ParseTuple(cc2, "ddd", &xc, &yc, &zc))
-        {
-                PyErr_SetString(PyExc_TypeError,
-                        "First argument must be a 3-member sequence.");
-                return NULL;
-        }
-        Py_DECREF(cc2);
+        return Py_BuildValue("O(N)N", (PyObject *) Py_TYPE(self), params,
+                extra);
+}
 
-        /* fetch the camera parameter mapping */
-        if (parse_camera_mapping(params) == 0)
+/**
+ * model.world2image(coord): world coordinates (xw, yw, zw) to image
+ * coordinates (Xf, Yf).
+ */
+static PyObject* camera_model_world2image(PyObject *self, PyObject *coord)
+{
+        struct tsai_context ctx;
+        double wc[3], ic[2];
+
+        if (!parse_point(coord, wc, 3))
                 return NULL;
+        camera_model_context(self, &ctx);
+        world_coord_to_image_coord(&ctx, wc[0], wc[1], wc[2], &ic[0],
+                &ic[1]);
+        return new_point_tuple(ic, 2);
+}
 
-        /* perform the C call */
-        camera_coord_to_world_coord(xc, yc, zc, &xw, &yw, &zw);
+/**
+ * model.image2world(coord): image coordinates and depth (Xf, Yf, zw) to
+ * world coordinates (xw, yw, zw).
+ */
+static PyObject* camera_model_image2world(PyObject *self, PyObject *coord)
+{
+        struct tsai_context ctx;
+        double ic[3], wc[3];
 
-        /* return the value (xw, yw, zw) */
-        return Py_BuildValue("ddd", xw, yw, zw);
+        if (!parse_point(coord, ic, 3))
+                return NULL;
+        camera_model_context(self, &ctx);
+        image_coord_to_world_coord(&ctx, ic[0], ic[1], ic[2], &wc[0],
+                &wc[1]);
+        wc[2] = ic[2];
+        return new_point_tuple(wc, 3);
 }
 
-
 /**
- * Adds distortion to un-distorted sensor coordinates, returning distorted
- * sensor coordinates.  The arguments to this function are:
- *      1 - Xu
- *      2 - Yu
- *      3 - dictionary of camera parameters
- * It returns a 2-tuple containing (Xd, Yd).
+ * model.world2camera(coord): world coordinates (xw, yw, zw) to camera
+ * coordinates (xc, yc, zc).
  */
-static PyObject* tsai_add_sensor_coord_distortion(PyObject *self, 
-        PyObject *args)
+static PyObject* camera_model_world2camera(PyObject *self, PyObject *coord)
 {
-        double Xu, Yu, Xd, Yd;
-        PyObject *params = NULL;
+        struct tsai_context ctx;
+        double wc[3], cc[3];
 
-        /* parse arguments */
-        if (!PyArg_ParseTuple(args, "ddO", &Xu, &Yu, &params))
+        if (!parse_point(coord, wc, 3))
                 return NULL;
+        camera_model_context(self, &ctx);
+        world_coord_to_camera_coord(&ctx, wc[0], wc[1], wc[2], &cc[0],
+                &cc[1], &cc[2]);
+        return new_point_tuple(cc, 3);
+}
 
-        /* fetch the camera parameter mapping */
-        if (parse_camera_mapping(params) == 0)
+/**
+ * model.camera2world(coord): camera coordinates (xc, yc, zc) to world
+ * coordinates (xw, yw, zw).
+ */
+static PyObject* camera_model_camera2world(PyObject *self, PyObject *coord)
+{
+        struct tsai_context ctx;
+        double cc[3], wc[3];
+
+        if (!parse_point(coord, cc, 3))
                 return NULL;
+        camera_model_context(self, &ctx);
+        camera_coord_to_world_coord(&ctx, cc[0], cc[1], cc[2], &wc[0],
+                &wc[1], &wc[2]);
+        return new_point_tuple(wc, 3);
+}
 
-        /* perform the C call */
-        undistorted_to_distorted_sensor_coord(Xu, Yu, &Xd, &Yd);
+/**
+ * model.name: a camera parameter, whose camera field is the closure.
+ */
+static PyObject* camera_model_get_field(PyObject *self, void *closure)
+{
+        const struct camera_field *field = closure;
 
-        /* return the value (Xd, Yd) */
-        return Py_BuildValue("dd", Xd, Yd);
+        return PyFloat_FromDouble(CAMERA_FIELD_VALUE(self,
+                field->model_offset));
+}
+
+/**
+ * model.name = value, as model[name] = value.
+ */
+static int camera_model_set_field(PyObject *self, PyObject *value,
+        void *closure)
+{
+        return set_camera_field(self, closure, value);
 }
 
+#define CAMERA_FIELD(s, name) { #name, camera_model_get_field, \
+        camera_model_set_field, NULL, (void *) &camera_fields[FIELD_##name] },
+static PyGetSetDef camera_model_getset[] = {
+        CAMERA_FIELDS
+        {NULL, NULL, NULL, NULL, NULL}
+};
+#undef CAMERA_FIELD
+
+static PyMethodDef camera_model_methods[] = {
+        {"world2image", camera_model_world2image, METH_O,
+         "world2image(coord)\n\nConverts world coordinates (xw, yw, zw) to " \
+         "image coordinates (Xf, Yf)."},
+        {"image2world", camera_model_image2world, METH_O,
+         "image2world(coord)\n\nConverts image coordinates and the depth " \
+         "in the world (Xf, Yf, zw) to world coordinates (xw, yw, zw)."},
+        {"world2camera", camera_model_world2camera, METH_O,
+         "world2camera(coord)\n\nConverts world coordinates (xw, yw, zw) " \
+         "to camera coordinates (xc, yc, zc)."},
+        {"camera2world", camera_model_camera2world, METH_O,
+         "camera2world(coord)\n\nConverts camera coordinates (xc, yc, zc) " \
+         "to world coordinates (xw, yw, zw)."},
+        {"keys", camera_model_keys, METH_NOARGS,
+         "keys()\n\nLists the camera parameter names, then any further " \
+         "keys."},
+        {"values", camera_model_values, METH_NOARGS,
+         "values()\n\nLists the values, in the order of keys()."},
+        {"items", camera_model_items, METH_NOARGS,
+         "items()\n\nLists the (key, value) pairs, in the order of keys()."},
+        {"get", FASTCALL(camera_model_get), METH_FASTCALL,
+         "get(key[, default])\n\nThe value of key, or default if there " \
+         "is none."},
+        {"__reduce__", camera_model_reduce, METH_NOARGS, NULL},
+        {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot camera_model_slots[] = {
+        {Py_tp_dealloc, camera_model_dealloc},
+        {Py_tp_doc, "CameraModel([params])\n\n" \
+         "The camera parameters and calibration constants of a camera, " \
+         "held natively.  They are read and written as attributes and as " \
+         "the items of a mapping; params, a mapping with the same keys, " \
+         "gives their starting values (0 for any it lacks)."},
+        {Py_tp_init, camera_model_init},
+        {Py_tp_new, PyType_GenericNew},
+        {Py_tp_iter, camera_model_iter},
+        {Py_tp_methods, camera_model_methods},
+        {Py_tp_getset, camera_model_getset},
+        {Py_mp_length, camera_model_length},
+        {Py_mp_subscript, camera_model_subscript},
+        {Py_mp_ass_subscript, camera_model_ass_subscript},
+        {Py_sq_contains, camera_model_contains},
+        {0, NULL}
+};
+
+/**
+ * The camera model type, made for each module from this specification (see
+ * module_exec()).
+ */
+static PyType_Spec camera_model_spec = {
+        "pytsai.CameraModel",           /* name */
+        sizeof(struct camera_model),    /* basicsize */
+        0,                              /* itemsize */
+#if PY_VERSION_HEX >= 0x030A0000
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+                Py_TPFLAGS_IMMUTABLETYPE, /* flags */
+#else
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* flags */
+#endif
+        camera_model_slots,             /* slots */
+};
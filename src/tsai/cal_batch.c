@@ -0,0 +1,187 @@
+/**
+ * cal_batch.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file contains the extrinsic parameter estimation of many frames of a  *
+* calibrated camera at once, such as of a long capture sequence:             *
+*                                                                            *
+*       extrinsic_parameter_estimation_batch ()                              *
+*                                                                            *
+* The points of all of the frames are packed one after the other in the      *
+* columns of a struct tsai_frames, frame i holding the points offset[i] up   *
+* to offset[i + 1]; the columns may be interleaved, stride doubles apart     *
+* (5 for the rows of an N by 5 array), or contiguous (stride 1), in which    *
+* case every frame is read in place.                                         *
+*                                                                            *
+* The frames are split into as many blocks of consecutive frames as there    *
+* are contexts, and each block is solved on a context of its own, which      *
+* holds the camera (whose intrinsic parameters stay fixed) and the settings  *
+* (RANSAC, robust loss) of the estimation.  A context's storage is sized to  *
+* the largest frame of its block once and then reused, so a block allocates  *
+* next to nothing.  Each frame's pose is estimated afresh by                 *
+* extrinsic_parameter_estimation() or, if chain is set and the frame before  *
+* it in the block was solved, followed from that one's pose by               *
+* extrinsic_pose_tracking(), which for frames in temporal order is far       *
+* cheaper; a chained result then depends on where the blocks start.  The     *
+* pose of a frame that cannot be estimated is left as NaNs.                  *
+*                                                                            *
+* If the first context has a pool the blocks are solved on it, a block to a  *
+* task, and the sweeps of each frame then run on the calling thread.         *
+*                                                                            *
+\****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "cal_main.h"
+#include "../errors.h"
+#include "../pool/pool.h"
+
+struct batch_problem {
+    struct tsai_context **ctx;
+    int       nblocks;
+    struct tsai_frames *frames;
+    int       chain;
+    double   *pose;
+    int      *solved;			/* frames solved by each block */
+};
+
+
+/* pytsai: can fail: need int return type.
+ *
+ * Points ctx at the points of frame i, read in place or copied into its
+ * storage. */
+static int load_frame (struct tsai_context *ctx, struct tsai_frames *frames, int i)
+{
+    ptrdiff_t first = frames->offset[i],
+              stride = frames->stride;
+
+    int       n = (int) (frames->offset[i + 1] - first),
+              k;
+
+    if (stride == 1)
+	return tsai_context_attach (ctx, n, frames->xw + first, frames->yw + first,
+				    frames->zw + first, frames->Xf + first,
+				    frames->Yf + first);
+
+    if (!tsai_context_reserve (ctx, n))
+	return 0;
+    for (k = 0; k < n; k++) {
+	ctx->cd.xw[k] = frames->xw[(first + k) * stride];
+	ctx->cd.yw[k] = frames->yw[(first + k) * stride];
+	ctx->cd.zw[k] = frames->zw[(first + k) * stride];
+	ctx->cd.Xf[k] = frames->Xf[(first + k) * stride];
+	ctx->cd.Yf[k] = frames->Yf[(first + k) * stride];
+    }
+    return 1;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task solving the
+ * frames of block b. */
+static void solve_block (void *arg, int b)
+{
+    struct batch_problem *bp = (struct batch_problem *) arg;
+    struct tsai_context *ctx = bp->ctx[b];
+
+    int       count = bp->frames->count,
+              first = (int) ((long long) count * b / bp->nblocks),
+              last = (int) ((long long) count * (b + 1) / bp->nblocks),
+              tracking = 0,
+              ok,
+              i;
+
+    double   *pose;
+
+    bp->solved[b] = 0;
+    for (i = first; i < last; i++) {
+	pytsai_clear (&ctx->err);
+	ok = load_frame (ctx, bp->frames, i);
+	if (ok && tracking)
+	    ok = extrinsic_pose_tracking (ctx);
+	else if (ok)
+	    ok = extrinsic_parameter_estimation (ctx);
+	ok = ok && !pytsai_haserror (&ctx->err);
+
+	pose = bp->pose + 6 * (ptrdiff_t) i;
+	if (ok) {
+	    pose[0] = ctx->cc.Rx;
+	    pose[1] = ctx->cc.Ry;
+	    pose[2] = ctx->cc.Rz;
+	    pose[3] = ctx->cc.Tx;
+	    pose[4] = ctx->cc.Ty;
+	    pose[5] = ctx->cc.Tz;
+	    bp->solved[b]++;
+	} else
+	    pose[0] = pose[1] = pose[2] = pose[3] = pose[4] = pose[5] = NAN;
+	tracking = bp->chain && ok;
+    }
+
+    /* forget the last frame, which may have been read in place */
+    ctx->cd.point_count = 0;
+    ctx->cd.xw = ctx->cd.yw = ctx->cd.zw = ctx->cd.Xf = ctx->cd.Yf = NULL;
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Estimates the pose of every frame of frames into pose (6 doubles a frame:
+ * Rx, Ry, Rz, Tx, Ty, Tz), splitting the frames into nblocks blocks solved
+ * on ctx[0..nblocks-1].  Returns the number of frames solved, or -1 with
+ * ctx[0]->err set if out of memory. */
+int extrinsic_parameter_estimation_batch (struct tsai_context **ctx, int nblocks,
+					  struct tsai_frames *frames, int chain, double *pose)
+{
+    struct batch_problem bp;
+    struct worker_pool *pool;
+
+    int       b,
+              solved = 0;
+
+    if (nblocks > frames->count)
+	nblocks = frames->count;
+    if (nblocks < 1)
+	return 0;
+
+    bp.ctx = ctx;
+    bp.nblocks = nblocks;
+    bp.frames = frames;
+    bp.chain = chain;
+    bp.pose = pose;
+    if ((bp.solved = malloc (nblocks * sizeof (int))) == NULL) {
+	pytsai_raise (&ctx[0]->err, "extrinsic_parameter_estimation_batch: out of memory");
+	return -1;
+    }
+
+    pool = nblocks > 1 ? ctx[0]->pool : NULL;
+    if (pool != NULL) {
+	for (b = 0; b < nblocks; b++)
+	    ctx[b]->pool = NULL;
+	pool_run (pool, nblocks, solve_block, &bp);
+	ctx[0]->pool = pool;
+    } else
+	for (b = 0; b < nblocks; b++)
+	    solve_block (&bp, b);
+
+    for (b = 0; b < nblocks; b++)
+	solved += bp.solved[b];
+    free (bp.solved);
+    return solved;
+}
@@ -0,0 +1,227 @@
+/**
+ * cal_cpu.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file picks, at run time, which build of the hot kernels the library   *
+* calls: the error of the nonlinear optimization stages (cal_jac.c,          *
+* cal_simd.c) and the array transforms (cal_tran.c).  The routines are:      *
+*                                                                            *
+*       tsai_simd_init ()                                                    *
+*       tsai_simd_level ()                                                   *
+*                                                                            *
+* tsai_simd_init() asks the processor (cpuid) which instruction sets it and  *
+* the operating system support, and installs the kernels for the best of     *
+* them: avx512, avx2 or sse2 on x86, neon on 64-bit ARM, or scalar.  If the  *
+* environment variable PYTSAI_SIMD names one of these, the best level no     *
+* higher than it is used instead, so that the kernels can be compared on a  *
+* single machine; an unknown name is ignored.  Both routines return the name *
+* of the level in use.                                                       *
+*                                                                            *
+* Until tsai_simd_init() is called the portable kernels are used.  It should *
+* be called before any calibration runs (the Python module does so whenever  *
+* an interpreter imports it).  Only the first call picks the kernels, under  *
+* pthread_once (InitOnceExecuteOnce on Windows); every later call, from any  *
+* thread or interpreter, waits for that one and returns the level it picked, *
+* so PYTSAI_SIMD is read only once.                                          *
+*                                                                            *
+* All levels give the same transforms, bit for bit; the optimization error   *
+* differs between the scalar and the vector kernels in the last bit of the   *
+* hypotenuse (see cal_simd.c).                                               *
+*                                                                            *
+\****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "cal_simd.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if defined (TSAI_X86_KERNELS) && defined (_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static const char *level_names[TSAI_SIMD_LEVELS] = {
+    "scalar", "sse2", "neon", "avx2", "avx512"
+};
+
+struct tsai_kernels tsai_kernels = {
+    TSAI_SIMD_SCALAR,
+    error_rows_scalar,
+    world_coord_to_image_coord_array_generic,
+    image_coord_to_world_coord_array_generic,
+    world_coord_to_camera_coord_array_generic,
+    camera_coord_to_world_coord_array_generic
+};
+
+
+/************************************************************************/
+/* pytsai: cannot fail.  The best level the processor supports. */
+static enum tsai_simd_level cpu_level (void)
+{
+#if defined (TSAI_X86_KERNELS) && defined (__GNUC__)
+    __builtin_cpu_init ();
+
+    /* these also check that the OS saves the vector registers */
+    if (__builtin_cpu_supports ("avx512f"))
+	return TSAI_SIMD_AVX512;
+    if (__builtin_cpu_supports ("avx2"))
+	return TSAI_SIMD_AVX2;
+    if (__builtin_cpu_supports ("sse2"))
+	return TSAI_SIMD_SSE2;
+    return TSAI_SIMD_SCALAR;
+#elif defined (TSAI_X86_KERNELS)
+    int       info[4],
+              max_leaf,
+              avx2 = 0,
+              avx512f = 0;
+
+    unsigned __int64 xcr0 = 0;
+
+    __cpuid (info, 0);
+    max_leaf = info[0];
+    __cpuid (info, 1);
+    if (info[2] & (1 << 27))	/* OSXSAVE */
+	xcr0 = _xgetbv (0);
+    if (max_leaf >= 7) {
+	__cpuidex (info, 7, 0);
+	avx2 = (info[1] >> 5) & 1;
+	avx512f = (info[1] >> 16) & 1;
+    }
+
+    /* the OS must save the YMM (and for AVX-512 the ZMM and mask) state */
+    if (avx512f && (xcr0 & 0xe6) == 0xe6)
+	return TSAI_SIMD_AVX512;
+    if (avx2 && (xcr0 & 0x06) == 0x06)
+	return TSAI_SIMD_AVX2;
+    __cpuid (info, 1);
+    if (info[3] & (1 << 26))
+	return TSAI_SIMD_SSE2;
+    return TSAI_SIMD_SCALAR;
+#elif defined (TSAI_NEON_KERNELS)
+    return TSAI_SIMD_NEON;
+#else
+    return TSAI_SIMD_SCALAR;
+#endif
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; the environment variable is only advice.  Run
+ * once, by tsai_simd_init(). */
+static void pick_kernels (void)
+{
+    struct tsai_kernels kernels;
+
+    enum tsai_simd_level level = cpu_level ();
+
+    const char *request = getenv ("PYTSAI_SIMD");
+
+    int       i;
+
+    if (request != NULL)
+	for (i = 0; i < TSAI_SIMD_LEVELS; i++)
+	    if (strcmp (request, level_names[i]) == 0) {
+		if (i < (int) level)
+		    level = (enum tsai_simd_level) i;
+		break;
+	    }
+
+    /* a level below the processor's that was not built for it, such as
+     * neon on x86, falls back to scalar */
+    kernels.level = TSAI_SIMD_SCALAR;
+    kernels.error_rows = error_rows_scalar;
+    kernels.world_coord_to_image_coord = world_coord_to_image_coord_array_generic;
+    kernels.image_coord_to_world_coord = image_coord_to_world_coord_array_generic;
+    kernels.world_coord_to_camera_coord = world_coord_to_camera_coord_array_generic;
+    kernels.camera_coord_to_world_coord = camera_coord_to_world_coord_array_generic;
+
+    switch (level) {
+#if defined (TSAI_X86_KERNELS)
+    case TSAI_SIMD_AVX512:
+	kernels.level = TSAI_SIMD_AVX512;
+	kernels.error_rows = error_rows_avx512;
+	kernels.world_coord_to_image_coord = world_coord_to_image_coord_array_avx512;
+	kernels.image_coord_to_world_coord = image_coord_to_world_coord_array_avx512;
+	kernels.world_coord_to_camera_coord = world_coord_to_camera_coord_array_avx512;
+	kernels.camera_coord_to_world_coord = camera_coord_to_world_coord_array_avx512;
+	break;
+    case TSAI_SIMD_AVX2:
+	kernels.level = TSAI_SIMD_AVX2;
+	kernels.error_rows = error_rows_avx2;
+	kernels.world_coord_to_image_coord = world_coord_to_image_coord_array_avx2;
+	kernels.image_coord_to_world_coord = image_coord_to_world_coord_array_avx2;
+	kernels.world_coord_to_camera_coord = world_coord_to_camera_coord_array_avx2;
+	kernels.camera_coord_to_world_coord = camera_coord_to_world_coord_array_avx2;
+	break;
+    case TSAI_SIMD_SSE2:
+	kernels.level = TSAI_SIMD_SSE2;
+	kernels.error_rows = error_rows_sse2;
+	break;
+#elif defined (TSAI_NEON_KERNELS)
+    case TSAI_SIMD_NEON:
+	kernels.level = TSAI_SIMD_NEON;
+	kernels.error_rows = error_rows_neon;
+	break;
+#endif
+    default:
+	break;
+    }
+
+    tsai_kernels = kernels;
+}
+
+
+#ifdef _WIN32
+static INIT_ONCE kernels_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK pick_kernels_once (PINIT_ONCE once, PVOID arg, PVOID *ctx)
+{
+    pick_kernels ();
+    return TRUE;
+}
+#else
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+#endif
+
+
+/************************************************************************/
+/* pytsai: cannot fail. */
+const char *tsai_simd_init (void)
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce (&kernels_once, pick_kernels_once, NULL, NULL);
+#else
+    pthread_once (&kernels_once, pick_kernels);
+#endif
+    return tsai_simd_level ();
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail. */
+const char *tsai_simd_level (void)
+{
+    return level_names[tsai_kernels.level];
+}
@@ -28,7 +28,7 @@
 *       normalized_calibration_error ()                                      *
 *                                                                            *
 * The routines make use of the calibrated camera parameters and calibration  *
-* constants contained in the two external data structures tsai_cp and tsai_cc.         *
+* constants contained in the calibration context passed to each routine.     *
 *                                                                            *
 * Notation                                                                   *
 * --------                                                                   *
@@ -50,9 +50,6 @@
 #include <math.h>
 #include "cal_main.h"
 
-extern struct camera_parameters tsai_cp;
-extern struct calibration_constants tsai_cc;
-
 
 /****************************************************************************\
 * This routine calculates the mean, standard deviation, max, and             *
@@ -62,7 +59,8 @@ extern struct calibration_constants tsai_cc;
 * calibrated model. The calculation is for all of the points in the          *
 * calibration data set.                                                      *
 \****************************************************************************/
-void      distorted_image_plane_error_stats (mean, stddev, max, sse)
+void      distorted_image_plane_error_stats (ctx, mean, stddev, max, sse)
+    struct tsai_context *ctx;
     double   *mean,
              *stddev,
              *max,
@@ -78,32 +76,32 @@ void      distorted_image_plane_error_stats (mean, stddev, max, sse)
               sum_error = 0,
               sum_squared_error = 0;
 
-    if (tsai_cd.point_count < 1) {
+    if (ctx->cd.point_count < 1) {
 	*mean = *stddev = *max = *sse = 0;
 	return;
     }
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
 	/* calculate the ideal location of the image of the data point */
-	world_coord_to_image_coord (tsai_cd.xw[i], tsai_cd.yw[i], tsai_cd.zw[i], &Xf, &Yf);
+	world_coord_to_image_coord (ctx, ctx->cd.xw[i], ctx->cd.yw[i], ctx->cd.zw[i], &Xf, &Yf);
 
 	/* determine the error between the ideal and actual location of the data point	 */
 	/* (in distorted image coordinates)						 */
-	squared_error = SQR (Xf - tsai_cd.Xf[i]) + SQR (Yf - tsai_cd.Yf[i]);
+	squared_error = SQR (Xf - ctx->cd.Xf[i]) + SQR (Yf - ctx->cd.Yf[i]);
 	error = sqrt (squared_error);
 	sum_error += error;
 	sum_squared_error += squared_error;
 	max_error = MAX (max_error, error);
     }
 
-    *mean = sum_error / tsai_cd.point_count;
+    *mean = sum_error / ctx->cd.point_count;
     *max = max_error;
     *sse = sum_squared_error;
 
-    if (tsai_cd.point_count == 1)
+    if (ctx->cd.point_count == 1)
 	*stddev = 0;
     else
-	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / tsai_cd.point_count) / (tsai_cd.point_count - 1));
+	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / ctx->cd.point_count) / (ctx->cd.point_count - 1));
 }
 
 
@@ -115,7 +113,8 @@ void      distorted_image_plane_error_stats (mean, stddev, max, sse)
 * calibrated model. The calculation is for all of the points in the           *
 * calibration data set.                                                       *
 \*****************************************************************************/
-void      undistorted_image_plane_error_stats (mean, stddev, max, sse)
+void      undistorted_image_plane_error_stats (ctx, mean, stddev, max, sse)
+    struct tsai_context *ctx;
     double   *mean,
              *stddev,
              *max,
@@ -141,32 +140,32 @@ void      undistorted_image_plane_error_stats (mean, stddev, max, sse)
               sum_error = 0,
               sum_squared_error = 0;
 
-    if (tsai_cd.point_count < 1) {
+    if (ctx->cd.point_count < 1) {
 	*mean = *stddev = *max = *sse = 0;
 	return;
     }
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
 	/* calculate the ideal location of the image of the data point */
-	world_coord_to_camera_coord (tsai_cd.xw[i], tsai_cd.yw[i], tsai_cd.zw[i], &xc, &yc, &zc);
+	world_coord_to_camera_coord (ctx, ctx->cd.xw[i], ctx->cd.yw[i], ctx->cd.zw[i], &xc, &yc, &zc);
 
 	/* convert from camera coordinates to undistorted sensor plane coordinates */
-	Xu_1 = tsai_cc.f * xc / zc;
-	Yu_1 = tsai_cc.f * yc / zc;
+	Xu_1 = ctx->cc.f * xc / zc;
+	Yu_1 = ctx->cc.f * yc / zc;
 
 	/* convert from 2D image coordinates to distorted sensor coordinates */
-	Xd = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
+	Xd = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
 
 	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
-	distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
+	distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
 	Xu_2 = Xd * distortion_factor;
 	Yu_2 = Yd * distortion_factor;
 
 	/* determine the error between the ideal and actual location of the data point	 */
 	/* (in undistorted image coordinates)						 */
-	x_pixel_error = tsai_cp.sx * (Xu_1 - Xu_2) / tsai_cp.dpx;
-	y_pixel_error = (Yu_1 - Yu_2) / tsai_cp.dpy;
+	x_pixel_error = ctx->cp.sx * (Xu_1 - Xu_2) / ctx->cp.dpx;
+	y_pixel_error = (Yu_1 - Yu_2) / ctx->cp.dpy;
 	squared_error = SQR (x_pixel_error) + SQR (y_pixel_error);
 	error = sqrt (squared_error);
 	sum_error += error;
@@ -174,14 +173,14 @@ void      undistorted_image_plane_error_stats (mean, stddev, max, sse)
 	max_error = MAX (max_error, error);
     }
 
-    *mean = sum_error / tsai_cd.point_count;
+    *mean = sum_error / ctx->cd.point_count;
     *max = max_error;
     *sse = sum_squared_error;
 
-    if (tsai_cd.point_count == 1)
+    if (ctx->cd.point_count == 1)
 	*stddev = 0;
     else
-	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / tsai_cd.point_count) / (tsai_cd.point_count - 1));
+	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / ctx->cd.point_count) / (ctx->cd.point_count - 1));
 }
 
 
@@ -192,7 +191,8 @@ void      undistorted_image_plane_error_stats (mean, stddev, max, sse)
 * projecting the measured 2D coordinates out through the camera model.       *                              *
 * The calculation is for all of the points in the calibration data set.      *
 \****************************************************************************/
-void      object_space_error_stats (mean, stddev, max, sse)
+void      object_space_error_stats (ctx, mean, stddev, max, sse)
+    struct tsai_context *ctx;
     double   *mean,
              *stddev,
              *max,
@@ -215,42 +215,42 @@ void      object_space_error_stats (mean, stddev, max, sse)
               sum_error = 0,
               sum_squared_error = 0;
 
-    if (tsai_cd.point_count < 1) {
+    if (ctx->cd.point_count < 1) {
 	*mean = *stddev = *max = *sse = 0;
 	return;
     }
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
 	/* determine the position of the 3D object space point in camera coordinates */
-	world_coord_to_camera_coord (tsai_cd.xw[i], tsai_cd.yw[i], tsai_cd.zw[i], &xc, &yc, &zc);
+	world_coord_to_camera_coord (ctx, ctx->cd.xw[i], ctx->cd.yw[i], ctx->cd.zw[i], &xc, &yc, &zc);
 
 	/* convert the measured 2D image coordinates into distorted sensor coordinates */
-	Xd = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
+	Xd = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
 
 	/* convert from distorted sensor coordinates into undistorted sensor plane coordinates */
-	distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
+	distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
 	Xu = Xd * distortion_factor;
 	Yu = Yd * distortion_factor;
 
 	/* find the magnitude of the distance (error) of closest approach */
 	/* between the undistorted line of sight and the point in 3 space */
-	t = (xc * Xu + yc * Yu + zc * tsai_cc.f) / (SQR (Xu) + SQR (Yu) + SQR (tsai_cc.f));
-	squared_error = SQR (xc - Xu * t) + SQR (yc - Yu * t) + SQR (zc - tsai_cc.f * t);
+	t = (xc * Xu + yc * Yu + zc * ctx->cc.f) / (SQR (Xu) + SQR (Yu) + SQR (ctx->cc.f));
+	squared_error = SQR (xc - Xu * t) + SQR (yc - Yu * t) + SQR (zc - ctx->cc.f * t);
 	error = sqrt (squared_error);
 	sum_error += error;
 	sum_squared_error += squared_error;
 	max_error = MAX (max_error, error);
     }
 
-    *mean = sum_error / tsai_cd.point_count;
+    *mean = sum_error / ctx->cd.point_count;
     *max = max_error;
     *sse = sum_squared_error;
 
-    if (tsai_cd.point_count == 1)
+    if (ctx->cd.point_count == 1)
 	*stddev = 0;
     else
-	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / tsai_cd.point_count) / (tsai_cd.point_count - 1));
+	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / ctx->cd.point_count) / (ctx->cd.point_count - 1));
 }
 
 
@@ -258,7 +258,8 @@ void      object_space_error_stats (mean, stddev, max, sse)
 * This routine performs an error measure proposed by Weng in IEEE PAMI,      *
 * October 1992.                                                              *
 \****************************************************************************/
-void      normalized_calibration_error (mean, stddev)
+void      normalized_calibration_error (ctx, mean, stddev)
+    struct tsai_context *ctx;
     double   *mean,
              *stddev;
 {
@@ -281,7 +282,7 @@ void      normalized_calibration_error (mean, stddev)
               sum_error = 0,
               sum_squared_error = 0;
 
-    if (tsai_cd.point_count < 1) {
+    if (ctx->cd.point_count < 1) {
 	*mean = *stddev = 0;
 	return;
     }
@@ -291,30 +292,30 @@ void      normalized_calibration_error (mean, stddev)
     /* J. Weng, P. Cohen, and M. Herniou					 */
     /* IEEE Transactions on PAMI, Vol. 14, No. 10, October 1992, pp965-980	 */
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
 	/* estimate the 3D coordinates of the calibration data point by back 	 */
 	/* projecting its measured image location through the model to the	 */
 	/* plane formed by the original z world component.			 */
 
 	/* calculate the location of the data point in camera coordinates */
-	world_coord_to_camera_coord (tsai_cd.xw[i], tsai_cd.yw[i], tsai_cd.zw[i], &xc, &yc, &zc);
+	world_coord_to_camera_coord (ctx, ctx->cd.xw[i], ctx->cd.yw[i], ctx->cd.zw[i], &xc, &yc, &zc);
 
 	/* convert from 2D image coordinates to distorted sensor coordinates */
-	Xd = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
+	Xd = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
 
 	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
-	distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
+	distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
 	Xu = Xd * distortion_factor;
 	Yu = Yd * distortion_factor;
 
 	/* estimate the location of the data point by back projecting the image position */
 	zc_est = zc;
-	xc_est = zc_est * Xu / tsai_cc.f;
-	yc_est = zc_est * Yu / tsai_cc.f;
+	xc_est = zc_est * Xu / ctx->cc.f;
+	yc_est = zc_est * Yu / ctx->cc.f;
 
-	fu = tsai_cp.sx * tsai_cc.f / tsai_cp.dpx;
-	fv = tsai_cc.f / tsai_cp.dpy;
+	fu = ctx->cp.sx * ctx->cc.f / ctx->cp.dpx;
+	fv = ctx->cc.f / ctx->cp.dpy;
 
 	squared_error = (SQR (xc_est - xc) + SQR (yc_est - yc)) /
 	 (SQR (zc_est) * (1 / SQR (fu) + 1 / SQR (fv)) / 12);
@@ -322,10 +323,10 @@ void      normalized_calibration_error (mean, stddev)
 	sum_squared_error += squared_error;
     }
 
-    *mean = sum_error / tsai_cd.point_count;
+    *mean = sum_error / ctx->cd.point_count;
 
-    if (tsai_cd.point_count == 1)
+    if (ctx->cd.point_count == 1)
 	*stddev = 0;
     else
-	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / tsai_cd.point_count) / (tsai_cd.point_count - 1));
+	*stddev = sqrt ((sum_squared_error - SQR (sum_error) / ctx->cd.point_count) / (ctx->cd.point_count - 1));
 }
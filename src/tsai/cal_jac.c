@@ -0,0 +1,782 @@
+/**
+ * cal_jac.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file contains the error that the nonlinear optimization stages in     *
+* cal_main.c and ecalmain.c minimize, and its analytic Jacobian.  The        *
+* routines are:                                                              *
+*                                                                            *
+*       undistorted_sensor_error ()                                          *
+*       undistorted_sensor_error_jacobian ()                                 *
+*       undistorted_sensor_error_triangle ()                                 *
+*       undistorted_sensor_error_normal ()                                   *
+*                                                                            *
+* Every stage minimizes, for each calibration point, the distance between    *
+* the undistorted sensor coordinates predicted from the world coordinates    *
+*                                                                            *
+*       Xu_1 = f * xc / zc,  Yu_1 = f * yc / zc                              *
+*                                                                            *
+* and the ones recovered from the measured image coordinates                 *
+*                                                                            *
+*       Xd = dpx * (Xf - Cx) / sx,  Yd = dpy * (Yf - Cy)                     *
+*       Xu_2 = Xd * (1 + kappa1 * (Xd^2 + Yd^2)),  Yu_2 likewise             *
+*                                                                            *
+* err = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2).  The stages differ only in which   *
+* of the model parameters (enum tsai_error_parameter) they let vary, so a    *
+* single pair of routines serves all of them: they are told which column of  *
+* MINPACK's parameter vector and fjac (if any) each model parameter maps to. *
+* For coplanar data zw is zero, so the terms in zw drop out exactly.         *
+*                                                                            *
+* The derivative of err is (ex * dex + ey * dey) / err, where ex and ey are  *
+* the two error components.  Where err is exactly zero it is taken to be 0.  *
+*                                                                            *
+* Each point's error and row of the Jacobian depend on that point alone.     *
+* If the context has a worker pool (ctx->pool), a sweep over more than one   *
+* chunk of ctx->min_chunk points is split into chunks of at least that many  *
+* points, which the pool's threads fill in in parallel; every chunk writes   *
+* its own range of err or of the rows of fjac, and the result does not       *
+* depend on the split.  Without a pool, or for fewer points, the sweep runs  *
+* on the calling thread.                                                     *
+*                                                                            *
+* For lmstr_ (ctx->jacobian is TSAI_JACOBIAN_STREAMED) and for cal_views.c   *
+* the Jacobian is never stored: its rows are computed TILE_ROWS at a time    *
+* and folded with Givens rotations into the triangle [R | Q^T err], as       *
+* lsq_add_row() in matrix.c does.  On the pool each chunk folds a triangle   *
+* of its own, and these are then folded together in chunk order, so the      *
+* result depends on the split, though only through rounding.                 *
+*                                                                            *
+* For the pose tracking (ecalmain.c), which takes a few Gauss-Newton steps   *
+* in six parameters from a nearby pose, the rows are instead added to the    *
+* normal equations J^T J a = J^T err, which cost a tenth of the Givens       *
+* rotations and are well enough conditioned for that.                        *
+*                                                                            *
+* While ctx->outlier is set (see cal_ransac.c), the points it flags have     *
+* zero error and a zero row of the Jacobian, so they drop out of the fit.    *
+* While ctx->weight is set (see cal_robust.c), each point's error and row    *
+* are scaled by its weight.                                                  *
+*                                                                            *
+* The error is computed by whichever kernel tsai_simd_init() picked for the  *
+* processor (see cal_cpu.c): error_rows_scalar(), the reference, or one of   *
+* the vector kernels in cal_simd.c.                                          *
+*                                                                            *
+\****************************************************************************/
+
+#include <math.h>
+#include "cal_simd.h"
+#include "../pool/pool.h"
+
+/* chunks handed to each thread of the pool, so uneven threads balance out */
+#define CHUNKS_PER_THREAD	4
+
+/* rows of a streamed Jacobian computed at a time */
+#define TILE_ROWS		64
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * column[p] is the index of parameter p within params[] and the column of
+ * fjac that receives d err / d p, or -1 if the stage holds p fixed at its
+ * value in ctx.  If any of the rotation angles vary the rotation matrix is
+ * built from them, otherwise ctx->cc.r1..r9 are used as they are.  Xd and Yd
+ * may give the distorted sensor coordinates of the points; if they are NULL
+ * they are computed from the image coordinates. */
+static void setup_model (model, ctx, params, column, Xd, Yd)
+    struct error_model *model;
+    struct tsai_context *ctx;
+    double   *params;
+    int      *column;
+    double   *Xd,
+             *Yd;
+{
+    int       p;
+
+    double   *value = model->value,
+             *r = model->r,
+              sa,
+              sb,
+              sg,
+              ca,
+              cb,
+              cg;
+
+    model->ctx = ctx;
+    model->column = column;
+    model->Xd = Xd;
+    model->Yd = Yd;
+    model->first = 0;
+    model->components = 0;
+    model->normal = 0;
+
+    value[TSAI_RX] = ctx->cc.Rx;
+    value[TSAI_RY] = ctx->cc.Ry;
+    value[TSAI_RZ] = ctx->cc.Rz;
+    value[TSAI_TX] = ctx->cc.Tx;
+    value[TSAI_TY] = ctx->cc.Ty;
+    value[TSAI_TZ] = ctx->cc.Tz;
+    value[TSAI_KAPPA1] = ctx->cc.kappa1;
+    value[TSAI_F] = ctx->cc.f;
+    value[TSAI_SX] = ctx->cp.sx;
+    value[TSAI_CX] = ctx->cp.Cx;
+    value[TSAI_CY] = ctx->cp.Cy;
+
+    for (p = 0; p < TSAI_ERROR_PARAMETERS; p++)
+	if (column[p] >= 0)
+	    value[p] = params[column[p]];
+
+    model->rotation = column[TSAI_RX] >= 0 || column[TSAI_RY] >= 0 ||
+                      column[TSAI_RZ] >= 0;
+
+    if (model->rotation) {
+	SINCOS (value[TSAI_RX], sa, ca);
+	SINCOS (value[TSAI_RY], sb, cb);
+	SINCOS (value[TSAI_RZ], sg, cg);
+
+	r[0] = cb * cg;
+	r[1] = cg * sa * sb - ca * sg;
+	r[2] = sa * sg + ca * cg * sb;
+	r[3] = cb * sg;
+	r[4] = sa * sb * sg + ca * cg;
+	r[5] = ca * sb * sg - cg * sa;
+	r[6] = -sb;
+	r[7] = cb * sa;
+	r[8] = ca * cb;
+
+	/* d R / d Rx */
+	model->dr[0][0] = 0;     model->dr[0][1] = r[2];  model->dr[0][2] = -r[1];
+	model->dr[0][3] = 0;     model->dr[0][4] = r[5];  model->dr[0][5] = -r[4];
+	model->dr[0][6] = 0;     model->dr[0][7] = r[8];  model->dr[0][8] = -r[7];
+
+	/* d R / d Ry */
+	model->dr[1][0] = -sb * cg;
+	model->dr[1][1] = cg * sa * cb;
+	model->dr[1][2] = ca * cg * cb;
+	model->dr[1][3] = -sb * sg;
+	model->dr[1][4] = sa * cb * sg;
+	model->dr[1][5] = ca * cb * sg;
+	model->dr[1][6] = -cb;
+	model->dr[1][7] = -sb * sa;
+	model->dr[1][8] = -ca * sb;
+
+	/* d R / d Rz */
+	model->dr[2][0] = -r[3]; model->dr[2][1] = -r[4]; model->dr[2][2] = -r[5];
+	model->dr[2][3] = r[0];  model->dr[2][4] = r[1];  model->dr[2][5] = r[2];
+	model->dr[2][6] = 0;     model->dr[2][7] = 0;     model->dr[2][8] = 0;
+    } else {
+	r[0] = ctx->cc.r1; r[1] = ctx->cc.r2; r[2] = ctx->cc.r3;
+	r[3] = ctx->cc.r4; r[4] = ctx->cc.r5; r[5] = ctx->cc.r6;
+	r[6] = ctx->cc.r7; r[7] = ctx->cc.r8; r[8] = ctx->cc.r9;
+    }
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.  Fills err[begin..end). */
+void error_rows_scalar (model, begin, end)
+    struct error_model *model;
+    int       begin,
+              end;
+{
+    struct tsai_context *ctx = model->ctx;
+
+    int       i;
+
+    double   *r = model->r,
+             *err = model->out,
+              xc,
+              yc,
+              zc,
+              Xd_,
+              Yd_,
+              Xu_1,
+              Yu_1,
+              Xu_2,
+              Yu_2,
+              distortion_factor,
+              Tx = model->value[TSAI_TX],
+              Ty = model->value[TSAI_TY],
+              Tz = model->value[TSAI_TZ],
+              kappa1 = model->value[TSAI_KAPPA1],
+              f = model->value[TSAI_F],
+              sx = model->value[TSAI_SX],
+              Cx = model->value[TSAI_CX],
+              Cy = model->value[TSAI_CY];
+
+    for (i = begin; i < end; i++) {
+	/* convert from world coordinates to camera coordinates */
+	xc = r[0] * ctx->cd.xw[i] + r[1] * ctx->cd.yw[i] + r[2] * ctx->cd.zw[i] + Tx;
+	yc = r[3] * ctx->cd.xw[i] + r[4] * ctx->cd.yw[i] + r[5] * ctx->cd.zw[i] + Ty;
+	zc = r[6] * ctx->cd.xw[i] + r[7] * ctx->cd.yw[i] + r[8] * ctx->cd.zw[i] + Tz;
+
+	/* convert from camera coordinates to undistorted sensor plane coordinates */
+	Xu_1 = f * xc / zc;
+	Yu_1 = f * yc / zc;
+
+	/* convert from 2D image coordinates to distorted sensor coordinates */
+	if (model->Xd != NULL) {
+	    Xd_ = model->Xd[i];
+	    Yd_ = model->Yd[i];
+	} else {
+	    Xd_ = ctx->cp.dpx * (ctx->cd.Xf[i] - Cx) / sx;
+	    Yd_ = ctx->cp.dpy * (ctx->cd.Yf[i] - Cy);
+	}
+
+	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
+	distortion_factor = 1 + kappa1 * (SQR (Xd_) + SQR (Yd_));
+	Xu_2 = Xd_ * distortion_factor;
+	Yu_2 = Yd_ * distortion_factor;
+
+	/* record the error in the undistorted sensor coordinates */
+	err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
+    }
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.  Fills the rows of fjac
+ * for points begin..end-1, point i in row i - model->first; or, if
+ * model->components, the rows of its two error components in rows
+ * 2 (i - model->first) and the one after, with the components themselves in
+ * the same places of model->err. */
+static void jacobian_rows (model, begin, end)
+    struct error_model *model;
+    int       begin,
+              end;
+{
+    struct tsai_context *ctx = model->ctx;
+
+    int      *column = model->column,
+              ldfjac = model->ldfjac,
+              row,
+              i,
+              p;
+
+    double   *r = model->r,
+             *fjac = model->out,
+              xw,
+              yw,
+              zw,
+              xc,
+              yc,
+              zc,
+              Xd_,
+              Yd_,
+              Xu_1,
+              Yu_1,
+              rho2,
+              distortion_factor,
+              ex,
+              ey,
+              gx,
+              gy,
+              dXd,
+              dYd,
+              keep,
+              dex[TSAI_ERROR_PARAMETERS],
+              dey[TSAI_ERROR_PARAMETERS],
+              f = model->value[TSAI_F],
+              kappa1 = model->value[TSAI_KAPPA1],
+              sx = model->value[TSAI_SX],
+              Cx = model->value[TSAI_CX],
+              Cy = model->value[TSAI_CY];
+
+    for (i = begin; i < end; i++) {
+	xw = ctx->cd.xw[i];
+	yw = ctx->cd.yw[i];
+	zw = ctx->cd.zw[i];
+
+	xc = r[0] * xw + r[1] * yw + r[2] * zw + model->value[TSAI_TX];
+	yc = r[3] * xw + r[4] * yw + r[5] * zw + model->value[TSAI_TY];
+	zc = r[6] * xw + r[7] * yw + r[8] * zw + model->value[TSAI_TZ];
+
+	Xu_1 = f * xc / zc;
+	Yu_1 = f * yc / zc;
+
+	if (model->Xd != NULL) {
+	    Xd_ = model->Xd[i];
+	    Yd_ = model->Yd[i];
+	} else {
+	    Xd_ = ctx->cp.dpx * (ctx->cd.Xf[i] - Cx) / sx;
+	    Yd_ = ctx->cp.dpy * (ctx->cd.Yf[i] - Cy);
+	}
+
+	rho2 = SQR (Xd_) + SQR (Yd_);
+	distortion_factor = 1 + kappa1 * rho2;
+
+	ex = Xu_1 - Xd_ * distortion_factor;
+	ey = Yu_1 - Yd_ * distortion_factor;
+
+	/* derivatives of the projected point Xu_1, Yu_1 */
+	if (model->rotation) {
+	    for (p = 0; p < 3; p++) {
+		double *dr = model->dr[p],
+		       dxc = dr[0] * xw + dr[1] * yw + dr[2] * zw,
+		       dyc = dr[3] * xw + dr[4] * yw + dr[5] * zw,
+		       dzc = dr[6] * xw + dr[7] * yw + dr[8] * zw;
+
+		dex[TSAI_RX + p] = (f * dxc - Xu_1 * dzc) / zc;
+		dey[TSAI_RX + p] = (f * dyc - Yu_1 * dzc) / zc;
+	    }
+	} else {
+	    for (p = 0; p < 3; p++)
+		dex[TSAI_RX + p] = dey[TSAI_RX + p] = 0;
+	}
+	dex[TSAI_TX] = f / zc;       dey[TSAI_TX] = 0;
+	dex[TSAI_TY] = 0;            dey[TSAI_TY] = f / zc;
+	dex[TSAI_TZ] = -Xu_1 / zc;   dey[TSAI_TZ] = -Yu_1 / zc;
+	dex[TSAI_F] = xc / zc;       dey[TSAI_F] = yc / zc;
+
+	/* derivatives of the recovered point Xu_2, Yu_2 (note the sign) */
+	dex[TSAI_KAPPA1] = -Xd_ * rho2;
+	dey[TSAI_KAPPA1] = -Yd_ * rho2;
+
+	/* d Xu_2 / d Xd and d Yu_2 / d Yd; d Yu_2 / d Xd is 2 kappa1 Xd Yd */
+	dXd = distortion_factor + 2 * kappa1 * SQR (Xd_);
+	dYd = distortion_factor + 2 * kappa1 * SQR (Yd_);
+
+	dex[TSAI_CX] = dXd * ctx->cp.dpx / sx;
+	dey[TSAI_CX] = 2 * kappa1 * Xd_ * Yd_ * ctx->cp.dpx / sx;
+	dex[TSAI_CY] = 2 * kappa1 * Xd_ * Yd_ * ctx->cp.dpy;
+	dey[TSAI_CY] = dYd * ctx->cp.dpy;
+	dex[TSAI_SX] = dXd * Xd_ / sx;
+	dey[TSAI_SX] = 2 * kappa1 * Xd_ * Yd_ * Xd_ / sx;
+
+	/* an outlier to the robust fit of U (see cal_ransac.c) counts for
+	 * nothing, and a robust loss weighs the point (see cal_robust.c) */
+	if (ctx->outlier != NULL && ctx->outlier[i])
+	    keep = 0.0;
+	else
+	    keep = ctx->weight != NULL ? ctx->weight[i] : 1.0;
+
+	if (model->components) {
+	    row = 2 * (i - model->first);
+	    model->err[row] = keep * ex;
+	    model->err[row + 1] = keep * ey;
+	    for (p = 0; p < TSAI_ERROR_PARAMETERS; p++)
+		if (column[p] >= 0) {
+		    fjac[row + column[p] * ldfjac] = keep * dex[p];
+		    fjac[row + 1 + column[p] * ldfjac] = keep * dey[p];
+		}
+	    continue;
+	}
+
+	/* gradient of hypot (ex, ey) */
+	gx = hypot (ex, ey);
+	if (gx == 0) {
+	    gy = 0;
+	} else {
+	    gy = ey / gx;
+	    gx = ex / gx;
+	}
+
+	for (p = 0; p < TSAI_ERROR_PARAMETERS; p++)
+	    if (column[p] >= 0)
+		fjac[i - model->first + column[p] * ldfjac] = keep * (gx * dex[p] + gy * dey[p]);
+    }
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task filling one
+ * chunk of points. */
+static void sweep_task (void *arg, int index)
+{
+    struct error_model *model = (struct error_model *) arg;
+    int       begin = index * model->chunk,
+              end = begin + model->chunk;
+
+    if (end > model->ctx->cd.point_count)
+	end = model->ctx->cd.point_count;
+    model->rows (model, begin, end);
+}
+
+
+/* pytsai: cannot fail.  The number of chunks a sweep over the points of
+ * ctx is split into, or 1 if it runs on the calling thread. */
+static int sweep_chunks (struct tsai_context *ctx)
+{
+    int       n = ctx->cd.point_count,
+              min_chunk = ctx->min_chunk > 0 ? ctx->min_chunk : TSAI_MIN_CHUNK,
+              nchunks = n / min_chunk;
+
+    if (ctx->pool == NULL || pool_size (ctx->pool) < 2 || nchunks < 2)
+	return 1;
+    if (nchunks > CHUNKS_PER_THREAD * pool_size (ctx->pool))
+	nchunks = CHUNKS_PER_THREAD * pool_size (ctx->pool);
+    return nchunks;
+}
+
+
+/* pytsai: cannot fail; void return type is fine. */
+static void sweep (struct error_model *model)
+{
+    struct tsai_context *ctx = model->ctx;
+    int       n = ctx->cd.point_count,
+              nchunks = sweep_chunks (ctx);
+
+    if (nchunks < 2) {
+	model->rows (model, 0, n);
+	return;
+    }
+
+    model->chunk = (n + nchunks - 1) / nchunks;
+    pool_run (ctx->pool, (n + model->chunk - 1) / model->chunk, sweep_task, model);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Folds the equation  x[0..n-1] . a = x[n]  into the triangle [R | Q^T b]
+ * (n by n+1, column-major, leading dimension ldr) with Givens rotations, as
+ * lsq_add_row() in matrix.c does.  x is overwritten. */
+void fold_row (double *r, int ldr, int n, double *x)
+{
+    int       j,
+              k;
+
+    double    c,
+              s,
+              h,
+              t;
+
+    for (j = 0; j < n; j++) {
+	if (x[j] == 0.0)
+	    continue;
+
+	h = hypot (r[j + j * ldr], x[j]);
+	c = r[j + j * ldr] / h;
+	s = x[j] / h;
+	r[j + j * ldr] = h;
+
+	for (k = j + 1; k <= n; k++) {
+	    t = r[j + k * ldr];
+	    r[j + k * ldr] = c * t + s * x[k];
+	    x[k] = c * x[k] - s * t;
+	}
+    }
+}
+
+
+/* pytsai: cannot fail.  The dot product of x[0..n-1] and y[0..n-1], in
+ * four interleaved sums that the processor can add up side by side. */
+static double dot (double *x, double *y, int n)
+{
+    int       i;
+
+    double    s0 = 0.0,
+              s1 = 0.0,
+              s2 = 0.0,
+              s3 = 0.0;
+
+    for (i = 0; i + 3 < n; i += 4) {
+	s0 += x[i] * y[i];
+	s1 += x[i + 1] * y[i + 1];
+	s2 += x[i + 2] * y[i + 2];
+	s3 += x[i + 3] * y[i + 3];
+    }
+    for (; i < n; i++)
+	s0 += x[i] * y[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Adds the nrows equations  rows[i, 0..n-1] . a = rhs[i]  (rows column-major,
+ * leading dimension ld) to the normal equations held in a: the lower
+ * triangle of J^T J (n by n, stored by rows), followed by the n elements of
+ * J^T rhs.  Works a column at a time, so the sums run over contiguous
+ * memory. */
+static void add_rows (double *a, int n, double *rows, int ld, double *rhs, int nrows)
+{
+    int       j,
+              k;
+
+    for (j = 0; j < n; j++) {
+	for (k = 0; k <= j; k++)
+	    a[j * n + k] += dot (rows + j * ld, rows + k * ld, nrows);
+	a[n * n + j] += dot (rows + j * ld, rhs, nrows);
+    }
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Folds the rows of the
+ * Jacobian for points begin..end-1, each with its error from model->err (or
+ * the rows of the error components, see jacobian_rows()), into the triangle
+ * model->out, or adds them to its normal equations if model->normal,
+ * TILE_ROWS points at a time. */
+static void triangle_rows (model, begin, end)
+    struct error_model *model;
+    int       begin,
+              end;
+{
+    struct error_model tile = *model;
+
+    int       i,
+              j,
+              stop,
+              nrows,
+              n = 0;
+
+    double    rows[2 * TILE_ROWS * TSAI_ERROR_PARAMETERS],
+              components[2 * TILE_ROWS],
+              x[TSAI_ERROR_PARAMETERS + 1];
+
+    for (j = 0; j < TSAI_ERROR_PARAMETERS; j++)
+	if (model->column[j] >= 0)
+	    n++;
+
+    tile.out = rows;
+    tile.ldfjac = 2 * TILE_ROWS;
+    if (model->components)
+	tile.err = components;
+    for (tile.first = begin; tile.first < end; tile.first += TILE_ROWS) {
+	stop = tile.first + TILE_ROWS < end ? tile.first + TILE_ROWS : end;
+	jacobian_rows (&tile, tile.first, stop);
+
+	nrows = model->components ? 2 * (stop - tile.first) : stop - tile.first;
+	if (model->normal) {
+	    add_rows (model->out, n, rows, 2 * TILE_ROWS,
+		      model->components ? components : model->err + tile.first, nrows);
+	    continue;
+	}
+	for (i = 0; i < nrows; i++) {
+	    for (j = 0; j < n; j++)
+		x[j] = rows[i + j * 2 * TILE_ROWS];
+	    x[n] = model->components ? components[i] : model->err[tile.first + i];
+	    fold_row (model->out, model->ldfjac, n, x);
+	}
+    }
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task folding one
+ * chunk of points into a triangle of its own. */
+static void triangle_task (void *arg, int index)
+{
+    struct error_model part = *(struct error_model *) arg;
+    int       begin = index * part.chunk,
+              end = begin + part.chunk;
+
+    if (end > part.ctx->cd.point_count)
+	end = part.ctx->cd.point_count;
+    part.out += index * part.ldfjac * (part.ldfjac + 1);
+    triangle_rows (&part, begin, end);
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Fills err with the error of every point for the parameters params; see
+ * setup_model() for column, Xd and Yd. */
+void undistorted_sensor_error (ctx, params, column, Xd, Yd, err)
+    struct tsai_context *ctx;
+    double   *params;
+    int      *column;
+    double   *Xd,
+             *Yd;
+    double   *err;
+{
+    struct error_model model;
+
+    int       i;
+
+    setup_model (&model, ctx, params, column, Xd, Yd);
+    model.out = err;
+    model.rows = tsai_kernels.error_rows;
+    sweep (&model);
+
+    if (ctx->weight != NULL)
+	for (i = 0; i < ctx->cd.point_count; i++)
+	    err[i] *= ctx->weight[i];
+    if (ctx->outlier != NULL)
+	for (i = 0; i < ctx->cd.point_count; i++)
+	    if (ctx->outlier[i])
+		err[i] = 0.0;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Folds the rows of model, which has n parameters that vary, into out (the
+ * triangle, leading dimension ldr, or the normal equations).  On the pool
+ * every chunk of points folds into a triangle (or normal equations) of its
+ * own, in the pool's scratch memory (pool_scratch()), and these are then
+ * folded (added) into out in order; if the pool cannot spare them the rows
+ * are folded on the calling thread. */
+static void fold_sweep (struct error_model *model, double *out, int ldr, int n)
+{
+    struct tsai_context *ctx = model->ctx;
+
+    int       c,
+              j,
+              k,
+              ntasks,
+              nchunks;
+
+    char     *block = NULL;
+
+    double   *parts,
+             *part,
+              x[TSAI_ERROR_PARAMETERS + 1];
+
+    /* room for a triangle per chunk, and a line of slack for alignment */
+    nchunks = sweep_chunks (ctx);
+    if (nchunks > 1)
+	block = pool_scratch (ctx->pool, (size_t) nchunks * n * (n + 1) * sizeof (double)
+			      + TSAI_DATA_ALIGNMENT);
+    if (block == NULL) {
+	model->out = out;
+	model->ldfjac = ldr;
+	triangle_rows (model, 0, ctx->cd.point_count);
+	return;
+    }
+
+    parts = (double *) (block + (TSAI_DATA_ALIGNMENT -
+				 (size_t) block % TSAI_DATA_ALIGNMENT) % TSAI_DATA_ALIGNMENT);
+    for (k = 0; k < nchunks * n * (n + 1); k++)
+	parts[k] = 0.0;
+
+    model->out = parts;
+    model->ldfjac = n;
+    model->chunk = (ctx->cd.point_count + nchunks - 1) / nchunks;
+    ntasks = (ctx->cd.point_count + model->chunk - 1) / model->chunk;
+    pool_run (ctx->pool, ntasks, triangle_task, model);
+
+    for (c = 0; c < ntasks; c++) {
+	part = parts + c * n * (n + 1);
+	if (model->normal) {
+	    for (k = 0; k < n * (n + 1); k++)
+		out[k] += part[k];
+	    continue;
+	}
+	for (j = 0; j < n; j++) {
+	    for (k = 0; k <= n; k++)
+		x[k] = k < j ? 0.0 : part[j + k * n];
+	    fold_row (out, ldr, n, x);
+	}
+    }
+}
+
+
+/* pytsai: cannot fail.  The number of parameters that vary. */
+static int varying (int *column)
+{
+    int       j,
+              n = 0;
+
+    for (j = 0; j < TSAI_ERROR_PARAMETERS; j++)
+	if (column[j] >= 0)
+	    n++;
+    return n;
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Folds the rows of the Jacobian of the error for the parameters params,
+ * each with its error from err, into the triangle [R | Q^T err] of n by n+1
+ * in r (column-major, leading dimension ldr), where n is the number of
+ * parameters that vary; r must hold the triangle so far (zero to start
+ * with).  If err is NULL the two components of each point's error, whose
+ * squares sum to that of the error, are folded instead, as two rows with
+ * the components as their right-hand sides; the linear model of the sum of
+ * squares is then exact where the error is small rather than poor.  On the
+ * pool the rows are folded by chunks, see fold_sweep(). */
+void undistorted_sensor_error_triangle (ctx, params, column, Xd, Yd, err, r, ldr)
+    struct tsai_context *ctx;
+    double   *params;
+    int      *column;
+    double   *Xd,
+             *Yd;
+    double   *err;
+    double   *r;
+    int       ldr;
+{
+    struct error_model model;
+
+    setup_model (&model, ctx, params, column, Xd, Yd);
+    model.err = err;
+    model.components = err == NULL;
+    fold_sweep (&model, r, ldr, varying (column));
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Adds the rows of the Jacobian of the two components of each point's
+ * error for the parameters params, with the components as their right-hand
+ * sides (see undistorted_sensor_error_triangle()), to the normal equations
+ * in a: the lower triangle of J^T J (n by n, stored by rows, as
+ * solve_normal_equations() in matrix.c takes it) followed by the n elements
+ * of J^T err, where n is the number of parameters that vary; a must hold
+ * the sums so far (zero to start with). */
+void undistorted_sensor_error_normal (ctx, params, column, Xd, Yd, a)
+    struct tsai_context *ctx;
+    double   *params;
+    int      *column;
+    double   *Xd,
+             *Yd;
+    double   *a;
+{
+    struct error_model model;
+
+    int       n = varying (column);
+
+    setup_model (&model, ctx, params, column, Xd, Yd);
+    model.err = NULL;
+    model.components = 1;
+    model.normal = 1;
+    fold_sweep (&model, a, n, n);
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Fills the columns of fjac (column-major, leading dimension ldfjac) named
+ * by column with the Jacobian of the error for the parameters params.  If
+ * the context streams its Jacobian (ctx->jacobian, for lmstr_) the rows are
+ * instead folded into fjac with undistorted_sensor_error_triangle(). */
+void undistorted_sensor_error_jacobian (ctx, params, column, Xd, Yd, err, fjac, ldfjac)
+    struct tsai_context *ctx;
+    double   *params;
+    int      *column;
+    double   *Xd,
+             *Yd;
+    double   *err;
+    double   *fjac;
+    int       ldfjac;
+{
+    struct error_model model;
+
+    if (ctx->jacobian == TSAI_JACOBIAN_STREAMED) {
+	undistorted_sensor_error_triangle (ctx, params, column, Xd, Yd, err, fjac, ldfjac);
+	return;
+    }
+
+    setup_model (&model, ctx, params, column, Xd, Yd);
+    model.out = fjac;
+    model.ldfjac = ldfjac;
+    model.rows = jacobian_rows;
+    sweep (&model);
+}
@@ -0,0 +1,57 @@
+/**
+ * cal_jac.h
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * The error model shared by the sweeps in cal_jac.c and the vector kernels
+ * in cal_simd.c, and the Givens fold cal_views.c also uses.  Not part of the
+ * library's interface.
+ */
+
+#ifndef CAL_JAC_H
+#define CAL_JAC_H
+
+#include "cal_main.h"
+
+/* The error model of one sweep: the parameter values and the rotation
+ * matrix (with its derivatives if the angles vary), and where the sweep
+ * writes its output. */
+struct error_model {
+    struct tsai_context *ctx;
+    int      *column;
+    double   *Xd,
+             *Yd;
+    double    value[TSAI_ERROR_PARAMETERS];
+    int       rotation;
+    double    r[9],
+              dr[3][9];
+
+    double   *out;			/* err, fjac or [R | Q^T err] */
+    int       ldfjac;
+    int       first;			/* point in the first row of fjac */
+    double   *err;			/* right-hand side when folding */
+    int       components;		/* fold ex and ey rather than err */
+    int       normal;			/* add to the normal equations */
+    int       chunk;			/* points per task */
+    void    (*rows) (struct error_model *model, int begin, int end);
+};
+
+/* folds one row into a triangle [R | Q^T b] (see cal_jac.c) */
+void  fold_row (double *r, int ldr, int n, double *x);
+
+#endif /* CAL_JAC_H */
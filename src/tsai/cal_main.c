@@ -61,6 +61,19 @@
 *       coplanar_calibration_with_full_optimization ()                       *
 *       noncoplanar_calibration_with_full_optimization ()                    *
 *                                                                            *
+* When the camera has already been calibrated and has only drifted since,    *
+* its previous camera parameters and calibration constants are a good        *
+* enough start for the full optimization alone.  The routines are:           *
+*                                                                            *
+*       coplanar_calibration_with_warm_start ()                              *
+*       noncoplanar_calibration_with_warm_start ()                           *
+*                                                                            *
+* which fall back on the second level routines if the warm start does not    *
+* converge (see warm_start_max_error in cal_main.h).  They are not always    *
+* faster: the full optimization is ill-conditioned, most of all for a plane  *
+* target, and from a drifted start it can take longer than the whole cold    *
+* calibration.                                                               *
+*                                                                            *
 * Routines are also provided for initializing camera parameter variables     *
 * for five of our camera/frame grabber systems.  These routines are:         *
 *                                                                            *
@@ -206,23 +219,16 @@
 #include <errno.h>
 #include "../matrix/matrix.h"
 #include "cal_main.h"
+#include "cal_jac.h"
 #include "../minpack/f2c.h"
 #include "../minpack/minpack.h"
 #include "../errors.h"
+#include "../pool/pool.h"
 
 
-/* Variables used by the subroutines for I/O (perhaps not the best way of 
- * doing this) */
-struct camera_parameters tsai_cp;
-struct calibration_data tsai_cd;
-struct calibration_constants tsai_cc;
-
-/* Local working storage */
-static
-double Xd[MAX_POINTS],
-       Yd[MAX_POINTS],
-       r_squared[MAX_POINTS],
-       U[7];
+/* All of the routines below operate on an explicit struct tsai_context (see
+ * cal_main.h), which holds the I/O variables, the local working storage and
+ * the error state of one calibration. */
 
 
 /* char camera_type[256] = "unknown"; */
@@ -369,6 +375,175 @@ void      initialize_xapshot_matrox_parms ()
 #endif  /* finish excluding camera settings routines */
 
 
+/***********************************************************************\
+* These routines manage the per-point storage of a context: the three	*
+* working arrays of the linear stages and, unless the caller supplies	*
+* its own (tsai_context_attach), the five calibration data arrays.	*
+* The block also holds the arena for the workspaces of the		*
+* optimization stages, sized for the context's Jacobian mode.  The	*
+* most any stage takes from it is that of the full optimizations with	*
+* a dense Jacobian: fvec, wa4 and eleven columns of fjac, and the	*
+* weights of a robust loss (see cal_robust.c) besides.  With a streamed	*
+* Jacobian only fvec, wa4 and the weights are per point, besides the	*
+* one byte outlier flags of a RANSAC fit (see cal_ransac.c), and fjac	*
+* is a triangle of at most eleven by twelve.  (The copies of the	*
+* working arrays for a five parameter stage on a pool are the pool's,	*
+* see cc_five_parm_setup.)  All of them live in one heap block, each	*
+* padded to a whole number of TSAI_DATA_ALIGNMENT byte lines so that	*
+* every array starts on an aligned boundary.  The block is only		*
+* reallocated when it must grow, so a context can be reused for		*
+* calibrations of varying size.						*
+\***********************************************************************/
+#define WORK_ARRAYS		3	/* Xd, Yd, r_squared */
+#define DATA_ARRAYS		5	/* xw, yw, zw, Xf, Yf */
+#define ARENA_ARRAYS		(TSAI_ERROR_PARAMETERS + 3)	/* fvec, wa4, fjac, weights */
+#define STREAMED_ARRAYS		3	/* fvec, wa4, weights */
+#define DOUBLES_PER_LINE	(TSAI_DATA_ALIGNMENT / sizeof (double))
+#define WHOLE_LINES(count)	(((count) + DOUBLES_PER_LINE - 1) / DOUBLES_PER_LINE * DOUBLES_PER_LINE)
+
+/* pytsai: cannot fail.  The doubles the arena needs for arrays of stride
+ * doubles, under the context's Jacobian mode. */
+static size_t arena_doubles (struct tsai_context *ctx, size_t stride)
+{
+    if (ctx->jacobian != TSAI_JACOBIAN_STREAMED)
+	return ARENA_ARRAYS * stride;
+
+    return STREAMED_ARRAYS * stride + WHOLE_LINES (stride / sizeof (double)) +
+	WHOLE_LINES ((size_t) TSAI_ERROR_PARAMETERS * (TSAI_ERROR_PARAMETERS + 1));
+}
+
+/* pytsai: can fail: need int return type. */
+static int reserve_storage (struct tsai_context *ctx, int point_count, int narrays)
+{
+    size_t    stride,
+              size;
+    char     *block;
+    double   *base;
+
+    if (point_count < 0) {
+	pytsai_raise (&ctx->err, "tsai_context_reserve: negative point count");
+	return 0;
+    }
+
+    /* doubles per array, rounded up to whole lines */
+    stride = WHOLE_LINES ((size_t) point_count);
+    if (stride == 0)
+	stride = DOUBLES_PER_LINE;
+    if (stride > ((size_t) -1 - TSAI_DATA_ALIGNMENT) / ((narrays + ARENA_ARRAYS) * sizeof (double))) {
+	pytsai_raise (&ctx->err, "tsai_context_reserve: too many points");
+	return 0;
+    }
+    size = (narrays * stride + arena_doubles (ctx, stride)) * sizeof (double);
+
+    if (size > ctx->storage_size || ctx->storage == NULL) {
+	free (ctx->storage);
+	ctx->storage_size = 0;
+	block = malloc (size + TSAI_DATA_ALIGNMENT);
+	if ((ctx->storage = block) == NULL) {
+	    pytsai_raise (&ctx->err, "tsai_context_reserve: out of memory");
+	    return 0;
+	}
+	ctx->storage_size = size;
+    }
+
+    block = ctx->storage;
+    base = (double *) (block + (TSAI_DATA_ALIGNMENT -
+				(size_t) block % TSAI_DATA_ALIGNMENT) % TSAI_DATA_ALIGNMENT);
+
+    ctx->Xd = base;
+    ctx->Yd = base + stride;
+    ctx->r_squared = base + 2 * stride;
+    if (narrays > WORK_ARRAYS) {
+	ctx->cd.xw = base + 3 * stride;
+	ctx->cd.yw = base + 4 * stride;
+	ctx->cd.zw = base + 5 * stride;
+	ctx->cd.Xf = base + 6 * stride;
+	ctx->cd.Yf = base + 7 * stride;
+    }
+
+    ctx->arena = base + narrays * stride;
+    ctx->arena_size = arena_doubles (ctx, stride);
+    ctx->arena_used = 0;
+
+    ctx->cd.point_count = point_count;
+    return 1;
+}
+
+
+/* pytsai: can fail: need int return type. */
+int tsai_context_reserve (struct tsai_context *ctx, int point_count)
+{
+    return reserve_storage (ctx, point_count, WORK_ARRAYS + DATA_ARRAYS);
+}
+
+
+/* pytsai: can fail: need int return type. */
+int tsai_context_attach (struct tsai_context *ctx, int point_count,
+			 double *xw, double *yw, double *zw, double *Xf, double *Yf)
+{
+    if (!reserve_storage (ctx, point_count, WORK_ARRAYS))
+	return 0;
+
+    ctx->cd.xw = xw;
+    ctx->cd.yw = yw;
+    ctx->cd.zw = zw;
+    ctx->cd.Xf = Xf;
+    ctx->cd.Yf = Yf;
+    return 1;
+}
+
+
+/* pytsai: cannot fail; void return type is fine. */
+void tsai_context_release (struct tsai_context *ctx)
+{
+    free (ctx->storage);
+    ctx->storage = NULL;
+    ctx->storage_size = 0;
+    ctx->cd.point_count = 0;
+    ctx->cd.xw = ctx->cd.yw = ctx->cd.zw = NULL;
+    ctx->cd.Xf = ctx->cd.Yf = NULL;
+    ctx->Xd = ctx->Yd = ctx->r_squared = NULL;
+    ctx->arena = NULL;
+    ctx->arena_size = ctx->arena_used = 0;
+}
+
+
+/* pytsai: can fail; returns NULL.
+ *
+ * Takes count doubles from the context's arena, rounded up to a whole line so
+ * that the next piece stays aligned. */
+double *tsai_arena_alloc (struct tsai_context *ctx, size_t count)
+{
+    double   *piece;
+
+    count = WHOLE_LINES (count);
+    if (count > ctx->arena_size - ctx->arena_used) {
+	pytsai_raise (&ctx->err, "tsai_arena_alloc: workspace arena exhausted");
+	return NULL;
+    }
+
+    piece = ctx->arena + ctx->arena_used;
+    ctx->arena_used += count;
+    return piece;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Returns every piece taken since arena_used was mark. */
+void tsai_arena_release (struct tsai_context *ctx, size_t mark)
+{
+    ctx->arena_used = mark;
+}
+
+#undef WORK_ARRAYS
+#undef DATA_ARRAYS
+#undef ARENA_ARRAYS
+#undef STREAMED_ARRAYS
+#undef DOUBLES_PER_LINE
+#undef WHOLE_LINES
+
+
 /***********************************************************************\
 * This routine solves for the roll, pitch and yaw angles (in radians)	*
 * for a given orthonormal rotation matrix (from Richard P. Paul,        *
@@ -380,15 +555,15 @@ void      initialize_xapshot_matrox_parms ()
 * Ry and Rx are calculated.                                             *
 \***********************************************************************/
 /* pytsai: cannot fail; void return type is fine. */
-void solve_RPY_transform (TSAI_ARGS_DECL)
+void solve_RPY_transform (struct tsai_context *ctx)
 {
     double    sg,
               cg;
 
-    tsai_cc.Rz = atan2 (tsai_cc.r4, tsai_cc.r1);
-    SINCOS (tsai_cc.Rz, sg, cg);
-    tsai_cc.Ry = atan2 (-tsai_cc.r7, tsai_cc.r1 * cg + tsai_cc.r4 * sg);
-    tsai_cc.Rx = atan2 (tsai_cc.r3 * sg - tsai_cc.r6 * cg, tsai_cc.r5 * cg - tsai_cc.r2 * sg);
+    ctx->cc.Rz = atan2 (ctx->cc.r4, ctx->cc.r1);
+    SINCOS (ctx->cc.Rz, sg, cg);
+    ctx->cc.Ry = atan2 (-ctx->cc.r7, ctx->cc.r1 * cg + ctx->cc.r4 * sg);
+    ctx->cc.Rx = atan2 (ctx->cc.r3 * sg - ctx->cc.r6 * cg, ctx->cc.r5 * cg - ctx->cc.r2 * sg);
 }
 
 
@@ -397,7 +572,7 @@ void solve_RPY_transform (TSAI_ARGS_DECL)
 * the rotation matrix elements r1-r9.					*
 \***********************************************************************/
 /* pytsai: cannot fail; void return type is fine. */
-void apply_RPY_transform (TSAI_ARGS_DECL)
+void apply_RPY_transform (struct tsai_context *ctx)
 {
     double    sa,
               ca,
@@ -406,19 +581,19 @@ void apply_RPY_transform (TSAI_ARGS_DECL)
               sg,
               cg;
 
-    SINCOS (tsai_cc.Rx, sa, ca);
-    SINCOS (tsai_cc.Ry, sb, cb);
-    SINCOS (tsai_cc.Rz, sg, cg);
-
-    tsai_cc.r1 = cb * cg;
-    tsai_cc.r2 = cg * sa * sb - ca * sg;
-    tsai_cc.r3 = sa * sg + ca * cg * sb;
-    tsai_cc.r4 = cb * sg;
-    tsai_cc.r5 = sa * sb * sg + ca * cg;
-    tsai_cc.r6 = ca * sb * sg - cg * sa;
-    tsai_cc.r7 = -sb;
-    tsai_cc.r8 = cb * sa;
-    tsai_cc.r9 = ca * cb;
+    SINCOS (ctx->cc.Rx, sa, ca);
+    SINCOS (ctx->cc.Ry, sb, cb);
+    SINCOS (ctx->cc.Rz, sg, cg);
+
+    ctx->cc.r1 = cb * cg;
+    ctx->cc.r2 = cg * sa * sb - ca * sg;
+    ctx->cc.r3 = sa * sg + ca * cg * sb;
+    ctx->cc.r4 = cb * sg;
+    ctx->cc.r5 = sa * sb * sg + ca * cg;
+    ctx->cc.r6 = ca * sb * sg - cg * sa;
+    ctx->cc.r7 = -sb;
+    ctx->cc.r8 = cb * sa;
+    ctx->cc.r9 = ca * cb;
 }
 
 
@@ -426,84 +601,104 @@ void apply_RPY_transform (TSAI_ARGS_DECL)
 * Routines for coplanar camera calibration	 			*
 \***********************************************************************/
 /* pytsai: cannot fail; void return type is fine. */
-void cc_compute_Xd_Yd_and_r_squared ()
+void cc_compute_Xd_Yd_and_r_squared (struct tsai_context *ctx)
 {
     int       i;
 
     double    Xd_,
               Yd_;
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	Xd[i] = Xd_ = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;	/* [mm] */
-	Yd[i] = Yd_ = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);	        /* [mm] */
-	r_squared[i] = SQR (Xd_) + SQR (Yd_);                   /* [mm^2] */
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	ctx->Xd[i] = Xd_ = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;	/* [mm] */
+	ctx->Yd[i] = Yd_ = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);	        /* [mm] */
+	ctx->r_squared[i] = SQR (Xd_) + SQR (Yd_);                   /* [mm^2] */
     }
 }
 
 
 /* pytsai: can fail: need int return type. */
-int cc_compute_U ()
+int cc_compute_U (struct tsai_context *ctx)
 {
     int       i;
 
-    dmat      M,
-              a,
-              b;
+    lsqsys    sys;
 
-    M = newdmat (0, (tsai_cd.point_count - 1), 0, 4, &errno);
-    if (errno) {
-	pytsai_raise ("cc compute U: unable to allocate matrix M");
-        return 0;
-    }
+    double    row[5],
+              a[5];
 
-    a = newdmat (0, 4, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise ("cc compute U: unable to allocate vector a");
-	return 0;
-    }
+    if (ctx->ransac_threshold > 0 && ctx->cd.point_count > 5)
+	return ransac_compute_U (ctx, 5);
 
-    b = newdmat (0, (tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise ("cc compute U: unable to allocate vector b");
-	return 0;
-    }
+    lsq_init (&sys, 5);
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	M.el[i][0] = Yd[i] * tsai_cd.xw[i];
-	M.el[i][1] = Yd[i] * tsai_cd.yw[i];
-	M.el[i][2] = Yd[i];
-	M.el[i][3] = -Xd[i] * tsai_cd.xw[i];
-	M.el[i][4] = -Xd[i] * tsai_cd.yw[i];
-	b.el[i][0] = Xd[i];
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	row[0] = ctx->Yd[i] * ctx->cd.xw[i];
+	row[1] = ctx->Yd[i] * ctx->cd.yw[i];
+	row[2] = ctx->Yd[i];
+	row[3] = -ctx->Xd[i] * ctx->cd.xw[i];
+	row[4] = -ctx->Xd[i] * ctx->cd.yw[i];
+	lsq_add_row (&sys, row, ctx->Xd[i]);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise ("cc compute U: unable to solve system  Ma=b");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise (&ctx->err, "cc compute U: unable to solve system  Ma=b");
 	return 0;
     }
 
-    U[0] = a.el[0][0];
-    U[1] = a.el[1][0];
-    U[2] = a.el[2][0];
-    U[3] = a.el[3][0];
-    U[4] = a.el[4][0];
-
-    freemat (M);
-    freemat (a);
-    freemat (b);
+    ctx->U[0] = a[0];
+    ctx->U[1] = a[1];
+    ctx->U[2] = a[2];
+    ctx->U[3] = a[3];
+    ctx->U[4] = a[4];
 
     return 1;
 }
 
 
+/* pytsai: cannot fail.
+ * The sign of Ty for a robust fit of U (ctx->outlier set), where the far
+ * point may be an outlier: whichever of Ty and -Ty most of the inliers
+ * agree with, given the rotation and Tx computed from U for Ty.  Flags the
+ * inliers that disagree, which lie on their radial lines but on the wrong
+ * side of the image center, as outliers too. */
+double vote_Ty_sign (struct tsai_context *ctx, double r1, double r2,
+		     double r3, double r4, double r5, double r6,
+		     double Tx, double Ty)
+{
+    int       i,
+              votes = 0;
+
+    double    x,
+              y,
+              sign;
+
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if (!ctx->outlier[i]) {
+	    x = r1 * ctx->cd.xw[i] + r2 * ctx->cd.yw[i] + r3 * ctx->cd.zw[i] + Tx;
+	    y = r4 * ctx->cd.xw[i] + r5 * ctx->cd.yw[i] + r6 * ctx->cd.zw[i] + Ty;
+	    if ((SIGNBIT (x) == SIGNBIT (ctx->Xd[i])) &&
+		(SIGNBIT (y) == SIGNBIT (ctx->Yd[i])))
+		votes++;
+	    else
+		votes--;
+	}
+    sign = votes < 0 ? -1.0 : 1.0;
+
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if (!ctx->outlier[i]) {
+	    x = sign * (r1 * ctx->cd.xw[i] + r2 * ctx->cd.yw[i] + r3 * ctx->cd.zw[i] + Tx);
+	    y = sign * (r4 * ctx->cd.xw[i] + r5 * ctx->cd.yw[i] + r6 * ctx->cd.zw[i] + Ty);
+	    if ((SIGNBIT (x) != SIGNBIT (ctx->Xd[i])) ||
+		(SIGNBIT (y) != SIGNBIT (ctx->Yd[i])))
+		ctx->outlier[i] = 1;
+	}
+
+    return sign * Ty;
+}
+
+
 /* pytsai: cannot fail; void return type is fine. */
-void cc_compute_Tx_and_Ty ()
+void cc_compute_Tx_and_Ty (struct tsai_context *ctx)
 {
     int       i,
               far_point;
@@ -525,10 +720,10 @@ void cc_compute_Tx_and_Ty ()
               distance,
               far_distance;
 
-    r1p = U[0];
-    r2p = U[1];
-    r4p = U[3];
-    r5p = U[4];
+    r1p = ctx->U[0];
+    r2p = ctx->U[1];
+    r4p = ctx->U[3];
+    r5p = ctx->U[4];
 
     /* first find the square of the magnitude of Ty */
     if ((fabs (r1p) < EPSILON) && (fabs (r2p) < EPSILON))
@@ -548,8 +743,8 @@ void cc_compute_Tx_and_Ty ()
     /* find a point that is far from the image center */
     far_distance = 0;
     far_point = 0;
-    for (i = 0; i < tsai_cd.point_count; i++)
-	if ((distance = r_squared[i]) > far_distance) {
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if ((distance = ctx->r_squared[i]) > far_distance) {
 	    far_point = i;
 	    far_distance = distance;
 	}
@@ -557,27 +752,29 @@ void cc_compute_Tx_and_Ty ()
     /* now find the sign for Ty */
     /* start by assuming Ty > 0 */
     Ty = sqrt (Ty_squared);
-    r1 = U[0] * Ty;
-    r2 = U[1] * Ty;
-    Tx = U[2] * Ty;
-    r4 = U[3] * Ty;
-    r5 = U[4] * Ty;
-    x = r1 * tsai_cd.xw[far_point] + r2 * tsai_cd.yw[far_point] + Tx;
-    y = r4 * tsai_cd.xw[far_point] + r5 * tsai_cd.yw[far_point] + Ty;
+    r1 = ctx->U[0] * Ty;
+    r2 = ctx->U[1] * Ty;
+    Tx = ctx->U[2] * Ty;
+    r4 = ctx->U[3] * Ty;
+    r5 = ctx->U[4] * Ty;
+    x = r1 * ctx->cd.xw[far_point] + r2 * ctx->cd.yw[far_point] + Tx;
+    y = r4 * ctx->cd.xw[far_point] + r5 * ctx->cd.yw[far_point] + Ty;
 
     /* flip Ty if we guessed wrong */
-    if ((SIGNBIT (x) != SIGNBIT (Xd[far_point])) ||
-	(SIGNBIT (y) != SIGNBIT (Yd[far_point])))
+    if (ctx->outlier != NULL)
+	Ty = vote_Ty_sign (ctx, r1, r2, 0.0, r4, r5, 0.0, Tx, Ty);
+    else if ((SIGNBIT (x) != SIGNBIT (ctx->Xd[far_point])) ||
+	(SIGNBIT (y) != SIGNBIT (ctx->Yd[far_point])))
 	Ty = -Ty;
 
     /* update the calibration constants */
-    tsai_cc.Tx = U[2] * Ty;
-    tsai_cc.Ty = Ty;
+    ctx->cc.Tx = ctx->U[2] * Ty;
+    ctx->cc.Ty = Ty;
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void cc_compute_R ()
+void cc_compute_R (struct tsai_context *ctx)
 {
     double    r1,
               r2,
@@ -589,12 +786,12 @@ void cc_compute_R ()
               r8,
               r9;
 
-    r1 = U[0] * tsai_cc.Ty;
-    r2 = U[1] * tsai_cc.Ty;
+    r1 = ctx->U[0] * ctx->cc.Ty;
+    r2 = ctx->U[1] * ctx->cc.Ty;
     r3 = sqrt (1 - SQR (r1) - SQR (r2));
 
-    r4 = U[3] * tsai_cc.Ty;
-    r5 = U[4] * tsai_cc.Ty;
+    r4 = ctx->U[3] * ctx->cc.Ty;
+    r5 = ctx->U[4] * ctx->cc.Ty;
     r6 = sqrt (1 - SQR (r4) - SQR (r5));
     if (!SIGNBIT (r1 * r4 + r2 * r5))
 	r6 = -r6;
@@ -605,186 +802,130 @@ void cc_compute_R ()
     r9 = r1 * r5 - r2 * r4;
 
     /* update the calibration constants */
-    tsai_cc.r1 = r1;
-    tsai_cc.r2 = r2;
-    tsai_cc.r3 = r3;
-    tsai_cc.r4 = r4;
-    tsai_cc.r5 = r5;
-    tsai_cc.r6 = r6;
-    tsai_cc.r7 = r7;
-    tsai_cc.r8 = r8;
-    tsai_cc.r9 = r9;
-
-    /* fill in tsai_cc.Rx, tsai_cc.Ry and tsai_cc.Rz */
-    solve_RPY_transform ();
+    ctx->cc.r1 = r1;
+    ctx->cc.r2 = r2;
+    ctx->cc.r3 = r3;
+    ctx->cc.r4 = r4;
+    ctx->cc.r5 = r5;
+    ctx->cc.r6 = r6;
+    ctx->cc.r7 = r7;
+    ctx->cc.r8 = r8;
+    ctx->cc.r9 = r9;
+
+    /* fill in ctx->cc.Rx, ctx->cc.Ry and ctx->cc.Rz */
+    solve_RPY_transform (ctx);
 }
 
  
 /* pytsai: can fail; need int return type */
-int cc_compute_approximate_f_and_Tz ()
+int cc_compute_approximate_f_and_Tz (struct tsai_context *ctx)
 {
     int       i;
 
-    dmat      M,
-              a,
-              b;
-
-    M = newdmat (0, (tsai_cd.point_count - 1), 0, 1, &errno);
-    if (errno) {
-	pytsai_raise ("cc compute apx: unable to allocate matrix M");
-	return 0;
-    }
+    lsqsys    sys;
 
-    a = newdmat (0, 1, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise ("cc compute apx: unable to allocate vector a");
-	return 0;
-    }
+    double    row[2],
+              a[2];
 
-    b = newdmat (0, (tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise ("cc compute apx: unable to allocate vector b");
-	return 0;
-    }
+    lsq_init (&sys, 2);
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	M.el[i][0] = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.Ty;
-	M.el[i][1] = -Yd[i];
-	b.el[i][0] = (tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i]) * Yd[i];
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	if (ctx->outlier != NULL && ctx->outlier[i])
+	    continue;
+	row[0] = ctx->cc.r4 * ctx->cd.xw[i] + ctx->cc.r5 * ctx->cd.yw[i] + ctx->cc.Ty;
+	row[1] = -ctx->Yd[i];
+	lsq_add_row (&sys, row, (ctx->cc.r7 * ctx->cd.xw[i] + ctx->cc.r8 * ctx->cd.yw[i]) * ctx->Yd[i]);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise ("cc compute apx: unable to solve system  Ma=b");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise (&ctx->err, "cc compute apx: unable to solve system  Ma=b");
 	return 0;
     }
 
     /* update the calibration constants */
-    tsai_cc.f = a.el[0][0];
-    tsai_cc.Tz = a.el[1][0];
-    tsai_cc.kappa1 = 0.0;  /* this is the assumption that our calculation was 
+    ctx->cc.f = a[0];
+    ctx->cc.Tz = a[1];
+    ctx->cc.kappa1 = 0.0;  /* this is the assumption that our calculation was 
                        * made under */
 
-    freemat (M);
-    freemat (a);
-    freemat (b);
 
     return 1;
 }
 
 
 /************************************************************************/
-/* pytsai: cannot fail; void return type is fine. */
+/* pytsai: cannot fail; void return type is fine.  Called by lmder_ to fill
+ * err (*iflag == 1) or its Jacobian fjac (*iflag == 2), or by lmstr_ to fold
+ * the Jacobian into fjac instead (see TSAI_LM). */
 void cc_compute_exact_f_and_Tz_error (
         integer *m_ptr,         /* pointer to number of points to fit */
         integer *n_ptr,         /* pointer to number of parameters */
         doublereal *params,     /* vector of parameters */
-        doublereal *err         /* vector of error from data */
+        doublereal *err,        /* vector of error from data */
+        doublereal *fjac,       /* Jacobian of err (column-major) */
+        integer *ldfjac,        /* pointer to leading dimension of fjac */
+        integer *iflag,         /* flag to indicate error to caller */
+        void *data              /* calibration context */
 )
 {
-    int       i;
-
-    double    f,
-              Tz,
-              kappa1,
-              xc,
-              yc,
-              zc,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor;
-
-    f = params[0];
-    Tz = params[1];
-    kappa1 = params[2];
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	/* Note: zw is implicitly assumed to be zero for these (coplanar) 
-	 * calculations */
-	xc = tsai_cc.r1 * tsai_cd.xw[i] + tsai_cc.r2 * tsai_cd.yw[i] + tsai_cc.Tx;
-	yc = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.Ty;
-	zc = tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i] + Tz;
-
-	/* convert from camera coordinates to undistorted sensor coordinates */
-	Xu_1 = f * xc / zc;
-	Yu_1 = f * yc / zc;
+    struct tsai_context *ctx = (struct tsai_context *) data;
 
-	/* convert from distorted sensor coordinates to undistorted sensor 
-	 * coordinates */
-	distortion_factor = 1 + kappa1 * (SQR (Xd[i]) + SQR (Yd[i]));
-	Xu_2 = Xd[i] * distortion_factor;
-	Yu_2 = Yd[i] * distortion_factor;
+    static int column[TSAI_ERROR_PARAMETERS] = { -1, -1, -1, -1, -1, 1, 2, 0, -1, -1, -1 };
 
-        /* record the error in the undistorted sensor coordinates */
-        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
-    }
+    if (*iflag == 2)
+	undistorted_sensor_error_jacobian (ctx, params, column, ctx->Xd, ctx->Yd, err, fjac, (int) *ldfjac);
+    else
+	undistorted_sensor_error (ctx, params, column, ctx->Xd, ctx->Yd, err);
 }
 
 
 /* pytsai: can fail; need int return type */
-int cc_compute_exact_f_and_Tz ()
+int cc_compute_exact_f_and_Tz (struct tsai_context *ctx)
 {
 #define NPARAMS 3
 
     int       i;
 
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
 
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
-
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
-
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
-
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    size_t      mark = ctx->arena_used;
+
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration constants as an initial guess */
-    x[0] = tsai_cc.f;
-    x[1] = tsai_cc.Tz;
-    x[2] = tsai_cc.kappa1;
+    x[0] = ctx->cc.f;
+    x[1] = ctx->cc.Tz;
+    x[2] = ctx->cc.kappa1;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -793,24 +934,25 @@ int cc_compute_exact_f_and_Tz ()
     }
 
     /* perform the optimization */ 
-    lmdif_ (cc_compute_exact_f_and_Tz_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
+    TSAI_LM (ctx) (cc_compute_exact_f_and_Tz_error,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, ctx);
+    ctx->nfev += nfev;
+    ctx->njev += njev;
+    ctx->lm_info = info;
 
     /* update the calibration constants */
-    tsai_cc.f = x[0];
-    tsai_cc.Tz = x[1];
-    tsai_cc.kappa1 = x[2];
+    ctx->cc.f = x[0];
+    ctx->cc.Tz = x[1];
+    ctx->cc.kappa1 = x[2];
 
     /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+    fprintf(stderr,"info: %d nfev: %d njev: %d\n\n",info,nfev,njev);
 #endif
 
     return 1;
@@ -820,354 +962,809 @@ int cc_compute_exact_f_and_Tz ()
 
 
 /************************************************************************/
-/* pytsai: can fail; int return type is required. */
-int cc_three_parm_optimization ()
+/* pytsai: can fail; int return type is required.
+ * The steps of cc_three_parm_optimization, which may leave ctx->outlier
+ * set and drawn from the arena. */
+static int cc_three_parm_steps (struct tsai_context *ctx)
 {
-    int       i;
-
-    for (i = 0; i < tsai_cd.point_count; i++)
-	if (tsai_cd.zw[i]) {
-	    pytsai_raise("error - coplanar calibration tried with data outside of Z plane");
-	    return 0;
-	}
+    cc_compute_Xd_Yd_and_r_squared (ctx);
 
-    cc_compute_Xd_Yd_and_r_squared ();
-
-    if (!cc_compute_U())
+    if (!cc_compute_U(ctx))
         return 0;
 
-    cc_compute_Tx_and_Ty ();
+    cc_compute_Tx_and_Ty (ctx);
 
-    cc_compute_R ();
+    cc_compute_R (ctx);
 
-    if (!cc_compute_approximate_f_and_Tz())
+    if (!cc_compute_approximate_f_and_Tz(ctx))
         return 0;
 
-    if (tsai_cc.f < 0) {
+    if (ctx->cc.f < 0) {
         /* try the other solution for the orthonormal matrix */
-	tsai_cc.r3 = -tsai_cc.r3;
-	tsai_cc.r6 = -tsai_cc.r6;
-	tsai_cc.r7 = -tsai_cc.r7;
-	tsai_cc.r8 = -tsai_cc.r8;
-	solve_RPY_transform ();
+	ctx->cc.r3 = -ctx->cc.r3;
+	ctx->cc.r6 = -ctx->cc.r6;
+	ctx->cc.r7 = -ctx->cc.r7;
+	ctx->cc.r8 = -ctx->cc.r8;
+	solve_RPY_transform (ctx);
 
-	if (!cc_compute_approximate_f_and_Tz())
+	if (!cc_compute_approximate_f_and_Tz(ctx))
                 return 0;
 
-	if (tsai_cc.f < 0) {
-	    pytsai_raise("error - possible handedness problem with data");
+	if (ctx->cc.f < 0) {
+	    pytsai_raise(&ctx->err, "error - possible handedness problem with data");
 	    return 0;
 	}
     }
 
-    if (!cc_compute_exact_f_and_Tz())
+    if (!cc_compute_exact_f_and_Tz(ctx))
         return 0;
 
     return 1;
 }
 
 
+/* pytsai: can fail; int return type is required. */
+int cc_three_parm_optimization (struct tsai_context *ctx)
+{
+    int       i,
+              ok;
+
+    size_t    mark = ctx->arena_used;
+
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if (ctx->cd.zw[i]) {
+	    pytsai_raise(&ctx->err, "error - coplanar calibration tried with data outside of Z plane");
+	    return 0;
+	}
+
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, cc_three_parm_optimization, 0);
+
+    ok = cc_three_parm_steps (ctx);
+
+    /* forget the outliers of a robust fit of U */
+    ctx->outlier = NULL;
+    tsai_arena_release (ctx, mark);
+
+    return ok;
+}
+
+
 /************************************************************************/
 /* pytsai: cannot fail; void return type is fine. */
-void cc_remove_sensor_plane_distortion_from_Xd_and_Yd ()
+void cc_remove_sensor_plane_distortion_from_Xd_and_Yd (struct tsai_context *ctx)
 {
     int       i;
     double    Xu,
               Yu;
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	distorted_to_undistorted_sensor_coord (Xd[i], Yd[i], &Xu, &Yu);
-	Xd[i] = Xu;
-	Yd[i] = Yu;
-	r_squared[i] = SQR (Xu) + SQR (Yu);
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	distorted_to_undistorted_sensor_coord (ctx, ctx->Xd[i], ctx->Yd[i], &Xu, &Yu);
+	ctx->Xd[i] = Xu;
+	ctx->Yd[i] = Yu;
+	ctx->r_squared[i] = SQR (Xu) + SQR (Yu);
     }
 }
 
 
 /************************************************************************/
-/* pytsai: can fail.  This method is called from within the lmdif_ routine.
- * To indicate failure, set *iflag = -1. */
-void cc_five_parm_optimization_with_late_distortion_removal_error (m_ptr, n_ptr, params, err, iflag)
-    integer  *m_ptr;		/* pointer to number of points to fit */
-    integer  *n_ptr;		/* pointer to number of parameters */
-    doublereal *params;		/* vector of parameters */
-    doublereal *err;		/* vector of error from data */
-    integer  *iflag;            /* flag to indicate error to caller */
+/* Sums over the calibration points of products of a sensor coordinate
+ * term (1, Xd, Yd, Xd^2, Xd Yd, Yd^2) and a world coordinate term (1, xw,
+ * yw, xw^2, xw yw, yw^2).  Every entry of the normal equations solved by
+ * cc_compute_U and cc_compute_approximate_f_and_Tz is one of these sums,
+ * so the five parameter error functions can rebuild both systems without
+ * allocating anything or running a least squares fit over the points.
+ * Under a robust loss every point's products are weighted, which makes the
+ * fits weighted least squares ones. */
+enum { S_1, S_X, S_Y, S_XX, S_XY, S_YY, SENSOR_TERMS };
+enum { W_1, W_X, W_Y, W_XX, W_XY, W_YY, WORLD_TERMS };
+
+struct cc_moments {
+    double    sum[SENSOR_TERMS][WORLD_TERMS];
+};
+
+
+/* pytsai: cannot fail; void return type is fine. */
+static void cc_accumulate_moments (struct tsai_context *ctx, struct cc_moments *mom)
 {
-    int       i;
+    int       i,
+              s,
+              w;
+
+    double    st[SENSOR_TERMS],
+              wt[WORLD_TERMS];
+
+    for (s = 0; s < SENSOR_TERMS; s++)
+	for (w = 0; w < WORLD_TERMS; w++)
+	    mom->sum[s][w] = 0;
+
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	st[S_1] = 1;
+	st[S_X] = ctx->Xd[i];
+	st[S_Y] = ctx->Yd[i];
+	st[S_XX] = ctx->Xd[i] * ctx->Xd[i];
+	st[S_XY] = ctx->Xd[i] * ctx->Yd[i];
+	st[S_YY] = ctx->Yd[i] * ctx->Yd[i];
+
+	wt[W_1] = 1;
+	wt[W_X] = ctx->cd.xw[i];
+	wt[W_Y] = ctx->cd.yw[i];
+	wt[W_XX] = ctx->cd.xw[i] * ctx->cd.xw[i];
+	wt[W_XY] = ctx->cd.xw[i] * ctx->cd.yw[i];
+	wt[W_YY] = ctx->cd.yw[i] * ctx->cd.yw[i];
+
+	/* a robust loss weighs the point (see cal_robust.c) */
+	if (ctx->weight != NULL)
+	    for (w = 0; w < WORLD_TERMS; w++)
+		wt[w] *= SQR (ctx->weight[i]);
+
+	for (s = 0; s < SENSOR_TERMS; s++)
+	    for (w = 0; w < WORLD_TERMS; w++)
+		mom->sum[s][w] += st[s] * wt[w];
+    }
+}
 
-    double    f,
-              Tz,
-              kappa1,
-              xc,
-              yc,
-              zc,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor;
 
-    /* in this routine radial lens distortion is only taken into account */
-    /* after the rotation and translation constants have been determined */
+/* pytsai: cannot fail; void return type is fine.
+ * Moments of the sensor coordinates Xd - dx, Yd - dy, from those of Xd, Yd.
+ * A shift of the image center (Cx, Cy) shifts every point's Xd and Yd by
+ * the same amount, so this replaces a pass over the points. */
+static void cc_shift_moments (struct cc_moments *from, double dx, double dy, struct cc_moments *to)
+{
+    int       w;
 
-    f = params[0];
-    Tz = params[1];
-    kappa1 = params[2];
+    for (w = 0; w < WORLD_TERMS; w++) {
+	double    s1 = from->sum[S_1][w],
+	          sX = from->sum[S_X][w],
+	          sY = from->sum[S_Y][w];
 
-    tsai_cp.Cx = params[3];
-    tsai_cp.Cy = params[4];
+	to->sum[S_1][w] = s1;
+	to->sum[S_X][w] = sX - dx * s1;
+	to->sum[S_Y][w] = sY - dy * s1;
+	to->sum[S_XX][w] = from->sum[S_XX][w] - 2 * dx * sX + dx * dx * s1;
+	to->sum[S_XY][w] = from->sum[S_XY][w] - dy * sX - dx * sY + dx * dy * s1;
+	to->sum[S_YY][w] = from->sum[S_YY][w] - 2 * dy * sY + dy * dy * s1;
+    }
+}
 
-    cc_compute_Xd_Yd_and_r_squared ();
 
-    if (!cc_compute_U())
-    {
-        *iflag = -1;
-        return;
+/* pytsai: can fail: need int return type.
+ * cc_compute_U, with the normal equations built from the moments. */
+static int cc_compute_U_from_moments (struct tsai_context *ctx, struct cc_moments *mom)
+{
+    /* column j of cc_compute_U's M is sign[j] * sensor[j] * world[j], and
+     * its right hand side is Xd */
+    static const int sensor[5] = { S_Y, S_Y, S_Y, S_X, S_X },
+                     world[5] = { W_X, W_Y, W_1, W_X, W_Y },
+                     sign[5] = { 1, 1, 1, -1, -1 };
+
+    /* products of the sensor and of the world terms */
+    static const int sensor_product[3][3] = {
+	{ S_1, S_X, S_Y }, { S_X, S_XX, S_XY }, { S_Y, S_XY, S_YY } };
+    static const int world_product[3][3] = {
+	{ W_1, W_X, W_Y }, { W_X, W_XX, W_XY }, { W_Y, W_XY, W_YY } };
+
+    double    MtM[5 * 5],
+              Mtb[5];
+
+    int       j,
+              k;
+
+    for (j = 0; j < 5; j++) {
+	for (k = 0; k <= j; k++)
+	    MtM[j * 5 + k] = sign[j] * sign[k] *
+		mom->sum[sensor_product[sensor[j]][sensor[k]]]
+		        [world_product[world[j]][world[k]]];
+	Mtb[j] = sign[j] * mom->sum[sensor_product[sensor[j]][S_X]][world[j]];
+    }
+
+    if (solve_normal_equations (MtM, Mtb, 5)) {
+	pytsai_raise (&ctx->err, "cc compute U: unable to solve system  Ma=b");
+	return 0;
     }
 
-    cc_compute_Tx_and_Ty ();
+    for (j = 0; j < 5; j++)
+	ctx->U[j] = Mtb[j];
 
-    cc_compute_R ();
+    return 1;
+}
 
-    if (!cc_compute_approximate_f_and_Tz())
-    {
-        *iflag = -1;
-        return;
-    }
 
-    if (tsai_cc.f < 0) {
-        /* try the other solution for the orthonormal matrix */
-	tsai_cc.r3 = -tsai_cc.r3;
-	tsai_cc.r6 = -tsai_cc.r6;
-	tsai_cc.r7 = -tsai_cc.r7;
-	tsai_cc.r8 = -tsai_cc.r8;
-	solve_RPY_transform ();
-
-        if (!cc_compute_approximate_f_and_Tz())
-        {
-                *iflag = -1;
-                return;
-        }
-
-        if (tsai_cc.f < 0) {
-            pytsai_raise("error - possible handedness problem with data");
-            *iflag = -1;
-            return;
-	}
+/* pytsai: can fail; need int return type
+ * cc_compute_approximate_f_and_Tz, with the normal equations built from
+ * the moments. */
+static int cc_compute_approximate_f_and_Tz_from_moments (struct tsai_context *ctx, struct cc_moments *mom)
+{
+    double    r4 = ctx->cc.r4,
+              r5 = ctx->cc.r5,
+              r7 = ctx->cc.r7,
+              r8 = ctx->cc.r8,
+              Ty = ctx->cc.Ty,
+              MtM[2 * 2],
+              Mtb[2];
+
+    /* the columns of M are r4 xw + r5 yw + Ty and -Yd, and the right hand
+     * side is (r7 xw + r8 yw) Yd */
+    MtM[0] = r4 * r4 * mom->sum[S_1][W_XX] + 2 * r4 * r5 * mom->sum[S_1][W_XY] +
+	     r5 * r5 * mom->sum[S_1][W_YY] + 2 * r4 * Ty * mom->sum[S_1][W_X] +
+	     2 * r5 * Ty * mom->sum[S_1][W_Y] + Ty * Ty * mom->sum[S_1][W_1];
+    MtM[2] = -(r4 * mom->sum[S_Y][W_X] + r5 * mom->sum[S_Y][W_Y] +
+	       Ty * mom->sum[S_Y][W_1]);
+    MtM[3] = mom->sum[S_YY][W_1];
+
+    Mtb[0] = r4 * r7 * mom->sum[S_Y][W_XX] + (r4 * r8 + r5 * r7) * mom->sum[S_Y][W_XY] +
+	     r5 * r8 * mom->sum[S_Y][W_YY] + Ty * r7 * mom->sum[S_Y][W_X] +
+	     Ty * r8 * mom->sum[S_Y][W_Y];
+    Mtb[1] = -(r7 * mom->sum[S_YY][W_X] + r8 * mom->sum[S_YY][W_Y]);
+
+    if (solve_normal_equations (MtM, Mtb, 2)) {
+	pytsai_raise (&ctx->err, "cc compute apx: unable to solve system  Ma=b");
+	return 0;
     }
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	/* Note: zw is implicitly assumed to be zero for these (coplanar) calculations */
-	xc = tsai_cc.r1 * tsai_cd.xw[i] + tsai_cc.r2 * tsai_cd.yw[i] + tsai_cc.Tx;
-	yc = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.Ty;
-	zc = tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i] + Tz;
+    /* update the calibration constants */
+    ctx->cc.f = Mtb[0];
+    ctx->cc.Tz = Mtb[1];
+    ctx->cc.kappa1 = 0.0;  /* this is the assumption that our calculation was 
+                       * made under */
 
-	/* convert from camera coordinates to undistorted sensor coordinates */
-	Xu_1 = f * xc / zc;
-	Yu_1 = f * yc / zc;
+    return 1;
+}
 
-	/* convert from distorted sensor coordinates to undistorted sensor coordinates */
-	distortion_factor = 1 + kappa1 * r_squared[i];
-	Xu_2 = Xd[i] * distortion_factor;
-	Yu_2 = Yd[i] * distortion_factor;
 
-        /* record the error in the undistorted sensor coordinates */
-        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
+/* pytsai: can fail; int return type is required.
+ * The linear part of cc_three_parm_optimization (U, Tx, Ty, R and the
+ * approximate f and Tz), from the moments of the current ctx->Xd and
+ * ctx->Yd. */
+static int cc_linear_parms_from_moments (struct tsai_context *ctx, struct cc_moments *mom)
+{
+    if (!cc_compute_U_from_moments (ctx, mom))
+        return 0;
+
+    cc_compute_Tx_and_Ty (ctx);
+
+    cc_compute_R (ctx);
+
+    if (!cc_compute_approximate_f_and_Tz_from_moments (ctx, mom))
+        return 0;
+
+    if (ctx->cc.f < 0) {
+        /* try the other solution for the orthonormal matrix */
+	ctx->cc.r3 = -ctx->cc.r3;
+	ctx->cc.r6 = -ctx->cc.r6;
+	ctx->cc.r7 = -ctx->cc.r7;
+	ctx->cc.r8 = -ctx->cc.r8;
+	solve_RPY_transform (ctx);
+
+        if (!cc_compute_approximate_f_and_Tz_from_moments (ctx, mom))
+                return 0;
+
+        if (ctx->cc.f < 0) {
+            pytsai_raise(&ctx->err, "error - possible handedness problem with data");
+            return 0;
+	}
     }
 
+    return 1;
 }
 
 
-/* pytsai: can fail; need int return type. */
-int cc_five_parm_optimization_with_late_distortion_removal ()
+/* How a five parameter stage computes its errors.  linear sets the camera
+ * parameters of the context that vary to those in params, with the sensor
+ * coordinates of its points as sensor computes them, and finds the linear
+ * parameters (R, Tx and Ty) for them; errors then takes the errors of the
+ * context's points from those.  error does both, for fdjac2_. */
+struct cc_five_parm_stage {
+    void    (*error) ();
+    int     (*linear) ();
+    void    (*sensor) ();
+    void    (*errors) ();
+};
+
+/* State shared with the error functions of the five parameter stages: for
+ * the late distortion removal, the moments of the sensor coordinates at the
+ * image center the optimization started from; for both, how to compute the
+ * forward-difference Jacobian (see cc_five_parm_error_and_jacobian). */
+#define FIVE_PARMS 5
+
+/* rows of a streamed forward-difference Jacobian computed at a time */
+#define TILE_ROWS 64
+
+struct cc_five_parm_columns;
+
+struct cc_five_parm_data {
+    struct tsai_context *ctx;
+    struct cc_moments moments;
+    double    Cx,
+              Cy;
+
+    const struct cc_five_parm_stage *stage;
+    doublereal *wa;				/* scratch for fdjac2_ */
+    struct cc_five_parm_columns *columns;	/* or the columns on the pool */
+};
+
+/* Workspace for evaluating the columns of the Jacobian on the context's
+ * pool: each column has its own copy of the context, with its own Xd, Yd
+ * and r_squared (in the pool's scratch memory, see cc_five_parm_setup),
+ * since the error functions write them. */
+struct cc_five_parm_columns {
+    struct tsai_context ctx[FIVE_PARMS];
+    struct cc_five_parm_data data[FIVE_PARMS];
+    void     *pcol[FIVE_PARMS];
+    doublereal xwa[FIVE_PARMS * FIVE_PARMS];
+    integer   iwa[FIVE_PARMS];
+};
+
+
+/* pytsai: can fail; int return type is required.
+ * Readies fd for cc_five_parm_error_and_jacobian.  A streamed Jacobian
+ * needs no workspace; otherwise the columns run on the pool if the context
+ * has one and at least min_chunk points, each with working arrays taken
+ * from the pool's scratch memory, or else one after another with scratch
+ * drawn from the context's arena. */
+static int cc_five_parm_setup (struct tsai_context *ctx, struct cc_five_parm_data *fd,
+			       struct cc_five_parm_columns *columns,
+			       const struct cc_five_parm_stage *stage)
 {
-#define NPARAMS 5
+    struct tsai_context *column;
 
-    int       i;
- 
-    /* Parameters needed by MINPACK's lmdif() */
- 
-    integer     m = tsai_cd.point_count;
-    integer     n = NPARAMS;
-    doublereal  x[NPARAMS];
-    doublereal *fvec;
-    doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
-    doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
-    doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
-    doublereal  diag[NPARAMS];
-    integer     mode = MODE;
-    doublereal  factor = FACTOR;
-    integer     nprint = 0;
-    integer     info;
-    integer     nfev;
-    doublereal *fjac;
-    integer     ldfjac = m;
-    integer     ipvt[NPARAMS];
-    doublereal  qtf[NPARAMS];
-    doublereal  wa1[NPARAMS];
-    doublereal  wa2[NPARAMS];
-    doublereal  wa3[NPARAMS];
-    doublereal *wa4;
+    int       j,
+              m = ctx->cd.point_count,
+              min_chunk = ctx->min_chunk > 0 ? ctx->min_chunk : TSAI_MIN_CHUNK;
 
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
- 
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
- 
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    size_t    line = TSAI_DATA_ALIGNMENT / sizeof (double),
+              stride = ((size_t) m + line - 1) / line * line;
+
+    char     *block = NULL;
+
+    double   *base;
+
+    fd->ctx = ctx;
+    fd->stage = stage;
+    fd->wa = NULL;
+    fd->columns = NULL;
+
+    if (ctx->jacobian == TSAI_JACOBIAN_STREAMED)
+	return 1;
+
+    if (ctx->pool != NULL && pool_size (ctx->pool) > 1 && m >= min_chunk)
+	block = pool_scratch (ctx->pool, FIVE_PARMS * 3 * stride * sizeof (double) + TSAI_DATA_ALIGNMENT);
+    if (block == NULL) {
+	fd->wa = tsai_arena_alloc (ctx, m);
+	return fd->wa != NULL;
     }
- 
-    /* use the current calibration constants as an initial guess */
-    x[0] = tsai_cc.f;
-    x[1] = tsai_cc.Tz;
-    x[2] = tsai_cc.kappa1;
-    x[3] = tsai_cp.Cx;
-    x[4] = tsai_cp.Cy;
+    base = (double *) (block + (TSAI_DATA_ALIGNMENT -
+				(size_t) block % TSAI_DATA_ALIGNMENT) % TSAI_DATA_ALIGNMENT);
 
-    /* define optional scale factors for the parameters */
-    if ( mode == 2 ) {
-        for (i = 0; i < NPARAMS; i++)
-            diag[i] = 1.0;             /* some user-defined values */
+    for (j = 0; j < FIVE_PARMS; j++) {
+	column = &columns->ctx[j];
+	*column = *ctx;
+	column->Xd = base + (3 * j) * stride;
+	column->Yd = base + (3 * j + 1) * stride;
+	column->r_squared = base + (3 * j + 2) * stride;
+	column->arena = NULL;
+	column->arena_size = column->arena_used = 0;
+	column->pool = NULL;
+	pytsai_clear (&column->err);
+
+	columns->data[j] = *fd;
+	columns->data[j].ctx = column;
+	columns->pcol[j] = &columns->data[j];
     }
- 
-    /* perform the optimization */
-    lmdif_ (cc_five_parm_optimization_with_late_distortion_removal_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
-    /* check for pytsai error condition */
-    if (info == -1)
-    {
-        free(fvec);
-        free(fjac);
-        free(wa4);
-        return 0;
-    }
-    /* TODO: Check for and translate other error conditions.  See
-     * lmdif.c for possible values of the info parameter. */
- 
-    /* update the calibration and camera constants */
-    tsai_cc.f = x[0];
-    tsai_cc.Tz = x[1];
-    tsai_cc.kappa1 = x[2];
-    tsai_cp.Cx = x[3];
-    tsai_cp.Cy = x[4];
+    fd->columns = columns;
+    return 1;
+}
 
-    /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
 
-#ifdef DEBUG
-    /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
-#endif
- 
-    return 1;
+/************************************************************************/
+/* pytsai: can fail.  Folds the forward-difference Jacobian at params into
+ * the triangle r for lmstr_ (see lmstr.c), without storing it: first the
+ * linear parameters are found for the step of each column, over all the
+ * points, as fdjac2_ takes the steps; then the errors of TILE_ROWS points
+ * at a time are taken at every step, and their rows folded in with the
+ * errors fvec at params.  To indicate failure, set *iflag = -1. */
+static void cc_five_parm_fold_jacobian (struct cc_five_parm_data *fd, int m, doublereal *params,
+					doublereal *fvec, doublereal *r, int ldr, integer *iflag)
+{
+    extern doublereal dpmpar_ ();
 
-#undef NPARAMS
+    const struct cc_five_parm_stage *stage = fd->stage;
+
+    struct tsai_context *ctx = fd->ctx,
+                tile;
+
+    struct camera_parameters cp[FIVE_PARMS];
+
+    struct calibration_constants cc[FIVE_PARMS];
+
+    integer   one = 1;
+
+    int       begin,
+              i,
+              j,
+              k;
+
+    doublereal eps = sqrt (MAX (EPSFCN, dpmpar_ (&one))),
+              h[FIVE_PARMS],
+              step[FIVE_PARMS][FIVE_PARMS],
+              Xd[TILE_ROWS],
+              Yd[TILE_ROWS],
+              r_squared[TILE_ROWS],
+              err[FIVE_PARMS][TILE_ROWS],
+              x[FIVE_PARMS + 1];
+
+    for (j = 0; j < FIVE_PARMS; j++) {
+	for (k = 0; k < FIVE_PARMS; k++)
+	    step[j][k] = params[k];
+	h[j] = eps * fabs (params[j]);
+	if (h[j] == 0.0)
+	    h[j] = eps;
+	step[j][j] = params[j] + h[j];
+
+	if (!stage->linear (fd, step[j])) {
+	    *iflag = -1;
+	    return;
+	}
+	cp[j] = ctx->cp;
+	cc[j] = ctx->cc;
+    }
+
+    tile = *ctx;
+    tile.Xd = Xd;
+    tile.Yd = Yd;
+    tile.r_squared = r_squared;
+    for (begin = 0; begin < m; begin += TILE_ROWS) {
+	tile.cd.point_count = MIN (TILE_ROWS, m - begin);
+	tile.cd.xw = ctx->cd.xw + begin;
+	tile.cd.yw = ctx->cd.yw + begin;
+	tile.cd.zw = ctx->cd.zw + begin;
+	tile.cd.Xf = ctx->cd.Xf + begin;
+	tile.cd.Yf = ctx->cd.Yf + begin;
+	if (ctx->weight != NULL)
+	    tile.weight = ctx->weight + begin;
+
+	for (j = 0; j < FIVE_PARMS; j++) {
+	    tile.cp = cp[j];
+	    tile.cc = cc[j];
+	    stage->sensor (&tile);
+	    stage->errors (&tile, step[j], err[j]);
+	}
+
+	for (i = 0; i < tile.cd.point_count; i++) {
+	    for (j = 0; j < FIVE_PARMS; j++)
+		x[j] = (err[j][i] - fvec[begin + i]) / h[j];
+	    x[FIVE_PARMS] = fvec[begin + i];
+	    fold_row (r, ldr, FIVE_PARMS, x);
+	}
+    }
 }
 
 
 /************************************************************************/
-/* pytsai: can fail.  This method is called from within the lmdif_ routine.
- * To indicate failure, set *iflag = -1. */
-void cc_five_parm_optimization_with_early_distortion_removal_error (m_ptr, n_ptr, params, err, iflag)
+/* pytsai: can fail.  Called by lmder_ (or lmstr_) for the five parameter
+ * stages to fill err (*iflag == 1), or fjac (*iflag == 2) with the
+ * forward-difference approximation lmdif_ would make, one column after
+ * another with fdjac2_ or all at once on the pool with fdjac2_pool_; a
+ * streamed Jacobian is instead folded into fjac with
+ * cc_five_parm_fold_jacobian.  To indicate failure, set *iflag = -1. */
+static void cc_five_parm_error_and_jacobian (m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, data)
     integer  *m_ptr;		/* pointer to number of points to fit */
     integer  *n_ptr;		/* pointer to number of parameters */
     doublereal *params;		/* vector of parameters */
     doublereal *err;		/* vector of error from data */
-    integer  *iflag;            /* flag to indicate error to caller */
+    doublereal *fjac;		/* Jacobian of err, m_ptr by n_ptr */
+    integer  *ldfjac;		/* leading dimension of fjac */
+    integer  *iflag;            /* 1 for err, 2 for fjac; -1 on failure */
+    void     *data;             /* struct cc_five_parm_data */
+{
+    struct cc_five_parm_data *fd = (struct cc_five_parm_data *) data;
+
+    doublereal epsfcn = EPSFCN;
+
+    int       j;
+
+    if (*iflag != 2)
+	fd->stage->error (m_ptr, n_ptr, params, err, iflag, fd);
+    else if (fd->ctx->jacobian == TSAI_JACOBIAN_STREAMED)
+	cc_five_parm_fold_jacobian (fd, *m_ptr, params, err, fjac, *ldfjac, iflag);
+    else if (fd->columns == NULL)
+	fdjac2_ (fd->stage->error, m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, &epsfcn, fd->wa, fd);
+    else {
+	fdjac2_pool_ (fd->stage->error, m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, &epsfcn,
+		      fd->columns->xwa, fd->columns->iwa, fd->columns->pcol, fd->ctx->pool);
+
+	/* pass on the first error raised by a column */
+	for (j = 0; j < FIVE_PARMS; j++)
+	    if (pytsai_haserror (&fd->columns->ctx[j].err)) {
+		pytsai_raise (&fd->ctx->err, fd->columns->ctx[j].err.string);
+		break;
+	    }
+    }
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.  The linear part of the
+ * late distortion removal (see struct cc_five_parm_stage): the linear
+ * parameters come from the moments at the starting image center, shifted
+ * to the new one. */
+static int cc_late_removal_linear_parms (struct cc_five_parm_data *fd, doublereal *params)
+{
+    struct tsai_context *ctx = fd->ctx;
+
+    struct cc_moments mom;
+
+    /* in this routine radial lens distortion is only taken into account */
+    /* after the rotation and translation constants have been determined */
+
+    ctx->cp.Cx = params[3];
+    ctx->cp.Cy = params[4];
+
+    cc_compute_Xd_Yd_and_r_squared (ctx);
+
+    /* the linear parameters for the new image center */
+    cc_shift_moments (&fd->moments,
+                      ctx->cp.dpx * (ctx->cp.Cx - fd->Cx) / ctx->cp.sx,
+                      ctx->cp.dpy * (ctx->cp.Cy - fd->Cy), &mom);
+
+    return cc_linear_parms_from_moments (ctx, &mom);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  The errors of the late
+ * distortion removal, from the sensor coordinates and linear parameters in
+ * ctx. */
+static void cc_late_removal_errors (struct tsai_context *ctx, doublereal *params, doublereal *err)
 {
     int       i;
 
     double    f,
               Tz,
+              kappa1,
               xc,
               yc,
               zc,
               Xu_1,
               Yu_1,
               Xu_2,
-              Yu_2;
-
-    /* in this routine radial lens distortion is taken into account */
-    /* before the rotation and translation constants are determined */
-    /* (this assumes we have the distortion reasonably modelled)    */
+              Yu_2,
+              distortion_factor;
 
     f = params[0];
     Tz = params[1];
+    kappa1 = params[2];
 
-    tsai_cc.kappa1 = params[2];
-    tsai_cp.Cx = params[3];
-    tsai_cp.Cy = params[4];
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	/* convert from world coordinates to camera coordinates */
+	/* Note: zw is implicitly assumed to be zero for these (coplanar) calculations */
+	xc = ctx->cc.r1 * ctx->cd.xw[i] + ctx->cc.r2 * ctx->cd.yw[i] + ctx->cc.Tx;
+	yc = ctx->cc.r4 * ctx->cd.xw[i] + ctx->cc.r5 * ctx->cd.yw[i] + ctx->cc.Ty;
+	zc = ctx->cc.r7 * ctx->cd.xw[i] + ctx->cc.r8 * ctx->cd.yw[i] + Tz;
 
-    cc_compute_Xd_Yd_and_r_squared ();
+	/* convert from camera coordinates to undistorted sensor coordinates */
+	Xu_1 = f * xc / zc;
+	Yu_1 = f * yc / zc;
 
-    /* remove the sensor distortion before computing the translation and rotation stuff */
-    cc_remove_sensor_plane_distortion_from_Xd_and_Yd ();
+	/* convert from distorted sensor coordinates to undistorted sensor coordinates */
+	distortion_factor = 1 + kappa1 * ctx->r_squared[i];
+	Xu_2 = ctx->Xd[i] * distortion_factor;
+	Yu_2 = ctx->Yd[i] * distortion_factor;
 
-    if (!cc_compute_U())
-    {
-        *iflag = -1;
-        return;
+        /* record the error in the undistorted sensor coordinates */
+        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
+        if (ctx->weight != NULL)
+            err[i] *= ctx->weight[i];
     }
+}
 
-    cc_compute_Tx_and_Ty ();
 
-    cc_compute_R ();
+/************************************************************************/
+/* pytsai: can fail.  Called through cc_five_parm_error_and_jacobian, and on
+ * the pool for a column of the Jacobian.  To indicate failure, set
+ * *iflag = -1. */
+void cc_five_parm_optimization_with_late_distortion_removal_error (m_ptr, n_ptr, params, err, iflag, data)
+    integer  *m_ptr;		/* pointer to number of points to fit */
+    integer  *n_ptr;		/* pointer to number of parameters */
+    doublereal *params;		/* vector of parameters */
+    doublereal *err;		/* vector of error from data */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* struct cc_five_parm_data */
+{
+    struct cc_five_parm_data *fd = (struct cc_five_parm_data *) data;
 
-    /* we need to do this just to see if we have to flip the rotation matrix */
-    if (!cc_compute_approximate_f_and_Tz())
+    if (!cc_late_removal_linear_parms (fd, params))
     {
         *iflag = -1;
         return;
     }
 
-    if (tsai_cc.f < 0) {
-        /* try the other solution for the orthonormal matrix */
-	tsai_cc.r3 = -tsai_cc.r3;
-	tsai_cc.r6 = -tsai_cc.r6;
-	tsai_cc.r7 = -tsai_cc.r7;
-	tsai_cc.r8 = -tsai_cc.r8;
-	solve_RPY_transform ();
-
-        if (!cc_compute_approximate_f_and_Tz())
-        {
-                *iflag = -1;
-                return;
-        }
-
-        if (tsai_cc.f < 0) 
-        {
-            pytsai_raise("error - possible handedness problem with data");
-            *iflag = -1;
-            return;
-	}
+    cc_late_removal_errors (fd->ctx, params, err);
+}
+
+
+static const struct cc_five_parm_stage cc_late_removal = {
+    cc_five_parm_optimization_with_late_distortion_removal_error,
+    cc_late_removal_linear_parms,
+    cc_compute_Xd_Yd_and_r_squared,
+    cc_late_removal_errors
+};
+
+
+/* pytsai: can fail; need int return type. */
+int cc_five_parm_optimization_with_late_distortion_removal (struct tsai_context *ctx)
+{
+#define NPARAMS 5
+
+    int       i;
+
+    struct cc_five_parm_data fd;
+ 
+    /* Parameters needed by MINPACK's lmder() */
+ 
+    integer     m = ctx->cd.point_count;
+    integer     n = NPARAMS;
+    doublereal  x[NPARAMS];
+    doublereal *fvec;
+    doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
+    doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
+    doublereal  gtol = ORTHO_TOLERANCE_gtol;
+    integer     maxfev = TSAI_MAXFEV (ctx);
+    doublereal  diag[NPARAMS];
+    integer     mode = MODE;
+    doublereal  factor = FACTOR;
+    integer     nprint = 0;
+    integer     info;
+    integer     nfev;
+    integer     njev;
+    doublereal *fjac;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
+    integer     ipvt[NPARAMS];
+    doublereal  qtf[NPARAMS];
+    doublereal  wa1[NPARAMS];
+    doublereal  wa2[NPARAMS];
+    doublereal  wa3[NPARAMS];
+    doublereal *wa4;
+    size_t      mark = ctx->arena_used;
+
+    struct cc_five_parm_columns columns;
+
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, cc_five_parm_optimization_with_late_distortion_removal, 1);
+
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
+    }
+ 
+    /* use the current calibration constants as an initial guess */
+    x[0] = ctx->cc.f;
+    x[1] = ctx->cc.Tz;
+    x[2] = ctx->cc.kappa1;
+    x[3] = ctx->cp.Cx;
+    x[4] = ctx->cp.Cy;
+
+    /* define optional scale factors for the parameters */
+    if ( mode == 2 ) {
+        for (i = 0; i < NPARAMS; i++)
+            diag[i] = 1.0;             /* some user-defined values */
+    }
+ 
+    /* take the moments at the starting image center */
+    fd.ctx = ctx;
+    fd.Cx = ctx->cp.Cx;
+    fd.Cy = ctx->cp.Cy;
+    cc_compute_Xd_Yd_and_r_squared (ctx);
+    cc_accumulate_moments (ctx, &fd.moments);
+    if (!cc_five_parm_setup (ctx, &fd, &columns, &cc_late_removal)) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
+    /* perform the optimization */
+    TSAI_LM (ctx) (cc_five_parm_error_and_jacobian,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, &fd);
+    ctx->nfev += nfev + n * njev;	/* the differences count, as under lmdif_ */
+    ctx->lm_info = info;
+    /* check for pytsai error condition */
+    if (info == -1)
+    {
+        tsai_arena_release (ctx, mark);
+        return 0;
+    }
+    /* TODO: Check for and translate other error conditions.  See
+     * lmder.c for possible values of the info parameter. */
+ 
+    /* update the calibration and camera constants */
+    ctx->cc.f = x[0];
+    ctx->cc.Tz = x[1];
+    ctx->cc.kappa1 = x[2];
+    ctx->cp.Cx = x[3];
+    ctx->cp.Cy = x[4];
+
+    /* release allocated workspace */
+    tsai_arena_release (ctx, mark);
+
+#ifdef DEBUG
+    /* print the number of function calls during iteration */
+    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+#endif
+ 
+    return 1;
+
+#undef NPARAMS
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.  The sensor coordinates of
+ * the early distortion removal, with the distortion taken out. */
+static void cc_compute_undistorted_Xd_Yd_and_r_squared (struct tsai_context *ctx)
+{
+    cc_compute_Xd_Yd_and_r_squared (ctx);
+    cc_remove_sensor_plane_distortion_from_Xd_and_Yd (ctx);
+}
+
+
+/* pytsai: can fail; int return type is required.  The linear part of the
+ * early distortion removal (see struct cc_five_parm_stage): the linear
+ * parameters come from the moments of the undistorted sensor coordinates. */
+static int cc_early_removal_linear_parms (struct cc_five_parm_data *fd, doublereal *params)
+{
+    struct tsai_context *ctx = fd->ctx;
+
+    struct cc_moments mom;
+
+    /* in this routine radial lens distortion is taken into account */
+    /* before the rotation and translation constants are determined */
+    /* (this assumes we have the distortion reasonably modelled)    */
+
+    ctx->cc.kappa1 = params[2];
+    ctx->cp.Cx = params[3];
+    ctx->cp.Cy = params[4];
+
+    /* remove the sensor distortion before computing the translation and rotation stuff */
+    cc_compute_undistorted_Xd_Yd_and_r_squared (ctx);
+
+    cc_accumulate_moments (ctx, &mom);
+
+    /* we need f and Tz just to see if we have to flip the rotation matrix */
+    return cc_linear_parms_from_moments (ctx, &mom);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  The errors of the early
+ * distortion removal, from the undistorted sensor coordinates and linear
+ * parameters in ctx. */
+static void cc_early_removal_errors (struct tsai_context *ctx, doublereal *params, doublereal *err)
+{
+    int       i;
+
+    double    f,
+              Tz,
+              xc,
+              yc,
+              zc,
+              Xu_1,
+              Yu_1,
+              Xu_2,
+              Yu_2;
+
+    f = params[0];
+    Tz = params[1];
+
     /* now calculate the squared error assuming zero distortion */
-    for (i = 0; i < tsai_cd.point_count; i++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
 	/* convert from world coordinates to camera coordinates */
 	/* Note: zw is implicitly assumed to be zero for these (coplanar) calculations */
-	xc = tsai_cc.r1 * tsai_cd.xw[i] + tsai_cc.r2 * tsai_cd.yw[i] + tsai_cc.Tx;
-	yc = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.Ty;
-	zc = tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i] + Tz;
+	xc = ctx->cc.r1 * ctx->cd.xw[i] + ctx->cc.r2 * ctx->cd.yw[i] + ctx->cc.Tx;
+	yc = ctx->cc.r4 * ctx->cd.xw[i] + ctx->cc.r5 * ctx->cd.yw[i] + ctx->cc.Ty;
+	zc = ctx->cc.r7 * ctx->cd.xw[i] + ctx->cc.r8 * ctx->cd.yw[i] + Tz;
 
 	/* convert from camera coordinates to undistorted sensor coordinates */
 	Xu_1 = f * xc / zc;
@@ -1175,75 +1772,105 @@ void cc_five_parm_optimization_with_early_distortion_removal_error (m_ptr, n_ptr
 
 	/* convert from distorted sensor coordinates to undistorted sensor coordinates  */
 	/* (already done, actually)							 */
-	Xu_2 = Xd[i];
-	Yu_2 = Yd[i];
+	Xu_2 = ctx->Xd[i];
+	Yu_2 = ctx->Yd[i];
 
         /* record the error in the undistorted sensor coordinates */
         err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
+        if (ctx->weight != NULL)
+            err[i] *= ctx->weight[i];
     }
+}
 
-    return;
+
+/************************************************************************/
+/* pytsai: can fail.  Called through cc_five_parm_error_and_jacobian, and on
+ * the pool for a column of the Jacobian.  To indicate failure, set
+ * *iflag = -1. */
+void cc_five_parm_optimization_with_early_distortion_removal_error (m_ptr, n_ptr, params, err, iflag, data)
+    integer  *m_ptr;		/* pointer to number of points to fit */
+    integer  *n_ptr;		/* pointer to number of parameters */
+    doublereal *params;		/* vector of parameters */
+    doublereal *err;		/* vector of error from data */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* struct cc_five_parm_data */
+{
+    struct cc_five_parm_data *fd = (struct cc_five_parm_data *) data;
+
+    if (!cc_early_removal_linear_parms (fd, params))
+    {
+        *iflag = -1;
+        return;
+    }
+
+    cc_early_removal_errors (fd->ctx, params, err);
 }
 
+
+static const struct cc_five_parm_stage cc_early_removal = {
+    cc_five_parm_optimization_with_early_distortion_removal_error,
+    cc_early_removal_linear_parms,
+    cc_compute_undistorted_Xd_Yd_and_r_squared,
+    cc_early_removal_errors
+};
+
  
 /* pytsai: can fail; int return type is required. */
-int cc_five_parm_optimization_with_early_distortion_removal ()
+int cc_five_parm_optimization_with_early_distortion_removal (struct tsai_context *ctx)
 {
 #define NPARAMS 5
 
     int       i;
+
+    struct cc_five_parm_data fd;
  
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
  
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
+    size_t      mark = ctx->arena_used;
 
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
- 
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
- 
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    struct cc_five_parm_columns columns;
+
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, cc_five_parm_optimization_with_early_distortion_removal, 1);
+
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration and camera constants as a starting point */
-    x[0] = tsai_cc.f;
-    x[1] = tsai_cc.Tz;
-    x[2] = tsai_cc.kappa1;
-    x[3] = tsai_cp.Cx;
-    x[4] = tsai_cp.Cy;
+    x[0] = ctx->cc.f;
+    x[1] = ctx->cc.Tz;
+    x[2] = ctx->cc.kappa1;
+    x[3] = ctx->cp.Cx;
+    x[4] = ctx->cp.Cy;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -1251,33 +1878,36 @@ int cc_five_parm_optimization_with_early_distortion_removal ()
             diag[i] = 1.0;             /* some user-defined values */
     }
  
+    if (!cc_five_parm_setup (ctx, &fd, &columns, &cc_early_removal)) {
+        tsai_arena_release (ctx, mark);
+        return 0;
+    }
+
     /* perform the optimization */
-    lmdif_ (cc_five_parm_optimization_with_early_distortion_removal_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
+    TSAI_LM (ctx) (cc_five_parm_error_and_jacobian,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, &fd);
+    ctx->nfev += nfev + n * njev;	/* the differences count, as under lmdif_ */
+    ctx->lm_info = info;
     /* check for pytsai error condition */
     if (info == -1)
     {
-        free(fvec);
-        free(fjac);
-        free(wa4);
+        tsai_arena_release (ctx, mark);
         return 0;
     }
-    /* TODO: Check for other error conditions.  See lmdif.c for possible
+    /* TODO: Check for other error conditions.  See lmder.c for possible
      * values of the info parameter. */
 
     /* update the calibration and camera constants */
-    tsai_cc.f = x[0];
-    tsai_cc.Tz = x[1];
-    tsai_cc.kappa1 = x[2];
-    tsai_cp.Cx = x[3];
-    tsai_cp.Cy = x[4];
+    ctx->cc.f = x[0];
+    ctx->cc.Tz = x[1];
+    ctx->cc.kappa1 = x[2];
+    ctx->cp.Cx = x[3];
+    ctx->cp.Cy = x[4];
 
     /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
@@ -1291,152 +1921,85 @@ int cc_five_parm_optimization_with_early_distortion_removal ()
 
 
 /************************************************************************/
-/* pytsai: cannot fail; void return type is fine. */
-void cc_nic_optimization_error (m_ptr, n_ptr, params, err)
+/* pytsai: cannot fail; void return type is fine.  Called by lmder_ to fill
+ * err (*iflag == 1) or its Jacobian fjac (*iflag == 2), or by lmstr_ to fold
+ * the Jacobian into fjac instead (see TSAI_LM). */
+void cc_nic_optimization_error (m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, data)
     integer  *m_ptr;		/* pointer to number of points to fit */
     integer  *n_ptr;		/* pointer to number of parameters */
     doublereal *params;		/* vector of parameters */
     doublereal *err;		/* vector of error from data */
+    doublereal *fjac;           /* Jacobian of err (column-major) */
+    integer  *ldfjac;           /* pointer to leading dimension of fjac */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* calibration context */
 {
-    int       i;
+    struct tsai_context *ctx = (struct tsai_context *) data;
 
-    double    xc,
-              yc,
-              zc,
-              Xd_,
-              Yd_,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor,
-              Rx,
-              Ry,
-              Rz,
-              Tx,
-              Ty,
-              Tz,
-              kappa1,
-              f,
-              r1,
-              r2,
-              r4,
-              r5,
-              r7,
-              r8,
-              sa,
-              sb,
-              sg,
-              ca,
-              cb,
-              cg;
-
-    Rx = params[0];
-    Ry = params[1];
-    Rz = params[2];
-    Tx = params[3];
-    Ty = params[4];
-    Tz = params[5];
-    kappa1 = params[6];
-    f = params[7];
-
-    SINCOS (Rx, sa, ca);
-    SINCOS (Ry, sb, cb);
-    SINCOS (Rz, sg, cg);
-    r1 = cb * cg;
-    r2 = cg * sa * sb - ca * sg;
-    r4 = cb * sg;
-    r5 = sa * sb * sg + ca * cg;
-    r7 = -sb;
-    r8 = cb * sa;
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	/* Note: zw is implicitly assumed to be zero for these (coplanar) calculations */
-	xc = r1 * tsai_cd.xw[i] + r2 * tsai_cd.yw[i] + Tx;
-	yc = r4 * tsai_cd.xw[i] + r5 * tsai_cd.yw[i] + Ty;
-	zc = r7 * tsai_cd.xw[i] + r8 * tsai_cd.yw[i] + Tz;
-
-	/* convert from camera coordinates to undistorted sensor plane coordinates */
-	Xu_1 = f * xc / zc;
-	Yu_1 = f * yc / zc;
+    static int column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, 6, 7, -1, -1, -1 };
 
-	/* convert from 2D image coordinates to distorted sensor coordinates */
-	Xd_ = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx; 
-	Yd_ = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
-
-	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
-	distortion_factor = 1 + kappa1 * (SQR (Xd_) + SQR (Yd_));
-	Xu_2 = Xd_ * distortion_factor;
-	Yu_2 = Yd_ * distortion_factor;
-
-        /* record the error in the undistorted sensor coordinates */
-        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
-    }
+    if (*iflag == 2)
+	undistorted_sensor_error_jacobian (ctx, params, column, NULL, NULL, err, fjac, (int) *ldfjac);
+    else
+	undistorted_sensor_error (ctx, params, column, NULL, NULL, err);
 }
 
 
 /* pytsai: can fail; int return type is required. */
-int cc_nic_optimization ()
+int cc_nic_optimization (struct tsai_context *ctx)
 {
 #define NPARAMS 8
 
     int       i;
 
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
 
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
+    size_t      mark = ctx->arena_used;
 
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, cc_nic_optimization, 1);
 
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
- 
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration and camera constants as a starting point */
-    x[0] = tsai_cc.Rx;
-    x[1] = tsai_cc.Ry;
-    x[2] = tsai_cc.Rz;
-    x[3] = tsai_cc.Tx;
-    x[4] = tsai_cc.Ty;
-    x[5] = tsai_cc.Tz;
-    x[6] = tsai_cc.kappa1;
-    x[7] = tsai_cc.f;
+    x[0] = ctx->cc.Rx;
+    x[1] = ctx->cc.Ry;
+    x[2] = ctx->cc.Rz;
+    x[3] = ctx->cc.Tx;
+    x[4] = ctx->cc.Ty;
+    x[5] = ctx->cc.Tz;
+    x[6] = ctx->cc.kappa1;
+    x[7] = ctx->cc.f;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -1445,32 +2008,33 @@ int cc_nic_optimization ()
     }
  
     /* perform the optimization */
-    lmdif_ (cc_nic_optimization_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
+    TSAI_LM (ctx) (cc_nic_optimization_error,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, ctx);
+    ctx->nfev += nfev;
+    ctx->njev += njev;
+    ctx->lm_info = info;
     /* TODO: check for error conditions in info. */
 
     /* update the calibration and camera constants */
-    tsai_cc.Rx = x[0];
-    tsai_cc.Ry = x[1];
-    tsai_cc.Rz = x[2];
-    apply_RPY_transform ();
+    ctx->cc.Rx = x[0];
+    ctx->cc.Ry = x[1];
+    ctx->cc.Rz = x[2];
+    apply_RPY_transform (ctx);
 
-    tsai_cc.Tx = x[3];
-    tsai_cc.Ty = x[4];
-    tsai_cc.Tz = x[5];
-    tsai_cc.kappa1 = x[6];
-    tsai_cc.f = x[7];
+    ctx->cc.Tx = x[3];
+    ctx->cc.Ty = x[4];
+    ctx->cc.Tz = x[5];
+    ctx->cc.kappa1 = x[6];
+    ctx->cc.f = x[7];
 
     /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+    fprintf(stderr,"info: %d nfev: %d njev: %d\n\n",info,nfev,njev);
 #endif
 
     return 1;
@@ -1480,158 +2044,87 @@ int cc_nic_optimization ()
 
 
 /************************************************************************/
-/* pytsai: cannot fail; void return type is fine. */
-void cc_full_optimization_error (m_ptr, n_ptr, params, err)
+/* pytsai: cannot fail; void return type is fine.  Called by lmder_ to fill
+ * err (*iflag == 1) or its Jacobian fjac (*iflag == 2), or by lmstr_ to fold
+ * the Jacobian into fjac instead (see TSAI_LM). */
+void cc_full_optimization_error (m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, data)
     integer  *m_ptr;		/* pointer to number of points to fit */
     integer  *n_ptr;		/* pointer to number of parameters */
     doublereal *params;		/* vector of parameters */
     doublereal *err;		/* vector of error from data */
+    doublereal *fjac;           /* Jacobian of err (column-major) */
+    integer  *ldfjac;           /* pointer to leading dimension of fjac */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* calibration context */
 {
-    int       i;
+    struct tsai_context *ctx = (struct tsai_context *) data;
 
-    double    xc,
-              yc,
-              zc,
-              Xd_,
-              Yd_,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor,
-              Rx,
-              Ry,
-              Rz,
-              Tx,
-              Ty,
-              Tz,
-              kappa1,
-              f,
-              Cx,
-              Cy,
-              r1,
-              r2,
-              r4,
-              r5,
-              r7,
-              r8,
-              sa,
-              sb,
-              sg,
-              ca,
-              cb,
-              cg;
-
-    Rx = params[0];
-    Ry = params[1];
-    Rz = params[2];
-    Tx = params[3];
-    Ty = params[4];
-    Tz = params[5];
-    kappa1 = params[6];
-    f = params[7];
-    Cx = params[8];
-    Cy = params[9];
-
-    SINCOS (Rx, sa, ca);
-    SINCOS (Ry, sb, cb);
-    SINCOS (Rz, sg, cg);
-    r1 = cb * cg;
-    r2 = cg * sa * sb - ca * sg;
-    r4 = cb * sg;
-    r5 = sa * sb * sg + ca * cg;
-    r7 = -sb;
-    r8 = cb * sa;
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	/* Note: zw is implicitly assumed to be zero for these (coplanar) calculations */
-	xc = r1 * tsai_cd.xw[i] + r2 * tsai_cd.yw[i] + Tx;
-	yc = r4 * tsai_cd.xw[i] + r5 * tsai_cd.yw[i] + Ty;
-	zc = r7 * tsai_cd.xw[i] + r8 * tsai_cd.yw[i] + Tz;
+    static int column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, 6, 7, -1, 8, 9 };
 
-	/* convert from camera coordinates to undistorted sensor plane coordinates */
-	Xu_1 = f * xc / zc;
-	Yu_1 = f * yc / zc;
-
-	/* convert from 2D image coordinates to distorted sensor coordinates */
-	Xd_ = tsai_cp.dpx * (tsai_cd.Xf[i] - Cx) / tsai_cp.sx; 
-	Yd_ = tsai_cp.dpy * (tsai_cd.Yf[i] - Cy);
-
-	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
-	distortion_factor = 1 + kappa1 * (SQR (Xd_) + SQR (Yd_));
-	Xu_2 = Xd_ * distortion_factor;
-	Yu_2 = Yd_ * distortion_factor;
-
-        /* record the error in the undistorted sensor coordinates */
-        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
-    }
+    if (*iflag == 2)
+	undistorted_sensor_error_jacobian (ctx, params, column, NULL, NULL, err, fjac, (int) *ldfjac);
+    else
+	undistorted_sensor_error (ctx, params, column, NULL, NULL, err);
 }
 
 
 /* pytsai: can fail; int return type is required. */
-int cc_full_optimization ()
+int cc_full_optimization (struct tsai_context *ctx)
 {
 #define NPARAMS 10
 
     int       i;
 
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
 
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
+    size_t      mark = ctx->arena_used;
 
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
-
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, cc_full_optimization, 1);
 
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration and camera constants as a starting point */
-    x[0] = tsai_cc.Rx;
-    x[1] = tsai_cc.Ry;
-    x[2] = tsai_cc.Rz;
-    x[3] = tsai_cc.Tx;
-    x[4] = tsai_cc.Ty;
-    x[5] = tsai_cc.Tz;
-    x[6] = tsai_cc.kappa1;
-    x[7] = tsai_cc.f;
-    x[8] = tsai_cp.Cx;
-    x[9] = tsai_cp.Cy;
+    x[0] = ctx->cc.Rx;
+    x[1] = ctx->cc.Ry;
+    x[2] = ctx->cc.Rz;
+    x[3] = ctx->cc.Tx;
+    x[4] = ctx->cc.Ty;
+    x[5] = ctx->cc.Tz;
+    x[6] = ctx->cc.kappa1;
+    x[7] = ctx->cc.f;
+    x[8] = ctx->cp.Cx;
+    x[9] = ctx->cp.Cy;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -1640,35 +2133,36 @@ int cc_full_optimization ()
     }
 
     /* perform the optimization */
-    lmdif_ (cc_full_optimization_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
-    /* TODO: Check for error conditions (info parameter).  See lmdif.c for
+    TSAI_LM (ctx) (cc_full_optimization_error,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, ctx);
+    ctx->nfev += nfev;
+    ctx->njev += njev;
+    ctx->lm_info = info;
+    /* TODO: Check for error conditions (info parameter).  See lmder.c for
      * possible values. */
 
     /* update the calibration and camera constants */
-    tsai_cc.Rx = x[0];
-    tsai_cc.Ry = x[1];
-    tsai_cc.Rz = x[2];
-    apply_RPY_transform ();
-
-    tsai_cc.Tx = x[3];
-    tsai_cc.Ty = x[4];
-    tsai_cc.Tz = x[5];
-    tsai_cc.kappa1 = x[6];
-    tsai_cc.f = x[7];
-    tsai_cp.Cx = x[8];
-    tsai_cp.Cy = x[9];
+    ctx->cc.Rx = x[0];
+    ctx->cc.Ry = x[1];
+    ctx->cc.Rz = x[2];
+    apply_RPY_transform (ctx);
+
+    ctx->cc.Tx = x[3];
+    ctx->cc.Ty = x[4];
+    ctx->cc.Tz = x[5];
+    ctx->cc.kappa1 = x[6];
+    ctx->cc.f = x[7];
+    ctx->cp.Cx = x[8];
+    ctx->cp.Cy = x[9];
 
     /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+    fprintf(stderr,"info: %d nfev: %d njev: %d\n\n",info,nfev,njev);
 #endif
 
     return 1;
@@ -1681,88 +2175,66 @@ int cc_full_optimization ()
 * Routines for noncoplanar camera calibration	 			*
 \***********************************************************************/
 /* pytsai: cannot fail; void return type is fine. */
-void ncc_compute_Xd_Yd_and_r_squared ()
+void ncc_compute_Xd_Yd_and_r_squared (struct tsai_context *ctx)
 {
     int       i;
 
     double    Xd_,
               Yd_;
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	Xd[i] = Xd_ = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;      /* [mm] */
-	Yd[i] = Yd_ = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);              /* [mm] */
-	r_squared[i] = SQR (Xd_) + SQR (Yd_);                   /* [mm^2] */
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	ctx->Xd[i] = Xd_ = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;      /* [mm] */
+	ctx->Yd[i] = Yd_ = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);              /* [mm] */
+	ctx->r_squared[i] = SQR (Xd_) + SQR (Yd_);                   /* [mm^2] */
     }
 }
 
 
 /* pytsai: can fail; int return type required. */
-int ncc_compute_U ()
+int ncc_compute_U (struct tsai_context *ctx)
 {
     int       i;
 
-    dmat      M,
-              a,
-              b;
+    lsqsys    sys;
 
-    M = newdmat (0, (tsai_cd.point_count - 1), 0, 6, &errno);
-    if (errno) {
-	pytsai_raise("ncc compute U: unable to allocate matrix M");
-	return 0;
-    }
+    double    row[7],
+              a[7];
 
-    a = newdmat (0, 6, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise("ncc compute U: unable to allocate vector a");
-	return 0;
-    }
+    if (ctx->ransac_threshold > 0 && ctx->cd.point_count > 7)
+	return ransac_compute_U (ctx, 7);
 
-    b = newdmat (0, (tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise("ncc compute U: unable to allocate vector b");
-	return 0;
-    }
+    lsq_init (&sys, 7);
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	M.el[i][0] = Yd[i] * tsai_cd.xw[i];
-	M.el[i][1] = Yd[i] * tsai_cd.yw[i];
-	M.el[i][2] = Yd[i] * tsai_cd.zw[i];
-	M.el[i][3] = Yd[i];
-	M.el[i][4] = -Xd[i] * tsai_cd.xw[i];
-	M.el[i][5] = -Xd[i] * tsai_cd.yw[i];
-	M.el[i][6] = -Xd[i] * tsai_cd.zw[i];
-	b.el[i][0] = Xd[i];
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	row[0] = ctx->Yd[i] * ctx->cd.xw[i];
+	row[1] = ctx->Yd[i] * ctx->cd.yw[i];
+	row[2] = ctx->Yd[i] * ctx->cd.zw[i];
+	row[3] = ctx->Yd[i];
+	row[4] = -ctx->Xd[i] * ctx->cd.xw[i];
+	row[5] = -ctx->Xd[i] * ctx->cd.yw[i];
+	row[6] = -ctx->Xd[i] * ctx->cd.zw[i];
+	lsq_add_row (&sys, row, ctx->Xd[i]);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise("ncc compute U: error - non-coplanar calibration tried with data which may possibly be coplanar");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise(&ctx->err, "ncc compute U: error - non-coplanar calibration tried with data which may possibly be coplanar");
 	return 0;
     }
 
-    U[0] = a.el[0][0];
-    U[1] = a.el[1][0];
-    U[2] = a.el[2][0];
-    U[3] = a.el[3][0];
-    U[4] = a.el[4][0];
-    U[5] = a.el[5][0];
-    U[6] = a.el[6][0];
-
-    freemat (M);
-    freemat (a);
-    freemat (b);
+    ctx->U[0] = a[0];
+    ctx->U[1] = a[1];
+    ctx->U[2] = a[2];
+    ctx->U[3] = a[3];
+    ctx->U[4] = a[4];
+    ctx->U[5] = a[5];
+    ctx->U[6] = a[6];
 
     return 1;
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void ncc_compute_Tx_and_Ty ()
+void ncc_compute_Tx_and_Ty (struct tsai_context *ctx)
 {
     int       i,
               far_point;
@@ -1782,13 +2254,13 @@ void ncc_compute_Tx_and_Ty ()
               far_distance;
 
     /* first find the square of the magnitude of Ty */
-    Ty_squared = 1 / (SQR (U[4]) + SQR (U[5]) + SQR (U[6]));
+    Ty_squared = 1 / (SQR (ctx->U[4]) + SQR (ctx->U[5]) + SQR (ctx->U[6]));
 
     /* find a point that is far from the image center */
     far_distance = 0;
     far_point = 0;
-    for (i = 0; i < tsai_cd.point_count; i++)
-	if ((distance = r_squared[i]) > far_distance) {
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if ((distance = ctx->r_squared[i]) > far_distance) {
 	    far_point = i;
 	    far_distance = distance;
 	}
@@ -1796,36 +2268,38 @@ void ncc_compute_Tx_and_Ty ()
     /* now find the sign for Ty */
     /* start by assuming Ty > 0 */
     Ty = sqrt (Ty_squared);
-    r1 = U[0] * Ty;
-    r2 = U[1] * Ty;
-    r3 = U[2] * Ty;
-    Tx = U[3] * Ty;
-    r4 = U[4] * Ty;
-    r5 = U[5] * Ty;
-    r6 = U[6] * Ty;
-    x = r1 * tsai_cd.xw[far_point] + r2 * tsai_cd.yw[far_point] + r3 * tsai_cd.zw[far_point] + Tx;
-    y = r4 * tsai_cd.xw[far_point] + r5 * tsai_cd.yw[far_point] + r6 * tsai_cd.zw[far_point] + Ty;
+    r1 = ctx->U[0] * Ty;
+    r2 = ctx->U[1] * Ty;
+    r3 = ctx->U[2] * Ty;
+    Tx = ctx->U[3] * Ty;
+    r4 = ctx->U[4] * Ty;
+    r5 = ctx->U[5] * Ty;
+    r6 = ctx->U[6] * Ty;
+    x = r1 * ctx->cd.xw[far_point] + r2 * ctx->cd.yw[far_point] + r3 * ctx->cd.zw[far_point] + Tx;
+    y = r4 * ctx->cd.xw[far_point] + r5 * ctx->cd.yw[far_point] + r6 * ctx->cd.zw[far_point] + Ty;
 
     /* flip Ty if we guessed wrong */
-    if ((SIGNBIT (x) != SIGNBIT (Xd[far_point])) ||
-	(SIGNBIT (y) != SIGNBIT (Yd[far_point])))
+    if (ctx->outlier != NULL)
+	Ty = vote_Ty_sign (ctx, r1, r2, r3, r4, r5, r6, Tx, Ty);
+    else if ((SIGNBIT (x) != SIGNBIT (ctx->Xd[far_point])) ||
+	(SIGNBIT (y) != SIGNBIT (ctx->Yd[far_point])))
 	Ty = -Ty;
 
     /* update the calibration constants */
-    tsai_cc.Tx = U[3] * Ty;
-    tsai_cc.Ty = Ty;
+    ctx->cc.Tx = ctx->U[3] * Ty;
+    ctx->cc.Ty = Ty;
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void ncc_compute_sx ()
+void ncc_compute_sx (struct tsai_context *ctx)
 {
-    tsai_cp.sx = sqrt (SQR (U[0]) + SQR (U[1]) + SQR (U[2])) * fabs (tsai_cc.Ty);
+    ctx->cp.sx = sqrt (SQR (ctx->U[0]) + SQR (ctx->U[1]) + SQR (ctx->U[2])) * fabs (ctx->cc.Ty);
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void ncc_compute_R ()
+void ncc_compute_R (struct tsai_context *ctx)
 {
     double    r1,
               r2,
@@ -1837,13 +2311,13 @@ void ncc_compute_R ()
               r8,
               r9;
 
-    r1 = U[0] * tsai_cc.Ty / tsai_cp.sx;
-    r2 = U[1] * tsai_cc.Ty / tsai_cp.sx;
-    r3 = U[2] * tsai_cc.Ty / tsai_cp.sx;
+    r1 = ctx->U[0] * ctx->cc.Ty / ctx->cp.sx;
+    r2 = ctx->U[1] * ctx->cc.Ty / ctx->cp.sx;
+    r3 = ctx->U[2] * ctx->cc.Ty / ctx->cp.sx;
 
-    r4 = U[4] * tsai_cc.Ty;
-    r5 = U[5] * tsai_cc.Ty;
-    r6 = U[6] * tsai_cc.Ty;
+    r4 = ctx->U[4] * ctx->cc.Ty;
+    r5 = ctx->U[5] * ctx->cc.Ty;
+    r6 = ctx->U[6] * ctx->cc.Ty;
 
     /* use the outer product of the first two rows to get the last row */
     r7 = r2 * r6 - r3 * r5;
@@ -1851,23 +2325,23 @@ void ncc_compute_R ()
     r9 = r1 * r5 - r2 * r4;
 
     /* update the calibration constants */
-    tsai_cc.r1 = r1;
-    tsai_cc.r2 = r2;
-    tsai_cc.r3 = r3;
-    tsai_cc.r4 = r4;
-    tsai_cc.r5 = r5;
-    tsai_cc.r6 = r6;
-    tsai_cc.r7 = r7;
-    tsai_cc.r8 = r8;
-    tsai_cc.r9 = r9;
-
-    /* fill in tsai_cc.Rx, tsai_cc.Ry and tsai_cc.Rz */
-    solve_RPY_transform ();
+    ctx->cc.r1 = r1;
+    ctx->cc.r2 = r2;
+    ctx->cc.r3 = r3;
+    ctx->cc.r4 = r4;
+    ctx->cc.r5 = r5;
+    ctx->cc.r6 = r6;
+    ctx->cc.r7 = r7;
+    ctx->cc.r8 = r8;
+    ctx->cc.r9 = r9;
+
+    /* fill in ctx->cc.Rx, ctx->cc.Ry and ctx->cc.Rz */
+    solve_RPY_transform (ctx);
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void ncc_compute_better_R ()
+void ncc_compute_better_R (struct tsai_context *ctx)
 {
     double    r1,
               r2,
@@ -1883,203 +2357,150 @@ void ncc_compute_better_R ()
               sg,
               cg;
 
-    r1 = U[0] * tsai_cc.Ty / tsai_cp.sx;
-    r2 = U[1] * tsai_cc.Ty / tsai_cp.sx;
-    r3 = U[2] * tsai_cc.Ty / tsai_cp.sx;
+    r1 = ctx->U[0] * ctx->cc.Ty / ctx->cp.sx;
+    r2 = ctx->U[1] * ctx->cc.Ty / ctx->cp.sx;
+    r3 = ctx->U[2] * ctx->cc.Ty / ctx->cp.sx;
 
-    r4 = U[4] * tsai_cc.Ty;
-    r5 = U[5] * tsai_cc.Ty;
-    r6 = U[6] * tsai_cc.Ty;
+    r4 = ctx->U[4] * ctx->cc.Ty;
+    r5 = ctx->U[5] * ctx->cc.Ty;
+    r6 = ctx->U[6] * ctx->cc.Ty;
 
     /* use the outer product of the first two rows to get the last row */
     r7 = r2 * r6 - r3 * r5;
 
     /* now find the RPY angles corresponding to the estimated rotation matrix */
-    tsai_cc.Rz = atan2 (r4, r1);
+    ctx->cc.Rz = atan2 (r4, r1);
 
-    SINCOS (tsai_cc.Rz, sg, cg);
+    SINCOS (ctx->cc.Rz, sg, cg);
 
-    tsai_cc.Ry = atan2 (-r7, r1 * cg + r4 * sg);
+    ctx->cc.Ry = atan2 (-r7, r1 * cg + r4 * sg);
 
-    tsai_cc.Rx = atan2 (r3 * sg - r6 * cg, r5 * cg - r2 * sg);
+    ctx->cc.Rx = atan2 (r3 * sg - r6 * cg, r5 * cg - r2 * sg);
 
-    SINCOS (tsai_cc.Rx, sa, ca);
+    SINCOS (ctx->cc.Rx, sa, ca);
 
-    SINCOS (tsai_cc.Ry, sb, cb);
+    SINCOS (ctx->cc.Ry, sb, cb);
 
     /* now generate a more orthonormal rotation matrix from the RPY angles */
-    tsai_cc.r1 = cb * cg;
-    tsai_cc.r2 = cg * sa * sb - ca * sg;
-    tsai_cc.r3 = sa * sg + ca * cg * sb;
-    tsai_cc.r4 = cb * sg;
-    tsai_cc.r5 = sa * sb * sg + ca * cg;
-    tsai_cc.r6 = ca * sb * sg - cg * sa;
-    tsai_cc.r7 = -sb;
-    tsai_cc.r8 = cb * sa;
-    tsai_cc.r9 = ca * cb;
+    ctx->cc.r1 = cb * cg;
+    ctx->cc.r2 = cg * sa * sb - ca * sg;
+    ctx->cc.r3 = sa * sg + ca * cg * sb;
+    ctx->cc.r4 = cb * sg;
+    ctx->cc.r5 = sa * sb * sg + ca * cg;
+    ctx->cc.r6 = ca * sb * sg - cg * sa;
+    ctx->cc.r7 = -sb;
+    ctx->cc.r8 = cb * sa;
+    ctx->cc.r9 = ca * cb;
 }
 
 
 /* pytsai: can fail; int return type required. */
-int ncc_compute_approximate_f_and_Tz ()
+int ncc_compute_approximate_f_and_Tz (struct tsai_context *ctx)
 {
     int       i;
 
-    dmat      M,
-              a,
-              b;
-
-    M = newdmat (0, (tsai_cd.point_count - 1), 0, 1, &errno);
-    if (errno) {
-	pytsai_raise("ncc compute apx: unable to allocate matrix M");
-	return 0;
-    }
+    lsqsys    sys;
 
-    a = newdmat (0, 1, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise("ncc compute apx: unable to allocate vector a");
-	return 0;
-    }
+    double    row[2],
+              a[2];
 
-    b = newdmat (0, (tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise("ncc compute apx: unable to allocate vector b");
-	return 0;
-    }
+    lsq_init (&sys, 2);
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	M.el[i][0] = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.r6 * tsai_cd.zw[i] + tsai_cc.Ty;
-	M.el[i][1] = -Yd[i];
-	b.el[i][0] = (tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i] + tsai_cc.r9 * tsai_cd.zw[i]) * Yd[i];
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	if (ctx->outlier != NULL && ctx->outlier[i])
+	    continue;
+	row[0] = ctx->cc.r4 * ctx->cd.xw[i] + ctx->cc.r5 * ctx->cd.yw[i] + ctx->cc.r6 * ctx->cd.zw[i] + ctx->cc.Ty;
+	row[1] = -ctx->Yd[i];
+	lsq_add_row (&sys, row, (ctx->cc.r7 * ctx->cd.xw[i] + ctx->cc.r8 * ctx->cd.yw[i] + ctx->cc.r9 * ctx->cd.zw[i]) * ctx->Yd[i]);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise("ncc compute apx: unable to solve system  Ma=b");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise(&ctx->err, "ncc compute apx: unable to solve system  Ma=b");
 	return 0;
     }
 
     /* update the calibration constants */
-    tsai_cc.f = a.el[0][0];
-    tsai_cc.Tz = a.el[1][0];
-    tsai_cc.kappa1 = 0.0;		/* this is the assumption that our calculation was made under */
+    ctx->cc.f = a[0];
+    ctx->cc.Tz = a[1];
+    ctx->cc.kappa1 = 0.0;		/* this is the assumption that our calculation was made under */
 
-    freemat (M);
-    freemat (a);
-    freemat (b);
 
     return 1;
 }
 
 
 /************************************************************************/
-/* pytsai: cannot fail; void return type is fine. */
-void ncc_compute_exact_f_and_Tz_error (m_ptr, n_ptr, params, err)
+/* pytsai: cannot fail; void return type is fine.  Called by lmder_ to fill
+ * err (*iflag == 1) or its Jacobian fjac (*iflag == 2), or by lmstr_ to fold
+ * the Jacobian into fjac instead (see TSAI_LM). */
+void ncc_compute_exact_f_and_Tz_error (m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, data)
     integer  *m_ptr;		/* pointer to number of points to fit */
     integer  *n_ptr;		/* pointer to number of parameters */
     doublereal *params;		/* vector of parameters */
     doublereal *err;		/* vector of error from data */
+    doublereal *fjac;           /* Jacobian of err (column-major) */
+    integer  *ldfjac;           /* pointer to leading dimension of fjac */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* calibration context */
 {
-    int       i;
+    struct tsai_context *ctx = (struct tsai_context *) data;
 
-    double    xc,
-              yc,
-              zc,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor,
-              f,
-              Tz,
-              kappa1;
-
-    f = params[0];
-    Tz = params[1];
-    kappa1 = params[2];
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	xc = tsai_cc.r1 * tsai_cd.xw[i] + tsai_cc.r2 * tsai_cd.yw[i] + tsai_cc.r3 * tsai_cd.zw[i] + tsai_cc.Tx;
-	yc = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.r6 * tsai_cd.zw[i] + tsai_cc.Ty;
-	zc = tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i] + tsai_cc.r9 * tsai_cd.zw[i] + Tz;
+    static int column[TSAI_ERROR_PARAMETERS] = { -1, -1, -1, -1, -1, 1, 2, 0, -1, -1, -1 };
 
-	/* convert from camera coordinates to undistorted sensor coordinates */
-	Xu_1 = f * xc / zc;
-	Yu_1 = f * yc / zc;
-
-	/* convert from distorted sensor coordinates to undistorted sensor coordinates */
-	distortion_factor = 1 + kappa1 * r_squared[i];
-	Xu_2 = Xd[i] * distortion_factor;
-	Yu_2 = Yd[i] * distortion_factor;
-
-        /* record the error in the undistorted sensor coordinates */
-        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
-    }
+    if (*iflag == 2)
+	undistorted_sensor_error_jacobian (ctx, params, column, ctx->Xd, ctx->Yd, err, fjac, (int) *ldfjac);
+    else
+	undistorted_sensor_error (ctx, params, column, ctx->Xd, ctx->Yd, err);
 }
 
 
 /* pytsai: can fail; int return type is required. */
-int ncc_compute_exact_f_and_Tz ()
+int ncc_compute_exact_f_and_Tz (struct tsai_context *ctx)
 {
 #define NPARAMS 3
 
     int       i;
 
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
 
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
-
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
-
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
-
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    size_t      mark = ctx->arena_used;
+
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration constants as an initial guess */
-    x[0] = tsai_cc.f;
-    x[1] = tsai_cc.Tz;
-    x[2] = tsai_cc.kappa1;
+    x[0] = ctx->cc.f;
+    x[1] = ctx->cc.Tz;
+    x[2] = ctx->cc.kappa1;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -2088,26 +2509,27 @@ int ncc_compute_exact_f_and_Tz ()
     }
  
     /* perform the optimization */
-    lmdif_ (ncc_compute_exact_f_and_Tz_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
+    TSAI_LM (ctx) (ncc_compute_exact_f_and_Tz_error,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, ctx);
+    ctx->nfev += nfev;
+    ctx->njev += njev;
+    ctx->lm_info = info;
     /* TODO: Check for error conditions (info parameter).  See lmbif.c
      * for possible values. */
 
     /* update the calibration constants */
-    tsai_cc.f = x[0];
-    tsai_cc.Tz = x[1];
-    tsai_cc.kappa1 = x[2];
+    ctx->cc.f = x[0];
+    ctx->cc.Tz = x[1];
+    ctx->cc.kappa1 = x[2];
 
     /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+    fprintf(stderr,"info: %d nfev: %d njev: %d\n\n",info,nfev,njev);
 #endif
 
     return 1;
@@ -2117,204 +2539,152 @@ int ncc_compute_exact_f_and_Tz ()
 
 
 /************************************************************************/
-/* pytsai: can fail; int return type is required. */
-int ncc_three_parm_optimization ()
+/* pytsai: can fail; int return type is required.
+ * The steps of ncc_three_parm_optimization, which may leave ctx->outlier
+ * set and drawn from the arena. */
+static int ncc_three_parm_steps (struct tsai_context *ctx)
 {
-    ncc_compute_Xd_Yd_and_r_squared ();
+    ncc_compute_Xd_Yd_and_r_squared (ctx);
 
-    if (!ncc_compute_U())
+    if (!ncc_compute_U(ctx))
         return 0;
 
-    ncc_compute_Tx_and_Ty ();
+    ncc_compute_Tx_and_Ty (ctx);
 
-    ncc_compute_sx ();
+    ncc_compute_sx (ctx);
 
-    ncc_compute_Xd_Yd_and_r_squared ();
+    ncc_compute_Xd_Yd_and_r_squared (ctx);
 
-    ncc_compute_better_R ();
+    ncc_compute_better_R (ctx);
 
-    if (!ncc_compute_approximate_f_and_Tz())
+    if (!ncc_compute_approximate_f_and_Tz(ctx))
         return 0;
 
-    if (tsai_cc.f < 0) {
+    if (ctx->cc.f < 0) {
 	/* try the other solution for the orthonormal matrix */
-	tsai_cc.r3 = -tsai_cc.r3;
-	tsai_cc.r6 = -tsai_cc.r6;
-	tsai_cc.r7 = -tsai_cc.r7;
-	tsai_cc.r8 = -tsai_cc.r8;
-	solve_RPY_transform ();
+	ctx->cc.r3 = -ctx->cc.r3;
+	ctx->cc.r6 = -ctx->cc.r6;
+	ctx->cc.r7 = -ctx->cc.r7;
+	ctx->cc.r8 = -ctx->cc.r8;
+	solve_RPY_transform (ctx);
 
-	if (!ncc_compute_approximate_f_and_Tz())
+	if (!ncc_compute_approximate_f_and_Tz(ctx))
                 return 0;
 
-        if (tsai_cc.f < 0) {
-            pytsai_raise("error - possible handedness problem with data");
+        if (ctx->cc.f < 0) {
+            pytsai_raise(&ctx->err, "error - possible handedness problem with data");
             return 0;
 	}
     }
 
-    if (!ncc_compute_exact_f_and_Tz())
+    if (!ncc_compute_exact_f_and_Tz(ctx))
         return 0;
 
     return 1;
 }
 
 
+/* pytsai: can fail; int return type is required. */
+int ncc_three_parm_optimization (struct tsai_context *ctx)
+{
+    int       ok;
+
+    size_t    mark = ctx->arena_used;
+
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, ncc_three_parm_optimization, 0);
+
+    ok = ncc_three_parm_steps (ctx);
+
+    /* forget the outliers of a robust fit of U */
+    ctx->outlier = NULL;
+    tsai_arena_release (ctx, mark);
+
+    return ok;
+}
+
+
 /************************************************************************/
-/* pytsai: cannot fail; void return type is fine. */
-void ncc_nic_optimization_error (m_ptr, n_ptr, params, err)
+/* pytsai: cannot fail; void return type is fine.  Called by lmder_ to fill
+ * err (*iflag == 1) or its Jacobian fjac (*iflag == 2), or by lmstr_ to fold
+ * the Jacobian into fjac instead (see TSAI_LM). */
+void ncc_nic_optimization_error (m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, data)
     integer  *m_ptr;		/* pointer to number of points to fit */
     integer  *n_ptr;		/* pointer to number of parameters */
     doublereal *params;		/* vector of parameters */
     doublereal *err;		/* vector of error from data */
+    doublereal *fjac;           /* Jacobian of err (column-major) */
+    integer  *ldfjac;           /* pointer to leading dimension of fjac */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* calibration context */
 {
-    int       i;
+    struct tsai_context *ctx = (struct tsai_context *) data;
 
-    double    xc,
-              yc,
-              zc,
-              Xd_,
-              Yd_,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor,
-              Rx,
-              Ry,
-              Rz,
-              Tx,
-              Ty,
-              Tz,
-              kappa1,
-              sx,
-              f,
-              r1,
-              r2,
-              r3,
-              r4,
-              r5,
-              r6,
-              r7,
-              r8,
-              r9,
-              sa,
-              sb,
-              sg,
-              ca,
-              cb,
-              cg;
-
-    Rx = params[0];
-    Ry = params[1];
-    Rz = params[2];
-    Tx = params[3];
-    Ty = params[4];
-    Tz = params[5];
-    kappa1 = params[6];
-    f = params[7];
-    sx = params[8];
-
-    SINCOS (Rx, sa, ca);
-    SINCOS (Ry, sb, cb);
-    SINCOS (Rz, sg, cg);
-    r1 = cb * cg;
-    r2 = cg * sa * sb - ca * sg;
-    r3 = sa * sg + ca * cg * sb;
-    r4 = cb * sg;
-    r5 = sa * sb * sg + ca * cg;
-    r6 = ca * sb * sg - cg * sa;
-    r7 = -sb;
-    r8 = cb * sa;
-    r9 = ca * cb;
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	xc = r1 * tsai_cd.xw[i] + r2 * tsai_cd.yw[i] + r3 * tsai_cd.zw[i] + Tx;
-	yc = r4 * tsai_cd.xw[i] + r5 * tsai_cd.yw[i] + r6 * tsai_cd.zw[i] + Ty;
-	zc = r7 * tsai_cd.xw[i] + r8 * tsai_cd.yw[i] + r9 * tsai_cd.zw[i] + Tz;
-
-	/* convert from camera coordinates to undistorted sensor plane coordinates */
-	Xu_1 = f * xc / zc;
-	Yu_1 = f * yc / zc;
-
-	/* convert from 2D image coordinates to distorted sensor coordinates */
-	Xd_ = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / sx;
-	Yd_ = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
-
-	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
-	distortion_factor = 1 + kappa1 * (SQR (Xd_) + SQR (Yd_));
-	Xu_2 = Xd_ * distortion_factor;
-	Yu_2 = Yd_ * distortion_factor;
+    static int column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, -1, -1 };
 
-        /* record the error in the undistorted sensor coordinates */
-        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
-    }
+    if (*iflag == 2)
+	undistorted_sensor_error_jacobian (ctx, params, column, NULL, NULL, err, fjac, (int) *ldfjac);
+    else
+	undistorted_sensor_error (ctx, params, column, NULL, NULL, err);
 }
 
 
 /* pytsai: can fail; int return type is required. */
-int ncc_nic_optimization ()
+int ncc_nic_optimization (struct tsai_context *ctx)
 {
 #define NPARAMS 9
 
     int       i;
 
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
 
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
+    size_t      mark = ctx->arena_used;
 
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, ncc_nic_optimization, 1);
 
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
-
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration and camera constants as a starting point */
-    x[0] = tsai_cc.Rx;
-    x[1] = tsai_cc.Ry;
-    x[2] = tsai_cc.Rz;
-    x[3] = tsai_cc.Tx;
-    x[4] = tsai_cc.Ty;
-    x[5] = tsai_cc.Tz;
-    x[6] = tsai_cc.kappa1;
-    x[7] = tsai_cc.f;
-    x[8] = tsai_cp.sx;
+    x[0] = ctx->cc.Rx;
+    x[1] = ctx->cc.Ry;
+    x[2] = ctx->cc.Rz;
+    x[3] = ctx->cc.Tx;
+    x[4] = ctx->cc.Ty;
+    x[5] = ctx->cc.Tz;
+    x[6] = ctx->cc.kappa1;
+    x[7] = ctx->cc.f;
+    x[8] = ctx->cp.sx;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -2323,34 +2693,35 @@ int ncc_nic_optimization ()
     }
 
     /* perform the optimization */
-    lmdif_ (ncc_nic_optimization_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
-    /* TODO: Check for error conditions (info parameter).  See lmdif.c for
+    TSAI_LM (ctx) (ncc_nic_optimization_error,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, ctx);
+    ctx->nfev += nfev;
+    ctx->njev += njev;
+    ctx->lm_info = info;
+    /* TODO: Check for error conditions (info parameter).  See lmder.c for
      * possible values of the info parameter. */
 
     /* update the calibration and camera constants */
-    tsai_cc.Rx = x[0];
-    tsai_cc.Ry = x[1];
-    tsai_cc.Rz = x[2];
-    apply_RPY_transform ();
-
-    tsai_cc.Tx = x[3];
-    tsai_cc.Ty = x[4];
-    tsai_cc.Tz = x[5];
-    tsai_cc.kappa1 = x[6];
-    tsai_cc.f = x[7];
-    tsai_cp.sx = x[8];
+    ctx->cc.Rx = x[0];
+    ctx->cc.Ry = x[1];
+    ctx->cc.Rz = x[2];
+    apply_RPY_transform (ctx);
+
+    ctx->cc.Tx = x[3];
+    ctx->cc.Ty = x[4];
+    ctx->cc.Tz = x[5];
+    ctx->cc.kappa1 = x[6];
+    ctx->cc.f = x[7];
+    ctx->cp.sx = x[8];
 
     /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+    fprintf(stderr,"info: %d nfev: %d njev: %d\n\n",info,nfev,njev);
 #endif
 
     return 1;
@@ -2360,166 +2731,88 @@ int ncc_nic_optimization ()
 
 
 /************************************************************************/
-/* pytsai: cannot fail; void return type is fine. */
-void ncc_full_optimization_error (m_ptr, n_ptr, params, err)
+/* pytsai: cannot fail; void return type is fine.  Called by lmder_ to fill
+ * err (*iflag == 1) or its Jacobian fjac (*iflag == 2), or by lmstr_ to fold
+ * the Jacobian into fjac instead (see TSAI_LM). */
+void ncc_full_optimization_error (m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, data)
     integer  *m_ptr;		/* pointer to number of points to fit */
     integer  *n_ptr;		/* pointer to number of parameters */
     doublereal *params;		/* vector of parameters */
     doublereal *err;		/* vector of error from data */
+    doublereal *fjac;           /* Jacobian of err (column-major) */
+    integer  *ldfjac;           /* pointer to leading dimension of fjac */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* calibration context */
 {
-    int       i;
-
-    double    xc,
-              yc,
-              zc,
-              Xd_,
-              Yd_,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor,
-              Rx,
-              Ry,
-              Rz,
-              Tx,
-              Ty,
-              Tz,
-              kappa1,
-              sx,
-              f,
-              Cx,
-              Cy,
-              r1,
-              r2,
-              r3,
-              r4,
-              r5,
-              r6,
-              r7,
-              r8,
-              r9,
-              sa,
-              sb,
-              sg,
-              ca,
-              cb,
-              cg;
-
-    Rx = params[0];
-    Ry = params[1];
-    Rz = params[2];
-    Tx = params[3];
-    Ty = params[4];
-    Tz = params[5];
-    kappa1 = params[6];
-    f = params[7];
-    sx = params[8];
-    Cx = params[9];
-    Cy = params[10];
-
-    SINCOS (Rx, sa, ca);
-    SINCOS (Ry, sb, cb);
-    SINCOS (Rz, sg, cg);
-    r1 = cb * cg;
-    r2 = cg * sa * sb - ca * sg;
-    r3 = sa * sg + ca * cg * sb;
-    r4 = cb * sg;
-    r5 = sa * sb * sg + ca * cg;
-    r6 = ca * sb * sg - cg * sa;
-    r7 = -sb;
-    r8 = cb * sa;
-    r9 = ca * cb;
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	xc = r1 * tsai_cd.xw[i] + r2 * tsai_cd.yw[i] + r3 * tsai_cd.zw[i] + Tx;
-	yc = r4 * tsai_cd.xw[i] + r5 * tsai_cd.yw[i] + r6 * tsai_cd.zw[i] + Ty;
-	zc = r7 * tsai_cd.xw[i] + r8 * tsai_cd.yw[i] + r9 * tsai_cd.zw[i] + Tz;
-
-	/* convert from camera coordinates to undistorted sensor plane coordinates */
-	Xu_1 = f * xc / zc;
-	Yu_1 = f * yc / zc;
+    struct tsai_context *ctx = (struct tsai_context *) data;
 
-	/* convert from 2D image coordinates to distorted sensor coordinates */
-	Xd_ = tsai_cp.dpx * (tsai_cd.Xf[i] - Cx) / sx;
-	Yd_ = tsai_cp.dpy * (tsai_cd.Yf[i] - Cy);
+    static int column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
 
-	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
-	distortion_factor = 1 + kappa1 * (SQR (Xd_) + SQR (Yd_));
-	Xu_2 = Xd_ * distortion_factor;
-	Yu_2 = Yd_ * distortion_factor;
-
-        /* record the error in the undistorted sensor coordinates */
-        err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
-    }
+    if (*iflag == 2)
+	undistorted_sensor_error_jacobian (ctx, params, column, NULL, NULL, err, fjac, (int) *ldfjac);
+    else
+	undistorted_sensor_error (ctx, params, column, NULL, NULL, err);
 }
 
 
 /* pytsai: can fail; int return type is required. */
-int ncc_full_optimization ()
+int ncc_full_optimization (struct tsai_context *ctx)
 {
 #define NPARAMS 11
 
     int     i;
 
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
  
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
+    size_t      mark = ctx->arena_used;
 
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
- 
-    if (( fjac = (doublereal *) malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       pytsai_raise("malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
- 
-    if (( wa4 = (doublereal *) malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       free(fvec);
-       free(fjac);
-       pytsai_raise("malloc: Cannot allocate workspace wa4");
-       return 0;
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, ncc_full_optimization, 1);
+
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration and camera constants as a starting point */
-    x[0] = tsai_cc.Rx;
-    x[1] = tsai_cc.Ry;
-    x[2] = tsai_cc.Rz;
-    x[3] = tsai_cc.Tx;
-    x[4] = tsai_cc.Ty;
-    x[5] = tsai_cc.Tz;
-    x[6] = tsai_cc.kappa1;
-    x[7] = tsai_cc.f;
-    x[8] = tsai_cp.sx;
-    x[9] = tsai_cp.Cx;
-    x[10] = tsai_cp.Cy;
+    x[0] = ctx->cc.Rx;
+    x[1] = ctx->cc.Ry;
+    x[2] = ctx->cc.Rz;
+    x[3] = ctx->cc.Tx;
+    x[4] = ctx->cc.Ty;
+    x[5] = ctx->cc.Tz;
+    x[6] = ctx->cc.kappa1;
+    x[7] = ctx->cc.f;
+    x[8] = ctx->cp.sx;
+    x[9] = ctx->cp.Cx;
+    x[10] = ctx->cp.Cy;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -2528,36 +2821,37 @@ int ncc_full_optimization ()
     }
  
     /* perform the optimization */
-    lmdif_ (ncc_full_optimization_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
-    /* TODO: Check for error conditions (info parameter).  See lmdif.c for
+    TSAI_LM (ctx) (ncc_full_optimization_error,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, ctx);
+    ctx->nfev += nfev;
+    ctx->njev += njev;
+    ctx->lm_info = info;
+    /* TODO: Check for error conditions (info parameter).  See lmder.c for
      * possible values. */
 
     /* update the calibration and camera constants */
-    tsai_cc.Rx = x[0];
-    tsai_cc.Ry = x[1];
-    tsai_cc.Rz = x[2];
-    apply_RPY_transform ();
-
-    tsai_cc.Tx = x[3];
-    tsai_cc.Ty = x[4];
-    tsai_cc.Tz = x[5];
-    tsai_cc.kappa1 = x[6];
-    tsai_cc.f = x[7];
-    tsai_cp.sx = x[8];
-    tsai_cp.Cx = x[9];
-    tsai_cp.Cy = x[10];
+    ctx->cc.Rx = x[0];
+    ctx->cc.Ry = x[1];
+    ctx->cc.Rz = x[2];
+    apply_RPY_transform (ctx);
+
+    ctx->cc.Tx = x[3];
+    ctx->cc.Ty = x[4];
+    ctx->cc.Tz = x[5];
+    ctx->cc.kappa1 = x[6];
+    ctx->cc.f = x[7];
+    ctx->cp.sx = x[8];
+    ctx->cp.Cx = x[9];
+    ctx->cp.Cy = x[10];
 
     /* release allocated workspace */
-    free(fvec);
-    free(fjac);
-    free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+    fprintf(stderr,"info: %d nfev: %d njev: %d\n\n",info,nfev,njev);
 #endif
 
     return 1;
@@ -2569,34 +2863,34 @@ int ncc_full_optimization ()
 /************************************************************************/
 
 /* pytsai: can fail; int return type is required. */
-int coplanar_calibration ()
+int coplanar_calibration (struct tsai_context *ctx)
 {
     /* just do the basic 3 parameter (Tz, f, kappa1) optimization */
-    return cc_three_parm_optimization ();
+    return cc_three_parm_optimization (ctx);
 }
 
  
 /* pytsai: can fail; int return type is required. */
-int coplanar_calibration_with_full_optimization ()
+int coplanar_calibration_with_full_optimization (struct tsai_context *ctx)
 {
     /* start with a 3 parameter (Tz, f, kappa1) optimization */
-    if (!cc_three_parm_optimization())
+    if (!cc_three_parm_optimization(ctx))
         return 0;
 
     /* do a 5 parameter (Tz, f, kappa1, Cx, Cy) optimization */
-    if (!cc_five_parm_optimization_with_late_distortion_removal())
+    if (!cc_five_parm_optimization_with_late_distortion_removal(ctx))
         return 0;
 
     /* do a better 5 parameter (Tz, f, kappa1, Cx, Cy) optimization */
-    if (!cc_five_parm_optimization_with_early_distortion_removal())
+    if (!cc_five_parm_optimization_with_early_distortion_removal(ctx))
         return 0;
 
     /* do a full optimization minus the image center */
-    if (!cc_nic_optimization())
+    if (!cc_nic_optimization(ctx))
         return 0;
 
     /* do a full optimization including the image center */
-    if (!cc_full_optimization())
+    if (!cc_full_optimization(ctx))
         return 0;
 
     return 1;
@@ -2604,27 +2898,97 @@ int coplanar_calibration_with_full_optimization ()
 
 
 /* pytsai: can fail; int return type is required. */
-int noncoplanar_calibration ()
+int noncoplanar_calibration (struct tsai_context *ctx)
 {
     /* just do the basic 3 parameter (Tz, f, kappa1) optimization */
-    return ncc_three_parm_optimization ();
+    return ncc_three_parm_optimization (ctx);
 }
 
  
 /* pytsai: can fail; int return type is required. */
-int noncoplanar_calibration_with_full_optimization ()
+int noncoplanar_calibration_with_full_optimization (struct tsai_context *ctx)
 {
     /* start with a 3 parameter (Tz, f, kappa1) optimization */
-    if (!ncc_three_parm_optimization())
+    if (!ncc_three_parm_optimization(ctx))
         return 0;
 
     /* do a full optimization minus the image center */
-    if (!ncc_nic_optimization())
+    if (!ncc_nic_optimization(ctx))
         return 0;
 
     /* do a full optimization including the image center */
-    if (!ncc_full_optimization())
+    if (!ncc_full_optimization(ctx))
         return 0;
 
     return 1;
 }
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Runs full from the camera parameters and calibration constants in ctx,
+ * with at most TSAI_WARM_START_MAXFEV residual evaluations, and falls back
+ * on cold, from the camera parameters ctx started with, if full fails, does
+ * not converge (MINPACK's info 0 or 5), leaves f non-positive or ends with
+ * a median error (see tsai_median_error()) above ctx->warm_start_max_error. */
+static int calibration_with_warm_start (struct tsai_context *ctx,
+					int (*full) (struct tsai_context *ctx),
+					int (*cold) (struct tsai_context *ctx))
+{
+    struct camera_parameters cp = ctx->cp;
+
+    double    max_error = ctx->warm_start_max_error > 0 ?
+		ctx->warm_start_max_error : TSAI_WARM_START_MAX_ERROR,
+              median;
+
+    int       maxfev = ctx->maxfev,
+              ok;
+
+    ctx->warm_start_fallback = 0;
+
+    if (ctx->cc.f > 0 && ctx->cd.point_count > 0) {
+	/* a warm start that wanders gives up early, to fall back cheaply */
+	if (maxfev <= 0 || maxfev > TSAI_WARM_START_MAXFEV)
+	    ctx->maxfev = TSAI_WARM_START_MAXFEV;
+	ok = full (ctx);
+	ctx->maxfev = maxfev;
+
+	if (ok && ctx->lm_info != 0 && ctx->lm_info != 5 && ctx->cc.f > 0) {
+	    if (!tsai_median_error (ctx, &median))
+		return 0;
+	    if (median <= max_error)
+		return 1;
+	}
+	pytsai_clear (&ctx->err);
+    }
+
+    /* the warm start diverged; start again from scratch */
+    ctx->warm_start_fallback = 1;
+    ctx->cp = cp;
+    return cold (ctx);
+}
+
+
+/* pytsai: can fail; int return type is required. */
+int coplanar_calibration_with_warm_start (struct tsai_context *ctx)
+{
+    int       i;
+
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if (ctx->cd.zw[i]) {
+	    pytsai_raise(&ctx->err, "error - coplanar calibration tried with data outside of Z plane");
+	    return 0;
+	}
+
+    return calibration_with_warm_start (ctx, cc_full_optimization,
+					coplanar_calibration_with_full_optimization);
+}
+
+
+/* pytsai: can fail; int return type is required. */
+int noncoplanar_calibration_with_warm_start (struct tsai_context *ctx)
+{
+    return calibration_with_warm_start (ctx, ncc_full_optimization,
+					noncoplanar_calibration_with_full_optimization);
+}
@@ -69,8 +69,8 @@
 #ifndef CAL_MAIN_H
 #define CAL_MAIN_H
 
-/* Maximum number of data points allowed */
-#define MAX_POINTS	500
+#include <stddef.h>
+#include "../errors.h"
 
 /* An arbitrary tolerance factor */
 #define EPSILON		1.0E-8
@@ -99,6 +99,7 @@ double sin(), cos();
 #define REL_PARAM_TOLERANCE_xtol     1.0E-7
 #define ORTHO_TOLERANCE_gtol         0.0
 #define MAXFEV                       (1000*n)
+#define TSAI_MAXFEV(ctx)             ((ctx)->maxfev > 0 ? (ctx)->maxfev : MAXFEV)
 #define EPSFCN                       1.0E-16          /* Do not set to zero! */
 #define MODE                         1   /* variables are scalled internally */
 #define FACTOR                       100.0 
@@ -147,14 +148,22 @@ struct camera_parameters {
 *                                                                            *
 * For noncoplanar calibration the data must not lie in a single plane.       *
 *                                                                            *
+*                                                                            *
+* Storage:                                                                   *
+*                                                                            *
+* There is no compiled in limit on the number of points.  The coordinate     *
+* arrays either point into storage owned by the calibration context and      *
+* sized by tsai_context_reserve(), or at arrays owned by the caller and      *
+* handed over with tsai_context_attach() (see below).                        *
+*                                                                            *
 \****************************************************************************/
 struct calibration_data {
     int       point_count;	/* [points] 	 */
-    double    xw[MAX_POINTS];	/* [mm]          */
-    double    yw[MAX_POINTS];	/* [mm]          */
-    double    zw[MAX_POINTS];	/* [mm]          */
-    double    Xf[MAX_POINTS];	/* [pix]         */
-    double    Yf[MAX_POINTS];	/* [pix]         */
+    double   *xw;		/* [mm]          */
+    double   *yw;		/* [mm]          */
+    double   *zw;		/* [mm]          */
+    double   *Xf;		/* [pix]         */
+    double   *Yf;		/* [pix]         */
 };
 
 
@@ -186,11 +195,174 @@ struct calibration_constants {
     double    r9;		/* []            */
 };
 
-/* External declarations for variables used by the subroutines for I/O */
-extern struct camera_parameters tsai_cp;
-extern struct calibration_data tsai_cd;
-extern struct calibration_constants tsai_cc;
-//extern char   camera_type[];
+/****************************************************************************\
+*                                                                            *
+* A calibration context holds everything a calibration, transform or error   *
+* statistics routine reads and writes: the camera parameters, calibration    *
+* data and calibration constants above, the working storage used by the      *
+* linear stages of Tsai's algorithm, and the error state.  Every routine     *
+* takes the context explicitly, so independent contexts may be calibrated    *
+* concurrently.                                                              *
+*                                                                            *
+* A context starts out zeroed.  Before calibrating, tsai_context_reserve()   *
+* sizes the per-point arrays (the calibration data and the working storage)  *
+* for the number of points; they are allocated as one heap block, as         *
+* separate arrays (structure of arrays), each starting on a                  *
+* TSAI_DATA_ALIGNMENT byte boundary.  tsai_context_attach() instead sizes    *
+* only the working storage and reads the calibration data in place from      *
+* the caller's arrays, which must outlive the calibration and need not be    *
+* aligned.  tsai_context_release() frees the context's storage.              *
+*                                                                            *
+* The same block also holds an arena from which the optimization stages      *
+* draw their MINPACK workspaces (fvec, fjac, wa4) instead of calling         *
+* malloc.  It is sized with the per-point arrays for the largest stage, and  *
+* is a simple bump allocator: tsai_arena_alloc() hands out the next piece,   *
+* and a stage returns everything it took in O(1) by restoring arena_used     *
+* with tsai_arena_release() once it is done.                                 *
+*                                                                            *
+* Every optimization stage adds the residual (nfev) and Jacobian (njev)      *
+* evaluations it made to the context's counters; the evaluations behind a    *
+* finite-difference Jacobian are counted in nfev, and a Gauss-Newton step of *
+* the pose tracking, which gives both in one sweep, counts in each.  The     *
+* counters are never reset by the library.  lm_info keeps the info MINPACK   *
+* returned to the last stage (see lmder.c), by which its caller can tell how *
+* it stopped.  maxfev, when positive, bounds the residual evaluations of     *
+* each stage in place of MAXFEV.                                             *
+*                                                                            *
+* If pool is set, the optimization stages split their residual and           *
+* Jacobian sweeps over its threads in chunks of at least min_chunk points    *
+* (TSAI_MIN_CHUNK if min_chunk is 0); see cal_jac.c.  The five parameter     *
+* stages, which have no analytic Jacobian, instead evaluate its columns on   *
+* the threads at once, each on a copy of the context whose working arrays    *
+* are the pool's scratch memory (pool_scratch()).  The pool belongs to the   *
+* caller, and must not be running anything else during the calibration.      *
+* The transform routines need no per-point storage.                          *
+*                                                                            *
+* jacobian chooses how the optimization stages hand their Jacobian to        *
+* MINPACK.  TSAI_JACOBIAN_DENSE (the default) stores all of its rows for     *
+* lmder_.  TSAI_JACOBIAN_STREAMED folds the rows as they are computed into   *
+* an n by n+1 triangle for lmstr_, so the stage needs O(n^2) storage for it  *
+* however many points there are; the results agree with the dense ones to    *
+* rounding.  (The five parameter stages take the forward differences of a    *
+* tile of points at a time for it, on the calling thread.)  The arena is     *
+* sized for the mode, which must therefore be chosen before                  *
+* tsai_context_reserve() or tsai_context_attach(): a streamed context keeps  *
+* three arrays per point in it rather than fourteen.                         *
+*                                                                            *
+* ransac_threshold, when positive, makes the linear stages fit the radial    *
+* alignment constraint by LO-RANSAC, taking points within that many pixels   *
+* of their radial line as inliers, instead of by least squares over every    *
+* point; see cal_ransac.c.  ransac_confidence (TSAI_RANSAC_CONFIDENCE if 0)  *
+* and ransac_max_hypotheses (TSAI_RANSAC_MAX_HYPOTHESES if 0) bound its      *
+* search; the extrinsic parameter estimation fits U the same way.  While the *
+* three parameter stage or the extrinsic parameter estimation runs, outlier  *
+* flags the points the fit rejected, which the rest of it leaves out.        *
+*                                                                            *
+* loss, when not TSAI_LOSS_SQUARED, makes every optimization stage minimize  *
+* that robust loss of the errors by iteratively reweighted least squares,    *
+* at the scale loss_scale [pix] (estimated from the errors if 0); see        *
+* cal_robust.c.  While such a stage runs, weight holds the square roots of   *
+* the weights of the points.                                                 *
+*                                                                            *
+* warm_start_max_error bounds the median error [pix] of the points (see      *
+* tsai_median_error()) after a warm start (TSAI_WARM_START_MAX_ERROR if 0):  *
+* the warm start routines run only the full optimization from the camera     *
+* parameters and calibration constants already in the context, with at most  *
+* TSAI_WARM_START_MAXFEV residual evaluations (or maxfev, if fewer), and if  *
+* it fails, does not converge, leaves f non-positive or ends with a larger   *
+* median error, they run the full calibration from scratch instead and set   *
+* warm_start_fallback.  The median, unlike the mean, is not thrown by        *
+* mislabelled points.  The pose tracking (extrinsic_pose_tracking()) is      *
+* judged the same way.                                                       *
+*                                                                            *
+\****************************************************************************/
+#define TSAI_DATA_ALIGNMENT	64	/* [bytes] one cache line */
+#define TSAI_MIN_CHUNK		4096	/* [points] default min_chunk */
+#define TSAI_RANSAC_CONFIDENCE	0.99
+#define TSAI_RANSAC_MAX_HYPOTHESES	5000
+#define TSAI_WARM_START_MAX_ERROR	1.0	/* [pix] */
+#define TSAI_WARM_START_MAXFEV	100	/* residual evaluations */
+#define TSAI_IRLS_ROUNDS	10	/* most runs of a robust stage */
+#define TSAI_IRLS_TOLERANCE	1e-3	/* on the square roots of the weights */
+
+enum tsai_jacobian {
+    TSAI_JACOBIAN_DENSE, TSAI_JACOBIAN_STREAMED
+};
+
+enum tsai_loss {
+    TSAI_LOSS_SQUARED, TSAI_LOSS_HUBER, TSAI_LOSS_CAUCHY, TSAI_LOSS_TUKEY
+};
+
+/* the size and leading dimension of fjac for a stage with m points and n
+ * parameters, and the MINPACK driver that takes it */
+#define TSAI_JACOBIAN_SIZE(ctx, m, n) \
+	((ctx)->jacobian == TSAI_JACOBIAN_STREAMED ? (n) * ((n) + 1) : (m) * (n))
+#define TSAI_JACOBIAN_LD(ctx, m, n) \
+	((ctx)->jacobian == TSAI_JACOBIAN_STREAMED ? (n) : (m))
+#define TSAI_LM(ctx) \
+	((ctx)->jacobian == TSAI_JACOBIAN_STREAMED ? lmstr_ : lmder_)
+
+struct worker_pool;
+
+struct tsai_context {
+    struct camera_parameters     cp;
+    struct calibration_data      cd;
+    struct calibration_constants cc;
+
+    /* working storage for the linear stages */
+    double   *Xd;			/* [mm]          */
+    double   *Yd;			/* [mm]          */
+    double   *r_squared;		/* [mm^2]        */
+    double    U[7];
+
+    /* the block backing the per-point arrays */
+    void     *storage;
+    size_t    storage_size;		/* [bytes]       */
+
+    /* the workspace arena within that block */
+    double   *arena;
+    size_t    arena_size;		/* [doubles]     */
+    size_t    arena_used;		/* [doubles]     */
+
+    /* residual and Jacobian evaluations made by the optimization stages */
+    long      nfev;
+    long      njev;
+    int       lm_info;			/* of the last one */
+    int       maxfev;			/* MAXFEV if 0   */
+
+    /* optional pool for the point sweeps of the optimization stages */
+    struct worker_pool *pool;
+    int       min_chunk;		/* [points]      */
+
+    enum tsai_jacobian jacobian;
+
+    /* optional robust fit of the radial alignment constraint */
+    double    ransac_threshold;		/* [pix]         */
+    double    ransac_confidence;
+    int       ransac_max_hypotheses;
+    unsigned char *outlier;
+
+    /* optional robust loss of the optimization stages */
+    enum tsai_loss loss;
+    double    loss_scale;		/* [pix]         */
+    double   *weight;
+
+    /* acceptance test of the warm start routines */
+    double    warm_start_max_error;	/* [pix]         */
+    int       warm_start_fallback;
+
+    struct pytsai_errors err;
+};
+
+int   tsai_context_reserve (struct tsai_context *ctx, int point_count);
+int   tsai_context_attach (struct tsai_context *ctx, int point_count, double *xw, double *yw, double *zw, double *Xf, double *Yf);
+void  tsai_context_release (struct tsai_context *ctx);
+double *tsai_arena_alloc (struct tsai_context *ctx, size_t count);
+void  tsai_arena_release (struct tsai_context *ctx, size_t mark);
+int   ransac_compute_U (struct tsai_context *ctx, int n);
+double vote_Ty_sign (struct tsai_context *ctx, double r1, double r2, double r3, double r4, double r5, double r6, double Tx, double Ty);
+int   tsai_robust_stage (struct tsai_context *ctx, int (*stage) (struct tsai_context *ctx), int warm);
+int   tsai_median_error (struct tsai_context *ctx, double *median);
 
 /* Forward declarations for the calibration routines */
 #if 0   /* not needed for the Python version. */
@@ -201,31 +373,87 @@ void  initialize_sony_xc77_matrox_parms ();
 void  initialize_sony_xc57_androx_parms ();
 #endif
 
-int   coplanar_calibration ();
-int   coplanar_calibration_with_full_optimization ();
+int   coplanar_calibration (struct tsai_context *ctx);
+int   coplanar_calibration_with_full_optimization (struct tsai_context *ctx);
+
+int   noncoplanar_calibration (struct tsai_context *ctx);
+int   noncoplanar_calibration_with_full_optimization (struct tsai_context *ctx);
 
-int   noncoplanar_calibration ();
-int   noncoplanar_calibration_with_full_optimization ();
+int   coplanar_calibration_with_warm_start (struct tsai_context *ctx);
+int   noncoplanar_calibration_with_warm_start (struct tsai_context *ctx);
 
-int   coplanar_extrinsic_parameter_estimation ();
-int   noncoplanar_extrinsic_parameter_estimation ();
+int   coplanar_extrinsic_parameter_estimation (struct tsai_context *ctx);
+int   noncoplanar_extrinsic_parameter_estimation (struct tsai_context *ctx);
+int   extrinsic_parameter_estimation (struct tsai_context *ctx);
+int   extrinsic_pose_tracking (struct tsai_context *ctx);
+
+/* one camera from several views of a coplanar target (see cal_views.c) */
+int   coplanar_multi_view_calibration (struct tsai_context **views, int nviews);
+
+/* a rig of cameras from their views of a target in several poses (see
+ * cal_rig.c) */
+int   rig_calibration (struct tsai_context **views, int ncameras, int nposes, double *extrinsics, double *poses);
+
+/* the poses of many frames of a calibrated camera (see cal_batch.c) */
+struct tsai_frames {
+    int       count;			/* [frames]      */
+    ptrdiff_t *offset;			/* count + 1 point offsets */
+    double   *xw, *yw, *zw, *Xf, *Yf;
+    ptrdiff_t stride;			/* [doubles] between points */
+};
+
+int   extrinsic_parameter_estimation_batch (struct tsai_context **ctx, int nblocks, struct tsai_frames *frames, int chain, double *pose);
+
+/* the stages the calibration routines above are built from */
+int   cc_three_parm_optimization (struct tsai_context *ctx);
+int   cc_five_parm_optimization_with_late_distortion_removal (struct tsai_context *ctx);
+int   cc_five_parm_optimization_with_early_distortion_removal (struct tsai_context *ctx);
+int   cc_nic_optimization (struct tsai_context *ctx);
+int   cc_full_optimization (struct tsai_context *ctx);
+int   ncc_three_parm_optimization (struct tsai_context *ctx);
+int   ncc_nic_optimization (struct tsai_context *ctx);
+int   ncc_full_optimization (struct tsai_context *ctx);
+
+void  world_coord_to_image_coord (struct tsai_context *ctx, double xw, double yw, double zw, double *Xf, double *Yf);
+void  image_coord_to_world_coord (struct tsai_context *ctx, double Xfd, double Yfd, double zw, double *xw, double *yw);
+void  world_coord_to_camera_coord (struct tsai_context *ctx, double xw, double yw, double zw, double *xc, double *yc, double *zc);
+void  camera_coord_to_world_coord (struct tsai_context *ctx, double xc, double yc, double zc, double *xw, double *yw, double *zw);
+void  distorted_to_undistorted_sensor_coord (struct tsai_context *ctx, double Xd, double Yd, double *Xu, double *Yu);
+void  undistorted_to_distorted_sensor_coord (struct tsai_context *ctx, double Xu, double Yu, double *Xd, double *Yd);
+void  distorted_to_undistorted_image_coord (struct tsai_context *ctx, double Xfd, double Yfd, double *Xfu, double *Yfu);
+void  undistorted_to_distorted_image_coord (struct tsai_context *ctx, double Xfu, double Yfu, double *Xfd, double *Yfd);
+
+void  world_coord_to_image_coord_array (struct tsai_context *ctx, int n, double *wc, double *ic);
+void  image_coord_to_world_coord_array (struct tsai_context *ctx, int n, double *ic, double *wc);
+void  world_coord_to_camera_coord_array (struct tsai_context *ctx, int n, double *wc, double *cc);
+void  camera_coord_to_world_coord_array (struct tsai_context *ctx, int n, double *cc, double *wc);
+
+void  distorted_image_plane_error_stats (struct tsai_context *ctx, double *mean, double *stddev, double *max, double *sse);
+void  undistorted_image_plane_error_stats (struct tsai_context *ctx, double *mean, double *stddev, double *max, double *sse);
+void  object_space_error_stats (struct tsai_context *ctx, double *mean, double *stddev, double *max, double *sse);
+void  normalized_calibration_error (struct tsai_context *ctx, double *mean, double *stddev);
+
+/* Parameters of the error minimized by the nonlinear optimization stages,
+ * in the order of the noncoplanar full optimization (see cal_jac.c) */
+enum tsai_error_parameter {
+    TSAI_RX, TSAI_RY, TSAI_RZ, TSAI_TX, TSAI_TY, TSAI_TZ,
+    TSAI_KAPPA1, TSAI_F, TSAI_SX, TSAI_CX, TSAI_CY,
+    TSAI_ERROR_PARAMETERS
+};
 
-void  world_coord_to_image_coord ();
-void  image_coord_to_world_coord ();
-void  world_coord_to_camera_coord ();
-void  camera_coord_to_world_coord ();
-void  distorted_to_undistorted_sensor_coord ();
-void  undistorted_to_distorted_sensor_coord ();
-void  distorted_to_undistorted_image_coord ();
-void  undistorted_to_distorted_image_coord ();
+void  undistorted_sensor_error (struct tsai_context *ctx, double *params, int *column, double *Xd, double *Yd, double *err);
+void  undistorted_sensor_error_jacobian (struct tsai_context *ctx, double *params, int *column, double *Xd, double *Yd, double *err, double *fjac, int ldfjac);
+void  undistorted_sensor_error_triangle (struct tsai_context *ctx, double *params, int *column, double *Xd, double *Yd, double *err, double *r, int ldr);
+void  undistorted_sensor_error_normal (struct tsai_context *ctx, double *params, int *column, double *Xd, double *Yd, double *a);
 
-void  distorted_image_plane_error_stats ();
-void  undistorted_image_plane_error_stats ();
-void  object_space_error_stats ();
-void  normalized_calibration_error ();
+void  solve_RPY_transform (struct tsai_context *ctx);
+void  apply_RPY_transform (struct tsai_context *ctx);
 
-void  solve_RPY_transform ();
-void  apply_RPY_transform ();
+/* Picks the kernels for the processor, or as the PYTSAI_SIMD environment
+ * variable asks (see cal_cpu.c), on the first call only; until then the
+ * portable ones are used. */
+const char *tsai_simd_init (void);
+const char *tsai_simd_level (void);
 
 #endif /* CAL_MAIN_H */
 
@@ -0,0 +1,354 @@
+/**
+ * cal_ransac.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file contains a robust replacement for the least squares fit of the   *
+* radial alignment constraint in cc_compute_U() and ncc_compute_U():         *
+*                                                                            *
+*       ransac_compute_U ()                                                  *
+*                                                                            *
+* Each calibration point gives one linear equation row . U = Xd in the n     *
+* unknowns of U (five for a coplanar target, seven otherwise), which says    *
+* that the distorted sensor point (Xd, Yd) lies on the radial line through   *
+* the point's predicted position (a, b) in the camera.  A single mislabelled *
+* point can turn the least squares fit of all of them far enough to defeat   *
+* the later stages, so instead the fit is found by LO-RANSAC:                *
+*                                                                            *
+*   - A hypothesis solves the n equations of a random minimal sample of n    *
+*     points.  It is scored by its truncated squared error (MSAC), the sum   *
+*     over the points of min (d^2, t^2), where d = |Yd a - Xd b| / |(a, b)|  *
+*     is the distance of the point from its radial line and t the            *
+*     threshold ctx->ransac_threshold [pix] times dpy; the points with d < t *
+*     are its inliers.                                                       *
+*   - Hypotheses are drawn RANSAC_BATCH at a time, and a batch is scored in  *
+*     parallel on ctx->pool, a hypothesis to a task.  Each hypothesis draws  *
+*     its sample from a generator seeded with its own index, so the result   *
+*     does not depend on the pool.                                           *
+*   - Whenever a batch brings a new best hypothesis, it is locally optimized *
+*     by refitting U to its inliers by least squares until the score stops   *
+*     improving (at most LO_STEPS times).                                    *
+*   - The search ends once enough hypotheses have been drawn to have found   *
+*     an all-inlier sample with probability ctx->ransac_confidence, given    *
+*     the best inlier ratio so far, or after ctx->ransac_max_hypotheses.     *
+*                                                                            *
+* The points the best fit rejects are flagged in ctx->outlier, which the     *
+* rest of the three parameter stage (the sign of Ty, the approximate f and   *
+* Tz, and their refinement; see cal_jac.c) then leaves out.  As the radial   *
+* alignment constraint cannot tell the two sides of the image center apart,  *
+* the sign of Ty is taken from a vote of the inliers, and those on the wrong *
+* side are flagged as well.  The flags are drawn from the context's arena,   *
+* and cc_three_parm_optimization() and ncc_three_parm_optimization() forget  *
+* them when they finish, so the later stages see every point again.          *
+*                                                                            *
+* The extrinsic parameter estimation (ecalmain.c) fits U the same way, to    *
+* the undistorted sensor coordinates of the points, and leaves the           *
+* outliers out of its remaining steps and of epe_optimize().                 *
+*                                                                            *
+\****************************************************************************/
+
+#include <math.h>
+#include "cal_main.h"
+#include "../errors.h"
+#include "../matrix/matrix.h"
+#include "../pool/pool.h"
+
+#define RANSAC_BATCH	32	/* hypotheses scored at a time */
+#define LO_STEPS	4	/* refits of a new best hypothesis */
+#define MAX_UNKNOWNS	7
+
+struct ransac_search {
+    struct tsai_context *ctx;
+    int       n;			/* unknowns in U */
+    double    t2;			/* [mm^2] squared threshold */
+    long      first;			/* index of the batch's first hypothesis */
+
+    double    U[RANSAC_BATCH][MAX_UNKNOWNS];
+    double    cost[RANSAC_BATCH];
+    int       inliers[RANSAC_BATCH];
+};
+
+
+/* pytsai: cannot fail.  Fills the row of point i of the radial alignment
+ * constraint in n unknowns, as cc_compute_U() and ncc_compute_U() do, and
+ * returns its right hand side. */
+static double rac_row (struct tsai_context *ctx, int n, int i, double *row)
+{
+    double    Xd = ctx->Xd[i],
+              Yd = ctx->Yd[i],
+              xw = ctx->cd.xw[i],
+              yw = ctx->cd.yw[i],
+              zw = ctx->cd.zw[i];
+
+    if (n == 5) {
+	row[0] = Yd * xw;
+	row[1] = Yd * yw;
+	row[2] = Yd;
+	row[3] = -Xd * xw;
+	row[4] = -Xd * yw;
+    } else {
+	row[0] = Yd * xw;
+	row[1] = Yd * yw;
+	row[2] = Yd * zw;
+	row[3] = Yd;
+	row[4] = -Xd * xw;
+	row[5] = -Xd * yw;
+	row[6] = -Xd * zw;
+    }
+    return Xd;
+}
+
+
+/* pytsai: cannot fail.  The squared distance [mm^2] of point i from the
+ * radial line U predicts for it. */
+static double rac_distance2 (struct tsai_context *ctx, int n, double *U, int i)
+{
+    double    a,
+              b,
+              norm2,
+              xw = ctx->cd.xw[i],
+              yw = ctx->cd.yw[i],
+              zw = ctx->cd.zw[i];
+
+    if (n == 5) {
+	a = U[0] * xw + U[1] * yw + U[2];
+	b = U[3] * xw + U[4] * yw + 1.0;
+    } else {
+	a = U[0] * xw + U[1] * yw + U[2] * zw + U[3];
+	b = U[4] * xw + U[5] * yw + U[6] * zw + 1.0;
+    }
+    norm2 = SQR (a) + SQR (b);
+    if (!(norm2 > 0.0))
+	return HUGE_VAL;
+    return SQR (ctx->Yd[i] * a - ctx->Xd[i] * b) / norm2;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  The MSAC cost and the
+ * inliers of U. */
+static void score (struct tsai_context *ctx, int n, double t2, double *U,
+		   double *cost, int *inliers)
+{
+    int       i,
+              count = 0;
+
+    double    d2,
+              sum = 0.0;
+
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	d2 = rac_distance2 (ctx, n, U, i);
+	if (d2 < t2) {
+	    sum += d2;
+	    count++;
+	} else
+	    sum += t2;
+    }
+    *cost = sum;
+    *inliers = count;
+}
+
+
+/* pytsai: cannot fail.  splitmix64, to seed each hypothesis's own
+ * generator from its index. */
+static unsigned long long mix (unsigned long long x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Pool task drawing hypothesis first + h from a minimal sample and scoring
+ * it; a sample whose equations are singular gets an infinite cost. */
+static void hypothesis_task (void *arg, int h)
+{
+    struct ransac_search *rs = (struct ransac_search *) arg;
+    struct tsai_context *ctx = rs->ctx;
+
+    unsigned long long state = mix ((unsigned long long) (rs->first + h));
+
+    int       sample[MAX_UNKNOWNS],
+              m = ctx->cd.point_count,
+              j,
+              k;
+
+    double    row[MAX_UNKNOWNS],
+              rhs;
+
+    lsqsys    sys;
+
+    for (j = 0; j < rs->n; j++) {
+	do {
+	    state = mix (state);
+	    sample[j] = (int) (state % (unsigned long long) m);
+	    for (k = 0; k < j && sample[k] != sample[j]; k++)
+		;
+	} while (k < j);
+    }
+
+    lsq_init (&sys, rs->n);
+    for (j = 0; j < rs->n; j++) {
+	rhs = rac_row (ctx, rs->n, sample[j], row);
+	lsq_add_row (&sys, row, rhs);
+    }
+
+    if (lsq_solve (&sys, rs->U[h])) {
+	rs->cost[h] = HUGE_VAL;
+	rs->inliers[h] = 0;
+	return;
+    }
+    score (ctx, rs->n, rs->t2, rs->U[h], &rs->cost[h], &rs->inliers[h]);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * The local optimization of LO-RANSAC: refits U by least squares to its
+ * inliers for as long as that lowers its cost. */
+static void local_optimization (struct ransac_search *rs, double *U,
+				double *cost, int *inliers)
+{
+    struct tsai_context *ctx = rs->ctx;
+
+    int       step,
+              i,
+              j,
+              count;
+
+    double    row[MAX_UNKNOWNS],
+              fit[MAX_UNKNOWNS],
+              rhs,
+              trial;
+
+    lsqsys    sys;
+
+    for (step = 0; step < LO_STEPS && *inliers > rs->n; step++) {
+	lsq_init (&sys, rs->n);
+	for (i = 0; i < ctx->cd.point_count; i++)
+	    if (rac_distance2 (ctx, rs->n, U, i) < rs->t2) {
+		rhs = rac_row (ctx, rs->n, i, row);
+		lsq_add_row (&sys, row, rhs);
+	    }
+	if (lsq_solve (&sys, fit))
+	    return;
+
+	score (ctx, rs->n, rs->t2, fit, &trial, &count);
+	if (!(trial < *cost))
+	    return;
+	for (j = 0; j < rs->n; j++)
+	    U[j] = fit[j];
+	*cost = trial;
+	*inliers = count;
+    }
+}
+
+
+/* pytsai: cannot fail.  The hypotheses needed to draw an all-inlier sample
+ * of n of the m points with the given confidence, if inliers of them are
+ * inliers. */
+static double hypotheses_needed (double confidence, int inliers, int m, int n)
+{
+    double    p = pow ((double) inliers / m, n);
+
+    if (p >= 1.0)
+	return 0.0;
+    if (p <= 0.0)
+	return HUGE_VAL;
+    return ceil (log (1.0 - confidence) / log (1.0 - p));
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Fits U in n unknowns (5 for coplanar data, 7 otherwise) to the more than
+ * n points of ctx by LO-RANSAC, and flags the points it rejects in
+ * ctx->outlier, drawn from the context's arena. */
+int ransac_compute_U (struct tsai_context *ctx, int n)
+{
+    struct ransac_search rs;
+
+    int       m = ctx->cd.point_count,
+              max_hypotheses = ctx->ransac_max_hypotheses > 0 ?
+		  ctx->ransac_max_hypotheses : TSAI_RANSAC_MAX_HYPOTHESES,
+              batch,
+              best_inliers = 0,
+              h,
+              i,
+              j;
+
+    long      drawn = 0;
+
+    double    confidence = ctx->ransac_confidence > 0.0 ?
+		  ctx->ransac_confidence : TSAI_RANSAC_CONFIDENCE,
+              best[MAX_UNKNOWNS],
+              best_cost = HUGE_VAL,
+              needed = HUGE_VAL;
+
+    unsigned char *outlier;
+
+    outlier = (unsigned char *) tsai_arena_alloc (ctx, ((size_t) m + sizeof (double) - 1) / sizeof (double));
+    if (outlier == NULL)
+	return 0;
+
+    rs.ctx = ctx;
+    rs.n = n;
+    rs.t2 = SQR (ctx->ransac_threshold * ctx->cp.dpy);
+
+    while (drawn < max_hypotheses && drawn < needed) {
+	batch = (int) MIN (RANSAC_BATCH, max_hypotheses - drawn);
+	rs.first = drawn;
+	if (ctx->pool != NULL)
+	    pool_run (ctx->pool, batch, hypothesis_task, &rs);
+	else
+	    for (h = 0; h < batch; h++)
+		hypothesis_task (&rs, h);
+	drawn += batch;
+
+	/* the best of the batch, the first of equals */
+	for (h = 0, i = -1; h < batch; h++)
+	    if (rs.cost[h] < best_cost && (i < 0 || rs.cost[h] < rs.cost[i]))
+		i = h;
+	if (i < 0)
+	    continue;
+
+	best_cost = rs.cost[i];
+	best_inliers = rs.inliers[i];
+	for (j = 0; j < n; j++)
+	    best[j] = rs.U[i][j];
+	local_optimization (&rs, best, &best_cost, &best_inliers);
+	needed = hypotheses_needed (confidence, best_inliers, m, n);
+    }
+
+    if (best_cost == HUGE_VAL) {
+	pytsai_raise (&ctx->err, "ransac compute U: no sample of points could be solved for U");
+	return 0;
+    }
+
+    for (j = 0; j < n; j++)
+	ctx->U[j] = best[j];
+    for (i = 0; i < m; i++)
+	outlier[i] = !(rac_distance2 (ctx, n, best, i) < rs.t2);
+    ctx->outlier = outlier;
+
+    return 1;
+}
@@ -0,0 +1,1171 @@
+/**
+ * cal_rig.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file contains the joint calibration of a rig of cameras, fixed to     *
+* one another, that all see the same target in several poses:                *
+*                                                                            *
+*       rig_calibration ()                                                   *
+*                                                                            *
+* Each view (camera c seeing the target in pose k) is a context of its own   *
+* holding the calibration data of that view and the camera parameters of     *
+* camera c.  Every camera has its own kappa1, f, sx, Cx and Cy and its own   *
+* Rx, Ry, Rz, Tx, Ty and Tz, which place it in the world; the world is that  *
+* of the target in its first pose.  Every other pose k has its own Rx, Ry,   *
+* Rz, Tx, Ty and Tz carrying the target into the world, and is shared by all *
+* of the cameras that see it.  A world point p of view (c, k) is thus seen   *
+* by camera c at                                                             *
+*                                                                            *
+*       R_c (R_k p + T_k) + T_c                                              *
+*                                                                            *
+* and the error minimized is that of the single camera stages (see           *
+* cal_jac.c), summed over the points of every view.                          *
+*                                                                            *
+* Every camera is first calibrated on its own: a camera with coplanar data   *
+* by coplanar_multi_view_calibration() over all of its views, or by          *
+* coplanar_calibration_with_full_optimization() if it has only one, and      *
+* otherwise by noncoplanar_calibration_with_full_optimization() of its       *
+* largest noncoplanar view, followed by the extrinsic parameter estimation   *
+* of each of its other views.  The cameras and poses are then placed by      *
+* walking from the first pose through the views, in the order of the         *
+* cameras.                                                                   *
+*                                                                            *
+* The joint problem is then solved by Levenberg-Marquardt on the normal      *
+* equations, which are block structured: the 11 by 11 block of a camera and  *
+* the 6 by 6 block of a pose are coupled only by the views between them.     *
+* Each view folds the rows of the two components of each point's error into  *
+* an 11 by 12 triangle in the parameters of the pose it sees the target in   *
+* (undistorted_sensor_error_triangle()), and the chain rule carries that     *
+* triangle over to the camera's and the target pose's parameters.  A step    *
+* eliminates the pose blocks (the Schur complement), leaving a system in the *
+* parameters of the cameras alone, whose blocks are nonzero only for cameras *
+* that see a pose in common; that system is solved by Cholesky               *
+* factorization, and then each pose block for the update of its pose.  The   *
+* cost of an iteration thus grows with the number of points and of views,    *
+* and with the cube of the number of cameras only.                           *
+*                                                                            *
+* The step is damped with lambda D^2, where D holds the norms of the columns *
+* of the Jacobian, never decreasing, as with MINPACK's mode 1.  lambda is    *
+* updated after Nielsen, and the iteration stops, as in cal_views.c.         *
+*                                                                            *
+* If the first view's context has a pool (and there is more than one view)   *
+* the cameras are calibrated on it a camera to a task, and the views are     *
+* evaluated and folded on it a view to a task; the sweeps of each view then  *
+* run on the calling thread.  The normal equations are assembled in the      *
+* order of the views, so the result does not depend on the pool.  The        *
+* evaluations of the joint stage are added to the counters of every view.    *
+* Each view's workspace comes from its own arena.                            *
+*                                                                            *
+\****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "cal_jac.h"
+#include "../errors.h"
+#include "../pool/pool.h"
+
+#define CAMERA_PARMS	11	/* Rx, Ry, Rz, Tx, Ty, Tz, kappa1, f, sx, Cx, Cy */
+#define POSE_PARMS	6	/* Rx, Ry, Rz, Tx, Ty, Tz of a target pose */
+#define TRIANGLE_SIZE	(CAMERA_PARMS * (CAMERA_PARMS + 1))
+
+#define LAMBDA_START	1.0E-3	/* relative to the squared column norms */
+#define LAMBDA_MAX	1.0E16	/* beyond which no step can make progress */
+#define ACCEPT_RATIO	1.0E-4	/* of the predicted reduction, to take a step */
+#define RIG_MAXFEV	(1000 * CAMERA_PARMS)
+
+/* the parameters of a view are in the order of enum tsai_error_parameter */
+static int rig_column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+struct rig_view {
+    struct tsai_context *ctx;
+    struct worker_pool *pool;		/* ctx->pool, while the views share one */
+    size_t    mark;			/* of ctx's arena */
+    int       camera,
+              pose;
+
+    double    a[CAMERA_PARMS * CAMERA_PARMS];	/* R d err / d camera */
+    double    b[CAMERA_PARMS * POSE_PARMS];	/* R d err / d pose */
+    double    q[CAMERA_PARMS];			/* Q^T err */
+    double    h[CAMERA_PARMS * POSE_PARMS];	/* a^T b */
+    double    w[POSE_PARMS * CAMERA_PARMS];	/* the pose block \ h^T */
+
+    double   *err;			/* of the last evaluation */
+    double    sse;
+};
+
+struct rig_camera {
+    int       first,			/* its views */
+              count;
+    int       seeded,
+              placed;
+
+    double    x[CAMERA_PARMS];
+    double    step[CAMERA_PARMS];
+    double    diag[CAMERA_PARMS];
+    double    h[CAMERA_PARMS * CAMERA_PARMS];
+    double    g[CAMERA_PARMS];
+};
+
+struct rig_pose {
+    int       first,			/* its views, in rig_problem.by_pose */
+              count;
+    int       placed;
+
+    double    x[POSE_PARMS];
+    double    step[POSE_PARMS];
+    double    diag[POSE_PARMS];
+    double    h[POSE_PARMS * POSE_PARMS];
+    double    g[POSE_PARMS];
+    double    c[POSE_PARMS * POSE_PARMS];	/* damped h, factored */
+    double    y[POSE_PARMS];			/* c \ g */
+};
+
+struct rig_problem {
+    struct rig_view *view;
+    int       nviews;
+    struct tsai_context **ctx;		/* of the views */
+    int      *by_pose;			/* the views, pose by pose */
+    struct rig_camera *camera;
+    int       ncameras;
+    struct rig_pose *pose;
+    int       nposes;
+    struct worker_pool *pool;
+    int       trying;			/* evaluate at x + step */
+
+    double   *s;			/* the reduced system in the cameras */
+    double   *rhs;
+};
+
+
+/* pytsai: cannot fail; void return type is fine.  The rotation matrix
+ * r1..r9 of the angles Rx, Ry and Rz, as apply_RPY_transform() builds it. */
+static void rotation (double *angles, double *r)
+{
+    double    sa,
+              ca,
+              sb,
+              cb,
+              sg,
+              cg;
+
+    SINCOS (angles[0], sa, ca);
+    SINCOS (angles[1], sb, cb);
+    SINCOS (angles[2], sg, cg);
+
+    r[0] = cb * cg;
+    r[1] = cg * sa * sb - ca * sg;
+    r[2] = sa * sg + ca * cg * sb;
+    r[3] = cb * sg;
+    r[4] = sa * sb * sg + ca * cg;
+    r[5] = ca * sb * sg - cg * sa;
+    r[6] = -sb;
+    r[7] = cb * sa;
+    r[8] = ca * cb;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  The angles of the
+ * rotation matrix r, as solve_RPY_transform() finds them. */
+static void rotation_angles (double *r, double *angles)
+{
+    double    sg,
+              cg;
+
+    angles[2] = atan2 (r[3], r[0]);
+    SINCOS (angles[2], sg, cg);
+    angles[1] = atan2 (-r[6], r[0] * cg + r[3] * sg);
+    angles[0] = atan2 (r[2] * sg - r[5] * cg, r[4] * cg - r[1] * sg);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * A change d of the angles turns the rotation matrix R by the small
+ * rotation [w]x R, with w = B d.  Sets w to column i of B. */
+static void rate_column (double *angles, int i, double *w)
+{
+    double    sb,
+              cb,
+              sg,
+              cg;
+
+    SINCOS (angles[1], sb, cb);
+    SINCOS (angles[2], sg, cg);
+
+    switch (i) {
+      case 0:
+	w[0] = cb * cg; w[1] = cb * sg; w[2] = -sb;
+	break;
+      case 1:
+	w[0] = -sg; w[1] = cg; w[2] = 0.0;
+	break;
+      default:
+	w[0] = 0.0; w[1] = 0.0; w[2] = 1.0;
+	break;
+    }
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  The change d = B^-1 w of
+ * the angles that turns their rotation matrix by [w]x; singular where
+ * cos (Ry) is zero, as the angles themselves are. */
+static void angle_rate (double *angles, double *w, double *d)
+{
+    double    sb,
+              cb,
+              sg,
+              cg;
+
+    SINCOS (angles[1], sb, cb);
+    SINCOS (angles[2], sg, cg);
+
+    d[0] = (w[0] * cg + w[1] * sg) / cb;
+    d[1] = w[1] * cg - w[0] * sg;
+    d[2] = w[2] + sb * d[0];
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  y = r x, or r^T x if
+ * transposed. */
+static void rotate (double *r, int transposed, double *x, double *y)
+{
+    int       i;
+
+    for (i = 0; i < 3; i++)
+	y[i] = transposed ? r[i] * x[0] + r[i + 3] * x[1] + r[i + 6] * x[2]
+			  : r[3 * i] * x[0] + r[3 * i + 1] * x[1] + r[3 * i + 2] * x[2];
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  c = a b, or a^T b if
+ * transposed, for the 3 by 3 row major a and b. */
+static void rotation_product (double *a, int transposed, double *b, double *c)
+{
+    int       i,
+              j;
+
+    for (i = 0; i < 3; i++)
+	for (j = 0; j < 3; j++)
+	    c[3 * i + j] = transposed
+		? a[i] * b[j] + a[i + 3] * b[j + 3] + a[i + 6] * b[j + 6]
+		: a[3 * i] * b[j] + a[3 * i + 1] * b[j + 3] + a[3 * i + 2] * b[j + 6];
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  t = r^T. */
+static void transpose (double *r, double *t)
+{
+    int       j;
+
+    for (j = 0; j < 9; j++)
+	t[j] = r[3 * (j % 3) + j / 3];
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  The parameters of the
+ * camera and the pose of view v, at x or at x + step. */
+static void view_state (struct rig_problem *rp, int v, double *camera, double *pose)
+{
+    struct rig_camera *cam = rp->camera + rp->view[v].camera;
+    struct rig_pose *pos = rp->pose + rp->view[v].pose;
+    int       j;
+
+    for (j = 0; j < CAMERA_PARMS; j++)
+	camera[j] = cam->x[j] + (rp->trying ? cam->step[j] : 0.0);
+    for (j = 0; j < POSE_PARMS; j++)
+	pose[j] = pos->x[j] + (rp->trying ? pos->step[j] : 0.0);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * The parameters of view v in the order of rig_column: the pose of the
+ * target as camera c sees it, R_c R_k and R_c T_k + T_c, and the camera's
+ * own intrinsic parameters.  rc receives R_c. */
+static void view_params (struct rig_problem *rp, int v, double *camera,
+			 double *pose, double *params, double *rc)
+{
+    int       j;
+
+    double    rk[9],
+              r[9];
+
+    view_state (rp, v, camera, pose);
+    rotation (camera, rc);
+    rotation (pose, rk);
+    rotation_product (rc, 0, rk, r);
+    rotation_angles (r, params);
+    rotate (rc, 0, pose + 3, params + 3);
+    for (j = 0; j < 3; j++)
+	params[3 + j] += camera[3 + j];
+    for (j = POSE_PARMS; j < CAMERA_PARMS; j++)
+	params[j] = camera[j];
+}
+
+
+/* pytsai: cannot fail. */
+static int is_coplanar (struct tsai_context *ctx)
+{
+    int       i;
+
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if (ctx->cd.zw[i] != 0.0)
+	    return 0;
+    return 1;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Copies the intrinsic
+ * parameters of ctx to other. */
+static void copy_intrinsics (struct tsai_context *ctx, struct tsai_context *other)
+{
+    other->cc.kappa1 = ctx->cc.kappa1;
+    other->cc.f = ctx->cc.f;
+    other->cp.sx = ctx->cp.sx;
+    other->cp.Cx = ctx->cp.Cx;
+    other->cp.Cy = ctx->cp.Cy;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task calibrating
+ * camera c on its own and posing each of its views; a failure is raised in
+ * the context of the view that failed. */
+static void seed_task (void *arg, int c)
+{
+    struct rig_problem *rp = (struct rig_problem *) arg;
+    struct rig_camera *cam = rp->camera + c;
+    struct tsai_context **ctx = rp->ctx + cam->first,
+             *seed = NULL;
+
+    int       v,
+              ok = 1;
+
+    if (cam->count == 0) {
+	cam->seeded = 1;	/* left for place_rig() to report */
+	return;
+    }
+
+    for (v = 0; v < cam->count; v++)
+	if (!is_coplanar (ctx[v]) &&
+	    (seed == NULL || ctx[v]->cd.point_count > seed->cd.point_count))
+	    seed = ctx[v];
+
+    if (seed == NULL) {
+	if (cam->count > 1)
+	    cam->seeded = coplanar_multi_view_calibration (ctx, cam->count);
+	else
+	    cam->seeded = coplanar_calibration_with_full_optimization (ctx[0]);
+	return;
+    }
+
+    if (!noncoplanar_calibration_with_full_optimization (seed)) {
+	cam->seeded = 0;
+	return;
+    }
+    for (v = 0; v < cam->count && ok; v++) {
+	if (ctx[v] == seed)
+	    continue;
+	copy_intrinsics (seed, ctx[v]);
+	if (is_coplanar (ctx[v]))
+	    ok = coplanar_extrinsic_parameter_estimation (ctx[v]);
+	else
+	    ok = noncoplanar_extrinsic_parameter_estimation (ctx[v]);
+    }
+    cam->seeded = ok;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task evaluating the
+ * error of view v, at x or at x + step. */
+static void error_task (void *arg, int v)
+{
+    struct rig_problem *rp = (struct rig_problem *) arg;
+    struct rig_view *view = rp->view + v;
+
+    int       i;
+
+    double    camera[CAMERA_PARMS],
+              pose[POSE_PARMS],
+              params[CAMERA_PARMS],
+              rc[9],
+              sse = 0.0;
+
+    view_params (rp, v, camera, pose, params, rc);
+    undistorted_sensor_error (view->ctx, params, rig_column, NULL, NULL, view->err);
+    for (i = 0; i < view->ctx->cd.point_count; i++)
+	sse += SQR (view->err[i]);
+    view->sse = sse;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Pool task folding the Jacobian of the error components of view v at x,
+ * and carrying it over to the parameters of the camera (a) and of the pose
+ * (b).  With the view's pose turned by [w]x, w = B_c d_c + R_c B_k d_k, and
+ * its translation moved by w x R_c T_k + T_c' + R_c T_k'. */
+static void fold_task (void *arg, int v)
+{
+    struct rig_problem *rp = (struct rig_problem *) arg;
+    struct rig_view *view = rp->view + v;
+
+    int       i,
+              j,
+              k;
+
+    double    camera[CAMERA_PARMS],
+              pose[POSE_PARMS],
+              params[CAMERA_PARMS],
+              rc[9],
+              r[TRIANGLE_SIZE],
+              mc[CAMERA_PARMS * CAMERA_PARMS],
+              mp[CAMERA_PARMS * POSE_PARMS],
+              t[3],
+              w[3],
+              u[3],
+              sum;
+
+    view_params (rp, v, camera, pose, params, rc);
+    for (k = 0; k < TRIANGLE_SIZE; k++)
+	r[k] = 0.0;
+    undistorted_sensor_error_triangle (view->ctx, params, rig_column, NULL, NULL,
+				       NULL, r, CAMERA_PARMS);
+
+    /* d params / d camera (mc) and d params / d pose (mp), column major */
+    for (k = 0; k < CAMERA_PARMS * CAMERA_PARMS; k++)
+	mc[k] = 0.0;
+    for (k = 0; k < CAMERA_PARMS * POSE_PARMS; k++)
+	mp[k] = 0.0;
+    rotate (rc, 0, pose + 3, t);
+    for (j = 0; j < 3; j++) {
+	rate_column (camera, j, w);
+	angle_rate (params, w, mc + j * CAMERA_PARMS);
+	mc[3 + j * CAMERA_PARMS] = w[1] * t[2] - w[2] * t[1];
+	mc[4 + j * CAMERA_PARMS] = w[2] * t[0] - w[0] * t[2];
+	mc[5 + j * CAMERA_PARMS] = w[0] * t[1] - w[1] * t[0];
+
+	rate_column (pose, j, u);
+	rotate (rc, 0, u, w);
+	angle_rate (params, w, mp + j * CAMERA_PARMS);
+	for (i = 0; i < 3; i++)
+	    mp[3 + i + (3 + j) * CAMERA_PARMS] = rc[3 * i + j];
+    }
+    for (j = 3; j < CAMERA_PARMS; j++)
+	mc[j + j * CAMERA_PARMS] = 1.0;
+
+    /* a = R mc, b = R mp, with R upper triangular */
+    for (i = 0; i < CAMERA_PARMS; i++) {
+	for (j = 0; j < CAMERA_PARMS; j++) {
+	    sum = 0.0;
+	    for (k = i; k < CAMERA_PARMS; k++)
+		sum += r[i + k * CAMERA_PARMS] * mc[k + j * CAMERA_PARMS];
+	    view->a[i + j * CAMERA_PARMS] = sum;
+	}
+	for (j = 0; j < POSE_PARMS; j++) {
+	    sum = 0.0;
+	    for (k = i; k < CAMERA_PARMS; k++)
+		sum += r[i + k * CAMERA_PARMS] * mp[k + j * CAMERA_PARMS];
+	    view->b[i + j * CAMERA_PARMS] = sum;
+	}
+	view->q[i] = r[i + CAMERA_PARMS * CAMERA_PARMS];
+    }
+
+    /* the coupling of the camera and the pose, a^T b */
+    for (i = 0; i < CAMERA_PARMS; i++)
+	for (j = 0; j < POSE_PARMS; j++) {
+	    sum = 0.0;
+	    for (k = 0; k < CAMERA_PARMS; k++)
+		sum += view->a[k + i * CAMERA_PARMS] * view->b[k + j * CAMERA_PARMS];
+	    view->h[i + j * CAMERA_PARMS] = sum;
+	}
+}
+
+
+/* pytsai: cannot fail; void return type is fine. */
+static void run_tasks (struct rig_problem *rp, int ntasks, pool_task task)
+{
+    int       i;
+
+    if (rp->pool != NULL)
+	pool_run (rp->pool, ntasks, task, rp);
+    else
+	for (i = 0; i < ntasks; i++)
+	    task (rp, i);
+}
+
+
+/* pytsai: cannot fail.  The sum of the squared errors of the last
+ * evaluation. */
+static double total_sse (struct rig_problem *rp)
+{
+    int       v;
+    double    sse = 0.0;
+
+    for (v = 0; v < rp->nviews; v++)
+	sse += rp->view[v].sse;
+    return sse;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  c += a^T b for the m by n
+ * a and m by p b (leading dimension m), and the n by p c (leading
+ * dimension ldc). */
+static void add_product (double *a, double *b, int m, int n, int p,
+			 double *c, int ldc)
+{
+    int       i,
+              j,
+              k;
+    double    sum;
+
+    for (i = 0; i < n; i++)
+	for (j = 0; j < p; j++) {
+	    sum = 0.0;
+	    for (k = 0; k < m; k++)
+		sum += a[k + i * m] * b[k + j * m];
+	    c[i + j * ldc] += sum;
+	}
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Sums the folded views into the blocks of the normal equations, J^T J and
+ * J^T err, and updates the scale D from the norms of the columns of J.  The
+ * first pose, which defines the world, is held fixed. */
+static void assemble (struct rig_problem *rp, int first)
+{
+    struct rig_view *view;
+    struct rig_camera *cam;
+    struct rig_pose *pos;
+
+    int       v,
+              c,
+              k,
+              j;
+
+    double    norm;
+
+    for (c = 0; c < rp->ncameras; c++) {
+	cam = rp->camera + c;
+	for (j = 0; j < CAMERA_PARMS * CAMERA_PARMS; j++)
+	    cam->h[j] = 0.0;
+	for (j = 0; j < CAMERA_PARMS; j++)
+	    cam->g[j] = 0.0;
+    }
+    for (k = 0; k < rp->nposes; k++) {
+	pos = rp->pose + k;
+	for (j = 0; j < POSE_PARMS * POSE_PARMS; j++)
+	    pos->h[j] = 0.0;
+	for (j = 0; j < POSE_PARMS; j++)
+	    pos->g[j] = 0.0;
+    }
+
+    for (v = 0; v < rp->nviews; v++) {
+	view = rp->view + v;
+	cam = rp->camera + view->camera;
+	add_product (view->a, view->a, CAMERA_PARMS, CAMERA_PARMS, CAMERA_PARMS,
+		     cam->h, CAMERA_PARMS);
+	add_product (view->a, view->q, CAMERA_PARMS, CAMERA_PARMS, 1,
+		     cam->g, CAMERA_PARMS);
+	if (view->pose > 0) {
+	    pos = rp->pose + view->pose;
+	    add_product (view->b, view->b, CAMERA_PARMS, POSE_PARMS, POSE_PARMS,
+			 pos->h, POSE_PARMS);
+	    add_product (view->b, view->q, CAMERA_PARMS, POSE_PARMS, 1,
+			 pos->g, POSE_PARMS);
+	}
+    }
+
+    for (c = 0; c < rp->ncameras; c++) {
+	cam = rp->camera + c;
+	for (j = 0; j < CAMERA_PARMS; j++) {
+	    norm = sqrt (cam->h[j + j * CAMERA_PARMS]);
+	    if (first)
+		cam->diag[j] = norm != 0.0 ? norm : 1.0;
+	    else if (norm > cam->diag[j])
+		cam->diag[j] = norm;
+	}
+    }
+    for (k = 1; k < rp->nposes; k++) {
+	pos = rp->pose + k;
+	for (j = 0; j < POSE_PARMS; j++) {
+	    norm = sqrt (pos->h[j + j * POSE_PARMS]);
+	    if (first)
+		pos->diag[j] = norm != 0.0 ? norm : 1.0;
+	    else if (norm > pos->diag[j])
+		pos->diag[j] = norm;
+	}
+    }
+}
+
+
+/* pytsai: cannot fail.  Factors the symmetric n by n a, of which it reads
+ * the lower triangle, into L L^T in place; 0 if a is not positive
+ * definite. */
+static int cholesky (double *a, int n)
+{
+    int       i,
+              j,
+              k;
+    double    sum;
+
+    for (j = 0; j < n; j++) {
+	sum = a[j + j * n];
+	for (k = 0; k < j; k++)
+	    sum -= SQR (a[j + k * n]);
+	if (!(sum > 0.0))
+	    return 0;
+	a[j + j * n] = sqrt (sum);
+	for (i = j + 1; i < n; i++) {
+	    sum = a[i + j * n];
+	    for (k = 0; k < j; k++)
+		sum -= a[i + k * n] * a[j + k * n];
+	    a[i + j * n] = sum / a[j + j * n];
+	}
+    }
+    return 1;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Solves L L^T x = b in
+ * place for the factor l of cholesky(). */
+static void cholesky_solve (double *l, int n, double *b)
+{
+    int       i,
+              k;
+
+    for (i = 0; i < n; i++) {
+	for (k = 0; k < i; k++)
+	    b[i] -= l[i + k * n] * b[k];
+	b[i] /= l[i + i * n];
+    }
+    for (i = n - 1; i >= 0; i--) {
+	for (k = i + 1; k < n; k++)
+	    b[i] -= l[k + i * n] * b[k];
+	b[i] /= l[i + i * n];
+    }
+}
+
+
+/* pytsai: cannot fail.
+ *
+ * Computes the step solving (J^T J + lambda D^2) step = -J^T err: the pose
+ * blocks are eliminated, the reduced system in the cameras is solved, and
+ * then each pose block.  0 if the damped system is not positive definite to
+ * working precision, which the caller takes as a failed step. */
+static int solve_step (struct rig_problem *rp, double lambda)
+{
+    struct rig_view *view,
+             *other;
+    struct rig_camera *cam;
+    struct rig_pose *pos;
+
+    int       n = rp->ncameras * CAMERA_PARMS,
+              v,
+              u,
+              c,
+              k,
+              i,
+              j,
+              l;
+
+    double   *s = rp->s,
+             *rhs = rp->rhs,
+              col[POSE_PARMS],
+              sum;
+
+    for (k = 0; k < n * n; k++)
+	s[k] = 0.0;
+
+    for (c = 0; c < rp->ncameras; c++) {
+	cam = rp->camera + c;
+	for (j = 0; j < CAMERA_PARMS; j++) {
+	    for (i = 0; i < CAMERA_PARMS; i++)
+		s[c * CAMERA_PARMS + i + (c * CAMERA_PARMS + j) * n] = cam->h[i + j * CAMERA_PARMS];
+	    s[c * CAMERA_PARMS + j + (c * CAMERA_PARMS + j) * n] += lambda * SQR (cam->diag[j]);
+	    rhs[c * CAMERA_PARMS + j] = -cam->g[j];
+	}
+    }
+
+    /* eliminate the pose blocks */
+    for (k = 1; k < rp->nposes; k++) {
+	pos = rp->pose + k;
+	for (j = 0; j < POSE_PARMS * POSE_PARMS; j++)
+	    pos->c[j] = pos->h[j];
+	for (j = 0; j < POSE_PARMS; j++) {
+	    pos->c[j + j * POSE_PARMS] += lambda * SQR (pos->diag[j]);
+	    pos->y[j] = pos->g[j];
+	}
+	if (!cholesky (pos->c, POSE_PARMS))
+	    return 0;
+	cholesky_solve (pos->c, POSE_PARMS, pos->y);
+
+	for (v = 0; v < pos->count; v++) {
+	    view = rp->view + rp->by_pose[pos->first + v];
+	    for (i = 0; i < CAMERA_PARMS; i++) {
+		for (j = 0; j < POSE_PARMS; j++)
+		    col[j] = view->h[i + j * CAMERA_PARMS];
+		cholesky_solve (pos->c, POSE_PARMS, col);
+		for (j = 0; j < POSE_PARMS; j++)
+		    view->w[j + i * POSE_PARMS] = col[j];
+	    }
+	    for (i = 0; i < CAMERA_PARMS; i++)
+		for (j = 0; j < POSE_PARMS; j++)
+		    rhs[view->camera * CAMERA_PARMS + i] += view->h[i + j * CAMERA_PARMS] * pos->y[j];
+
+	    /* the views are by camera, so other->camera <= view->camera */
+	    for (u = 0; u <= v; u++) {
+		other = rp->view + rp->by_pose[pos->first + u];
+		for (i = 0; i < CAMERA_PARMS; i++)
+		    for (j = 0; j < CAMERA_PARMS; j++) {
+			sum = 0.0;
+			for (l = 0; l < POSE_PARMS; l++)
+			    sum += view->h[i + l * CAMERA_PARMS] * other->w[l + j * POSE_PARMS];
+			s[view->camera * CAMERA_PARMS + i + (other->camera * CAMERA_PARMS + j) * n] -= sum;
+		    }
+	    }
+	}
+    }
+
+    if (!cholesky (s, n))
+	return 0;
+    cholesky_solve (s, n, rhs);
+    for (c = 0; c < rp->ncameras; c++)
+	for (j = 0; j < CAMERA_PARMS; j++)
+	    rp->camera[c].step[j] = rhs[c * CAMERA_PARMS + j];
+
+    /* and back substitute for the poses */
+    for (j = 0; j < POSE_PARMS; j++)
+	rp->pose[0].step[j] = 0.0;
+    for (k = 1; k < rp->nposes; k++) {
+	pos = rp->pose + k;
+	for (j = 0; j < POSE_PARMS; j++)
+	    col[j] = -pos->g[j];
+	for (v = 0; v < pos->count; v++) {
+	    view = rp->view + rp->by_pose[pos->first + v];
+	    cam = rp->camera + view->camera;
+	    for (j = 0; j < POSE_PARMS; j++)
+		for (i = 0; i < CAMERA_PARMS; i++)
+		    col[j] -= view->h[i + j * CAMERA_PARMS] * cam->step[i];
+	}
+	cholesky_solve (pos->c, POSE_PARMS, col);
+	for (j = 0; j < POSE_PARMS; j++)
+	    pos->step[j] = col[j];
+    }
+    return 1;
+}
+
+
+/* pytsai: cannot fail.  -g^T step + lambda |D step|^2, which is
+ * |err|^2 - |J step + err|^2, the reduction of the error the linear model
+ * predicts for the step solve_step() found. */
+static double predicted_reduction (struct rig_problem *rp, double lambda)
+{
+    struct rig_camera *cam;
+    struct rig_pose *pos;
+
+    int       c,
+              k,
+              j;
+
+    double    sum = 0.0;
+
+    for (c = 0; c < rp->ncameras; c++) {
+	cam = rp->camera + c;
+	for (j = 0; j < CAMERA_PARMS; j++)
+	    sum += -cam->g[j] * cam->step[j] + lambda * SQR (cam->diag[j] * cam->step[j]);
+    }
+    for (k = 1; k < rp->nposes; k++) {
+	pos = rp->pose + k;
+	for (j = 0; j < POSE_PARMS; j++)
+	    sum += -pos->g[j] * pos->step[j] + lambda * SQR (pos->diag[j] * pos->step[j]);
+    }
+    return sum;
+}
+
+
+/* pytsai: cannot fail.  |D x| or, if of_step, |D step|. */
+static double scaled_norm (struct rig_problem *rp, int of_step)
+{
+    struct rig_camera *cam;
+    struct rig_pose *pos;
+
+    int       c,
+              k,
+              j;
+
+    double    sum = 0.0;
+
+    for (c = 0; c < rp->ncameras; c++) {
+	cam = rp->camera + c;
+	for (j = 0; j < CAMERA_PARMS; j++)
+	    sum += SQR (cam->diag[j] * (of_step ? cam->step[j] : cam->x[j]));
+    }
+    for (k = 1; k < rp->nposes; k++) {
+	pos = rp->pose + k;
+	for (j = 0; j < POSE_PARMS; j++)
+	    sum += SQR (pos->diag[j] * (of_step ? pos->step[j] : pos->x[j]));
+    }
+    return sqrt (sum);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * The Levenberg-Marquardt iteration, as in cal_views.c.  A step the damped
+ * system cannot be solved for fails like any other bad step. */
+static void optimize_rig (struct rig_problem *rp, long *nfev, long *njev)
+{
+    struct rig_camera *cam;
+    struct rig_pose *pos;
+
+    int       first = 1,
+              c,
+              k,
+              j;
+
+    double    sse,
+              trial,
+              actual,
+              predicted,
+              ratio,
+              pnorm,
+              t,
+              lambda = LAMBDA_START,
+              nu = 2.0;
+
+    rp->trying = 0;
+    run_tasks (rp, rp->nviews, error_task);
+    sse = total_sse (rp);
+    ++*nfev;
+
+    while (sse > 0.0) {
+	run_tasks (rp, rp->nviews, fold_task);
+	++*njev;
+	assemble (rp, first);
+	first = 0;
+
+	for (;;) {
+	    if (solve_step (rp, lambda)) {
+		rp->trying = 1;
+		run_tasks (rp, rp->nviews, error_task);
+		rp->trying = 0;
+		++*nfev;
+
+		trial = total_sse (rp);
+		actual = sse - trial;
+		predicted = predicted_reduction (rp, lambda);
+		ratio = predicted > 0.0 ? actual / predicted : 0.0;
+		pnorm = scaled_norm (rp, 1);
+
+		if (ratio > ACCEPT_RATIO) {
+		    for (c = 0; c < rp->ncameras; c++) {
+			cam = rp->camera + c;
+			for (j = 0; j < CAMERA_PARMS; j++)
+			    cam->x[j] += cam->step[j];
+		    }
+		    for (k = 1; k < rp->nposes; k++) {
+			pos = rp->pose + k;
+			for (j = 0; j < POSE_PARMS; j++)
+			    pos->x[j] += pos->step[j];
+		    }
+
+		    t = 2.0 * ratio - 1.0;
+		    lambda *= (1.0 - t * t * t > 1.0 / 3.0) ? 1.0 - t * t * t : 1.0 / 3.0;
+		    nu = 2.0;
+
+		    if ((fabs (actual) <= REL_SENSOR_TOLERANCE_ftol * sse &&
+			 predicted <= REL_SENSOR_TOLERANCE_ftol * sse) ||
+			pnorm <= REL_PARAM_TOLERANCE_xtol * scaled_norm (rp, 0) ||
+			*nfev >= RIG_MAXFEV)
+			return;
+		    sse = trial;
+		    break;
+		}
+		if (pnorm <= REL_PARAM_TOLERANCE_xtol * scaled_norm (rp, 0))
+		    return;
+	    }
+
+	    lambda *= nu;
+	    nu *= 2.0;
+	    if (lambda > LAMBDA_MAX || *nfev >= RIG_MAXFEV)
+		return;
+	}
+    }
+}
+
+
+/* pytsai: cannot fail.
+ *
+ * Places the cameras and poses from the poses of the views found by
+ * seed_task(), walking out from the first pose; 0 if some camera or pose
+ * cannot be reached. */
+static int place_rig (struct rig_problem *rp)
+{
+    struct rig_view *view;
+    struct rig_camera *cam;
+    struct rig_pose *pos;
+    struct tsai_context *ctx;
+
+    int       changed = 1,
+              v,
+              c,
+              k,
+              j;
+
+    double    p[POSE_PARMS],
+              rv[9],
+              rc[9],
+              rk[9],
+              r[9],
+              t[3];
+
+    for (j = 0; j < POSE_PARMS; j++)
+	rp->pose[0].x[j] = 0.0;
+    rp->pose[0].placed = 1;
+
+    while (changed) {
+	changed = 0;
+	for (v = 0; v < rp->nviews; v++) {
+	    view = rp->view + v;
+	    cam = rp->camera + view->camera;
+	    pos = rp->pose + view->pose;
+	    if (cam->placed == pos->placed)
+		continue;
+
+	    ctx = view->ctx;
+	    p[0] = ctx->cc.Rx;
+	    p[1] = ctx->cc.Ry;
+	    p[2] = ctx->cc.Rz;
+	    p[3] = ctx->cc.Tx;
+	    p[4] = ctx->cc.Ty;
+	    p[5] = ctx->cc.Tz;
+	    rotation (p, rv);
+
+	    if (pos->placed) {
+		/* R_c = R_p R_k^T, T_c = T_p - R_c T_k */
+		rotation (pos->x, rk);
+		transpose (rk, r);
+		rotation_product (rv, 0, r, rc);
+		rotation_angles (rc, cam->x);
+		rotate (rc, 0, pos->x + 3, t);
+		for (j = 0; j < 3; j++)
+		    cam->x[3 + j] = p[3 + j] - t[j];
+		cam->placed = 1;
+	    } else {
+		/* R_k = R_c^T R_p, T_k = R_c^T (T_p - T_c) */
+		rotation (cam->x, rc);
+		rotation_product (rc, 1, rv, rk);
+		rotation_angles (rk, pos->x);
+		for (j = 0; j < 3; j++)
+		    t[j] = p[3 + j] - cam->x[3 + j];
+		rotate (rc, 1, t, pos->x + 3);
+		pos->placed = 1;
+	    }
+	    changed = 1;
+	}
+    }
+
+    for (c = 0; c < rp->ncameras; c++)
+	if (!rp->camera[c].placed)
+	    return 0;
+    for (k = 0; k < rp->nposes; k++)
+	if (!rp->pose[k].placed)
+	    return 0;
+    return 1;
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Calibrates the rig of ncameras cameras from its views of the target in
+ * nposes poses.  views[c * nposes + k] is the view of camera c of pose k,
+ * or NULL if the camera did not see it; there must be at least one view.
+ * Each view's context is left with the intrinsic parameters of its camera
+ * and the pose of the target as the camera sees it, extrinsics[6 * c] with
+ * the Rx, Ry, Rz, Tx, Ty and Tz of camera c in the world, and poses[6 * k]
+ * with those of pose k (zero for the first).  A failure is raised in the
+ * context of the view that failed, or in the first view's if the views
+ * could not be set up. */
+int rig_calibration (struct tsai_context **views, int ncameras, int nposes,
+		     double *extrinsics, double *poses)
+{
+    struct rig_problem rp;
+    struct rig_view *view;
+    struct rig_camera *cam;
+    struct tsai_context *ctx,
+             *first = NULL;
+
+    int       ok = 1,
+              n = ncameras * CAMERA_PARMS,
+              nviews = 0,
+             *fill,
+              v,
+              c,
+              k,
+              j;
+
+    long      nfev = 0,
+              njev = 0;
+
+    double    camera[CAMERA_PARMS],
+              pose[POSE_PARMS],
+              params[CAMERA_PARMS],
+              rc[9];
+
+    for (v = 0; v < ncameras * nposes; v++)
+	if (views[v] != NULL) {
+	    if (first == NULL)
+		first = views[v];
+	    nviews++;
+	}
+    if (first == NULL)
+	return 0;
+
+    rp.s = (double *) malloc ((size_t) (n * n + n) * sizeof (double) +
+			      nviews * sizeof (struct rig_view) +
+			      ncameras * sizeof (struct rig_camera) +
+			      nposes * sizeof (struct rig_pose) +
+			      nviews * sizeof (struct tsai_context *) +
+			      (nviews + nposes) * sizeof (int));
+    if (rp.s == NULL) {
+	pytsai_raise (&first->err, "rig_calibration: out of memory");
+	return 0;
+    }
+    rp.rhs = rp.s + n * n;
+    rp.view = (struct rig_view *) (rp.rhs + n);
+    rp.camera = (struct rig_camera *) (rp.view + nviews);
+    rp.pose = (struct rig_pose *) (rp.camera + ncameras);
+    rp.ctx = (struct tsai_context **) (rp.pose + nposes);
+    rp.by_pose = (int *) (rp.ctx + nviews);
+    fill = rp.by_pose + nviews;
+    rp.nviews = nviews;
+    rp.ncameras = ncameras;
+    rp.nposes = nposes;
+    rp.pool = nviews > 1 ? first->pool : NULL;
+    rp.trying = 0;
+
+    /* the views, camera by camera, and pose by pose */
+    for (k = 0; k < nposes; k++) {
+	rp.pose[k].count = 0;
+	rp.pose[k].placed = 0;
+    }
+    for (c = 0, v = 0; c < ncameras; c++) {
+	cam = rp.camera + c;
+	cam->first = v;
+	cam->count = 0;
+	cam->placed = 0;
+	for (k = 0; k < nposes; k++) {
+	    ctx = views[c * nposes + k];
+	    if (ctx == NULL)
+		continue;
+	    view = rp.view + v;
+	    view->ctx = ctx;
+	    view->pool = ctx->pool;
+	    view->mark = ctx->arena_used;
+	    view->camera = c;
+	    view->pose = k;
+	    if (rp.pool != NULL)
+		ctx->pool = NULL;
+	    rp.ctx[v++] = ctx;
+	    cam->count++;
+	    rp.pose[k].count++;
+	}
+    }
+    for (k = 0, v = 0; k < nposes; k++) {
+	rp.pose[k].first = v;
+	fill[k] = v;
+	v += rp.pose[k].count;
+    }
+    for (v = 0; v < nviews; v++)
+	rp.by_pose[fill[rp.view[v].pose]++] = v;
+
+    /* calibrate every camera on its own, and pose its views */
+    run_tasks (&rp, ncameras, seed_task);
+    for (c = 0; c < ncameras; c++)
+	if (rp.camera[c].count > 0 && !rp.camera[c].seeded)
+	    ok = 0;
+
+    if (ok) {
+	for (c = 0; c < ncameras; c++) {
+	    cam = rp.camera + c;
+	    if (cam->count == 0)
+		continue;
+	    ctx = rp.ctx[cam->first];
+	    cam->x[TSAI_KAPPA1] = ctx->cc.kappa1;
+	    cam->x[TSAI_F] = ctx->cc.f;
+	    cam->x[TSAI_SX] = ctx->cp.sx;
+	    cam->x[TSAI_CX] = ctx->cp.Cx;
+	    cam->x[TSAI_CY] = ctx->cp.Cy;
+	}
+	if (!place_rig (&rp)) {
+	    pytsai_raise (&first->err, "rig_calibration: the views do not link every camera and pose to the first pose");
+	    ok = 0;
+	}
+    }
+
+    for (v = 0; v < nviews && ok; v++) {
+	view = rp.view + v;
+	view->err = tsai_arena_alloc (view->ctx, view->ctx->cd.point_count);
+	if (view->err == NULL)
+	    ok = 0;
+    }
+
+    if (ok) {
+	optimize_rig (&rp, &nfev, &njev);
+
+	for (v = 0; v < nviews; v++) {
+	    view = rp.view + v;
+	    ctx = view->ctx;
+	    view_params (&rp, v, camera, pose, params, rc);
+	    ctx->cc.Rx = params[TSAI_RX];
+	    ctx->cc.Ry = params[TSAI_RY];
+	    ctx->cc.Rz = params[TSAI_RZ];
+	    apply_RPY_transform (ctx);
+
+	    ctx->cc.Tx = params[TSAI_TX];
+	    ctx->cc.Ty = params[TSAI_TY];
+	    ctx->cc.Tz = params[TSAI_TZ];
+	    ctx->cc.kappa1 = params[TSAI_KAPPA1];
+	    ctx->cc.f = params[TSAI_F];
+	    ctx->cp.sx = params[TSAI_SX];
+	    ctx->cp.Cx = params[TSAI_CX];
+	    ctx->cp.Cy = params[TSAI_CY];
+	    ctx->nfev += nfev;
+	    ctx->njev += njev;
+	}
+	for (c = 0; c < ncameras; c++)
+	    for (j = 0; j < POSE_PARMS; j++)
+		extrinsics[POSE_PARMS * c + j] = rp.camera[c].x[j];
+	for (k = 0; k < nposes; k++)
+	    for (j = 0; j < POSE_PARMS; j++)
+		poses[POSE_PARMS * k + j] = rp.pose[k].x[j];
+    }
+
+    for (v = 0; v < nviews; v++) {
+	view = rp.view + v;
+	tsai_arena_release (view->ctx, view->mark);
+	view->ctx->pool = view->pool;
+    }
+    free (rp.s);
+    return ok;
+}
@@ -0,0 +1,347 @@
+/**
+ * cal_robust.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file contains the robust losses of the optimization stages:           *
+*                                                                            *
+*       tsai_robust_stage ()                                                 *
+*       tsai_median_error ()                                                 *
+*                                                                            *
+* MINPACK minimizes the sum of the squared errors, which lets a single       *
+* mislabelled point drag the whole calibration after it.  With ctx->loss     *
+* set to one of the robust losses, every optimization stage (the three and   *
+* five parameter stages, the nic and full optimizations and epe_optimize)    *
+* minimizes instead the sum of rho (err / s) by iteratively reweighted       *
+* least squares: the stage runs to convergence with each point's error       *
+* (and its row of the Jacobian) scaled by the square root of a weight        *
+* w (u) = rho' (u) / u of its scaled error u from the previous run, and is   *
+* run again from where it stopped, until the weights settle (no weight       *
+* moves by more than TSAI_IRLS_TOLERANCE) or after TSAI_IRLS_ROUNDS runs.    *
+* The first weights come from the errors of the parameters the stage starts  *
+* from, so a good start (say from RANSAC, see cal_ransac.c) is not lost to   *
+* an unweighted first run; only the three parameter stages, which start      *
+* afresh, weigh every point the same at first.                               *
+* The weights stay fixed during a run, so they cost the error routines a     *
+* multiplication per point.  With u = |err| / s and the usual tuning         *
+* constants c (95% efficiency for Gaussian errors):                          *
+*                                                                            *
+*       TSAI_LOSS_HUBER    w = 1 for u <= c, c / u otherwise (c = 1.345)     *
+*       TSAI_LOSS_CAUCHY   w = 1 / (1 + (u / c)^2)           (c = 2.3849)    *
+*       TSAI_LOSS_TUKEY    w = (1 - (u / c)^2)^2 for u < c, 0 otherwise      *
+*                                                            (c = 4.6851)    *
+*                                                                            *
+* The scale s is ctx->loss_scale [pix] if it is positive, and otherwise      *
+* the median absolute error of the previous run times 1.4826, the            *
+* consistent estimate of the standard deviation for Gaussian errors.  The    *
+* errors are measured on the undistorted sensor plane and taken to pixels    *
+* with dpy.  The points the robust fit of U rejected (ctx->outlier, still    *
+* set while the extrinsic parameter estimation runs) are left out of the     *
+* median, as their errors are held at zero.                                  *
+*                                                                            *
+* A run that does not converge, or that leaves f non-positive or any         *
+* parameter not finite, fails the stage.  A run that raises the median error *
+* (see below) over the best run so far ends the stage with the best run's    *
+* parameters: a scale estimated from growing errors would let the outliers   *
+* back in, and the fit could slide away from the inliers.                    *
+*                                                                            *
+* tsai_median_error() gives the median of the same errors, by which the      *
+* warm start routines (cal_main.c) and the pose tracking (ecalmain.c) judge  *
+* their results.                                                             *
+*                                                                            *
+* The square roots of the weights live in ctx->weight, drawn from the        *
+* context's arena, while a robust stage runs; undistorted_sensor_error()     *
+* and its Jacobian (cal_jac.c) and the five parameter error routines apply   *
+* them, as do the moments behind the linear fits of the five parameter       *
+* stages.                                                                    *
+*                                                                            *
+\****************************************************************************/
+
+#include <math.h>
+#include "cal_main.h"
+#include "../errors.h"
+
+#define HUBER_C		1.345
+#define CAUCHY_C	2.3849
+#define TUKEY_C		4.6851
+#define MAD_TO_SIGMA	1.4826	/* 1 / Phi^-1 (3/4) */
+
+/* whether point i is left out by the robust fit of U (see cal_ransac.c),
+ * which makes its error zero */
+#define FLAGGED(ctx, i)	((ctx)->outlier != NULL && (ctx)->outlier[i])
+
+
+/* pytsai: cannot fail.  The k-th smallest of a[0..n-1], which it reorders
+ * (Hoare's selection). */
+static double select_kth (double *a, int n, int k)
+{
+    int       lo = 0,
+              hi = n - 1,
+              i,
+              j;
+
+    double    pivot,
+              t;
+
+    while (lo < hi) {
+	pivot = a[(lo + hi) / 2];
+	i = lo;
+	j = hi;
+	do {
+	    while (a[i] < pivot)
+		i++;
+	    while (pivot < a[j])
+		j--;
+	    if (i <= j) {
+		t = a[i];
+		a[i] = a[j];
+		a[j] = t;
+		i++;
+		j--;
+	    }
+	} while (i <= j);
+	if (k <= j)
+	    hi = j;
+	else if (k >= i)
+	    lo = i;
+	else
+	    break;
+    }
+    return a[k];
+}
+
+
+/* pytsai: cannot fail.  The square root of the weight of a point with the
+ * scaled error u >= 0. */
+static double root_weight (enum tsai_loss loss, double u)
+{
+    switch (loss) {
+    case TSAI_LOSS_HUBER:
+	return u <= HUBER_C ? 1.0 : sqrt (HUBER_C / u);
+    case TSAI_LOSS_CAUCHY:
+	return 1.0 / sqrt (1.0 + SQR (u / CAUCHY_C));
+    case TSAI_LOSS_TUKEY:
+	return u < TUKEY_C ? 1.0 - SQR (u / TUKEY_C) : 0.0;
+    default:
+	return 1.0;
+    }
+}
+
+
+/* pytsai: cannot fail.  Fills err with the plain errors [pix] of the
+ * points for the current parameters. */
+static void plain_errors (struct tsai_context *ctx, double *err)
+{
+    static int column[TSAI_ERROR_PARAMETERS] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+
+    int       i;
+
+    undistorted_sensor_error (ctx, NULL, column, NULL, NULL, err);
+    for (i = 0; i < ctx->cd.point_count; i++)
+	err[i] /= ctx->cp.dpy;
+}
+
+
+/* pytsai: cannot fail.  Whether f is positive and the parameters a stage
+ * fits are all finite. */
+static int usable_parameters (struct tsai_context *ctx)
+{
+    double    p[] = { ctx->cc.f, ctx->cc.kappa1, ctx->cc.Tx, ctx->cc.Ty, ctx->cc.Tz,
+		      ctx->cc.Rx, ctx->cc.Ry, ctx->cc.Rz, ctx->cp.Cx, ctx->cp.Cy, ctx->cp.sx };
+
+    int       i;
+
+    if (!(ctx->cc.f > 0))
+	return 0;
+    for (i = 0; i < (int) (sizeof (p) / sizeof (p[0])); i++)
+	if (!(fabs (p[i]) < HUGE_VAL))
+	    return 0;
+    return 1;
+}
+
+
+/* pytsai: can fail; int return type is required.
+ *
+ * Sets weight from the errors of the current parameters, and *change to
+ * the most any of them moved; leaves them, with *change 0, if the errors
+ * are all zero.  The scale is estimated from the points not FLAGGED, whose
+ * zero errors would otherwise pull it down. */
+static int reweigh (struct tsai_context *ctx, double *weight, double *change)
+{
+    int       m = ctx->cd.point_count,
+              kept,
+              i;
+
+    double   *err,
+             *sorted,
+              scale,
+              w;
+
+    size_t    mark = ctx->arena_used;
+
+    *change = 0.0;
+
+    /* the plain errors [pix] */
+    err = tsai_arena_alloc (ctx, m);
+    sorted = tsai_arena_alloc (ctx, m);
+    if (err == NULL || sorted == NULL) {
+	tsai_arena_release (ctx, mark);
+	return 0;
+    }
+    plain_errors (ctx, err);
+    for (i = kept = 0; i < m; i++)
+	if (!FLAGGED (ctx, i))
+	    sorted[kept++] = err[i];
+
+    if (ctx->loss_scale > 0)
+	scale = ctx->loss_scale;
+    else if (kept > 0)
+	scale = MAD_TO_SIGMA * select_kth (sorted, kept, kept / 2);
+    else
+	scale = 0;
+
+    if (scale > 0)
+	for (i = 0; i < m; i++) {
+	    w = root_weight (ctx->loss, err[i] / scale);
+	    if (fabs (w - weight[i]) > *change)
+		*change = fabs (w - weight[i]);
+	    weight[i] = w;
+	}
+
+    tsai_arena_release (ctx, mark);
+    return 1;
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Runs stage under ctx->loss by iteratively reweighted least squares.  The
+ * stage is called with ctx->weight set, which is how a stage tells that it
+ * is being run from here rather than on its own.  If warm, the stage starts
+ * from the current parameters, and the first weights come from their
+ * errors; otherwise (the three parameter stages, which start afresh) the
+ * first run weighs every point the same.
+ *
+ * Fails if a run ends with MINPACK's info 0 or 5 or diverges, and stops
+ * at the best run once one raises the median error (see above). */
+int tsai_robust_stage (struct tsai_context *ctx, int (*stage) (struct tsai_context *ctx), int warm)
+{
+    int       m = ctx->cd.point_count,
+              round,
+              i,
+              ok;
+
+    double   *weight,
+              change,
+              median,
+              best = HUGE_VAL;
+
+    struct calibration_constants best_cc;
+    struct camera_parameters     best_cp;
+
+    size_t    mark = ctx->arena_used;
+
+    if ((weight = tsai_arena_alloc (ctx, m)) == NULL)
+	return 0;
+    for (i = 0; i < m; i++)
+	weight[i] = 1.0;
+
+    if (warm && !reweigh (ctx, weight, &change)) {
+	tsai_arena_release (ctx, mark);
+	return 0;
+    }
+
+    for (round = 1;; round++) {
+	ctx->weight = weight;
+	ok = stage (ctx);
+	ctx->weight = NULL;
+	if (!ok)
+	    break;
+
+	/* a run that did not converge, or that left f or any parameter
+	 * unusable, fails the stage */
+	if (ctx->lm_info == 0 || ctx->lm_info == 5) {
+	    pytsai_raise (&ctx->err, "tsai_robust_stage: the weighted fit did not converge");
+	    ok = 0;
+	    break;
+	}
+	if (!usable_parameters (ctx) || !tsai_median_error (ctx, &median) || !(median < HUGE_VAL)) {
+	    pytsai_raise (&ctx->err, "tsai_robust_stage: the weighted fit diverged");
+	    ok = 0;
+	    break;
+	}
+
+	/* a run that raised the median error ends the stage with the best */
+	if (round > 1 && median > best) {
+	    ctx->cc = best_cc;
+	    ctx->cp = best_cp;
+	    break;
+	}
+	best = median;
+	best_cc = ctx->cc;
+	best_cp = ctx->cp;
+	if (round == TSAI_IRLS_ROUNDS)
+	    break;
+
+	if (!reweigh (ctx, weight, &change)) {
+	    ok = 0;
+	    break;
+	}
+	if (change <= TSAI_IRLS_TOLERANCE)
+	    break;
+    }
+
+    tsai_arena_release (ctx, mark);
+    return ok;
+}
+
+
+/* pytsai: can fail; int return type is required.
+ *
+ * Sets *median to the median of the plain errors [pix] of the points not
+ * FLAGGED for the current parameters, as the optimization stages measure
+ * them, or to HUGE_VAL if any of them is not finite. */
+int tsai_median_error (struct tsai_context *ctx, double *median)
+{
+    int       m = ctx->cd.point_count,
+              kept,
+              i;
+
+    double   *err;
+
+    size_t    mark = ctx->arena_used;
+
+    if ((err = tsai_arena_alloc (ctx, m)) == NULL)
+	return 0;
+
+    plain_errors (ctx, err);
+    *median = 0;
+    for (i = kept = 0; i < m; i++)
+	if (!FLAGGED (ctx, i)) {
+	    if (!(err[i] < HUGE_VAL))
+		*median = HUGE_VAL;
+	    err[kept++] = err[i];
+	}
+    if (*median == 0 && kept > 0)
+	*median = select_kth (err, kept, kept / 2);
+
+    tsai_arena_release (ctx, mark);
+    return 1;
+}
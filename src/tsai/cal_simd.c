@@ -0,0 +1,506 @@
+/**
+ * cal_simd.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file contains vector versions of error_rows_scalar() in cal_jac.c,    *
+* which computes the error of the nonlinear optimization stages for a range  *
+* of calibration points.  The kernels are:                                   *
+*                                                                            *
+*       error_rows_avx512 ()    8 points at a time                           *
+*       error_rows_avx2 ()      4 points at a time                           *
+*       error_rows_sse2 ()      2 points at a time                           *
+*       error_rows_neon ()      2 points at a time (64-bit ARM)              *
+*                                                                            *
+* On x86 all three are built, each for its own instruction set whatever the  *
+* library as a whole is compiled for, and tsai_simd_init() (cal_cpu.c)       *
+* picks the one the processor runs.  Each reads the point arrays of the      *
+* context (structure of arrays) a vector at a time; the last, partial vector *
+* is loaded and stored under a mask, or copied through a padded vector where *
+* there are no masked loads, so no point outside [begin, end) is ever read   *
+* or written.                                                                *
+*                                                                            *
+* The arithmetic is the same as error_rows_scalar(), operation for           *
+* operation, and so gives the same result, with one exception: hypot (ex,    *
+* ey) is computed as sqrt (ex * ex + ey * ey), which may differ from the C   *
+* library's in the last bit.  Where ex * ex + ey * ey overflows or           *
+* underflows (it never does for a sensible calibration) the lanes concerned  *
+* are recomputed with hypot().  This holds only if the compiler does not     *
+* fuse multiplies and adds, which setup.py turns off.                        *
+*                                                                            *
+\****************************************************************************/
+
+#include <math.h>
+#include <float.h>
+#include "cal_simd.h"
+
+#if defined (TSAI_X86_KERNELS)
+#include <immintrin.h>
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * SSE2 has no masked loads, so a last, single point is copied into a
+ * zero-padded vector and only its own lane is stored back. */
+TSAI_TARGET ("sse2")
+void error_rows_sse2 (struct error_model *model, int begin, int end)
+{
+    struct tsai_context *ctx = model->ctx;
+
+    int       i,
+              k,
+              count,
+              bad;
+
+    double   *err = model->out,
+              lane_in[5][2],
+              lane_ex[2],
+              lane_ey[2],
+              lane_err[2];
+
+    __m128d   r0 = _mm_set1_pd (model->r[0]),
+              r1 = _mm_set1_pd (model->r[1]),
+              r2 = _mm_set1_pd (model->r[2]),
+              r3 = _mm_set1_pd (model->r[3]),
+              r4 = _mm_set1_pd (model->r[4]),
+              r5 = _mm_set1_pd (model->r[5]),
+              r6 = _mm_set1_pd (model->r[6]),
+              r7 = _mm_set1_pd (model->r[7]),
+              r8 = _mm_set1_pd (model->r[8]),
+              Tx = _mm_set1_pd (model->value[TSAI_TX]),
+              Ty = _mm_set1_pd (model->value[TSAI_TY]),
+              Tz = _mm_set1_pd (model->value[TSAI_TZ]),
+              kappa1 = _mm_set1_pd (model->value[TSAI_KAPPA1]),
+              f = _mm_set1_pd (model->value[TSAI_F]),
+              sx = _mm_set1_pd (model->value[TSAI_SX]),
+              Cx = _mm_set1_pd (model->value[TSAI_CX]),
+              Cy = _mm_set1_pd (model->value[TSAI_CY]),
+              dpx = _mm_set1_pd (ctx->cp.dpx),
+              dpy = _mm_set1_pd (ctx->cp.dpy),
+              one = _mm_set1_pd (1.0),
+              smallest = _mm_set1_pd (DBL_MIN),
+              largest = _mm_set1_pd (DBL_MAX),
+              xw,
+              yw,
+              zw,
+              Xf,
+              Yf,
+              xc,
+              yc,
+              zc,
+              Xd,
+              Yd,
+              distortion_factor,
+              ex,
+              ey,
+              sum;
+
+    for (i = begin; i < end; i += 2) {
+	count = end - i >= 2 ? 2 : 1;
+
+	if (count == 2) {
+	    xw = _mm_loadu_pd (ctx->cd.xw + i);
+	    yw = _mm_loadu_pd (ctx->cd.yw + i);
+	    zw = _mm_loadu_pd (ctx->cd.zw + i);
+	    Xf = _mm_loadu_pd (model->Xd != NULL ? model->Xd + i : ctx->cd.Xf + i);
+	    Yf = _mm_loadu_pd (model->Xd != NULL ? model->Yd + i : ctx->cd.Yf + i);
+	} else {
+	    lane_in[0][0] = ctx->cd.xw[i];
+	    lane_in[1][0] = ctx->cd.yw[i];
+	    lane_in[2][0] = ctx->cd.zw[i];
+	    lane_in[3][0] = model->Xd != NULL ? model->Xd[i] : ctx->cd.Xf[i];
+	    lane_in[4][0] = model->Xd != NULL ? model->Yd[i] : ctx->cd.Yf[i];
+	    for (k = 0; k < 5; k++)
+		lane_in[k][1] = 0;
+	    xw = _mm_loadu_pd (lane_in[0]);
+	    yw = _mm_loadu_pd (lane_in[1]);
+	    zw = _mm_loadu_pd (lane_in[2]);
+	    Xf = _mm_loadu_pd (lane_in[3]);
+	    Yf = _mm_loadu_pd (lane_in[4]);
+	}
+
+	/* convert from world coordinates to camera coordinates */
+	xc = _mm_add_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (r0, xw), _mm_mul_pd (r1, yw)), _mm_mul_pd (r2, zw)), Tx);
+	yc = _mm_add_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (r3, xw), _mm_mul_pd (r4, yw)), _mm_mul_pd (r5, zw)), Ty);
+	zc = _mm_add_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (r6, xw), _mm_mul_pd (r7, yw)), _mm_mul_pd (r8, zw)), Tz);
+
+	/* convert from 2D image coordinates to distorted sensor coordinates */
+	if (model->Xd != NULL) {
+	    Xd = Xf;
+	    Yd = Yf;
+	} else {
+	    Xd = _mm_div_pd (_mm_mul_pd (dpx, _mm_sub_pd (Xf, Cx)), sx);
+	    Yd = _mm_mul_pd (dpy, _mm_sub_pd (Yf, Cy));
+	}
+
+	/* the error between the undistorted sensor coordinates of the
+	 * projected point and of the recovered one */
+	distortion_factor = _mm_add_pd (one, _mm_mul_pd (kappa1,
+				_mm_add_pd (_mm_mul_pd (Xd, Xd), _mm_mul_pd (Yd, Yd))));
+	ex = _mm_sub_pd (_mm_div_pd (_mm_mul_pd (f, xc), zc), _mm_mul_pd (Xd, distortion_factor));
+	ey = _mm_sub_pd (_mm_div_pd (_mm_mul_pd (f, yc), zc), _mm_mul_pd (Yd, distortion_factor));
+
+	sum = _mm_add_pd (_mm_mul_pd (ex, ex), _mm_mul_pd (ey, ey));
+	_mm_storeu_pd (lane_err, _mm_sqrt_pd (sum));
+
+	bad = _mm_movemask_pd (_mm_or_pd (_mm_cmpnge_pd (sum, smallest), _mm_cmpgt_pd (sum, largest)));
+	if (bad) {
+	    _mm_storeu_pd (lane_ex, ex);
+	    _mm_storeu_pd (lane_ey, ey);
+	    for (k = 0; k < count; k++)
+		if (bad & (1 << k))
+		    lane_err[k] = hypot (lane_ex[k], lane_ey[k]);
+	}
+
+	for (k = 0; k < count; k++)
+	    err[i + k] = lane_err[k];
+    }
+}
+
+#elif defined (TSAI_NEON_KERNELS)
+#include <arm_neon.h>
+#endif
+
+
+#if defined (TSAI_X86_KERNELS)
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine. */
+TSAI_TARGET ("avx512f")
+void error_rows_avx512 (struct error_model *model, int begin, int end)
+{
+    struct tsai_context *ctx = model->ctx;
+
+    int       i,
+              k;
+
+    double   *err = model->out,
+              lane_ex[8],
+              lane_ey[8];
+
+    __m512d   r0 = _mm512_set1_pd (model->r[0]),
+              r1 = _mm512_set1_pd (model->r[1]),
+              r2 = _mm512_set1_pd (model->r[2]),
+              r3 = _mm512_set1_pd (model->r[3]),
+              r4 = _mm512_set1_pd (model->r[4]),
+              r5 = _mm512_set1_pd (model->r[5]),
+              r6 = _mm512_set1_pd (model->r[6]),
+              r7 = _mm512_set1_pd (model->r[7]),
+              r8 = _mm512_set1_pd (model->r[8]),
+              Tx = _mm512_set1_pd (model->value[TSAI_TX]),
+              Ty = _mm512_set1_pd (model->value[TSAI_TY]),
+              Tz = _mm512_set1_pd (model->value[TSAI_TZ]),
+              kappa1 = _mm512_set1_pd (model->value[TSAI_KAPPA1]),
+              f = _mm512_set1_pd (model->value[TSAI_F]),
+              sx = _mm512_set1_pd (model->value[TSAI_SX]),
+              Cx = _mm512_set1_pd (model->value[TSAI_CX]),
+              Cy = _mm512_set1_pd (model->value[TSAI_CY]),
+              dpx = _mm512_set1_pd (ctx->cp.dpx),
+              dpy = _mm512_set1_pd (ctx->cp.dpy),
+              one = _mm512_set1_pd (1.0),
+              smallest = _mm512_set1_pd (DBL_MIN),
+              largest = _mm512_set1_pd (DBL_MAX),
+              xw,
+              yw,
+              zw,
+              xc,
+              yc,
+              zc,
+              Xd,
+              Yd,
+              distortion_factor,
+              ex,
+              ey,
+              sum;
+
+    __mmask8  lanes,
+              bad;
+
+    for (i = begin; i < end; i += 8) {
+	lanes = end - i >= 8 ? 0xff : (__mmask8) ((1u << (end - i)) - 1);
+
+	xw = _mm512_maskz_loadu_pd (lanes, ctx->cd.xw + i);
+	yw = _mm512_maskz_loadu_pd (lanes, ctx->cd.yw + i);
+	zw = _mm512_maskz_loadu_pd (lanes, ctx->cd.zw + i);
+
+	/* convert from world coordinates to camera coordinates */
+	xc = _mm512_add_pd (_mm512_add_pd (_mm512_add_pd (_mm512_mul_pd (r0, xw), _mm512_mul_pd (r1, yw)),
+					   _mm512_mul_pd (r2, zw)), Tx);
+	yc = _mm512_add_pd (_mm512_add_pd (_mm512_add_pd (_mm512_mul_pd (r3, xw), _mm512_mul_pd (r4, yw)),
+					   _mm512_mul_pd (r5, zw)), Ty);
+	zc = _mm512_add_pd (_mm512_add_pd (_mm512_add_pd (_mm512_mul_pd (r6, xw), _mm512_mul_pd (r7, yw)),
+					   _mm512_mul_pd (r8, zw)), Tz);
+
+	/* convert from 2D image coordinates to distorted sensor coordinates */
+	if (model->Xd != NULL) {
+	    Xd = _mm512_maskz_loadu_pd (lanes, model->Xd + i);
+	    Yd = _mm512_maskz_loadu_pd (lanes, model->Yd + i);
+	} else {
+	    Xd = _mm512_div_pd (_mm512_mul_pd (dpx, _mm512_sub_pd (_mm512_maskz_loadu_pd (lanes, ctx->cd.Xf + i), Cx)), sx);
+	    Yd = _mm512_mul_pd (dpy, _mm512_sub_pd (_mm512_maskz_loadu_pd (lanes, ctx->cd.Yf + i), Cy));
+	}
+
+	/* the error between the undistorted sensor coordinates of the
+	 * projected point and of the recovered one */
+	distortion_factor = _mm512_add_pd (one, _mm512_mul_pd (kappa1,
+				_mm512_add_pd (_mm512_mul_pd (Xd, Xd), _mm512_mul_pd (Yd, Yd))));
+	ex = _mm512_sub_pd (_mm512_div_pd (_mm512_mul_pd (f, xc), zc), _mm512_mul_pd (Xd, distortion_factor));
+	ey = _mm512_sub_pd (_mm512_div_pd (_mm512_mul_pd (f, yc), zc), _mm512_mul_pd (Yd, distortion_factor));
+
+	sum = _mm512_add_pd (_mm512_mul_pd (ex, ex), _mm512_mul_pd (ey, ey));
+	_mm512_mask_storeu_pd (err + i, lanes, _mm512_sqrt_pd (sum));
+
+	bad = lanes & (_mm512_cmp_pd_mask (sum, smallest, _CMP_NGE_UQ) |
+		       _mm512_cmp_pd_mask (sum, largest, _CMP_GT_OQ));
+	if (bad) {
+	    _mm512_storeu_pd (lane_ex, ex);
+	    _mm512_storeu_pd (lane_ey, ey);
+	    for (k = 0; k < 8; k++)
+		if (bad & (1u << k))
+		    err[i + k] = hypot (lane_ex[k], lane_ey[k]);
+	}
+    }
+}
+
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine. */
+TSAI_TARGET ("avx2")
+void error_rows_avx2 (struct error_model *model, int begin, int end)
+{
+    struct tsai_context *ctx = model->ctx;
+
+    int       i,
+              k,
+              bad;
+
+    double   *err = model->out,
+              lane_ex[4],
+              lane_ey[4];
+
+    __m256i   lanes,
+              lane_index = _mm256_setr_epi64x (0, 1, 2, 3);
+
+    __m256d   r0 = _mm256_set1_pd (model->r[0]),
+              r1 = _mm256_set1_pd (model->r[1]),
+              r2 = _mm256_set1_pd (model->r[2]),
+              r3 = _mm256_set1_pd (model->r[3]),
+              r4 = _mm256_set1_pd (model->r[4]),
+              r5 = _mm256_set1_pd (model->r[5]),
+              r6 = _mm256_set1_pd (model->r[6]),
+              r7 = _mm256_set1_pd (model->r[7]),
+              r8 = _mm256_set1_pd (model->r[8]),
+              Tx = _mm256_set1_pd (model->value[TSAI_TX]),
+              Ty = _mm256_set1_pd (model->value[TSAI_TY]),
+              Tz = _mm256_set1_pd (model->value[TSAI_TZ]),
+              kappa1 = _mm256_set1_pd (model->value[TSAI_KAPPA1]),
+              f = _mm256_set1_pd (model->value[TSAI_F]),
+              sx = _mm256_set1_pd (model->value[TSAI_SX]),
+              Cx = _mm256_set1_pd (model->value[TSAI_CX]),
+              Cy = _mm256_set1_pd (model->value[TSAI_CY]),
+              dpx = _mm256_set1_pd (ctx->cp.dpx),
+              dpy = _mm256_set1_pd (ctx->cp.dpy),
+              one = _mm256_set1_pd (1.0),
+              smallest = _mm256_set1_pd (DBL_MIN),
+              largest = _mm256_set1_pd (DBL_MAX),
+              xw,
+              yw,
+              zw,
+              xc,
+              yc,
+              zc,
+              Xd,
+              Yd,
+              distortion_factor,
+              ex,
+              ey,
+              sum;
+
+    for (i = begin; i < end; i += 4) {
+	lanes = _mm256_cmpgt_epi64 (_mm256_set1_epi64x (end - i), lane_index);
+
+	xw = _mm256_maskload_pd (ctx->cd.xw + i, lanes);
+	yw = _mm256_maskload_pd (ctx->cd.yw + i, lanes);
+	zw = _mm256_maskload_pd (ctx->cd.zw + i, lanes);
+
+	/* convert from world coordinates to camera coordinates */
+	xc = _mm256_add_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (r0, xw), _mm256_mul_pd (r1, yw)),
+					   _mm256_mul_pd (r2, zw)), Tx);
+	yc = _mm256_add_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (r3, xw), _mm256_mul_pd (r4, yw)),
+					   _mm256_mul_pd (r5, zw)), Ty);
+	zc = _mm256_add_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (r6, xw), _mm256_mul_pd (r7, yw)),
+					   _mm256_mul_pd (r8, zw)), Tz);
+
+	/* convert from 2D image coordinates to distorted sensor coordinates */
+	if (model->Xd != NULL) {
+	    Xd = _mm256_maskload_pd (model->Xd + i, lanes);
+	    Yd = _mm256_maskload_pd (model->Yd + i, lanes);
+	} else {
+	    Xd = _mm256_div_pd (_mm256_mul_pd (dpx, _mm256_sub_pd (_mm256_maskload_pd (ctx->cd.Xf + i, lanes), Cx)), sx);
+	    Yd = _mm256_mul_pd (dpy, _mm256_sub_pd (_mm256_maskload_pd (ctx->cd.Yf + i, lanes), Cy));
+	}
+
+	/* the error between the undistorted sensor coordinates of the
+	 * projected point and of the recovered one */
+	distortion_factor = _mm256_add_pd (one, _mm256_mul_pd (kappa1,
+				_mm256_add_pd (_mm256_mul_pd (Xd, Xd), _mm256_mul_pd (Yd, Yd))));
+	ex = _mm256_sub_pd (_mm256_div_pd (_mm256_mul_pd (f, xc), zc), _mm256_mul_pd (Xd, distortion_factor));
+	ey = _mm256_sub_pd (_mm256_div_pd (_mm256_mul_pd (f, yc), zc), _mm256_mul_pd (Yd, distortion_factor));
+
+	sum = _mm256_add_pd (_mm256_mul_pd (ex, ex), _mm256_mul_pd (ey, ey));
+	_mm256_maskstore_pd (err + i, lanes, _mm256_sqrt_pd (sum));
+
+	bad = _mm256_movemask_pd (_mm256_and_pd (_mm256_castsi256_pd (lanes),
+			_mm256_or_pd (_mm256_cmp_pd (sum, smallest, _CMP_NGE_UQ),
+				      _mm256_cmp_pd (sum, largest, _CMP_GT_OQ))));
+	if (bad) {
+	    _mm256_storeu_pd (lane_ex, ex);
+	    _mm256_storeu_pd (lane_ey, ey);
+	    for (k = 0; k < 4; k++)
+		if (bad & (1 << k))
+		    err[i + k] = hypot (lane_ex[k], lane_ey[k]);
+	}
+    }
+}
+
+#elif defined (TSAI_NEON_KERNELS)
+
+/************************************************************************/
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * NEON has no masked loads, so a last, single point is copied into a
+ * zero-padded vector and only its own lane is stored back. */
+void error_rows_neon (struct error_model *model, int begin, int end)
+{
+    struct tsai_context *ctx = model->ctx;
+
+    int       i,
+              k,
+              count;
+
+    double   *err = model->out,
+              lane_in[5][2],
+              lane_ex[2],
+              lane_ey[2],
+              lane_sum[2],
+              lane_err[2];
+
+    float64x2_t r0 = vdupq_n_f64 (model->r[0]),
+              r1 = vdupq_n_f64 (model->r[1]),
+              r2 = vdupq_n_f64 (model->r[2]),
+              r3 = vdupq_n_f64 (model->r[3]),
+              r4 = vdupq_n_f64 (model->r[4]),
+              r5 = vdupq_n_f64 (model->r[5]),
+              r6 = vdupq_n_f64 (model->r[6]),
+              r7 = vdupq_n_f64 (model->r[7]),
+              r8 = vdupq_n_f64 (model->r[8]),
+              Tx = vdupq_n_f64 (model->value[TSAI_TX]),
+              Ty = vdupq_n_f64 (model->value[TSAI_TY]),
+              Tz = vdupq_n_f64 (model->value[TSAI_TZ]),
+              kappa1 = vdupq_n_f64 (model->value[TSAI_KAPPA1]),
+              f = vdupq_n_f64 (model->value[TSAI_F]),
+              sx = vdupq_n_f64 (model->value[TSAI_SX]),
+              Cx = vdupq_n_f64 (model->value[TSAI_CX]),
+              Cy = vdupq_n_f64 (model->value[TSAI_CY]),
+              dpx = vdupq_n_f64 (ctx->cp.dpx),
+              dpy = vdupq_n_f64 (ctx->cp.dpy),
+              one = vdupq_n_f64 (1.0),
+              smallest = vdupq_n_f64 (DBL_MIN),
+              largest = vdupq_n_f64 (DBL_MAX),
+              xw,
+              yw,
+              zw,
+              Xf,
+              Yf,
+              xc,
+              yc,
+              zc,
+              Xd,
+              Yd,
+              distortion_factor,
+              ex,
+              ey,
+              sum;
+
+    uint64x2_t good;
+
+    for (i = begin; i < end; i += 2) {
+	count = end - i >= 2 ? 2 : 1;
+
+	if (count == 2) {
+	    xw = vld1q_f64 (ctx->cd.xw + i);
+	    yw = vld1q_f64 (ctx->cd.yw + i);
+	    zw = vld1q_f64 (ctx->cd.zw + i);
+	    Xf = vld1q_f64 (model->Xd != NULL ? model->Xd + i : ctx->cd.Xf + i);
+	    Yf = vld1q_f64 (model->Xd != NULL ? model->Yd + i : ctx->cd.Yf + i);
+	} else {
+	    lane_in[0][0] = ctx->cd.xw[i];
+	    lane_in[1][0] = ctx->cd.yw[i];
+	    lane_in[2][0] = ctx->cd.zw[i];
+	    lane_in[3][0] = model->Xd != NULL ? model->Xd[i] : ctx->cd.Xf[i];
+	    lane_in[4][0] = model->Xd != NULL ? model->Yd[i] : ctx->cd.Yf[i];
+	    for (k = 0; k < 5; k++)
+		lane_in[k][1] = 0;
+	    xw = vld1q_f64 (lane_in[0]);
+	    yw = vld1q_f64 (lane_in[1]);
+	    zw = vld1q_f64 (lane_in[2]);
+	    Xf = vld1q_f64 (lane_in[3]);
+	    Yf = vld1q_f64 (lane_in[4]);
+	}
+
+	/* convert from world coordinates to camera coordinates */
+	xc = vaddq_f64 (vaddq_f64 (vaddq_f64 (vmulq_f64 (r0, xw), vmulq_f64 (r1, yw)), vmulq_f64 (r2, zw)), Tx);
+	yc = vaddq_f64 (vaddq_f64 (vaddq_f64 (vmulq_f64 (r3, xw), vmulq_f64 (r4, yw)), vmulq_f64 (r5, zw)), Ty);
+	zc = vaddq_f64 (vaddq_f64 (vaddq_f64 (vmulq_f64 (r6, xw), vmulq_f64 (r7, yw)), vmulq_f64 (r8, zw)), Tz);
+
+	/* convert from 2D image coordinates to distorted sensor coordinates */
+	if (model->Xd != NULL) {
+	    Xd = Xf;
+	    Yd = Yf;
+	} else {
+	    Xd = vdivq_f64 (vmulq_f64 (dpx, vsubq_f64 (Xf, Cx)), sx);
+	    Yd = vmulq_f64 (dpy, vsubq_f64 (Yf, Cy));
+	}
+
+	/* the error between the undistorted sensor coordinates of the
+	 * projected point and of the recovered one */
+	distortion_factor = vaddq_f64 (one, vmulq_f64 (kappa1,
+				vaddq_f64 (vmulq_f64 (Xd, Xd), vmulq_f64 (Yd, Yd))));
+	ex = vsubq_f64 (vdivq_f64 (vmulq_f64 (f, xc), zc), vmulq_f64 (Xd, distortion_factor));
+	ey = vsubq_f64 (vdivq_f64 (vmulq_f64 (f, yc), zc), vmulq_f64 (Yd, distortion_factor));
+
+	sum = vaddq_f64 (vmulq_f64 (ex, ex), vmulq_f64 (ey, ey));
+	vst1q_f64 (lane_err, vsqrtq_f64 (sum));
+
+	good = vandq_u64 (vcgeq_f64 (sum, smallest), vcleq_f64 (sum, largest));
+	if (vgetq_lane_u64 (good, 0) == 0 || vgetq_lane_u64 (good, 1) == 0) {
+	    vst1q_f64 (lane_ex, ex);
+	    vst1q_f64 (lane_ey, ey);
+	    vst1q_f64 (lane_sum, sum);
+	    for (k = 0; k < count; k++)
+		if (!(lane_sum[k] >= DBL_MIN && lane_sum[k] <= DBL_MAX))
+		    lane_err[k] = hypot (lane_ex[k], lane_ey[k]);
+	}
+
+	for (k = 0; k < count; k++)
+	    err[i + k] = lane_err[k];
+    }
+}
+
+#endif
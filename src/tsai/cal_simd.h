@@ -0,0 +1,98 @@
+/**
+ * cal_simd.h
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * The kernels built for more than one instruction set, and the table
+ * through which the library calls the ones picked at run time (see
+ * cal_cpu.c).  Not part of the library's interface.
+ */
+
+#ifndef CAL_SIMD_H
+#define CAL_SIMD_H
+
+#include "cal_jac.h"
+
+/* Kernels for AVX2 and AVX-512 are built wherever the compiler can target
+ * them function by function; NEON is part of every 64-bit ARM. */
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__)
+#define TSAI_X86_KERNELS
+#define TSAI_TARGET(isa)	__attribute__ ((target (isa)))
+#elif (defined (_M_X64) || defined (_M_IX86)) && defined (_MSC_VER)
+#define TSAI_X86_KERNELS
+#define TSAI_TARGET(isa)
+#elif defined (__aarch64__) && defined (__ARM_NEON)
+#define TSAI_NEON_KERNELS
+#endif
+
+#if defined (__GNUC__)
+#define TSAI_INLINE		static __inline__ __attribute__ ((always_inline))
+#elif defined (_MSC_VER)
+#define TSAI_INLINE		static __forceinline
+#else
+#define TSAI_INLINE		static
+#endif
+
+/* instruction sets, in increasing order of preference */
+enum tsai_simd_level {
+    TSAI_SIMD_SCALAR, TSAI_SIMD_SSE2, TSAI_SIMD_NEON,
+    TSAI_SIMD_AVX2, TSAI_SIMD_AVX512,
+    TSAI_SIMD_LEVELS
+};
+
+typedef void (*tsai_array_kernel) (struct tsai_context *ctx, int n, double *in, double *out);
+
+struct tsai_kernels {
+    enum tsai_simd_level level;
+    void    (*error_rows) (struct error_model *model, int begin, int end);
+    tsai_array_kernel world_coord_to_image_coord;
+    tsai_array_kernel image_coord_to_world_coord;
+    tsai_array_kernel world_coord_to_camera_coord;
+    tsai_array_kernel camera_coord_to_world_coord;
+};
+
+extern struct tsai_kernels tsai_kernels;
+
+/* cal_jac.c and cal_simd.c */
+void  error_rows_scalar (struct error_model *model, int begin, int end);
+#ifdef TSAI_X86_KERNELS
+void  error_rows_sse2 (struct error_model *model, int begin, int end);
+void  error_rows_avx2 (struct error_model *model, int begin, int end);
+void  error_rows_avx512 (struct error_model *model, int begin, int end);
+#endif
+#ifdef TSAI_NEON_KERNELS
+void  error_rows_neon (struct error_model *model, int begin, int end);
+#endif
+
+/* cal_tran.c */
+void  world_coord_to_image_coord_array_generic (struct tsai_context *ctx, int n, double *wc, double *ic);
+void  image_coord_to_world_coord_array_generic (struct tsai_context *ctx, int n, double *ic, double *wc);
+void  world_coord_to_camera_coord_array_generic (struct tsai_context *ctx, int n, double *wc, double *cc);
+void  camera_coord_to_world_coord_array_generic (struct tsai_context *ctx, int n, double *cc, double *wc);
+#ifdef TSAI_X86_KERNELS
+void  world_coord_to_image_coord_array_avx2 (struct tsai_context *ctx, int n, double *wc, double *ic);
+void  image_coord_to_world_coord_array_avx2 (struct tsai_context *ctx, int n, double *ic, double *wc);
+void  world_coord_to_camera_coord_array_avx2 (struct tsai_context *ctx, int n, double *wc, double *cc);
+void  camera_coord_to_world_coord_array_avx2 (struct tsai_context *ctx, int n, double *cc, double *wc);
+void  world_coord_to_image_coord_array_avx512 (struct tsai_context *ctx, int n, double *wc, double *ic);
+void  image_coord_to_world_coord_array_avx512 (struct tsai_context *ctx, int n, double *ic, double *wc);
+void  world_coord_to_camera_coord_array_avx512 (struct tsai_context *ctx, int n, double *wc, double *cc);
+void  camera_coord_to_world_coord_array_avx512 (struct tsai_context *ctx, int n, double *cc, double *wc);
+#endif
+
+#endif /* CAL_SIMD_H */
@@ -32,8 +32,16 @@
 *       distorted_to_undistorted_image_coord ()                              *
 *       undistorted_to_distorted_image_coord ()                              *
 *                                                                            *
+* along with versions of the first three and of camera_coord_to_world_coord  *
+* that transform arrays of points:                                           *
+*                                                                            *
+*       world_coord_to_image_coord_array ()                                  *
+*       image_coord_to_world_coord_array ()                                  *
+*       world_coord_to_camera_coord_array ()                                 *
+*       camera_coord_to_world_coord_array ()                                 *
+*                                                                            *
 * The routines make use of the calibrated camera parameters and calibration  *
-* constants contained in the two external data structures tsai_cp and tsai_cc.         *
+* constants contained in the calibration context passed to each routine.     *
 *                                                                            *
 * Notation                                                                   *
 * --------                                                                   *
@@ -62,11 +70,9 @@
 #include <stdio.h>
 #include <math.h>
 #include "cal_main.h"
+#include "cal_simd.h"
 
 
-extern struct camera_parameters tsai_cp;
-extern struct calibration_constants tsai_cc;
-
 
 #define SQRT(x) sqrt(fabs(x))
 
@@ -104,7 +110,8 @@ double    CBRT (x)
 	     polynomial for positive and negative kappa1's
 */
 
-void      undistorted_to_distorted_sensor_coord (Xu, Yu, Xd, Yd)
+void      undistorted_to_distorted_sensor_coord (ctx, Xu, Yu, Xd, Yd)
+    struct tsai_context *ctx;
     double    Xu,
               Yu,
              *Xd,
@@ -125,7 +132,7 @@ void      undistorted_to_distorted_sensor_coord (Xu, Yu, Xd, Yd)
               sinT,
               cosT;
 
-    if (((Xu == 0) && (Yu == 0)) || (tsai_cc.kappa1 == 0)) {
+    if (((Xu == 0) && (Yu == 0)) || (ctx->cc.kappa1 == 0)) {
 	*Xd = Xu;
 	*Yd = Yu;
 	return;
@@ -133,7 +140,7 @@ void      undistorted_to_distorted_sensor_coord (Xu, Yu, Xd, Yd)
 
     Ru = hypot (Xu, Yu);	/* SQRT(Xu*Xu+Yu*Yu) */
 
-    c = 1 / tsai_cc.kappa1;
+    c = 1 / ctx->cc.kappa1;
     d = -c * Ru;
 
     Q = c / 3;
@@ -147,7 +154,7 @@ void      undistorted_to_distorted_sensor_coord (Xu, Yu, Xd, Yd)
 	Rd = S + T;
 
 	if (Rd < 0) {
-	    Rd = SQRT (-1 / (3 * tsai_cc.kappa1));
+	    Rd = SQRT (-1 / (3 * ctx->cc.kappa1));
 	    fprintf (stderr, "\nWarning: undistorted image point to distorted image point mapping limited by\n");
 	    fprintf (stderr, "         maximum barrel distortion radius of %lf\n", Rd);
 	    fprintf (stderr, "         (Xu = %lf, Yu = %lf) -> (Xd = %lf, Yd = %lf)\n\n",
@@ -174,7 +181,8 @@ void      undistorted_to_distorted_sensor_coord (Xu, Yu, Xd, Yd)
 
 
 /************************************************************************/
-void      distorted_to_undistorted_sensor_coord (Xd, Yd, Xu, Yu)
+void      distorted_to_undistorted_sensor_coord (ctx, Xd, Yd, Xu, Yu)
+    struct tsai_context *ctx;
     double    Xd,
               Yd,
              *Xu,
@@ -183,14 +191,15 @@ void      distorted_to_undistorted_sensor_coord (Xd, Yd, Xu, Yu)
     double    distortion_factor;
 
     /* convert from distorted to undistorted sensor plane coordinates */
-    distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
+    distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
     *Xu = Xd * distortion_factor;
     *Yu = Yd * distortion_factor;
 }
 
 
 /************************************************************************/
-void      undistorted_to_distorted_image_coord (Xfu, Yfu, Xfd, Yfd)
+void      undistorted_to_distorted_image_coord (ctx, Xfu, Yfu, Xfd, Yfd)
+    struct tsai_context *ctx;
     double    Xfu,
               Yfu,
              *Xfd,
@@ -202,20 +211,21 @@ void      undistorted_to_distorted_image_coord (Xfu, Yfu, Xfd, Yfd)
               Yd;
 
     /* convert from image to sensor coordinates */
-    Xu = tsai_cp.dpx * (Xfu - tsai_cp.Cx) / tsai_cp.sx;
-    Yu = tsai_cp.dpy * (Yfu - tsai_cp.Cy);
+    Xu = ctx->cp.dpx * (Xfu - ctx->cp.Cx) / ctx->cp.sx;
+    Yu = ctx->cp.dpy * (Yfu - ctx->cp.Cy);
 
     /* convert from undistorted sensor to distorted sensor plane coordinates */
-    undistorted_to_distorted_sensor_coord (Xu, Yu, &Xd, &Yd);
+    undistorted_to_distorted_sensor_coord (ctx, Xu, Yu, &Xd, &Yd);
 
     /* convert from sensor to image coordinates */
-    *Xfd = Xd * tsai_cp.sx / tsai_cp.dpx + tsai_cp.Cx;
-    *Yfd = Yd / tsai_cp.dpy + tsai_cp.Cy;
+    *Xfd = Xd * ctx->cp.sx / ctx->cp.dpx + ctx->cp.Cx;
+    *Yfd = Yd / ctx->cp.dpy + ctx->cp.Cy;
 }
 
 
 /************************************************************************/
-void      distorted_to_undistorted_image_coord (Xfd, Yfd, Xfu, Yfu)
+void      distorted_to_undistorted_image_coord (ctx, Xfd, Yfd, Xfu, Yfu)
+    struct tsai_context *ctx;
     double    Xfd,
               Yfd,
              *Xfu,
@@ -227,15 +237,15 @@ void      distorted_to_undistorted_image_coord (Xfd, Yfd, Xfu, Yfu)
               Yu;
 
     /* convert from image to sensor coordinates */
-    Xd = tsai_cp.dpx * (Xfd - tsai_cp.Cx) / tsai_cp.sx;
-    Yd = tsai_cp.dpy * (Yfd - tsai_cp.Cy);
+    Xd = ctx->cp.dpx * (Xfd - ctx->cp.Cx) / ctx->cp.sx;
+    Yd = ctx->cp.dpy * (Yfd - ctx->cp.Cy);
 
     /* convert from distorted sensor to undistorted sensor plane coordinates */
-    distorted_to_undistorted_sensor_coord (Xd, Yd, &Xu, &Yu);
+    distorted_to_undistorted_sensor_coord (ctx, Xd, Yd, &Xu, &Yu);
 
     /* convert from sensor to image coordinates */
-    *Xfu = Xu * tsai_cp.sx / tsai_cp.dpx + tsai_cp.Cx;
-    *Yfu = Yu / tsai_cp.dpy + tsai_cp.Cy;
+    *Xfu = Xu * ctx->cp.sx / ctx->cp.dpx + ctx->cp.Cx;
+    *Yfu = Yu / ctx->cp.dpy + ctx->cp.Cy;
 }
 
 
@@ -243,7 +253,8 @@ void      distorted_to_undistorted_image_coord (Xfd, Yfd, Xfu, Yfu)
 * This routine takes the position of a point in world coordinates [mm]	*
 * and determines the position of its image in image coordinates [pix].	*
 \***********************************************************************/
-void      world_coord_to_image_coord (xw, yw, zw, Xf, Yf)
+void      world_coord_to_image_coord (ctx, xw, yw, zw, Xf, Yf)
+    struct tsai_context *ctx;
     double    xw,
               yw,
               zw,
@@ -259,20 +270,20 @@ void      world_coord_to_image_coord (xw, yw, zw, Xf, Yf)
               Yd;
 
     /* convert from world coordinates to camera coordinates */
-    xc = tsai_cc.r1 * xw + tsai_cc.r2 * yw + tsai_cc.r3 * zw + tsai_cc.Tx;
-    yc = tsai_cc.r4 * xw + tsai_cc.r5 * yw + tsai_cc.r6 * zw + tsai_cc.Ty;
-    zc = tsai_cc.r7 * xw + tsai_cc.r8 * yw + tsai_cc.r9 * zw + tsai_cc.Tz;
+    xc = ctx->cc.r1 * xw + ctx->cc.r2 * yw + ctx->cc.r3 * zw + ctx->cc.Tx;
+    yc = ctx->cc.r4 * xw + ctx->cc.r5 * yw + ctx->cc.r6 * zw + ctx->cc.Ty;
+    zc = ctx->cc.r7 * xw + ctx->cc.r8 * yw + ctx->cc.r9 * zw + ctx->cc.Tz;
 
     /* convert from camera coordinates to undistorted sensor plane coordinates */
-    Xu = tsai_cc.f * xc / zc;
-    Yu = tsai_cc.f * yc / zc;
+    Xu = ctx->cc.f * xc / zc;
+    Yu = ctx->cc.f * yc / zc;
 
     /* convert from undistorted to distorted sensor plane coordinates */
-    undistorted_to_distorted_sensor_coord (Xu, Yu, &Xd, &Yd);
+    undistorted_to_distorted_sensor_coord (ctx, Xu, Yu, &Xd, &Yd);
 
     /* convert from distorted sensor plane coordinates to image coordinates */
-    *Xf = Xd * tsai_cp.sx / tsai_cp.dpx + tsai_cp.Cx;
-    *Yf = Yd / tsai_cp.dpy + tsai_cp.Cy;
+    *Xf = Xd * ctx->cp.sx / ctx->cp.dpx + ctx->cp.Cx;
+    *Yf = Yd / ctx->cp.dpy + ctx->cp.Cy;
 }
 
 
@@ -283,7 +294,8 @@ void      world_coord_to_image_coord (xw, yw, zw, Xf, Yf)
 * projection to a single point the routine requires a Z world	 	*
 * coordinate for the point in addition to the X and Y image coordinates.* 
 \***********************************************************************/
-void      image_coord_to_world_coord (Xfd, Yfd, zw, xw, yw)
+void      image_coord_to_world_coord (ctx, Xfd, Yfd, zw, xw, yw)
+    struct tsai_context *ctx;
     double    Xfd,
               Yfd, 
               zw,
@@ -297,32 +309,32 @@ void      image_coord_to_world_coord (Xfd, Yfd, zw, xw, yw)
               common_denominator;
 
     /* convert from image to distorted sensor coordinates */
-    Xd = tsai_cp.dpx * (Xfd - tsai_cp.Cx) / tsai_cp.sx;
-    Yd = tsai_cp.dpy * (Yfd - tsai_cp.Cy);
+    Xd = ctx->cp.dpx * (Xfd - ctx->cp.Cx) / ctx->cp.sx;
+    Yd = ctx->cp.dpy * (Yfd - ctx->cp.Cy);
 
     /* convert from distorted sensor to undistorted sensor plane coordinates */
-    distorted_to_undistorted_sensor_coord (Xd, Yd, &Xu, &Yu);
+    distorted_to_undistorted_sensor_coord (ctx, Xd, Yd, &Xu, &Yu);
 
     /* calculate the corresponding xw and yw world coordinates	 */
     /* (these equations were derived by simply inverting	 */
     /* the perspective projection equations using Macsyma)	 */
-    common_denominator = ((tsai_cc.r1 * tsai_cc.r8 - tsai_cc.r2 * tsai_cc.r7) * Yu +
-			  (tsai_cc.r5 * tsai_cc.r7 - tsai_cc.r4 * tsai_cc.r8) * Xu -
-			  tsai_cc.f * tsai_cc.r1 * tsai_cc.r5 + tsai_cc.f * tsai_cc.r2 * tsai_cc.r4);
-
-    *xw = (((tsai_cc.r2 * tsai_cc.r9 - tsai_cc.r3 * tsai_cc.r8) * Yu +
-	    (tsai_cc.r6 * tsai_cc.r8 - tsai_cc.r5 * tsai_cc.r9) * Xu -
-	    tsai_cc.f * tsai_cc.r2 * tsai_cc.r6 + tsai_cc.f * tsai_cc.r3 * tsai_cc.r5) * zw +
-	   (tsai_cc.r2 * tsai_cc.Tz - tsai_cc.r8 * tsai_cc.Tx) * Yu +
-	   (tsai_cc.r8 * tsai_cc.Ty - tsai_cc.r5 * tsai_cc.Tz) * Xu -
-	   tsai_cc.f * tsai_cc.r2 * tsai_cc.Ty + tsai_cc.f * tsai_cc.r5 * tsai_cc.Tx) / common_denominator;
-
-    *yw = -(((tsai_cc.r1 * tsai_cc.r9 - tsai_cc.r3 * tsai_cc.r7) * Yu +
-	     (tsai_cc.r6 * tsai_cc.r7 - tsai_cc.r4 * tsai_cc.r9) * Xu -
-	     tsai_cc.f * tsai_cc.r1 * tsai_cc.r6 + tsai_cc.f * tsai_cc.r3 * tsai_cc.r4) * zw +
-	    (tsai_cc.r1 * tsai_cc.Tz - tsai_cc.r7 * tsai_cc.Tx) * Yu +
-	    (tsai_cc.r7 * tsai_cc.Ty - tsai_cc.r4 * tsai_cc.Tz) * Xu -
-	    tsai_cc.f * tsai_cc.r1 * tsai_cc.Ty + tsai_cc.f * tsai_cc.r4 * tsai_cc.Tx) / common_denominator;
+    common_denominator = ((ctx->cc.r1 * ctx->cc.r8 - ctx->cc.r2 * ctx->cc.r7) * Yu +
+			  (ctx->cc.r5 * ctx->cc.r7 - ctx->cc.r4 * ctx->cc.r8) * Xu -
+			  ctx->cc.f * ctx->cc.r1 * ctx->cc.r5 + ctx->cc.f * ctx->cc.r2 * ctx->cc.r4);
+
+    *xw = (((ctx->cc.r2 * ctx->cc.r9 - ctx->cc.r3 * ctx->cc.r8) * Yu +
+	    (ctx->cc.r6 * ctx->cc.r8 - ctx->cc.r5 * ctx->cc.r9) * Xu -
+	    ctx->cc.f * ctx->cc.r2 * ctx->cc.r6 + ctx->cc.f * ctx->cc.r3 * ctx->cc.r5) * zw +
+	   (ctx->cc.r2 * ctx->cc.Tz - ctx->cc.r8 * ctx->cc.Tx) * Yu +
+	   (ctx->cc.r8 * ctx->cc.Ty - ctx->cc.r5 * ctx->cc.Tz) * Xu -
+	   ctx->cc.f * ctx->cc.r2 * ctx->cc.Ty + ctx->cc.f * ctx->cc.r5 * ctx->cc.Tx) / common_denominator;
+
+    *yw = -(((ctx->cc.r1 * ctx->cc.r9 - ctx->cc.r3 * ctx->cc.r7) * Yu +
+	     (ctx->cc.r6 * ctx->cc.r7 - ctx->cc.r4 * ctx->cc.r9) * Xu -
+	     ctx->cc.f * ctx->cc.r1 * ctx->cc.r6 + ctx->cc.f * ctx->cc.r3 * ctx->cc.r4) * zw +
+	    (ctx->cc.r1 * ctx->cc.Tz - ctx->cc.r7 * ctx->cc.Tx) * Yu +
+	    (ctx->cc.r7 * ctx->cc.Ty - ctx->cc.r4 * ctx->cc.Tz) * Xu -
+	    ctx->cc.f * ctx->cc.r1 * ctx->cc.Ty + ctx->cc.f * ctx->cc.r4 * ctx->cc.Tx) / common_denominator;
 }
 
 
@@ -330,7 +342,8 @@ void      image_coord_to_world_coord (Xfd, Yfd, zw, xw, yw)
 * This routine takes the position of a point in world coordinates [mm]	*
 * and determines its position in camera coordinates [mm].		*
 \***********************************************************************/
-void      world_coord_to_camera_coord (xw, yw, zw, xc, yc, zc)
+void      world_coord_to_camera_coord (ctx, xw, yw, zw, xc, yc, zc)
+    struct tsai_context *ctx;
     double    xw,
               yw,
               zw,
@@ -338,9 +351,9 @@ void      world_coord_to_camera_coord (xw, yw, zw, xc, yc, zc)
              *yc,
 	     *zc;
 {
-    *xc = tsai_cc.r1 * xw + tsai_cc.r2 * yw + tsai_cc.r3 * zw + tsai_cc.Tx;
-    *yc = tsai_cc.r4 * xw + tsai_cc.r5 * yw + tsai_cc.r6 * zw + tsai_cc.Ty;
-    *zc = tsai_cc.r7 * xw + tsai_cc.r8 * yw + tsai_cc.r9 * zw + tsai_cc.Tz;
+    *xc = ctx->cc.r1 * xw + ctx->cc.r2 * yw + ctx->cc.r3 * zw + ctx->cc.Tx;
+    *yc = ctx->cc.r4 * xw + ctx->cc.r5 * yw + ctx->cc.r6 * zw + ctx->cc.Ty;
+    *zc = ctx->cc.r7 * xw + ctx->cc.r8 * yw + ctx->cc.r9 * zw + ctx->cc.Tz;
 }
 
 
@@ -348,7 +361,8 @@ void      world_coord_to_camera_coord (xw, yw, zw, xc, yc, zc)
 * This routine takes the position of a point in camera coordinates [mm]	*
 * and determines its position in world coordinates [mm].		*
 \***********************************************************************/
-void      camera_coord_to_world_coord (xc, yc, zc, xw, yw, zw)
+void      camera_coord_to_world_coord (ctx, xc, yc, zc, xw, yw, zw)
+    struct tsai_context *ctx;
     double    xc,
               yc,
               zc,
@@ -360,28 +374,309 @@ void      camera_coord_to_world_coord (xc, yc, zc, xw, yw, zw)
 
     /* these equations were found by simply inverting the previous routine using Macsyma */
 
-    common_denominator = ((tsai_cc.r1 * tsai_cc.r5 - tsai_cc.r2 * tsai_cc.r4) * tsai_cc.r9 +
-			  (tsai_cc.r3 * tsai_cc.r4 - tsai_cc.r1 * tsai_cc.r6) * tsai_cc.r8 +
-			  (tsai_cc.r2 * tsai_cc.r6 - tsai_cc.r3 * tsai_cc.r5) * tsai_cc.r7);
-
-    *xw = ((tsai_cc.r2 * tsai_cc.r6 - tsai_cc.r3 * tsai_cc.r5) * zc +
-	   (tsai_cc.r3 * tsai_cc.r8 - tsai_cc.r2 * tsai_cc.r9) * yc +
-	   (tsai_cc.r5 * tsai_cc.r9 - tsai_cc.r6 * tsai_cc.r8) * xc +
-	   (tsai_cc.r3 * tsai_cc.r5 - tsai_cc.r2 * tsai_cc.r6) * tsai_cc.Tz +
-	   (tsai_cc.r2 * tsai_cc.r9 - tsai_cc.r3 * tsai_cc.r8) * tsai_cc.Ty +
-	   (tsai_cc.r6 * tsai_cc.r8 - tsai_cc.r5 * tsai_cc.r9) * tsai_cc.Tx) / common_denominator;
-
-    *yw = -((tsai_cc.r1 * tsai_cc.r6 - tsai_cc.r3 * tsai_cc.r4) * zc +
-	    (tsai_cc.r3 * tsai_cc.r7 - tsai_cc.r1 * tsai_cc.r9) * yc +
-	    (tsai_cc.r4 * tsai_cc.r9 - tsai_cc.r6 * tsai_cc.r7) * xc +
-	    (tsai_cc.r3 * tsai_cc.r4 - tsai_cc.r1 * tsai_cc.r6) * tsai_cc.Tz +
-	    (tsai_cc.r1 * tsai_cc.r9 - tsai_cc.r3 * tsai_cc.r7) * tsai_cc.Ty +
-	    (tsai_cc.r6 * tsai_cc.r7 - tsai_cc.r4 * tsai_cc.r9) * tsai_cc.Tx) / common_denominator;
-
-    *zw = ((tsai_cc.r1 * tsai_cc.r5 - tsai_cc.r2 * tsai_cc.r4) * zc +
-	   (tsai_cc.r2 * tsai_cc.r7 - tsai_cc.r1 * tsai_cc.r8) * yc +
-	   (tsai_cc.r4 * tsai_cc.r8 - tsai_cc.r5 * tsai_cc.r7) * xc +
-	   (tsai_cc.r2 * tsai_cc.r4 - tsai_cc.r1 * tsai_cc.r5) * tsai_cc.Tz +
-	   (tsai_cc.r1 * tsai_cc.r8 - tsai_cc.r2 * tsai_cc.r7) * tsai_cc.Ty +
-	   (tsai_cc.r5 * tsai_cc.r7 - tsai_cc.r4 * tsai_cc.r8) * tsai_cc.Tx) / common_denominator;
+    common_denominator = ((ctx->cc.r1 * ctx->cc.r5 - ctx->cc.r2 * ctx->cc.r4) * ctx->cc.r9 +
+			  (ctx->cc.r3 * ctx->cc.r4 - ctx->cc.r1 * ctx->cc.r6) * ctx->cc.r8 +
+			  (ctx->cc.r2 * ctx->cc.r6 - ctx->cc.r3 * ctx->cc.r5) * ctx->cc.r7);
+
+    *xw = ((ctx->cc.r2 * ctx->cc.r6 - ctx->cc.r3 * ctx->cc.r5) * zc +
+	   (ctx->cc.r3 * ctx->cc.r8 - ctx->cc.r2 * ctx->cc.r9) * yc +
+	   (ctx->cc.r5 * ctx->cc.r9 - ctx->cc.r6 * ctx->cc.r8) * xc +
+	   (ctx->cc.r3 * ctx->cc.r5 - ctx->cc.r2 * ctx->cc.r6) * ctx->cc.Tz +
+	   (ctx->cc.r2 * ctx->cc.r9 - ctx->cc.r3 * ctx->cc.r8) * ctx->cc.Ty +
+	   (ctx->cc.r6 * ctx->cc.r8 - ctx->cc.r5 * ctx->cc.r9) * ctx->cc.Tx) / common_denominator;
+
+    *yw = -((ctx->cc.r1 * ctx->cc.r6 - ctx->cc.r3 * ctx->cc.r4) * zc +
+	    (ctx->cc.r3 * ctx->cc.r7 - ctx->cc.r1 * ctx->cc.r9) * yc +
+	    (ctx->cc.r4 * ctx->cc.r9 - ctx->cc.r6 * ctx->cc.r7) * xc +
+	    (ctx->cc.r3 * ctx->cc.r4 - ctx->cc.r1 * ctx->cc.r6) * ctx->cc.Tz +
+	    (ctx->cc.r1 * ctx->cc.r9 - ctx->cc.r3 * ctx->cc.r7) * ctx->cc.Ty +
+	    (ctx->cc.r6 * ctx->cc.r7 - ctx->cc.r4 * ctx->cc.r9) * ctx->cc.Tx) / common_denominator;
+
+    *zw = ((ctx->cc.r1 * ctx->cc.r5 - ctx->cc.r2 * ctx->cc.r4) * zc +
+	   (ctx->cc.r2 * ctx->cc.r7 - ctx->cc.r1 * ctx->cc.r8) * yc +
+	   (ctx->cc.r4 * ctx->cc.r8 - ctx->cc.r5 * ctx->cc.r7) * xc +
+	   (ctx->cc.r2 * ctx->cc.r4 - ctx->cc.r1 * ctx->cc.r5) * ctx->cc.Tz +
+	   (ctx->cc.r1 * ctx->cc.r8 - ctx->cc.r2 * ctx->cc.r7) * ctx->cc.Ty +
+	   (ctx->cc.r5 * ctx->cc.r7 - ctx->cc.r4 * ctx->cc.r8) * ctx->cc.Tx) / common_denominator;
+}
+
+
+/***********************************************************************\
+* The routines below apply the transforms above to n points at a time.	*
+* Points are stored row by row, as in a C-contiguous array: (x, y, z)	*
+* triples for world and camera coordinates, (Xf, Yf) pairs for image	*
+* coordinates, and (Xf, Yf, zw) triples for image_coord_to_world_coord.	*
+* The camera constants are loaded once per call and the loops make no	*
+* calls, so that the compiler can vectorize them; only the Cardan	*
+* solution of the lens distortion (kappa1 != 0) is done point by point.	*
+* The results are identical to those of the single point routines.	*
+* Output may overwrite input with the same number of columns.		*
+*									*
+* Each loop is compiled once per instruction set the processor may	*
+* offer (the _generic, _avx2 and _avx512 routines at the end of this	*
+* file); the public routines call the ones tsai_simd_init() picked.	*
+\***********************************************************************/
+TSAI_INLINE void world_coord_to_image_coord_rows (ctx, n, wc, ic)
+    struct tsai_context *ctx;
+    int       n;
+    double   *wc,
+             *ic;
+{
+    int       i;
+
+    double    xw,
+              yw,
+              zw,
+              xc,
+              yc,
+              zc,
+              Xu,
+              Yu;
+
+    double    r1 = ctx->cc.r1, r2 = ctx->cc.r2, r3 = ctx->cc.r3,
+              r4 = ctx->cc.r4, r5 = ctx->cc.r5, r6 = ctx->cc.r6,
+              r7 = ctx->cc.r7, r8 = ctx->cc.r8, r9 = ctx->cc.r9,
+              Tx = ctx->cc.Tx, Ty = ctx->cc.Ty, Tz = ctx->cc.Tz,
+              f = ctx->cc.f,
+              sx = ctx->cp.sx, dpx = ctx->cp.dpx, dpy = ctx->cp.dpy,
+              Cx = ctx->cp.Cx, Cy = ctx->cp.Cy;
+
+    /* convert from world coordinates to undistorted sensor plane coordinates */
+    for (i = 0; i < n; i++) {
+	xw = wc[3 * i];
+	yw = wc[3 * i + 1];
+	zw = wc[3 * i + 2];
+
+	xc = r1 * xw + r2 * yw + r3 * zw + Tx;
+	yc = r4 * xw + r5 * yw + r6 * zw + Ty;
+	zc = r7 * xw + r8 * yw + r9 * zw + Tz;
+
+	ic[2 * i] = f * xc / zc;
+	ic[2 * i + 1] = f * yc / zc;
+    }
+
+    /* convert from undistorted to distorted sensor plane coordinates */
+    if (ctx->cc.kappa1 != 0)
+	for (i = 0; i < n; i++) {
+	    Xu = ic[2 * i];
+	    Yu = ic[2 * i + 1];
+	    undistorted_to_distorted_sensor_coord (ctx, Xu, Yu, &ic[2 * i], &ic[2 * i + 1]);
+	}
+
+    /* convert from distorted sensor plane coordinates to image coordinates */
+    for (i = 0; i < n; i++) {
+	ic[2 * i] = ic[2 * i] * sx / dpx + Cx;
+	ic[2 * i + 1] = ic[2 * i + 1] / dpy + Cy;
+    }
+}
+
+
+/************************************************************************/
+TSAI_INLINE void image_coord_to_world_coord_rows (ctx, n, ic, wc)
+    struct tsai_context *ctx;
+    int       n;
+    double   *ic,
+             *wc;
+{
+    int       i;
+
+    double    Xfd,
+              Yfd,
+              zw,
+              Xd,
+              Yd,
+              Xu,
+              Yu,
+              distortion_factor,
+              common_denominator;
+
+    double    r1 = ctx->cc.r1, r2 = ctx->cc.r2, r3 = ctx->cc.r3,
+              r4 = ctx->cc.r4, r5 = ctx->cc.r5, r6 = ctx->cc.r6,
+              r7 = ctx->cc.r7, r8 = ctx->cc.r8, r9 = ctx->cc.r9,
+              Tx = ctx->cc.Tx, Ty = ctx->cc.Ty, Tz = ctx->cc.Tz,
+              f = ctx->cc.f, kappa1 = ctx->cc.kappa1,
+              sx = ctx->cp.sx, dpx = ctx->cp.dpx, dpy = ctx->cp.dpy,
+              Cx = ctx->cp.Cx, Cy = ctx->cp.Cy;
+
+    for (i = 0; i < n; i++) {
+	Xfd = ic[3 * i];
+	Yfd = ic[3 * i + 1];
+	zw = ic[3 * i + 2];
+
+	/* convert from image to distorted sensor coordinates */
+	Xd = dpx * (Xfd - Cx) / sx;
+	Yd = dpy * (Yfd - Cy);
+
+	/* convert from distorted sensor to undistorted sensor plane coordinates */
+	distortion_factor = 1 + kappa1 * (SQR (Xd) + SQR (Yd));
+	Xu = Xd * distortion_factor;
+	Yu = Yd * distortion_factor;
+
+	/* calculate the corresponding xw and yw world coordinates */
+	common_denominator = ((r1 * r8 - r2 * r7) * Yu +
+			      (r5 * r7 - r4 * r8) * Xu -
+			      f * r1 * r5 + f * r2 * r4);
+
+	wc[3 * i] = (((r2 * r9 - r3 * r8) * Yu +
+		      (r6 * r8 - r5 * r9) * Xu -
+		      f * r2 * r6 + f * r3 * r5) * zw +
+		     (r2 * Tz - r8 * Tx) * Yu +
+		     (r8 * Ty - r5 * Tz) * Xu -
+		     f * r2 * Ty + f * r5 * Tx) / common_denominator;
+
+	wc[3 * i + 1] = -(((r1 * r9 - r3 * r7) * Yu +
+			   (r6 * r7 - r4 * r9) * Xu -
+			   f * r1 * r6 + f * r3 * r4) * zw +
+			  (r1 * Tz - r7 * Tx) * Yu +
+			  (r7 * Ty - r4 * Tz) * Xu -
+			  f * r1 * Ty + f * r4 * Tx) / common_denominator;
+
+	wc[3 * i + 2] = zw;
+    }
+}
+
+
+/************************************************************************/
+TSAI_INLINE void world_coord_to_camera_coord_rows (ctx, n, wc, cc)
+    struct tsai_context *ctx;
+    int       n;
+    double   *wc,
+             *cc;
+{
+    int       i;
+
+    double    xw,
+              yw,
+              zw;
+
+    double    r1 = ctx->cc.r1, r2 = ctx->cc.r2, r3 = ctx->cc.r3,
+              r4 = ctx->cc.r4, r5 = ctx->cc.r5, r6 = ctx->cc.r6,
+              r7 = ctx->cc.r7, r8 = ctx->cc.r8, r9 = ctx->cc.r9,
+              Tx = ctx->cc.Tx, Ty = ctx->cc.Ty, Tz = ctx->cc.Tz;
+
+    for (i = 0; i < n; i++) {
+	xw = wc[3 * i];
+	yw = wc[3 * i + 1];
+	zw = wc[3 * i + 2];
+
+	cc[3 * i] = r1 * xw + r2 * yw + r3 * zw + Tx;
+	cc[3 * i + 1] = r4 * xw + r5 * yw + r6 * zw + Ty;
+	cc[3 * i + 2] = r7 * xw + r8 * yw + r9 * zw + Tz;
+    }
+}
+
+
+/************************************************************************/
+TSAI_INLINE void camera_coord_to_world_coord_rows (ctx, n, cc, wc)
+    struct tsai_context *ctx;
+    int       n;
+    double   *cc,
+             *wc;
+{
+    int       i;
+
+    double    xc,
+              yc,
+              zc,
+              common_denominator;
+
+    double    r1 = ctx->cc.r1, r2 = ctx->cc.r2, r3 = ctx->cc.r3,
+              r4 = ctx->cc.r4, r5 = ctx->cc.r5, r6 = ctx->cc.r6,
+              r7 = ctx->cc.r7, r8 = ctx->cc.r8, r9 = ctx->cc.r9,
+              Tx = ctx->cc.Tx, Ty = ctx->cc.Ty, Tz = ctx->cc.Tz;
+
+    common_denominator = ((r1 * r5 - r2 * r4) * r9 +
+			  (r3 * r4 - r1 * r6) * r8 +
+			  (r2 * r6 - r3 * r5) * r7);
+
+    for (i = 0; i < n; i++) {
+	xc = cc[3 * i];
+	yc = cc[3 * i + 1];
+	zc = cc[3 * i + 2];
+
+	wc[3 * i] = ((r2 * r6 - r3 * r5) * zc +
+		     (r3 * r8 - r2 * r9) * yc +
+		     (r5 * r9 - r6 * r8) * xc +
+		     (r3 * r5 - r2 * r6) * Tz +
+		     (r2 * r9 - r3 * r8) * Ty +
+		     (r6 * r8 - r5 * r9) * Tx) / common_denominator;
+
+	wc[3 * i + 1] = -((r1 * r6 - r3 * r4) * zc +
+			  (r3 * r7 - r1 * r9) * yc +
+			  (r4 * r9 - r6 * r7) * xc +
+			  (r3 * r4 - r1 * r6) * Tz +
+			  (r1 * r9 - r3 * r7) * Ty +
+			  (r6 * r7 - r4 * r9) * Tx) / common_denominator;
+
+	wc[3 * i + 2] = ((r1 * r5 - r2 * r4) * zc +
+			 (r2 * r7 - r1 * r8) * yc +
+			 (r4 * r8 - r5 * r7) * xc +
+			 (r2 * r4 - r1 * r5) * Tz +
+			 (r1 * r8 - r2 * r7) * Ty +
+			 (r5 * r7 - r4 * r8) * Tx) / common_denominator;
+    }
+}
+
+
+/************************************************************************/
+#define ARRAY_KERNEL(name, suffix, target) \
+target void name##_array_##suffix (struct tsai_context *ctx, int n, double *in, double *out) \
+{ \
+    name##_rows (ctx, n, in, out); \
+}
+
+#define ARRAY_KERNELS(suffix, target) \
+ARRAY_KERNEL (world_coord_to_image_coord, suffix, target) \
+ARRAY_KERNEL (image_coord_to_world_coord, suffix, target) \
+ARRAY_KERNEL (world_coord_to_camera_coord, suffix, target) \
+ARRAY_KERNEL (camera_coord_to_world_coord, suffix, target)
+
+ARRAY_KERNELS (generic, )
+#ifdef TSAI_X86_KERNELS
+ARRAY_KERNELS (avx2, TSAI_TARGET ("avx2"))
+ARRAY_KERNELS (avx512, TSAI_TARGET ("avx512f"))
+#endif
+
+
+/************************************************************************/
+void      world_coord_to_image_coord_array (ctx, n, wc, ic)
+    struct tsai_context *ctx;
+    int       n;
+    double   *wc,
+             *ic;
+{
+    tsai_kernels.world_coord_to_image_coord (ctx, n, wc, ic);
+}
+
+
+/************************************************************************/
+void      image_coord_to_world_coord_array (ctx, n, ic, wc)
+    struct tsai_context *ctx;
+    int       n;
+    double   *ic,
+             *wc;
+{
+    tsai_kernels.image_coord_to_world_coord (ctx, n, ic, wc);
+}
+
+
+/************************************************************************/
+void      world_coord_to_camera_coord_array (ctx, n, wc, cc)
+    struct tsai_context *ctx;
+    int       n;
+    double   *wc,
+             *cc;
+{
+    tsai_kernels.world_coord_to_camera_coord (ctx, n, wc, cc);
+}
+
+
+/************************************************************************/
+void      camera_coord_to_world_coord_array (ctx, n, cc, wc)
+    struct tsai_context *ctx;
+    int       n;
+    double   *cc,
+             *wc;
+{
+    tsai_kernels.camera_coord_to_world_coord (ctx, n, cc, wc);
 }
@@ -0,0 +1,608 @@
+/**
+ * cal_views.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/****************************************************************************\
+*                                                                            *
+* This file contains the calibration of one camera from several views of a   *
+* coplanar target, such as a checkerboard moved about in front of it:        *
+*                                                                            *
+*       coplanar_multi_view_calibration ()                                   *
+*                                                                            *
+* Each view is a context of its own holding the calibration data of that     *
+* view, and all of them hold the same camera parameters.  The views share    *
+* the intrinsic parameters kappa1, f, sx, Cx and Cy, while each has its own  *
+* Rx, Ry, Rz, Tx, Ty and Tz; the error minimized is that of the single view  *
+* stages (see cal_jac.c), summed over the points of every view.              *
+*                                                                            *
+* Every view is first calibrated on its own by cc_three_parm_optimization(). *
+* The shared f and kappa1 start out as the medians over the views, with the  *
+* Tz of each view scaled by the change in its f so that its image keeps its  *
+* size, and the shared sx, Cx and Cy as given.                               *
+*                                                                            *
+* The joint problem is then solved by Levenberg-Marquardt.  The Jacobian of  *
+* the errors of a view has only eleven nonzero columns, its own six and the  *
+* five shared ones, so its rows are folded into an 11 by 12 triangle         *
+* [R | Q^T err] of the view's own (undistorted_sensor_error_triangle()).     *
+* The rows folded are those of the two components of each point's error,     *
+* which make a far better linear model than the error itself; the sum of     *
+* their squares is the same.                                                 *
+* The last five rows of that triangle hold the view's part of the problem    *
+* in the shared parameters alone, with its own ones eliminated (the Schur    *
+* complement, in square root form), and these rows of all of the views are   *
+* folded into a single 5 by 6 triangle.  A step solves that triangle for     *
+* the update of the shared parameters, and then the first six rows of each   *
+* view's triangle for the update of its own.  An iteration thus takes time   *
+* and storage linear in the number of views, rather than the cubic time a    *
+* dense solve for all 6 * views + 5 parameters would take.                   *
+*                                                                            *
+* The step is damped by folding the rows sqrt (lambda) D into copies of the  *
+* triangles, where D holds the norms of the columns of the Jacobian, never   *
+* decreasing, as with MINPACK's mode 1.  lambda is updated after Nielsen     *
+* from the ratio of the actual to the predicted reduction of the error.      *
+* The iteration stops on the tolerances of the single view stages.           *
+*                                                                            *
+* If the first view's context has a pool (and there is more than one view)   *
+* the views are calibrated, evaluated and folded in parallel on it, a view   *
+* to a task, and the sweeps of each view then run on the calling thread.     *
+* The triangles are combined in the order of the views, so the result does   *
+* not depend on the pool.  The evaluations of the joint stage are added to   *
+* the counters of every view.  Each view's workspace comes from its own      *
+* arena.                                                                     *
+*                                                                            *
+\****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "cal_jac.h"
+#include "../errors.h"
+#include "../pool/pool.h"
+
+#define VIEW_PARMS	6	/* Rx, Ry, Rz, Tx, Ty, Tz of each view */
+#define SHARED_PARMS	5	/* kappa1, f, sx, Cx, Cy */
+#define VIEW_COLUMNS	(VIEW_PARMS + SHARED_PARMS)
+#define TRIANGLE_SIZE	(VIEW_COLUMNS * (VIEW_COLUMNS + 1))
+
+#define LAMBDA_START	1.0E-3	/* relative to the squared column norms */
+#define LAMBDA_MAX	1.0E16	/* beyond which no step can make progress */
+#define ACCEPT_RATIO	1.0E-4	/* of the predicted reduction, to take a step */
+#define VIEWS_MAXFEV	(1000 * VIEW_COLUMNS)
+
+/* the parameters of a view are in the order of enum tsai_error_parameter */
+static int view_column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+struct view_state {
+    struct tsai_context *ctx;
+    struct worker_pool *pool;		/* ctx->pool, while the views share one */
+    size_t    mark;			/* of ctx's arena */
+    int       seeded;
+
+    double    x[VIEW_PARMS];
+    double    step[VIEW_PARMS];
+    double    diag[VIEW_PARMS];
+
+    double    r[TRIANGLE_SIZE];		/* [R | Q^T err] at x */
+    double    damped[TRIANGLE_SIZE];	/* r with the damping folded in */
+
+    double   *err;			/* of the last evaluation */
+    double    sse;
+};
+
+struct view_problem {
+    struct view_state *view;
+    int       nviews;
+    struct worker_pool *pool;
+    int       trying;			/* evaluate at x + step */
+
+    double    shared[SHARED_PARMS];
+    double    shared_step[SHARED_PARMS];
+    double    shared_diag[SHARED_PARMS];
+};
+
+
+/* pytsai: cannot fail; void return type is fine.  The parameters of view v
+ * in the order of view_column. */
+static void view_params (struct view_problem *vp, int v, double *params)
+{
+    struct view_state *view = vp->view + v;
+    int       j;
+
+    for (j = 0; j < VIEW_PARMS; j++)
+	params[j] = view->x[j] + (vp->trying ? view->step[j] : 0.0);
+    for (j = 0; j < SHARED_PARMS; j++)
+	params[VIEW_PARMS + j] = vp->shared[j] + (vp->trying ? vp->shared_step[j] : 0.0);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task posing view v
+ * on its own; a failure is raised in the view's context. */
+static void seed_task (void *arg, int v)
+{
+    struct view_problem *vp = (struct view_problem *) arg;
+
+    vp->view[v].seeded = cc_three_parm_optimization (vp->view[v].ctx);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task evaluating the
+ * error of view v, at x or at x + step. */
+static void error_task (void *arg, int v)
+{
+    struct view_problem *vp = (struct view_problem *) arg;
+    struct view_state *view = vp->view + v;
+
+    int       i;
+
+    double    params[VIEW_COLUMNS],
+              sse = 0.0;
+
+    view_params (vp, v, params);
+    undistorted_sensor_error (view->ctx, params, view_column, NULL, NULL, view->err);
+    for (i = 0; i < view->ctx->cd.point_count; i++)
+	sse += SQR (view->err[i]);
+    view->sse = sse;
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Pool task folding the
+ * Jacobian of the error components of view v at x into its triangle. */
+static void fold_task (void *arg, int v)
+{
+    struct view_problem *vp = (struct view_problem *) arg;
+    struct view_state *view = vp->view + v;
+
+    int       k;
+
+    double    params[VIEW_COLUMNS];
+
+    view_params (vp, v, params);
+    for (k = 0; k < TRIANGLE_SIZE; k++)
+	view->r[k] = 0.0;
+    undistorted_sensor_error_triangle (view->ctx, params, view_column, NULL, NULL,
+				       NULL, view->r, VIEW_COLUMNS);
+}
+
+
+/* pytsai: cannot fail; void return type is fine. */
+static void run_views (struct view_problem *vp, pool_task task)
+{
+    int       v;
+
+    if (vp->pool != NULL)
+	pool_run (vp->pool, vp->nviews, task, vp);
+    else
+	for (v = 0; v < vp->nviews; v++)
+	    task (vp, v);
+}
+
+
+/* pytsai: cannot fail.  The sum of the squared errors of the last
+ * evaluation. */
+static double total_sse (struct view_problem *vp)
+{
+    int       v;
+    double    sse = 0.0;
+
+    for (v = 0; v < vp->nviews; v++)
+	sse += vp->view[v].sse;
+    return sse;
+}
+
+
+/* pytsai: cannot fail.  The norm of column j of the triangle r. */
+static double column_norm (double *r, int j)
+{
+    int       i;
+    double    sum = 0.0;
+
+    for (i = 0; i <= j; i++)
+	sum += SQR (r[i + j * VIEW_COLUMNS]);
+    return sqrt (sum);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Updates the scale D from the norms of the columns of the Jacobian, which
+ * are those of the columns of the triangles. */
+static void update_scale (struct view_problem *vp, int first)
+{
+    struct view_state *view;
+
+    int       v,
+              j;
+
+    double    norm,
+              sum[SHARED_PARMS];
+
+    for (j = 0; j < SHARED_PARMS; j++)
+	sum[j] = 0.0;
+
+    for (v = 0; v < vp->nviews; v++) {
+	view = vp->view + v;
+	for (j = 0; j < VIEW_PARMS; j++) {
+	    norm = column_norm (view->r, j);
+	    if (first)
+		view->diag[j] = norm != 0.0 ? norm : 1.0;
+	    else if (norm > view->diag[j])
+		view->diag[j] = norm;
+	}
+	for (j = 0; j < SHARED_PARMS; j++)
+	    sum[j] += SQR (column_norm (view->r, VIEW_PARMS + j));
+    }
+
+    for (j = 0; j < SHARED_PARMS; j++) {
+	norm = sqrt (sum[j]);
+	if (first)
+	    vp->shared_diag[j] = norm != 0.0 ? norm : 1.0;
+	else if (norm > vp->shared_diag[j])
+	    vp->shared_diag[j] = norm;
+    }
+}
+
+
+/* pytsai: cannot fail; void return type is fine.  Solves R x = -q for the
+ * leading n by n part of the triangle r (leading dimension ldr); where R is
+ * singular the component is taken to be zero. */
+static void back_substitute (double *r, int ldr, int n, double *q, double *x)
+{
+    int       j,
+              k;
+    double    t;
+
+    for (j = n - 1; j >= 0; j--) {
+	t = -q[j];
+	for (k = j + 1; k < n; k++)
+	    t -= r[j + k * ldr] * x[k];
+	x[j] = r[j + j * ldr] != 0.0 ? t / r[j + j * ldr] : 0.0;
+    }
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * Computes the step minimizing |J step + err|^2 + lambda |D step|^2: first
+ * the shared part from the triangle the views' Schur complements fold into,
+ * then the part of each view. */
+static void solve_step (struct view_problem *vp, double lambda)
+{
+    struct view_state *view;
+
+    int       v,
+              i,
+              j,
+              k;
+
+    double    shared[SHARED_PARMS * (SHARED_PARMS + 1)],
+              row[VIEW_COLUMNS + 1],
+              q[VIEW_PARMS],
+              s = sqrt (lambda);
+
+    for (k = 0; k < SHARED_PARMS * (SHARED_PARMS + 1); k++)
+	shared[k] = 0.0;
+
+    for (v = 0; v < vp->nviews; v++) {
+	view = vp->view + v;
+	for (k = 0; k < TRIANGLE_SIZE; k++)
+	    view->damped[k] = view->r[k];
+
+	/* damp the view's own parameters */
+	for (j = 0; j < VIEW_PARMS; j++) {
+	    for (k = 0; k <= VIEW_COLUMNS; k++)
+		row[k] = 0.0;
+	    row[j] = s * view->diag[j];
+	    fold_row (view->damped, VIEW_COLUMNS, VIEW_COLUMNS, row);
+	}
+
+	/* the rows left in the shared parameters alone */
+	for (i = VIEW_PARMS; i < VIEW_COLUMNS; i++) {
+	    for (k = 0; k <= SHARED_PARMS; k++)
+		row[k] = view->damped[i + (VIEW_PARMS + k) * VIEW_COLUMNS];
+	    fold_row (shared, SHARED_PARMS, SHARED_PARMS, row);
+	}
+    }
+
+    for (j = 0; j < SHARED_PARMS; j++) {
+	for (k = 0; k <= SHARED_PARMS; k++)
+	    row[k] = 0.0;
+	row[j] = s * vp->shared_diag[j];
+	fold_row (shared, SHARED_PARMS, SHARED_PARMS, row);
+    }
+    back_substitute (shared, SHARED_PARMS, SHARED_PARMS,
+		     shared + SHARED_PARMS * SHARED_PARMS, vp->shared_step);
+
+    for (v = 0; v < vp->nviews; v++) {
+	view = vp->view + v;
+	for (i = 0; i < VIEW_PARMS; i++) {
+	    q[i] = view->damped[i + VIEW_COLUMNS * VIEW_COLUMNS];
+	    for (k = 0; k < SHARED_PARMS; k++)
+		q[i] += view->damped[i + (VIEW_PARMS + k) * VIEW_COLUMNS] * vp->shared_step[k];
+	}
+	back_substitute (view->damped, VIEW_COLUMNS, VIEW_PARMS, q, view->step);
+    }
+}
+
+
+/* pytsai: cannot fail.  |err|^2 - |J step + err|^2, the reduction of the
+ * error the linear model predicts for the step. */
+static double predicted_reduction (struct view_problem *vp)
+{
+    struct view_state *view;
+
+    int       v,
+              i,
+              k;
+
+    double    step[VIEW_COLUMNS],
+              y,
+              q,
+              sum = 0.0;
+
+    for (k = 0; k < SHARED_PARMS; k++)
+	step[VIEW_PARMS + k] = vp->shared_step[k];
+
+    for (v = 0; v < vp->nviews; v++) {
+	view = vp->view + v;
+	for (k = 0; k < VIEW_PARMS; k++)
+	    step[k] = view->step[k];
+	for (i = 0; i < VIEW_COLUMNS; i++) {
+	    q = view->r[i + VIEW_COLUMNS * VIEW_COLUMNS];
+	    y = q;
+	    for (k = i; k < VIEW_COLUMNS; k++)
+		y += view->r[i + k * VIEW_COLUMNS] * step[k];
+	    sum += SQR (q) - SQR (y);
+	}
+    }
+    return sum;
+}
+
+
+/* pytsai: cannot fail.  |D x| or, if of_step, |D step|. */
+static double scaled_norm (struct view_problem *vp, int of_step)
+{
+    struct view_state *view;
+
+    int       v,
+              j;
+
+    double    sum = 0.0;
+
+    for (v = 0; v < vp->nviews; v++) {
+	view = vp->view + v;
+	for (j = 0; j < VIEW_PARMS; j++)
+	    sum += SQR (view->diag[j] * (of_step ? view->step[j] : view->x[j]));
+    }
+    for (j = 0; j < SHARED_PARMS; j++)
+	sum += SQR (vp->shared_diag[j] * (of_step ? vp->shared_step[j] : vp->shared[j]));
+    return sqrt (sum);
+}
+
+
+/* pytsai: cannot fail; void return type is fine.
+ *
+ * The Levenberg-Marquardt iteration.  A trial error that is not a number
+ * fails the ratio test like any other bad step. */
+static void optimize_views (struct view_problem *vp, long *nfev, long *njev)
+{
+    struct view_state *view;
+
+    int       first = 1,
+              v,
+              j;
+
+    double    sse,
+              trial,
+              actual,
+              predicted,
+              ratio,
+              pnorm,
+              t,
+              lambda = LAMBDA_START,
+              nu = 2.0;
+
+    vp->trying = 0;
+    run_views (vp, error_task);
+    sse = total_sse (vp);
+    ++*nfev;
+
+    while (sse > 0.0) {
+	run_views (vp, fold_task);
+	++*njev;
+	update_scale (vp, first);
+	first = 0;
+
+	for (;;) {
+	    solve_step (vp, lambda);
+	    vp->trying = 1;
+	    run_views (vp, error_task);
+	    vp->trying = 0;
+	    ++*nfev;
+
+	    trial = total_sse (vp);
+	    actual = sse - trial;
+	    predicted = predicted_reduction (vp);
+	    ratio = predicted > 0.0 ? actual / predicted : 0.0;
+	    pnorm = scaled_norm (vp, 1);
+
+	    if (ratio > ACCEPT_RATIO) {
+		for (v = 0; v < vp->nviews; v++) {
+		    view = vp->view + v;
+		    for (j = 0; j < VIEW_PARMS; j++)
+			view->x[j] += view->step[j];
+		}
+		for (j = 0; j < SHARED_PARMS; j++)
+		    vp->shared[j] += vp->shared_step[j];
+
+		t = 2.0 * ratio - 1.0;
+		lambda *= (1.0 - t * t * t > 1.0 / 3.0) ? 1.0 - t * t * t : 1.0 / 3.0;
+		nu = 2.0;
+
+		if ((fabs (actual) <= REL_SENSOR_TOLERANCE_ftol * sse &&
+		     predicted <= REL_SENSOR_TOLERANCE_ftol * sse) ||
+		    pnorm <= REL_PARAM_TOLERANCE_xtol * scaled_norm (vp, 0) ||
+		    *nfev >= VIEWS_MAXFEV)
+		    return;
+		sse = trial;
+		break;
+	    }
+
+	    lambda *= nu;
+	    nu *= 2.0;
+	    if (pnorm <= REL_PARAM_TOLERANCE_xtol * scaled_norm (vp, 0) ||
+		lambda > LAMBDA_MAX || *nfev >= VIEWS_MAXFEV)
+		return;
+	}
+    }
+}
+
+
+/* pytsai: cannot fail. */
+static int compare_doubles (const void *a, const void *b)
+{
+    double    x = *(const double *) a,
+              y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+/* pytsai: cannot fail.  The median of the n values in a, which it sorts. */
+static double median (double *a, int n)
+{
+    qsort (a, n, sizeof (double), compare_doubles);
+    return n % 2 ? a[n / 2] : 0.5 * (a[n / 2 - 1] + a[n / 2]);
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Calibrates the camera from the nviews (at least two) views, and leaves
+ * the shared intrinsic parameters and each view's pose in every view's
+ * context.  A single view of a plane cannot tell sx from f (which is why
+ * the single view coplanar stages hold sx fixed), so fewer views are
+ * refused.  A failure is raised in the context of the view that failed,
+ * or in the first view's if the views could not be set up. */
+int coplanar_multi_view_calibration (struct tsai_context **views, int nviews)
+{
+    struct view_problem vp;
+    struct view_state *view;
+    struct tsai_context *ctx;
+
+    int       ok = 1,
+              v;
+
+    long      nfev = 0,
+              njev = 0;
+
+    double   *values,
+              f,
+              kappa1;
+
+    if (nviews < 2) {
+	pytsai_raise (&views[0]->err, "coplanar_multi_view_calibration: at least two views are needed");
+	return 0;
+    }
+
+    vp.view = (struct view_state *) malloc (nviews * (sizeof (struct view_state) + sizeof (double)));
+    if (vp.view == NULL) {
+	pytsai_raise (&views[0]->err, "coplanar_multi_view_calibration: out of memory");
+	return 0;
+    }
+    values = (double *) (vp.view + nviews);
+    vp.nviews = nviews;
+    vp.pool = nviews > 1 ? views[0]->pool : NULL;
+    vp.trying = 0;
+
+    for (v = 0; v < nviews; v++) {
+	view = vp.view + v;
+	view->ctx = views[v];
+	view->pool = views[v]->pool;
+	view->mark = views[v]->arena_used;
+	if (vp.pool != NULL)
+	    views[v]->pool = NULL;
+    }
+
+    /* pose every view on its own */
+    run_views (&vp, seed_task);
+    for (v = 0; v < nviews; v++)
+	if (!vp.view[v].seeded)
+	    ok = 0;
+
+    if (ok) {
+	for (v = 0; v < nviews; v++)
+	    values[v] = views[v]->cc.f;
+	f = median (values, nviews);
+	for (v = 0; v < nviews; v++)
+	    values[v] = views[v]->cc.kappa1;
+	kappa1 = median (values, nviews);
+
+	vp.shared[TSAI_KAPPA1 - VIEW_PARMS] = kappa1;
+	vp.shared[TSAI_F - VIEW_PARMS] = f;
+	vp.shared[TSAI_SX - VIEW_PARMS] = views[0]->cp.sx;
+	vp.shared[TSAI_CX - VIEW_PARMS] = views[0]->cp.Cx;
+	vp.shared[TSAI_CY - VIEW_PARMS] = views[0]->cp.Cy;
+
+	for (v = 0; v < nviews && ok; v++) {
+	    view = vp.view + v;
+	    ctx = view->ctx;
+	    view->x[TSAI_RX] = ctx->cc.Rx;
+	    view->x[TSAI_RY] = ctx->cc.Ry;
+	    view->x[TSAI_RZ] = ctx->cc.Rz;
+	    view->x[TSAI_TX] = ctx->cc.Tx;
+	    view->x[TSAI_TY] = ctx->cc.Ty;
+	    view->x[TSAI_TZ] = ctx->cc.Tz * f / ctx->cc.f;
+
+	    view->err = tsai_arena_alloc (ctx, ctx->cd.point_count);
+	    if (view->err == NULL)
+		ok = 0;
+	}
+    }
+
+    if (ok) {
+	optimize_views (&vp, &nfev, &njev);
+
+	for (v = 0; v < nviews; v++) {
+	    view = vp.view + v;
+	    ctx = view->ctx;
+	    ctx->cc.Rx = view->x[TSAI_RX];
+	    ctx->cc.Ry = view->x[TSAI_RY];
+	    ctx->cc.Rz = view->x[TSAI_RZ];
+	    apply_RPY_transform (ctx);
+
+	    ctx->cc.Tx = view->x[TSAI_TX];
+	    ctx->cc.Ty = view->x[TSAI_TY];
+	    ctx->cc.Tz = view->x[TSAI_TZ];
+	    ctx->cc.kappa1 = vp.shared[TSAI_KAPPA1 - VIEW_PARMS];
+	    ctx->cc.f = vp.shared[TSAI_F - VIEW_PARMS];
+	    ctx->cp.sx = vp.shared[TSAI_SX - VIEW_PARMS];
+	    ctx->cp.Cx = vp.shared[TSAI_CX - VIEW_PARMS];
+	    ctx->cp.Cy = vp.shared[TSAI_CY - VIEW_PARMS];
+	    ctx->nfev += nfev;
+	    ctx->njev += njev;
+	}
+    }
+
+    for (v = 0; v < nviews; v++) {
+	view = vp.view + v;
+	tsai_arena_release (view->ctx, view->mark);
+	view->ctx->pool = view->pool;
+    }
+    free (vp.view);
+    return ok;
+}
@@ -44,9 +44,9 @@
 *                                                                            *
 * This file provides two routines:                                           *
 *                                                                            *
-*       coplanar_extrinsic_parameter_estimation ()                           *
+*       coplanar_extrinsic_parameter_estimation (ctx)                           *
 * and                                                                        *
-*       noncoplanar_extrinsic_parameter_estimation ()                        *
+*       noncoplanar_extrinsic_parameter_estimation (ctx)                        *
 *                                                                            *
 * which are used respectively for coplanar and non-coplanar calibration      *
 * data.                                                                      *
@@ -55,6 +55,21 @@
 * a modification of the first stage of Tsai's algorithm.  These estimates    *
 * are then refined using iterative non-linear optimization.                  *
 *                                                                            *
+* extrinsic_parameter_estimation (ctx) picks whichever of the two the data   *
+* calls for.                                                                 *
+*                                                                            *
+* To follow a moving camera from frame to frame, the routine                 *
+*                                                                            *
+*       extrinsic_pose_tracking (ctx)                                        *
+*                                                                            *
+* instead refines the pose ctx already holds (the previous frame's)          *
+* directly, skipping the initial estimates, and only falls back on them      *
+* when the refinement goes astray.  It takes Gauss-Newton steps on the two   *
+* components of each point's error, whose normal equations in the six        *
+* parameters cost a sweep over the points to build (see cal_jac.c); from a   *
+* nearby pose two or three steps converge, so a frame of a few hundred       *
+* points takes some tens of microseconds.                                    *
+*                                                                            *
 *                                                                            *
 * History                                                                    *
 * -------                                                                    *
@@ -85,7 +100,7 @@
 *                                                                            *
 * 25-Mar-94  Torfi Thorhallsson (torfit@verk.hi.is) at the University of     *
 *            Iceland                                                         *
-*       Added a new version of the routine epe_optimize() which uses the     *
+*       Added a new version of the routine epe_optimize(ctx) which uses the     *
 *       *public domain* MINPACK optimization library instead of IMSL.        *
 *       To select the new routine, compile this file with the flag -DMINPACK *
 *                                                                            *
@@ -104,17 +119,43 @@
 #include "../minpack/minpack.h"
 #include "../errors.h"
 
+#define TRACKING_STEPS	10	/* most Gauss-Newton steps of a frame */
+
 
 /***********************************************************************\
 * Routines for coplanar extrinsic parameter estimation			*
 \***********************************************************************/
+/* pytsai: cannot fail.
+ * Fills ctx->Xd and ctx->Yd with the undistorted sensor coordinates of the
+ * points, for ransac_compute_U() to fit U to in place of the distorted ones
+ * it fits during calibration. */
+static void epe_compute_Xu_Yu (struct tsai_context *ctx)
+{
+    double    Xd,
+              Yd,
+              distortion_factor;
+
+    int       i;
+
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	Xd = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
+	distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
+	ctx->Xd[i] = Xd * distortion_factor;
+	ctx->Yd[i] = Yd * distortion_factor;
+    }
+}
+
+
 /* pytsai: can fail; int return type is required. */
-int cepe_compute_U (U)
+int cepe_compute_U (ctx, U)
+    struct tsai_context *ctx;
     double    U[];
 {
-    dmat      M,
-              a,
-              b;
+    lsqsys    sys;
+
+    double    row[5],
+              a[5];
 
     double    Xd,
               Yd,
@@ -124,69 +165,53 @@ int cepe_compute_U (U)
 
     int       i;
 
-    M = newdmat (0, (tsai_cd.point_count - 1), 0, 4, &errno);
-    if (errno) {
-	pytsai_raise("cepe compute U: unable to allocate matrix M");
-	return 0;
+    if (ctx->ransac_threshold > 0 && ctx->cd.point_count > 5) {
+	epe_compute_Xu_Yu (ctx);
+	if (!ransac_compute_U (ctx, 5))
+	    return 0;
+	for (i = 0; i < 5; i++)
+	    U[i] = ctx->U[i];
+	return 1;
     }
 
-    a = newdmat (0, 4, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise("cepe compute U: unable to allocate vector a");
-	return 0;
-    }
+    lsq_init (&sys, 5);
 
-    b = newdmat (0, (tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise("cepe compute U: unable to allocate vector b");
-	return 0;
-    }
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
 	/* convert from image coordinates to distorted sensor coordinates */
-	Xd = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
+	Xd = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
 
 	/* convert from distorted sensor coordinates to undistorted sensor coordinates */
-	distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
+	distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
 	Xu = Xd * distortion_factor;
 	Yu = Yd * distortion_factor;
 
-	M.el[i][0] = Yu * tsai_cd.xw[i];
-	M.el[i][1] = Yu * tsai_cd.yw[i];
-	M.el[i][2] = Yu;
-	M.el[i][3] = -Xu * tsai_cd.xw[i];
-	M.el[i][4] = -Xu * tsai_cd.yw[i];
-	b.el[i][0] = Xu;
+	row[0] = Yu * ctx->cd.xw[i];
+	row[1] = Yu * ctx->cd.yw[i];
+	row[2] = Yu;
+	row[3] = -Xu * ctx->cd.xw[i];
+	row[4] = -Xu * ctx->cd.yw[i];
+	lsq_add_row (&sys, row, Xu);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise("cepe compute U: unable to solve system  Ma=b");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise(&ctx->err, "cepe compute U: unable to solve system  Ma=b");
 	return 0;
     }
 
-    U[0] = a.el[0][0];
-    U[1] = a.el[1][0];
-    U[2] = a.el[2][0];
-    U[3] = a.el[3][0];
-    U[4] = a.el[4][0];
-
-    freemat (M);
-    freemat (a);
-    freemat (b);
+    U[0] = a[0];
+    U[1] = a[1];
+    U[2] = a[2];
+    U[3] = a[3];
+    U[4] = a[4];
 
     return 1;
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void cepe_compute_Tx_and_Ty (U)
+void cepe_compute_Tx_and_Ty (ctx, U)
+    struct tsai_context *ctx;
     double    U[];
 {
     double    Tx,
@@ -232,8 +257,8 @@ void cepe_compute_Tx_and_Ty (U)
     /* find a point that is far from the image center */
     far_distance = 0;
     far_point = 0;
-    for (i = 0; i < tsai_cd.point_count; i++)
-	if ((distance = SQR (tsai_cd.Xf[i] - tsai_cp.Cx) + SQR (tsai_cd.Yf[i] - tsai_cp.Cy)) > far_distance) {
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if ((distance = SQR (ctx->cd.Xf[i] - ctx->cp.Cx) + SQR (ctx->cd.Yf[i] - ctx->cp.Cy)) > far_distance) {
 	    far_point = i;
 	    far_distance = distance;
 	}
@@ -246,22 +271,25 @@ void cepe_compute_Tx_and_Ty (U)
     Tx = U[2] * Ty;
     r4 = U[3] * Ty;
     r5 = U[4] * Ty;
-    x = r1 * tsai_cd.xw[far_point] + r2 * tsai_cd.yw[far_point] + Tx;
-    y = r4 * tsai_cd.xw[far_point] + r5 * tsai_cd.yw[far_point] + Ty;
+    x = r1 * ctx->cd.xw[far_point] + r2 * ctx->cd.yw[far_point] + Tx;
+    y = r4 * ctx->cd.xw[far_point] + r5 * ctx->cd.yw[far_point] + Ty;
 
     /* flip Ty if we guessed wrong */
-    if ((SIGNBIT (x) != SIGNBIT (tsai_cd.Xf[far_point] - tsai_cp.Cx)) ||
-	(SIGNBIT (y) != SIGNBIT (tsai_cd.Yf[far_point] - tsai_cp.Cy)))
+    if (ctx->outlier != NULL)
+	Ty = vote_Ty_sign (ctx, r1, r2, 0.0, r4, r5, 0.0, Tx, Ty);
+    else if ((SIGNBIT (x) != SIGNBIT (ctx->cd.Xf[far_point] - ctx->cp.Cx)) ||
+	(SIGNBIT (y) != SIGNBIT (ctx->cd.Yf[far_point] - ctx->cp.Cy)))
 	Ty = -Ty;
 
     /* update the calibration constants */
-    tsai_cc.Tx = U[2] * Ty;
-    tsai_cc.Ty = Ty;
+    ctx->cc.Tx = U[2] * Ty;
+    ctx->cc.Ty = Ty;
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void cepe_compute_R (U)
+void cepe_compute_R (ctx, U)
+    struct tsai_context *ctx;
     double    U[];
 {
     double    r1,
@@ -274,12 +302,12 @@ void cepe_compute_R (U)
               r8,
               r9;
 
-    r1 = U[0] * tsai_cc.Ty;
-    r2 = U[1] * tsai_cc.Ty;
+    r1 = U[0] * ctx->cc.Ty;
+    r2 = U[1] * ctx->cc.Ty;
     r3 = sqrt (1 - SQR (r1) - SQR (r2));
 
-    r4 = U[3] * tsai_cc.Ty;
-    r5 = U[4] * tsai_cc.Ty;
+    r4 = U[3] * ctx->cc.Ty;
+    r5 = U[4] * ctx->cc.Ty;
     r6 = sqrt (1 - SQR (r4) - SQR (r5));
     if (!SIGNBIT (r1 * r4 + r2 * r5))
 	r6 = -r6;
@@ -290,76 +318,54 @@ void cepe_compute_R (U)
     r9 = r1 * r5 - r2 * r4;
 
     /* update the calibration constants */
-    tsai_cc.r1 = r1;
-    tsai_cc.r2 = r2;
-    tsai_cc.r3 = r3;
-    tsai_cc.r4 = r4;
-    tsai_cc.r5 = r5;
-    tsai_cc.r6 = r6;
-    tsai_cc.r7 = r7;
-    tsai_cc.r8 = r8;
-    tsai_cc.r9 = r9;
-
-    /* fill in tsai_cc.Rx, tsai_cc.Ry and tsai_cc.Rz */
-    solve_RPY_transform ();
+    ctx->cc.r1 = r1;
+    ctx->cc.r2 = r2;
+    ctx->cc.r3 = r3;
+    ctx->cc.r4 = r4;
+    ctx->cc.r5 = r5;
+    ctx->cc.r6 = r6;
+    ctx->cc.r7 = r7;
+    ctx->cc.r8 = r8;
+    ctx->cc.r9 = r9;
+
+    /* fill in ctx->cc.Rx, ctx->cc.Ry and ctx->cc.Rz */
+    solve_RPY_transform (ctx);
 }
 
 
 /* pytsai: can fail; int return type is required. */
-int cepe_compute_approximate_f (f)
+int cepe_compute_approximate_f (ctx, f)
+    struct tsai_context *ctx;
     double   *f;
 {
-    dmat      M,
-              a,
-              b;
+    lsqsys    sys;
+
+    double    row[2],
+              a[2];
 
     double    Yd;
 
     int       i;
 
-    M = newdmat (0, (tsai_cd.point_count - 1), 0, 1, &errno);
-    if (errno) {
-	pytsai_raise("cepe compute apx: unable to allocate matrix M");
-	return 0;
-    }
-
-    a = newdmat (0, 1, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise("cepe compute apx: unable to allocate vector a");
-	return 0;
-    }
-
-    b = newdmat (0, (tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise("cepe compute apx: unable to allocate vector b");
-	return 0;
-    }
+    lsq_init (&sys, 2);
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	if (ctx->outlier != NULL && ctx->outlier[i])
+	    continue;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
 
-	M.el[i][0] = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.Ty;
-	M.el[i][1] = -Yd;
-	b.el[i][0] = (tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i]) * Yd;
+	row[0] = ctx->cc.r4 * ctx->cd.xw[i] + ctx->cc.r5 * ctx->cd.yw[i] + ctx->cc.Ty;
+	row[1] = -Yd;
+	lsq_add_row (&sys, row, (ctx->cc.r7 * ctx->cd.xw[i] + ctx->cc.r8 * ctx->cd.yw[i]) * Yd);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise("cepe compute apx: unable to solve system  Ma=b");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise(&ctx->err, "cepe compute apx: unable to solve system  Ma=b");
 	return 0;
     }
 
     /* return the approximate effective focal length */
-    *f = a.el[0][0];
-
-    freemat (M);
-    freemat (a);
-    freemat (b);
+    *f = a[0];
 
     return 1;
 }
@@ -369,12 +375,14 @@ int cepe_compute_approximate_f (f)
 * Routines for noncoplanar extrinsic parameter estimation		*
 \***********************************************************************/
 /* pytsai: can fail; int return type is required. */
-int ncepe_compute_U (U)
+int ncepe_compute_U (ctx, U)
+    struct tsai_context *ctx;
     double    U[];
 {
-    dmat      M,
-              a,
-              b;
+    lsqsys    sys;
+
+    double    row[7],
+              a[7];
 
     double    Xu,
               Yu,
@@ -384,73 +392,57 @@ int ncepe_compute_U (U)
 
     int       i;
 
-    M = newdmat (0, (tsai_cd.point_count - 1), 0, 6, &errno);
-    if (errno) {
-	pytsai_raise("ncepe compute U: unable to allocate matrix M");
-	return 0;
-    }
-
-    a = newdmat (0, 6, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise("ncepe compute U: unable to allocate vector a");
-	return 0;
+    if (ctx->ransac_threshold > 0 && ctx->cd.point_count > 7) {
+	epe_compute_Xu_Yu (ctx);
+	if (!ransac_compute_U (ctx, 7))
+	    return 0;
+	for (i = 0; i < 7; i++)
+	    U[i] = ctx->U[i];
+	return 1;
     }
 
-    b = newdmat (0, (tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise("ncepe compute U: unable to allocate vector b");
-	return 0;
-    }
+    lsq_init (&sys, 7);
 
-    for (i = 0; i < tsai_cd.point_count; i++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
 	/* convert from image coordinates to distorted sensor coordinates */
-	Xd = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
+	Xd = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
 
 	/* convert from distorted sensor coordinates to undistorted sensor coordinates */
-	distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
+	distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
 	Xu = Xd * distortion_factor;
 	Yu = Yd * distortion_factor;
 
-	M.el[i][0] = Yu * tsai_cd.xw[i];
-	M.el[i][1] = Yu * tsai_cd.yw[i];
-	M.el[i][2] = Yu * tsai_cd.zw[i];
-	M.el[i][3] = Yu;
-	M.el[i][4] = -Xu * tsai_cd.xw[i];
-	M.el[i][5] = -Xu * tsai_cd.yw[i];
-	M.el[i][6] = -Xu * tsai_cd.zw[i];
-	b.el[i][0] = Xu;
+	row[0] = Yu * ctx->cd.xw[i];
+	row[1] = Yu * ctx->cd.yw[i];
+	row[2] = Yu * ctx->cd.zw[i];
+	row[3] = Yu;
+	row[4] = -Xu * ctx->cd.xw[i];
+	row[5] = -Xu * ctx->cd.yw[i];
+	row[6] = -Xu * ctx->cd.zw[i];
+	lsq_add_row (&sys, row, Xu);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise("ncepe compute U: unable to solve system  Ma=b");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise(&ctx->err, "ncepe compute U: unable to solve system  Ma=b");
 	return 0;
     }
 
-    U[0] = a.el[0][0];
-    U[1] = a.el[1][0];
-    U[2] = a.el[2][0];
-    U[3] = a.el[3][0];
-    U[4] = a.el[4][0];
-    U[5] = a.el[5][0];
-    U[6] = a.el[6][0];
-
-    freemat (M);
-    freemat (a);
-    freemat (b);
+    U[0] = a[0];
+    U[1] = a[1];
+    U[2] = a[2];
+    U[3] = a[3];
+    U[4] = a[4];
+    U[5] = a[5];
+    U[6] = a[6];
 
     return 1;
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void ncepe_compute_Tx_and_Ty (U)
+void ncepe_compute_Tx_and_Ty (ctx, U)
+    struct tsai_context *ctx;
     double    U[];
 {
     double    Tx,
@@ -476,8 +468,8 @@ void ncepe_compute_Tx_and_Ty (U)
     /* find a point that is far from the image center */
     far_distance = 0;
     far_point = 0;
-    for (i = 0; i < tsai_cd.point_count; i++)
-	if ((distance = SQR (tsai_cd.Xf[i] - tsai_cp.Cx) + SQR (tsai_cd.Yf[i] - tsai_cp.Cy)) > far_distance) {
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if ((distance = SQR (ctx->cd.Xf[i] - ctx->cp.Cx) + SQR (ctx->cd.Yf[i] - ctx->cp.Cy)) > far_distance) {
 	    far_point = i;
 	    far_distance = distance;
 	}
@@ -492,22 +484,25 @@ void ncepe_compute_Tx_and_Ty (U)
     r4 = U[4] * Ty;
     r5 = U[5] * Ty;
     r6 = U[6] * Ty;
-    x = r1 * tsai_cd.xw[far_point] + r2 * tsai_cd.yw[far_point] + r3 * tsai_cd.zw[far_point] + Tx;
-    y = r4 * tsai_cd.xw[far_point] + r5 * tsai_cd.yw[far_point] + r6 * tsai_cd.zw[far_point] + Ty;
+    x = r1 * ctx->cd.xw[far_point] + r2 * ctx->cd.yw[far_point] + r3 * ctx->cd.zw[far_point] + Tx;
+    y = r4 * ctx->cd.xw[far_point] + r5 * ctx->cd.yw[far_point] + r6 * ctx->cd.zw[far_point] + Ty;
 
     /* flip Ty if we guessed wrong */
-    if ((SIGNBIT (x) != SIGNBIT (tsai_cd.Xf[far_point] - tsai_cp.Cx)) ||
-	(SIGNBIT (y) != SIGNBIT (tsai_cd.Yf[far_point] - tsai_cp.Cy)))
+    if (ctx->outlier != NULL)
+	Ty = vote_Ty_sign (ctx, r1, r2, r3, r4, r5, r6, Tx, Ty);
+    else if ((SIGNBIT (x) != SIGNBIT (ctx->cd.Xf[far_point] - ctx->cp.Cx)) ||
+	(SIGNBIT (y) != SIGNBIT (ctx->cd.Yf[far_point] - ctx->cp.Cy)))
 	Ty = -Ty;
 
     /* update the calibration constants */
-    tsai_cc.Tx = U[3] * Ty;
-    tsai_cc.Ty = Ty;
+    ctx->cc.Tx = U[3] * Ty;
+    ctx->cc.Ty = Ty;
 }
 
 
 /* pytsai: cannot fail; void return type is fine. */
-void ncepe_compute_R (U)
+void ncepe_compute_R (ctx, U)
+    struct tsai_context *ctx;
     double    U[];
 {
     double    r1,
@@ -520,13 +515,13 @@ void ncepe_compute_R (U)
               r8,
               r9;
 
-    r1 = U[0] * tsai_cc.Ty;
-    r2 = U[1] * tsai_cc.Ty;
-    r3 = U[2] * tsai_cc.Ty;
+    r1 = U[0] * ctx->cc.Ty;
+    r2 = U[1] * ctx->cc.Ty;
+    r3 = U[2] * ctx->cc.Ty;
 
-    r4 = U[4] * tsai_cc.Ty;
-    r5 = U[5] * tsai_cc.Ty;
-    r6 = U[6] * tsai_cc.Ty;
+    r4 = U[4] * ctx->cc.Ty;
+    r5 = U[5] * ctx->cc.Ty;
+    r6 = U[6] * ctx->cc.Ty;
 
     /* use the outer product of the first two rows to get the last row */
     r7 = r2 * r6 - r3 * r5;
@@ -534,28 +529,29 @@ void ncepe_compute_R (U)
     r9 = r1 * r5 - r2 * r4;
 
     /* update the calibration constants */
-    tsai_cc.r1 = r1;
-    tsai_cc.r2 = r2;
-    tsai_cc.r3 = r3;
-    tsai_cc.r4 = r4;
-    tsai_cc.r5 = r5;
-    tsai_cc.r6 = r6;
-    tsai_cc.r7 = r7;
-    tsai_cc.r8 = r8;
-    tsai_cc.r9 = r9;
-
-    /* fill in tsai_cc.Rx, tsai_cc.Ry and tsai_cc.Rz */
-    solve_RPY_transform ();
+    ctx->cc.r1 = r1;
+    ctx->cc.r2 = r2;
+    ctx->cc.r3 = r3;
+    ctx->cc.r4 = r4;
+    ctx->cc.r5 = r5;
+    ctx->cc.r6 = r6;
+    ctx->cc.r7 = r7;
+    ctx->cc.r8 = r8;
+    ctx->cc.r9 = r9;
+
+    /* fill in ctx->cc.Rx, ctx->cc.Ry and ctx->cc.Rz */
+    solve_RPY_transform (ctx);
 }
 
 
 /************************************************************************/
 /* pytsai: can fail; int return type is required. */
-int epe_compute_Tx_Ty_Tz ()
+int epe_compute_Tx_Ty_Tz (struct tsai_context *ctx)
 {
-    dmat      M,
-              a,
-              b;
+    lsqsys    sys;
+
+    double    row[3],
+              a[3];
 
     double    xk,
               yk,
@@ -566,223 +562,129 @@ int epe_compute_Tx_Ty_Tz ()
               Yd,
               distortion_factor;
 
-    int       i,
-              j;
-
-    M = newdmat (0, (2 * tsai_cd.point_count - 1), 0, 2, &errno);
-    if (errno) {
-	pytsai_raise("epe compute Tx Ty Tz: unable to allocate matrix M");
-	return 0;
-    }
-
-    a = newdmat (0, 2, 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-	pytsai_raise("epe compute Tx Ty Tz: unable to allocate vector a");
-	return 0;
-    }
+    int       i;
 
-    b = newdmat (0, (2 * tsai_cd.point_count - 1), 0, 0, &errno);
-    if (errno) {
-        freemat(M);
-        freemat(a);
-	pytsai_raise("epe compute Tx Ty Tz: unable to allocate vector b");
-	return 0;
-    }
+    lsq_init (&sys, 3);
 
-    for (i = 0, j = tsai_cd.point_count; i < tsai_cd.point_count; i++, j++) {
+    for (i = 0; i < ctx->cd.point_count; i++) {
+	if (ctx->outlier != NULL && ctx->outlier[i])
+	    continue;
 	/* convert from world coordinates to untranslated camera coordinates */
-	xk = tsai_cc.r1 * tsai_cd.xw[i] + tsai_cc.r2 * tsai_cd.yw[i] + tsai_cc.r3 * tsai_cd.zw[i];
-	yk = tsai_cc.r4 * tsai_cd.xw[i] + tsai_cc.r5 * tsai_cd.yw[i] + tsai_cc.r6 * tsai_cd.zw[i];
-	zk = tsai_cc.r7 * tsai_cd.xw[i] + tsai_cc.r8 * tsai_cd.yw[i] + tsai_cc.r9 * tsai_cd.zw[i];
+	xk = ctx->cc.r1 * ctx->cd.xw[i] + ctx->cc.r2 * ctx->cd.yw[i] + ctx->cc.r3 * ctx->cd.zw[i];
+	yk = ctx->cc.r4 * ctx->cd.xw[i] + ctx->cc.r5 * ctx->cd.yw[i] + ctx->cc.r6 * ctx->cd.zw[i];
+	zk = ctx->cc.r7 * ctx->cd.xw[i] + ctx->cc.r8 * ctx->cd.yw[i] + ctx->cc.r9 * ctx->cd.zw[i];
 
 	/* convert from image coordinates to distorted sensor coordinates */
-	Xd = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
+	Xd = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
 
 	/* convert from distorted sensor coordinates to undistorted sensor coordinates */
-	distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
+	distortion_factor = 1 + ctx->cc.kappa1 * (SQR (Xd) + SQR (Yd));
 	Xu = Xd * distortion_factor;
 	Yu = Yd * distortion_factor;
 
-	M.el[i][0] = tsai_cc.f;
-	M.el[i][1] = 0;
-	M.el[i][2] = -Xu;
-	b.el[i][0] = Xu * zk - tsai_cc.f * xk;
+	row[0] = ctx->cc.f;
+	row[1] = 0;
+	row[2] = -Xu;
+	lsq_add_row (&sys, row, Xu * zk - ctx->cc.f * xk);
 
-	M.el[j][0] = 0;
-	M.el[j][1] = tsai_cc.f;
-	M.el[j][2] = -Yu;
-	b.el[j][0] = Yu * zk - tsai_cc.f * yk;
+	row[0] = 0;
+	row[1] = ctx->cc.f;
+	row[2] = -Yu;
+	lsq_add_row (&sys, row, Yu * zk - ctx->cc.f * yk);
     }
 
-    if (solve_system (M, a, b)) {
-        freemat(M);
-        freemat(a);
-        freemat(b);
-	pytsai_raise("epe compute Tx Ty Tz: unable to solve system  Ma=b");
+    if (lsq_solve (&sys, a)) {
+	pytsai_raise(&ctx->err, "epe compute Tx Ty Tz: unable to solve system  Ma=b");
 	return 0;
     }
 
-    tsai_cc.Tx = a.el[0][0];
-    tsai_cc.Ty = a.el[1][0];
-    tsai_cc.Tz = a.el[2][0];
-
-    freemat (M);
-    freemat (a);
-    freemat (b);
+    ctx->cc.Tx = a[0];
+    ctx->cc.Ty = a[1];
+    ctx->cc.Tz = a[2];
 
     return 1;
 }
 
 
 /************************************************************************/
-/* pytsai: cannot fail; void return type is fine. */
-void epe_optimize_error (m_ptr, n_ptr, params, err)
+/* pytsai: cannot fail; void return type is fine.  Called by lmder_ to fill
+ * err (*iflag == 1) or its Jacobian fjac (*iflag == 2), or by lmstr_ to fold
+ * the Jacobian into fjac instead (see TSAI_LM). */
+void epe_optimize_error (m_ptr, n_ptr, params, err, fjac, ldfjac, iflag, data)
     integer  *m_ptr;		/* pointer to number of points to fit */
     integer  *n_ptr;		/* pointer to number of parameters */
     doublereal *params;		/* vector of parameters */
     doublereal *err;		/* vector of error from data */
+    doublereal *fjac;           /* Jacobian of err (column-major) */
+    integer  *ldfjac;           /* pointer to leading dimension of fjac */
+    integer  *iflag;            /* flag to indicate error to caller */
+    void     *data;             /* calibration context */
 {
-    int       i;
+    struct tsai_context *ctx = (struct tsai_context *) data;
 
-    double    xc,
-              yc,
-              zc,
-              Xd,
-              Yd,
-              Xu_1,
-              Yu_1,
-              Xu_2,
-              Yu_2,
-              distortion_factor,
-              Rx,
-              Ry,
-              Rz,
-              Tx,
-              Ty,
-              Tz,
-              r1,
-              r2,
-              r3,
-              r4,
-              r5,
-              r6,
-              r7,
-              r8,
-              r9,
-              sa,
-              sb,
-              sg,
-              ca,
-              cb,
-              cg;
-
-    Rx = params[0];
-    Ry = params[1];
-    Rz = params[2];
-    Tx = params[3];
-    Ty = params[4];
-    Tz = params[5];
-
-    SINCOS (Rx, sa, ca);
-    SINCOS (Ry, sb, cb);
-    SINCOS (Rz, sg, cg);
-
-    r1 = cb * cg;
-    r2 = cg * sa * sb - ca * sg;
-    r3 = sa * sg + ca * cg * sb;
-    r4 = cb * sg;
-    r5 = sa * sb * sg + ca * cg;
-    r6 = ca * sb * sg - cg * sa;
-    r7 = -sb;
-    r8 = cb * sa;
-    r9 = ca * cb;
-
-    for (i = 0; i < tsai_cd.point_count; i++) {
-	/* convert from world coordinates to camera coordinates */
-	xc = r1 * tsai_cd.xw[i] + r2 * tsai_cd.yw[i] + r3 * tsai_cd.zw[i] + Tx;
-	yc = r4 * tsai_cd.xw[i] + r5 * tsai_cd.yw[i] + r6 * tsai_cd.zw[i] + Ty;
-	zc = r7 * tsai_cd.xw[i] + r8 * tsai_cd.yw[i] + r9 * tsai_cd.zw[i] + Tz;
-
-	/* convert from camera coordinates to undistorted sensor plane coordinates */
-	Xu_1 = tsai_cc.f * xc / zc;
-	Yu_1 = tsai_cc.f * yc / zc;
-
-	/* convert from 2D image coordinates to distorted sensor coordinates */
-	Xd = tsai_cp.dpx * (tsai_cd.Xf[i] - tsai_cp.Cx) / tsai_cp.sx;
-	Yd = tsai_cp.dpy * (tsai_cd.Yf[i] - tsai_cp.Cy);
-
-	/* convert from distorted sensor coordinates to undistorted sensor plane coordinates */
-	distortion_factor = 1 + tsai_cc.kappa1 * (SQR (Xd) + SQR (Yd));
-	Xu_2 = Xd * distortion_factor;
-	Yu_2 = Yd * distortion_factor;
-
-	/* record the error in the undistorted sensor coordinates */
-	err[i] = hypot (Xu_1 - Xu_2, Yu_1 - Yu_2);
-    }
+    static int column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, -1, -1, -1, -1, -1 };
+
+    if (*iflag == 2)
+	undistorted_sensor_error_jacobian (ctx, params, column, NULL, NULL, err, fjac, (int) *ldfjac);
+    else
+	undistorted_sensor_error (ctx, params, column, NULL, NULL, err);
 }
 
 
 /* pytsai: can fail; int return type is required. */
-int epe_optimize ()
+int epe_optimize (struct tsai_context *ctx)
 {
 #define NPARAMS 6
 
     int       i;
 
-    /* Parameters needed by MINPACK's lmdif() */
+    /* Parameters needed by MINPACK's lmder() */
 
-    integer     m = tsai_cd.point_count;
+    integer     m = ctx->cd.point_count;
     integer     n = NPARAMS;
     doublereal  x[NPARAMS];
     doublereal *fvec;
     doublereal  ftol = REL_SENSOR_TOLERANCE_ftol;
     doublereal  xtol = REL_PARAM_TOLERANCE_xtol;
     doublereal  gtol = ORTHO_TOLERANCE_gtol;
-    integer     maxfev = MAXFEV;
-    doublereal  epsfcn = EPSFCN;
+    integer     maxfev = TSAI_MAXFEV (ctx);
     doublereal  diag[NPARAMS];
     integer     mode = MODE;
     doublereal  factor = FACTOR;
     integer     nprint = 0;
     integer     info;
     integer     nfev;
+    integer     njev;
     doublereal *fjac;
-    integer     ldfjac = m;
+    integer     ldfjac = TSAI_JACOBIAN_LD (ctx, m, n);
     integer     ipvt[NPARAMS];
     doublereal  qtf[NPARAMS];
     doublereal  wa1[NPARAMS];
     doublereal  wa2[NPARAMS];
     doublereal  wa3[NPARAMS];
     doublereal *wa4;
+    size_t      mark = ctx->arena_used;
 
-    /* allocate some workspace */
-    if (( fvec = (doublereal *) PyMem_Malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       pytsai_raise("PyMem_Malloc: Cannot allocate workspace fvec");
-       return 0;
-    }
- 
-    if (( fjac = (doublereal *) PyMem_Malloc ((unsigned int) m*n * (unsigned int) sizeof(doublereal))) == NULL ) {
-       PyMem_Free(fvec);
-       pytsai_raise("PyMem_Malloc: Cannot allocate workspace fjac");
-       return 0;
-    }
- 
-    if (( wa4 = (doublereal *) PyMem_Malloc ((unsigned int) m * (unsigned int) sizeof(doublereal))) == NULL ) {
-       PyMem_Free(fvec);
-       PyMem_Free(fjac);
-       pytsai_raise("PyMem_Malloc: Cannot allocate workspace wa4");
-       return 0;
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, epe_optimize, 1);
+
+    /* draw the workspace from the context's arena */
+    fvec = tsai_arena_alloc (ctx, m);
+    fjac = tsai_arena_alloc (ctx, TSAI_JACOBIAN_SIZE (ctx, m, n));
+    wa4 = tsai_arena_alloc (ctx, m);
+    if (fvec == NULL || fjac == NULL || wa4 == NULL) {
+        tsai_arena_release (ctx, mark);
+        return 0;
     }
 
     /* use the current calibration and camera constants as a starting point */
-    x[0] = tsai_cc.Rx;
-    x[1] = tsai_cc.Ry;
-    x[2] = tsai_cc.Rz;
-    x[3] = tsai_cc.Tx;
-    x[4] = tsai_cc.Ty;
-    x[5] = tsai_cc.Tz;
+    x[0] = ctx->cc.Rx;
+    x[1] = ctx->cc.Ry;
+    x[2] = ctx->cc.Rz;
+    x[3] = ctx->cc.Tx;
+    x[4] = ctx->cc.Ty;
+    x[5] = ctx->cc.Tz;
 
     /* define optional scale factors for the parameters */
     if ( mode == 2 ) {
@@ -791,30 +693,31 @@ int epe_optimize ()
     }
        
     /* perform the optimization */
-    lmdif_ (epe_optimize_error,
-            &m, &n, x, fvec, &ftol, &xtol, &gtol, &maxfev, &epsfcn,
-            diag, &mode, &factor, &nprint, &info, &nfev, fjac, &ldfjac,
-            ipvt, qtf, wa1, wa2, wa3, wa4);
+    TSAI_LM (ctx) (epe_optimize_error,
+            &m, &n, x, fvec, fjac, &ldfjac, &ftol, &xtol, &gtol, &maxfev,
+            diag, &mode, &factor, &nprint, &info, &nfev, &njev,
+            ipvt, qtf, wa1, wa2, wa3, wa4, ctx);
+    ctx->nfev += nfev;
+    ctx->njev += njev;
+    ctx->lm_info = info;
     /* TODO: Check for error conditions (into parameter). */
 
     /* update the calibration and camera constants */
-    tsai_cc.Rx = x[0];
-    tsai_cc.Ry = x[1];
-    tsai_cc.Rz = x[2];
-    apply_RPY_transform ();
+    ctx->cc.Rx = x[0];
+    ctx->cc.Ry = x[1];
+    ctx->cc.Rz = x[2];
+    apply_RPY_transform (ctx);
 
-    tsai_cc.Tx = x[3];
-    tsai_cc.Ty = x[4];
-    tsai_cc.Tz = x[5];
+    ctx->cc.Tx = x[3];
+    ctx->cc.Ty = x[4];
+    ctx->cc.Tz = x[5];
 
     /* release allocated workspace */
-    PyMem_Free(fvec);
-    PyMem_Free(fjac);
-    PyMem_Free(wa4);
+    tsai_arena_release (ctx, mark);
 
 #ifdef DEBUG
     /* print the number of function calls during iteration */
-    fprintf(stderr,"info: %d nfev: %d\n\n",info,nfev);
+    fprintf(stderr,"info: %d nfev: %d njev: %d\n\n",info,nfev,njev);
 #endif
 
     return 1;
@@ -824,67 +727,241 @@ int epe_optimize ()
 
 
 /************************************************************************/
-/* pytsai: can fail; int return type is required. */
-int coplanar_extrinsic_parameter_estimation ()
+/* pytsai: can fail; int return type is required.
+ * The steps of coplanar_extrinsic_parameter_estimation, which may leave
+ * ctx->outlier set and drawn from the arena. */
+static int cepe_steps (struct tsai_context *ctx)
 {
     double    trial_f,
               U[5];
 
-    if (!cepe_compute_U(U))
+    if (!cepe_compute_U(ctx, U))
         return 0;
 
-    cepe_compute_Tx_and_Ty (U);
+    cepe_compute_Tx_and_Ty (ctx, U);
 
-    cepe_compute_R (U);
+    cepe_compute_R (ctx, U);
 
-    if (!cepe_compute_approximate_f(&trial_f))
+    if (!cepe_compute_approximate_f(ctx, &trial_f))
         return 0;
 
     if (trial_f < 0) {
 	/* try the other rotation matrix solution */
-	tsai_cc.r3 = -tsai_cc.r3;
-	tsai_cc.r6 = -tsai_cc.r6;
-	tsai_cc.r7 = -tsai_cc.r7;
-	tsai_cc.r8 = -tsai_cc.r8;
-	solve_RPY_transform ();
+	ctx->cc.r3 = -ctx->cc.r3;
+	ctx->cc.r6 = -ctx->cc.r6;
+	ctx->cc.r7 = -ctx->cc.r7;
+	ctx->cc.r8 = -ctx->cc.r8;
+	solve_RPY_transform (ctx);
 
-	if (!cepe_compute_approximate_f(&trial_f))
+	if (!cepe_compute_approximate_f(ctx, &trial_f))
                 return 0;
 
 	if (trial_f < 0) {
-	    pytsai_raise("error - possible handedness problem with data");
+	    pytsai_raise(&ctx->err, "error - possible handedness problem with data");
 	    return 0;
 	}
     }
 
-    if (!epe_compute_Tx_Ty_Tz())
+    if (!epe_compute_Tx_Ty_Tz(ctx))
         return 0;
 
-    if (!epe_optimize())
+    if (!epe_optimize(ctx))
         return 0;
 
     return 1;
 }
 
 
-/************************************************************************/
 /* pytsai: can fail; int return type is required. */
-int noncoplanar_extrinsic_parameter_estimation ()
+int coplanar_extrinsic_parameter_estimation (struct tsai_context *ctx)
+{
+    int       ok;
+
+    size_t    mark = ctx->arena_used;
+
+    ok = cepe_steps (ctx);
+
+    /* forget the outliers of a robust fit of U */
+    ctx->outlier = NULL;
+    tsai_arena_release (ctx, mark);
+
+    return ok;
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ * The steps of noncoplanar_extrinsic_parameter_estimation, which may leave
+ * ctx->outlier set and drawn from the arena. */
+static int ncepe_steps (struct tsai_context *ctx)
 {
     double    U[7];
 
-    if (!ncepe_compute_U(U))
+    if (!ncepe_compute_U(ctx, U))
         return 0;
 
-    ncepe_compute_Tx_and_Ty (U);
+    ncepe_compute_Tx_and_Ty (ctx, U);
 
-    ncepe_compute_R (U);
+    ncepe_compute_R (ctx, U);
 
-    if (!epe_compute_Tx_Ty_Tz())
+    if (!epe_compute_Tx_Ty_Tz(ctx))
         return 0;
 
-    if (!epe_optimize())
+    if (!epe_optimize(ctx))
         return 0;
 
     return 1;
 }
+
+
+/* pytsai: can fail; int return type is required. */
+int noncoplanar_extrinsic_parameter_estimation (struct tsai_context *ctx)
+{
+    int       ok;
+
+    size_t    mark = ctx->arena_used;
+
+    ok = ncepe_steps (ctx);
+
+    /* forget the outliers of a robust fit of U */
+    ctx->outlier = NULL;
+    tsai_arena_release (ctx, mark);
+
+    return ok;
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Estimates the pose by the coplanar or the noncoplanar extrinsic parameter
+ * estimation, as the world coordinates of the points call for. */
+int extrinsic_parameter_estimation (struct tsai_context *ctx)
+{
+    int       i;
+
+    for (i = 0; i < ctx->cd.point_count; i++)
+	if (ctx->cd.zw[i])
+	    return noncoplanar_extrinsic_parameter_estimation (ctx);
+    return coplanar_extrinsic_parameter_estimation (ctx);
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Refines the pose in ctx by Gauss-Newton steps on the two components of
+ * each point's error, solving the normal equations of the six parameters
+ * that undistorted_sensor_error_normal() accumulates.  From a nearby pose
+ * these converge in a few steps, where Levenberg-Marquardt on the error
+ * itself, whose linear model is poor near the solution, creeps in over ten
+ * or more.  Stops once a step, or the distance still to go as the shrinking
+ * of the steps foretells it (the step times its ratio to the step before,
+ * while that ratio is below a half), is within REL_PARAM_TOLERANCE_xtol of
+ * the pose, all scaled by the norms of the columns of the Jacobian as in
+ * MINPACK's mode 1; that saves the sweep that would only confirm it.  Fails,
+ * leaving ctx alone, if the normal equations are singular or TRACKING_STEPS
+ * steps do not get there. */
+static int epe_track (struct tsai_context *ctx)
+{
+#define NPARAMS 6
+
+    static int column[TSAI_ERROR_PARAMETERS] = { 0, 1, 2, 3, 4, 5, -1, -1, -1, -1, -1 };
+
+    int       iter,
+              j;
+
+    double    x[NPARAMS],
+              a[NPARAMS * (NPARAMS + 1)],
+              d2[NPARAMS],
+             *step = a + NPARAMS * NPARAMS,
+              xnorm,
+              pnorm,
+              last = 0.0;
+
+    if (ctx->loss != TSAI_LOSS_SQUARED && ctx->weight == NULL)
+	return tsai_robust_stage (ctx, epe_track, 1);
+
+    x[0] = ctx->cc.Rx;
+    x[1] = ctx->cc.Ry;
+    x[2] = ctx->cc.Rz;
+    x[3] = ctx->cc.Tx;
+    x[4] = ctx->cc.Ty;
+    x[5] = ctx->cc.Tz;
+
+    for (iter = 0; iter < TRACKING_STEPS; iter++) {
+	for (j = 0; j < NPARAMS * (NPARAMS + 1); j++)
+	    a[j] = 0.0;
+	/* one sweep gives the error and the Jacobian together */
+	undistorted_sensor_error_normal (ctx, x, column, NULL, NULL, a);
+	ctx->nfev++;
+	ctx->njev++;
+
+	/* J^T J step = -J^T err, solved in place */
+	for (j = 0; j < NPARAMS; j++) {
+	    d2[j] = a[j * NPARAMS + j];
+	    step[j] = -step[j];
+	}
+	if (solve_normal_equations (a, step, NPARAMS))
+	    return 0;
+
+	xnorm = pnorm = 0.0;
+	for (j = 0; j < NPARAMS; j++) {
+	    xnorm += d2[j] * SQR (x[j]);
+	    pnorm += d2[j] * SQR (step[j]);
+	    x[j] += step[j];
+	}
+	if (!(pnorm < HUGE_VAL))
+	    return 0;
+
+	/* (squared norms throughout) */
+	if (pnorm <= SQR (REL_PARAM_TOLERANCE_xtol) * xnorm ||
+	    (iter > 0 && 4.0 * pnorm < last &&
+	     SQR (pnorm) <= SQR (REL_PARAM_TOLERANCE_xtol) * xnorm * last)) {
+	    ctx->cc.Rx = x[0];
+	    ctx->cc.Ry = x[1];
+	    ctx->cc.Rz = x[2];
+	    apply_RPY_transform (ctx);
+
+	    ctx->cc.Tx = x[3];
+	    ctx->cc.Ty = x[4];
+	    ctx->cc.Tz = x[5];
+	    ctx->lm_info = 2;		/* converged in x, as MINPACK's info 2 */
+	    return 1;
+	}
+	last = pnorm;
+    }
+    return 0;
+
+#undef NPARAMS
+}
+
+
+/************************************************************************/
+/* pytsai: can fail; int return type is required.
+ *
+ * Updates the pose in ctx for new calibration data, holding the intrinsic
+ * parameters fixed, by epe_track() alone from the pose ctx holds.  If that
+ * fails or ends with a median error (see tsai_median_error()) above
+ * ctx->warm_start_max_error, the pose is instead estimated afresh by
+ * extrinsic_parameter_estimation(), and ctx->warm_start_fallback is set. */
+int extrinsic_pose_tracking (struct tsai_context *ctx)
+{
+    double    max_error = ctx->warm_start_max_error > 0 ?
+		ctx->warm_start_max_error : TSAI_WARM_START_MAX_ERROR,
+              median;
+
+    ctx->warm_start_fallback = 0;
+
+    if (epe_track (ctx)) {
+	if (!tsai_median_error (ctx, &median))
+	    return 0;
+	if (median <= max_error)
+	    return 1;
+    }
+    pytsai_clear (&ctx->err);
+
+    /* the camera moved too far since the last frame; start again */
+    ctx->warm_start_fallback = 1;
+    return extrinsic_parameter_estimation (ctx);
+}
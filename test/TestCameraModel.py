@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+
+"""
+Tests of the camera parameters held natively by pytsai.CameraModel.  Run
+from the test directory, with pytsai built in place (python setup.py
+build_ext --inplace).
+"""
+
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+
+
+class TestCameraModel(unittest.TestCase):
+
+        def test_attributes(self):
+                cp = Tsai.CameraParameters(dict(f=8.0, Cx=320.0))
+                cp.Tz = 700
+                self.assertEqual(cp.f, 8.0)
+                self.assertEqual(cp['Tz'], 700.0)
+                cp['Cy'] = 240.0
+                self.assertEqual(cp.Cy, 240.0)
+
+        def test_bad_values(self):
+                # a value that is not a number leaves the parameter alone,
+                # whether set as an attribute or as an item
+                cp = Tsai.CameraParameters(dict(f=8.0))
+                for value in ('abc', None, [1.0]):
+                        self.assertRaises(TypeError, setattr, cp, 'f', value)
+                        self.assertEqual(cp.f, 8.0)
+                        self.assertRaises(TypeError, cp.__setitem__, 'f', value)
+                        self.assertEqual(cp.f, 8.0)
+                self.assertRaises(TypeError, delattr, cp, 'f')
+                self.assertEqual(cp.f, 8.0)
+
+
+if __name__ == '__main__':
+        unittest.main()
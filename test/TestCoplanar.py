@@ -4,6 +4,14 @@
 TODO: Finish.
 """
 
+import math
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+
 def grid(side, n):
         """
         Returns a grid with specified side length and number of points,
@@ -19,3 +27,20 @@ def grid(side, n):
                         coords.append([x, y, 0.0])
         return coords
 
+
+def rotated_camera(base, pose):
+        """
+        Returns the camera parameters of the mapping base in the pose
+        (Rx, Ry, Rz, Tx, Ty, Tz), with the rotation matrix r1..r9 that the
+        transforms use worked out from the angles.
+        """
+        (Rx, Ry, Rz, Tx, Ty, Tz) = pose
+        cp = Tsai.CameraParameters(dict(base, Rx=Rx, Ry=Ry, Rz=Rz,
+                Tx=Tx, Ty=Ty, Tz=Tz))
+        sa, ca = math.sin(Rx), math.cos(Rx)
+        sb, cb = math.sin(Ry), math.cos(Ry)
+        sg, cg = math.sin(Rz), math.cos(Rz)
+        cp.r1 = cb*cg; cp.r2 = cg*sa*sb - ca*sg; cp.r3 = sa*sg + ca*cg*sb
+        cp.r4 = cb*sg; cp.r5 = sa*sb*sg + ca*cg; cp.r6 = ca*sb*sg - cg*sa
+        cp.r7 = -sb; cp.r8 = cb*sa; cp.r9 = ca*cb
+        return cp
@@ -0,0 +1,101 @@
+#!/usr/bin/env python
+
+"""
+Tests of Tsai.estimate_poses, the pose estimation of every frame of a
+capture sequence at once.  Run from the test directory, with pytsai built
+in place (python setup.py build_ext --inplace).
+"""
+
+import array
+import math
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+from TestCoplanar import rotated_camera
+from TestPoseTracker import CAMERA, START, frame, poses
+
+
+def packed(points):
+        """
+        Returns the points as an (N, 5) buffer of doubles, one point a row.
+        """
+        flat = array.array('d', [ v for p in points for v in p ])
+        return memoryview(flat).cast('B').cast('d', (len(points), 5))
+
+
+def offsets(frames):
+        """
+        Returns the offsets of the frames packed one after the other.
+        """
+        offs = [0]
+        for f in frames:
+                offs.append(offs[-1] + len(f))
+        return offs
+
+
+class TestEstimatePoses(unittest.TestCase):
+
+        def setUp(self):
+                self.camera = rotated_camera(CAMERA, START)
+                self.truth = poses(24)
+                self.frames = [ frame(p) for p in self.truth ]
+                self.points = [ p for f in self.frames for p in f ]
+                self.offsets = offsets(self.frames)
+
+        def assertPoses(self, result, truth):
+                self.assertEqual(len(result), len(truth))
+                for (pose, t) in zip(result, truth):
+                        for (a, b) in zip(pose[:3], t[:3]):
+                                self.assertAlmostEqual(a, b, 6)
+                        for (a, b) in zip(pose[3:], t[3:]):
+                                self.assertAlmostEqual(a, b, 3)
+
+        def test_buffer(self):
+                # the (N, 5) buffer read in place gives what the list does
+                listed = Tsai.estimate_poses(self.points, self.offsets,
+                        self.camera, 2)
+                inplace = Tsai.estimate_poses(packed(self.points),
+                        self.offsets, self.camera, 2)
+                self.assertEqual(listed.shape, (len(self.frames), 6))
+                self.assertEqual(inplace.tolist(), listed.tolist())
+                self.assertPoses(inplace.tolist(), self.truth)
+
+        def test_chain(self):
+                # following the frames ends where estimating each afresh does
+                afresh = Tsai.estimate_poses(packed(self.points),
+                        self.offsets, self.camera, 1).tolist()
+                for nthreads in (1, 3):
+                        chained = Tsai.estimate_poses(packed(self.points),
+                                self.offsets, self.camera, nthreads, True)
+                        self.assertPoses(chained.tolist(), afresh)
+
+        def test_unsolvable(self):
+                # three points are too few for a pose
+                points = self.points[:3] + self.points
+                offs = [0] + [ o + 3 for o in self.offsets ]
+                for chain in (False, True):
+                        result = Tsai.estimate_poses(packed(points), offs,
+                                self.camera, 2, chain).tolist()
+                        self.assertTrue(all(math.isnan(v) for v in result[0]))
+                        self.assertPoses(result[1:], self.truth)
+
+        def test_offsets(self):
+                n = len(self.points)
+                for offs in ([], [1] + self.offsets[1:],
+                             self.offsets[:-1] + [n - 1],
+                             self.offsets[:-1] + [n + 1],
+                             [0, 300, 200, n]):
+                        self.assertRaises(Tsai.CalibrationError,
+                                Tsai.estimate_poses, packed(self.points),
+                                offs, self.camera)
+                for offs in (3, [0, 'a', n]):
+                        self.assertRaises(TypeError, Tsai.estimate_poses,
+                                packed(self.points), offs, self.camera)
+
+
+if __name__ == '__main__':
+        unittest.main()
@@ -0,0 +1,71 @@
+#!/usr/bin/env python
+
+"""
+Tests that the ways of running the optimization stages
+(Tsai.set_jacobian_mode, Tsai.set_residual_threads) give the same
+calibration.  Run from the test directory, with pytsai built in place
+(python setup.py build_ext --inplace).
+"""
+
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+from TestRecalibrate import BASE, POSE, data
+
+# calibrations well enough conditioned for rounding not to move the result
+# (the full optimization of a plane target is not)
+CALIBRATIONS = [ ('noncoplanar', 'full', (0.0, 50.0, 100.0)),
+                 ('coplanar', 'three-param', (0.0,)) ]
+
+
+class TestModes(unittest.TestCase):
+
+        def tearDown(self):
+                Tsai.set_jacobian_mode('dense')
+                Tsai.set_residual_threads(1)
+
+        def assertAgree(self, cp, reference):
+                for (name, value) in reference.items():
+                        self.assertTrue(abs(cp[name] - value) <=
+                                1e-9 * abs(value), name)
+
+        def calibrations(self, mode):
+                Tsai.set_jacobian_mode(mode)
+                return [ Tsai.calibrate(target_type, optimization_type,
+                                data(POSE, 1, depths), BASE)
+                         for (target_type, optimization_type, depths)
+                         in CALIBRATIONS ]
+
+        def test_streamed(self):
+                dense = self.calibrations('dense')
+                streamed = self.calibrations('streamed')
+                for (cp, reference) in zip(streamed, dense):
+                        self.assertAgree(cp, reference)
+
+        def test_pooled(self):
+                # chunks of 16 points split even the 144 points of the plane
+                # target over the threads
+                dense = self.calibrations('dense')
+                Tsai.set_residual_threads(4, 16)
+                for mode in ('dense', 'streamed'):
+                        for (cp, reference) in zip(self.calibrations(mode),
+                                                   dense):
+                                self.assertAgree(cp, reference)
+
+        def test_bad_threads(self):
+                self.assertRaises(Tsai.CalibrationError,
+                        Tsai.set_residual_threads, 2, -1)
+
+        def test_unknown_mode(self):
+                self.assertRaises(Tsai.CalibrationError,
+                        Tsai.set_jacobian_mode, 'sparse')
+                self.assertRaises(Tsai.CalibrationError,
+                        Tsai.set_jacobian_mode, '')
+
+
+if __name__ == '__main__':
+        unittest.main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python
+
+"""
+Tests of Tsai.PoseTracker, which follows the pose of a calibrated camera
+through a stream of frames.  Run from the test directory, with pytsai
+built in place (python setup.py build_ext --inplace).
+"""
+
+import os
+import sys
+import threading
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+import pytsai
+from TestCoplanar import grid, rotated_camera
+
+CAMERA = dict(Ncx=640, Nfx=640, dx=0.01, dy=0.01, dpx=0.01, dpy=0.01,
+        f=8.0, kappa1=1e-4, Cx=320.0, Cy=240.0, sx=1.0)
+START = (0.2, -0.15, 0.4, -30.0, 20.0, 700.0)
+
+
+def frame(pose):
+        """
+        Returns the points of a 110 mm grid, 12 by 12 points, at depths 0, 20
+        and 40 mm, as the CAMERA sees them in the given pose.
+        """
+        cp = rotated_camera(CAMERA, pose)
+        points = []
+        for z in (0.0, 20.0, 40.0):
+                for (x, y, _) in grid(110.0, 12):
+                        (X, Y) = cp.world2image((x, y, z))
+                        points.append([x, y, z, X, Y])
+        return points
+
+
+def poses(n):
+        """
+        Returns n poses from START on, each moved by 0.5 mm and turned by
+        2 mrad from the one before.
+        """
+        (Rx, Ry, Rz, Tx, Ty, Tz) = START
+        return [ (Rx, Ry, Rz + 2e-3 * k, Tx + 0.5 * k, Ty, Tz)
+                 for k in range(n) ]
+
+
+class Blocking:
+
+        """
+        A point coordinate that, once the tracker reads it, holds the
+        update until the test has tried another one.
+        """
+
+        def __init__(self, value, reading, done):
+                self.value = value
+                self.reading = reading
+                self.done = done
+
+        def __float__(self):
+                self.reading.set()
+                self.done.wait(10.0)
+                return self.value
+
+
+class TestPoseTracker(unittest.TestCase):
+
+        def assertPose(self, pose, truth):
+                for (a, b) in zip(pose[:3], truth[:3]):
+                        self.assertAlmostEqual(a, b, 6)
+                for (a, b) in zip(pose[3:], truth[3:]):
+                        self.assertAlmostEqual(a, b, 3)
+
+        def test_tracking(self):
+                tracker = Tsai.PoseTracker(rotated_camera(CAMERA, START))
+                for (k, truth) in enumerate(poses(20)):
+                        self.assertPose(tracker.update(frame(truth)), truth)
+                        # only the first frame is estimated afresh
+                        self.assertEqual(tracker.estimated_afresh, k == 0)
+                cp = tracker.camera_parameters()
+                self.assertEqual(cp.f, CAMERA['f'])
+                self.assertAlmostEqual(cp.Tx, truth[3], 3)
+
+        def test_afresh(self):
+                tracker = Tsai.PoseTracker(rotated_camera(CAMERA, START))
+                (first, second) = poses(2)
+                tracker.update(frame(first))
+                self.assertTrue(tracker.estimated_afresh)
+                tracker.update(frame(second))
+                self.assertFalse(tracker.estimated_afresh)
+
+                tracker.reset()
+                self.assertPose(tracker.update(frame(second)), second)
+                self.assertTrue(tracker.estimated_afresh)
+
+                # a jump too far for the refinement is caught
+                (Rx, Ry, Rz, Tx, Ty, Tz) = second
+                jump = (Rx, Ry, Rz + 1.5, Tx + 100.0, Ty + 50.0, Tz - 200.0)
+                self.assertPose(tracker.update(frame(jump)), jump)
+                self.assertTrue(tracker.estimated_afresh)
+
+        def test_concurrent_update(self):
+                tracker = Tsai.PoseTracker(rotated_camera(CAMERA, START))
+                points = frame(START)
+                reading = threading.Event()
+                done = threading.Event()
+                points[0] = [ Blocking(x, reading, done) for x in points[0] ]
+                worker = threading.Thread(target=tracker.update, args=(points,))
+                worker.start()
+                try:
+                        self.assertTrue(reading.wait(10.0))
+                        # the worker is inside its update, holding the tracker
+                        self.assertRaises(RuntimeError,
+                                pytsai._pytsai_track_pose, tracker._tracker,
+                                frame(START))
+                        self.assertRaises(RuntimeError,
+                                pytsai._pytsai_reset_pose_tracker,
+                                tracker._tracker)
+                finally:
+                        done.set()
+                        worker.join()
+                # the tracker is free again once the update is over
+                self.assertPose(tracker.update(frame(START)), START)
+
+
+if __name__ == '__main__':
+        unittest.main()
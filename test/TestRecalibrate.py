@@ -0,0 +1,83 @@
+#!/usr/bin/env python
+
+"""
+Tests of Tsai.recalibrate, the warm start calibration of a camera that has
+drifted since an earlier calibration.  Run from the test directory, with
+pytsai built in place (python setup.py build_ext --inplace).
+"""
+
+import os
+import random
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+from TestCoplanar import grid, rotated_camera
+
+BASE = dict(Ncx=640, Nfx=640, dx=0.01, dy=0.01, dpx=0.01, dpy=0.01,
+        Cx=320.0, Cy=240.0, sx=1.0)
+CAMERA = dict(BASE, f=8.0, kappa1=1e-3, Cx=323.0, Cy=238.0)
+POSE = (0.3, -0.25, 0.4, -20.0, 10.0, 500.0)
+
+# the pose after the camera has drifted by 0.3 mm and 1 mrad
+DRIFTED = (0.3, -0.25, 0.401, -20.3, 10.0, 500.3)
+
+
+def data(pose, seed, depths=(0.0, 50.0, 100.0)):
+        """
+        Returns the calibration points of a 300 mm grid, 12 by 12 points, at
+        each of the given depths, as the CAMERA sees them in the given pose,
+        with 0.1 pixel noise.
+        """
+        cp = rotated_camera(CAMERA, pose)
+        rng = random.Random(seed)
+        points = []
+        for z in depths:
+                for (x, y, _) in grid(300.0, 12):
+                        (X, Y) = cp.world2image((x, y, z))
+                        points.append([x, y, z, X + rng.gauss(0, 0.1),
+                                Y + rng.gauss(0, 0.1)])
+        return points
+
+
+class TestRecalibrate(unittest.TestCase):
+
+        def test_warm_start(self):
+                # from the calibration before the drift, the warm start ends
+                # where a calibration from scratch does
+                for seed in range(3):
+                        earlier = Tsai.calibrate('noncoplanar', 'full',
+                                data(POSE, seed), BASE)
+                        points = data(DRIFTED, seed + 100)
+                        cold = Tsai.calibrate('noncoplanar', 'full', points,
+                                BASE)
+                        warm = Tsai.recalibrate('noncoplanar', points,
+                                earlier)
+                        self.assertAlmostEqual(warm.f / cold.f, 1.0, 3)
+                        self.assertAlmostEqual(warm.kappa1, cold.kappa1, 5)
+                        self.assertTrue(abs(warm.Cx - cold.Cx) < 0.5)
+                        self.assertTrue(abs(warm.Cy - cold.Cy) < 0.5)
+                        self.assertTrue(abs(warm.Tz - cold.Tz) < 0.5)
+
+        def test_far_start(self):
+                # a start far from the camera falls back to a calibration
+                # from scratch, which finds it all the same
+                for (target_type, depths) in (('noncoplanar', (0.0, 50.0, 100.0)),
+                                              ('coplanar', (0.0,))):
+                        earlier = Tsai.calibrate(target_type, 'full',
+                                data(POSE, 0, depths), BASE)
+                        points = data(DRIFTED, 100, depths)
+                        far = Tsai.CameraParameters(dict(earlier))
+                        far.Rx += 2.5
+                        far.Tz = -50.0
+                        warm = Tsai.recalibrate(target_type, points, far)
+                        cold = Tsai.calibrate(target_type, 'full', points, far)
+                        self.assertEqual(dict(warm), dict(cold))
+                        self.assertAlmostEqual(warm.f / CAMERA['f'], 1.0, 1)
+                        self.assertAlmostEqual(warm.Tz / DRIFTED[5], 1.0, 1)
+
+
+if __name__ == '__main__':
+        unittest.main()
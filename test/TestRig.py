@@ -0,0 +1,116 @@
+#!/usr/bin/env python
+
+"""
+Tests of Tsai.calibrate_rig, the calibration of cameras fixed to one
+another from their views of a target in several poses.  Run from the test
+directory, with pytsai built in place (python setup.py build_ext
+--inplace).
+"""
+
+import os
+import random
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+from TestCoplanar import rotated_camera
+
+# the sensors of the cameras: the third has smaller pixels
+SENSORS = [ dict(Ncx=640, Nfx=640, dx=0.01, dy=0.01, dpx=0.01, dpy=0.01,
+                 Cx=320.0, Cy=240.0, sx=1.0) ] * 2 + \
+          [ dict(Ncx=640, Nfx=640, dx=0.0074, dy=0.0074, dpx=0.0074,
+                 dpy=0.0074, Cx=320.0, Cy=240.0, sx=1.0) ]
+
+# the cameras, each as its intrinsic parameters and its pose in the world
+CAMERAS = [ (dict(f=8.0, kappa1=1e-3, Cx=324.0, Cy=238.0),
+             (0.1, -0.2, 0.05, -60.0, 10.0, 620.0)),
+            (dict(f=8.3, kappa1=5e-4, Cx=317.0, Cy=243.0),
+             (-0.15, 0.2, -0.1, 50.0, -5.0, 580.0)),
+            (dict(f=6.0, kappa1=2e-3, Cx=322.0, Cy=241.0),
+             (0.05, 0.1, 0.3, 5.0, 40.0, 650.0)) ]
+
+# the poses of the target: the first is the world
+POSES = [ (0.0, 0.0, 0.0, 0.0, 0.0, 0.0),
+          (0.1, -0.05, 0.12, 20.0, -15.0, 10.0),
+          (-0.08, 0.1, -0.1, -25.0, 10.0, -20.0) ]
+
+
+def cameras():
+        """
+        Returns the true CameraParameters of the CAMERAS.
+        """
+        return [ rotated_camera(dict(sensor, **intrinsic), pose)
+                 for (sensor, (intrinsic, pose)) in zip(SENSORS, CAMERAS) ]
+
+
+def view(cp, pose, seed):
+        """
+        Returns 80 points scattered through a 250 by 250 by 100 mm target,
+        as the camera cp sees them with the target in the given pose.
+        """
+        rng = random.Random(seed)
+        r = rotated_camera(SENSORS[0], pose)
+        (Tx, Ty, Tz) = pose[3:]
+        points = []
+        for i in range(80):
+                x = rng.uniform(-125.0, 125.0)
+                y = rng.uniform(-125.0, 125.0)
+                z = rng.uniform(0.0, 100.0)
+                (X, Y) = cp.world2image((r.r1*x + r.r2*y + r.r3*z + Tx,
+                        r.r4*x + r.r5*y + r.r6*z + Ty,
+                        r.r7*x + r.r8*y + r.r9*z + Tz))
+                points.append([x, y, z, X, Y])
+        return points
+
+
+def views(seen):
+        """
+        Returns the calibration data of the rig, where seen(c, k) tells
+        whether camera c sees the target in pose k.
+        """
+        return [ [ view(cp, pose, 10 * c + k) if seen(c, k) else None
+                   for (k, pose) in enumerate(POSES) ]
+                 for (c, cp) in enumerate(cameras()) ]
+
+
+class TestRig(unittest.TestCase):
+
+        def test_rig(self):
+                # the second camera misses the last pose, the third the
+                # second; each is still linked to the first pose
+                data = views(lambda c, k: (c, k) not in ((1, 2), (2, 1)))
+                (cps, poses) = Tsai.calibrate_rig(data, SENSORS)
+                self.assertEqual(len(cps), len(CAMERAS))
+                self.assertEqual(len(poses), len(POSES))
+                for (cp, truth) in zip(cps, cameras()):
+                        self.assertAlmostEqual(cp.f / truth.f, 1.0, 4)
+                        self.assertAlmostEqual(cp.Cx, truth.Cx, 1)
+                        self.assertAlmostEqual(cp.Cy, truth.Cy, 1)
+                        self.assertAlmostEqual(cp.Tz, truth.Tz, 1)
+                for (pose, truth) in zip(poses, POSES):
+                        for (a, b) in zip(pose[:3], truth[:3]):
+                                self.assertAlmostEqual(a, b, 4)
+                        for (a, b) in zip(pose[3:], truth[3:]):
+                                self.assertAlmostEqual(a, b, 1)
+
+        def test_one_sensor(self):
+                # a single mapping serves every camera
+                data = [ row[:2] for row in views(lambda c, k: True)[:2] ]
+                (cps, poses) = Tsai.calibrate_rig(data, SENSORS[0])
+                for (cp, truth) in zip(cps, cameras()):
+                        self.assertAlmostEqual(cp.f / truth.f, 1.0, 4)
+
+        def test_disconnected(self):
+                # the third camera only sees the last pose, which no other
+                # camera sees, so nothing places it in the world
+                data = views(lambda c, k: (c == 2) == (k == 2))
+                self.assertRaises(Tsai.CalibrationError, Tsai.calibrate_rig,
+                        data, SENSORS)
+                self.assertRaises(Tsai.CalibrationError, Tsai.calibrate_rig,
+                        [], SENSORS)
+
+
+if __name__ == '__main__':
+        unittest.main()
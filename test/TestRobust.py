@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+
+"""
+Tests of the robust losses (Tsai.set_robust_loss) on calibration data with
+mislabelled points.  Run from the test directory, with pytsai built in
+place (python setup.py build_ext --inplace).
+"""
+
+import os
+import random
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+from TestCoplanar import grid, rotated_camera
+
+BASE = dict(Ncx=640, Nfx=640, dx=0.01, dy=0.01, dpx=0.01, dpy=0.01,
+        Cx=320.0, Cy=240.0, sx=1.0)
+POSE = (0.2, -0.15, 0.4, -30.0, 20.0, 700.0)
+F = 8.0
+
+
+def camera():
+        """
+        Returns the camera the data is taken with, f = 8 mm at 700 mm.
+        """
+        return rotated_camera(dict(BASE, f=F, kappa1=1e-4), POSE)
+
+
+def data(seed, fraction, depths):
+        """
+        Returns the calibration points of a 110 mm grid, 12 by 12 points, at
+        each of the given depths, with 0.1 pixel noise, and the given
+        fraction of them mislabelled (placed anywhere in the image).
+        """
+        cp = camera()
+        rng = random.Random(seed)
+        points = []
+        for z in depths:
+                for (x, y, _) in grid(110.0, 12):
+                        (X, Y) = cp.world2image((x, y, z))
+                        if rng.random() < fraction:
+                                X, Y = rng.uniform(0, 640), rng.uniform(0, 480)
+                        else:
+                                X += rng.gauss(0, 0.1)
+                                Y += rng.gauss(0, 0.1)
+                        points.append([x, y, z, X, Y])
+        return points
+
+
+class TestRobust(unittest.TestCase):
+
+        def tearDown(self):
+                Tsai.set_ransac()
+                Tsai.set_robust_loss()
+
+        def test_outliers(self):
+                # 40% mislabelled points: with RANSAC to start from, the
+                # redescending losses find the camera (huber still lets
+                # gross outliers pull)
+                Tsai.set_ransac(2.0)
+                for loss in ('cauchy', 'tukey'):
+                        Tsai.set_robust_loss(loss)
+                        for seed in range(3):
+                                cp = Tsai.calibrate('noncoplanar', 'full',
+                                        data(seed, 0.4, (0.0, 20.0, 40.0)), BASE)
+                                self.assertAlmostEqual(cp.f / F, 1.0, 1)
+                                self.assertAlmostEqual(cp.Tz / POSE[5], 1.0, 1)
+
+        def test_no_absurd_results(self):
+                # a plane target leaves the full optimization of a single
+                # view ill-conditioned; a fit that runs away must raise
+                # rather than return a camera with f far from the truth
+                Tsai.set_ransac(2.0)
+                for loss in ('huber', 'cauchy', 'tukey'):
+                        Tsai.set_robust_loss(loss)
+                        for seed in range(4):
+                                try:
+                                        cp = Tsai.calibrate('coplanar', 'full',
+                                                data(seed, 0.25, (0.0,)), BASE)
+                                except Tsai.CalibrationError:
+                                        continue
+                                self.assertTrue(0.5 * F < cp.f < 2.0 * F)
+
+
+if __name__ == '__main__':
+        unittest.main()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python
+
+"""
+Tests of Tsai.calibrate_views, the calibration of one camera from several
+views of a coplanar target.  Run from the test directory, with pytsai
+built in place (python setup.py build_ext --inplace).
+"""
+
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+import Tsai
+from TestCoplanar import grid, rotated_camera
+
+# the camera the views are taken with, and the one the calibration starts from
+TRUTH = dict(Ncx=640, Nfx=640, dx=0.01, dy=0.01, dpx=0.01, dpy=0.01,
+        f=8.0, kappa1=1e-3, Cx=320.0, Cy=240.0, sx=1.02)
+START = dict(TRUTH, f=0.0, kappa1=0.0, Cx=318.0, Cy=242.0, sx=1.0)
+
+# the poses (Rx, Ry, Rz, Tx, Ty, Tz) of the target in the views
+POSES = [ (0.25, -0.2, 0.1, -10.0, 5.0, 500.0),
+          (-0.3, 0.15, -0.4, 8.0, -12.0, 560.0),
+          (0.1, 0.3, 1.2, 15.0, 10.0, 450.0) ]
+
+
+def view(pose):
+        """
+        Returns the calibration points of a 100 mm target, 10 by 10 points,
+        seen by the TRUTH camera with the target in the given pose.
+        """
+        cp = rotated_camera(TRUTH, pose)
+        points = []
+        for (x, y, z) in grid(100.0, 10):
+                (X, Y) = cp.world2image((x, y, z))
+                points.append([x, y, z, X, Y])
+        return points
+
+
+class TestViews(unittest.TestCase):
+
+        def test_views(self):
+                cps = Tsai.calibrate_views([ view(p) for p in POSES ], START)
+                self.assertEqual(len(cps), len(POSES))
+                for (cp, pose) in zip(cps, POSES):
+                        self.assertAlmostEqual(cp.f, TRUTH['f'], 3)
+                        self.assertAlmostEqual(cp.sx, TRUTH['sx'], 4)
+                        self.assertAlmostEqual(cp.Cx, TRUTH['Cx'], 1)
+                        self.assertAlmostEqual(cp.Cy, TRUTH['Cy'], 1)
+                        self.assertAlmostEqual(cp.Tz, pose[5], 1)
+
+        def test_one_view(self):
+                # one view cannot tell sx from f, so it is refused
+                self.assertRaises(Tsai.CalibrationError, Tsai.calibrate_views,
+                        [ view(POSES[0]) ], START)
+                self.assertRaises(Tsai.CalibrationError, Tsai.calibrate_views,
+                        [], START)
+
+
+if __name__ == '__main__':
+        unittest.main()
@@ -0,0 +1,1005 @@
+/**
+ * bench_calibration.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+ /***************************************************************************\
+ * Native benchmark of the calibration pipeline.                             *
+ *                                                                           *
+ * Synthetic coplanar and noncoplanar targets are generated from a known     *
+ * camera, projected through the Tsai model and perturbed with Gaussian      *
+ * image noise.  Each target is then calibrated stage by stage exactly as    *
+ * coplanar_calibration_with_full_optimization() and                         *
+ * noncoplanar_calibration_with_full_optimization() do, followed by the      *
+ * extrinsic parameter estimation for the calibrated camera, and the camera  *
+ * is then recalibrated by the warm start routines from that calibration,    *
+ * after it has drifted by 0.5 mm and 1 mrad.  For every stage the best      *
+ * wall time over the repetitions is reported together with the residual     *
+ * (nfev) and Jacobian (njev) evaluations and the heap allocations it made;  *
+ * for every pipeline the final image plane error and the deviation of the   *
+ * recovered camera from the ground truth.  Last the pose of the camera is   *
+ * tracked by extrinsic_pose_tracking() through 100 frames, in each of which *
+ * the camera moves by 0.5 mm and turns by 2 mrad; the mean time and         *
+ * evaluations per frame are reported, with the best frame, the number of    *
+ * frames whose pose was estimated afresh and the error of the last pose.    *
+ * Each Gauss-Newton step of the tracking, which accumulates the error and   *
+ * the Jacobian in one sweep over the points, counts as one of each.         *
+ * The same motion is then packed into a batch of up to 1000 frames (and at  *
+ * most a million points), whose poses are estimated by                      *
+ * extrinsic_parameter_estimation_batch() in four blocks a thread, afresh    *
+ * and chained from frame to frame; the time per frame is reported for both. *
+ *                                                                           *
+ * Everything is seeded, so runs are reproducible.  Allocations are only     *
+ * counted with glibc, where malloc and friends can be interposed.           *
+ *                                                                           *
+ * Build and run from the top of the tree with something like:               *
+ *                                                                           *
+ *      cc -O2 -ffp-contract=off -o bench_calibration                        *
+ *          test/bench_calibration.c src/errors.c src/tsai/cal_batch.c       *
+ *          src/tsai/cal_cpu.c src/tsai/cal_eval.c src/tsai/cal_jac.c        *
+ *          src/tsai/cal_main.c src/tsai/cal_ransac.c src/tsai/cal_rig.c     *
+ *          src/tsai/cal_robust.c src/tsai/cal_simd.c src/tsai/cal_tran.c    *
+ *          src/tsai/cal_views.c src/tsai/ecalmain.c src/matrix/matrix.c     *
+ *          src/minpack/dpmpar.c src/minpack/enorm.c src/minpack/fdjac2.c    *
+ *          src/minpack/lmder.c src/minpack/lmdif.c src/minpack/lmpar.c      *
+ *          src/minpack/lmstr.c src/minpack/qrfac.c src/minpack/qrsolv.c     *
+ *          src/pool/pool.c -lm -lpthread                                    *
+ *      ./bench_calibration [-r repeats] [-s sigma] [-t threads]             *
+ *          [-c min_chunk] [-j jacobian] [-o outliers] [-a threshold]        *
+ *          [-l loss] [-v views] [-p points] [-m cameras] [points ...]       *
+ *                                                                           *
+ * repeats defaults to 3, sigma (the image noise in pixels) to 0.1 and the   *
+ * target sizes to 50, 500, 5000 and 50000 points.  With more than one       *
+ * thread (0 means one per processor) the residual and Jacobian sweeps are   *
+ * split over a worker pool in chunks of at least min_chunk points.  The     *
+ * jacobian is dense (the default), or streamed to fold it into a triangle   *
+ * as it is computed instead of storing it.  The kernels are picked for the  *
+ * processor, as by the Python module; set PYTSAI_SIMD to scalar, sse2,      *
+ * avx2 or avx512 to compare them.                                           *
+ *                                                                           *
+ * A fraction outliers (default 0) of the points of each target are          *
+ * mislabelled, with image coordinates drawn anywhere in the image.  With a  *
+ * positive threshold [pix] the three parameter stages fit the radial        *
+ * alignment constraint by RANSAC with that inlier threshold.  loss is the   *
+ * loss the optimization stages minimize: squared (the default), or one of   *
+ * the robust huber, cauchy and tukey.                                       *
+ *                                                                           *
+ * Finally the camera is calibrated from 5, 10, 20 and so on up to views     *
+ * (default 40, 0 skips this) views of a coplanar target of points points    *
+ * (default 100) each, in random poses, by                                   *
+ * coplanar_multi_view_calibration(), and rigs of 5, 10, 20 and so on up to  *
+ * cameras (default 40, 0 skips this) cameras, by rig_calibration(), from    *
+ * their views of a noncoplanar target of as many points in ten poses.       *
+ \***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/tsai/cal_main.h"
+#include "../src/pool/pool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+/* Counting allocations: the executable's definitions take the place of the
+ * C library's for every caller, including the calibration code. */
+static long allocations;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+
+void *malloc (size_t size)
+{
+    allocations++;
+    return __libc_malloc (size);
+}
+
+void *calloc (size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc (count, size);
+}
+
+void *realloc (void *block, size_t size)
+{
+    allocations++;
+    return __libc_realloc (block, size);
+}
+#define COUNTS_ALLOCATIONS 1
+#else
+#define COUNTS_ALLOCATIONS 0
+#endif
+
+
+static double seconds (void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count,
+                  frequency;
+
+    QueryPerformanceCounter (&count);
+    QueryPerformanceFrequency (&frequency);
+    return (double) count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+
+/* xorshift64* and Box-Muller: the same sequence on every platform */
+static unsigned long long random_state;
+
+static double uniform (void)
+{
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return ((random_state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian (void)
+{
+    double    u;
+
+    do
+	u = uniform ();
+    while (u == 0);
+    return sqrt (-2 * log (u)) * cos (6.283185307179586 * uniform ());
+}
+
+
+/* A 640 x 480 camera with a 8 mm lens, 600 mm in front of the target. */
+static void true_camera (struct tsai_context *ctx, int coplanar)
+{
+    ctx->cp.Ncx = 640;
+    ctx->cp.Nfx = 640;
+    ctx->cp.dx = 0.0074;
+    ctx->cp.dy = 0.0074;
+    ctx->cp.dpx = ctx->cp.dx * ctx->cp.Ncx / ctx->cp.Nfx;
+    ctx->cp.dpy = ctx->cp.dy;
+    ctx->cp.Cx = 326.5;
+    ctx->cp.Cy = 235.75;
+    ctx->cp.sx = coplanar ? 1.0 : 1.002;
+
+    ctx->cc.f = 8.0;
+    ctx->cc.kappa1 = 2e-3;
+    ctx->cc.Rx = 0.35;
+    ctx->cc.Ry = -0.25;
+    ctx->cc.Rz = 0.1;
+    ctx->cc.Tx = -40;
+    ctx->cc.Ty = -30;
+    ctx->cc.Tz = 600;
+    ctx->cc.p1 = ctx->cc.p2 = 0;
+    apply_RPY_transform (ctx);
+}
+
+
+/* The starting point of a calibration: the nominal sensor, nothing else. */
+static void nominal_camera (struct tsai_context *ctx, struct tsai_context *truth)
+{
+    ctx->cp = truth->cp;
+    ctx->cp.Cx = ctx->cp.Nfx / 2;
+    ctx->cp.Cy = 480 / 2;
+    ctx->cp.sx = 1.0;
+    memset (&ctx->cc, 0, sizeof ctx->cc);
+    ctx->nfev = ctx->njev = 0;
+    pytsai_clear (&ctx->err);
+}
+
+
+/* pytsai: can fail; int return type is required.  A fraction outliers of
+ * the points are mislabelled, their image coordinates drawn at random
+ * anywhere in the image. */
+static int make_target (struct tsai_context *ctx, struct tsai_context *truth,
+			int point_count, int coplanar, double sigma, double outliers)
+{
+    int       i;
+
+    if (!tsai_context_reserve (ctx, point_count))
+	return 0;
+
+    for (i = 0; i < point_count; i++) {
+	ctx->cd.xw[i] = 250 * uniform () - 125;
+	ctx->cd.yw[i] = 250 * uniform () - 125;
+	ctx->cd.zw[i] = coplanar ? 0 : 100 * uniform ();
+	world_coord_to_image_coord (truth, ctx->cd.xw[i], ctx->cd.yw[i], ctx->cd.zw[i],
+				    &ctx->cd.Xf[i], &ctx->cd.Yf[i]);
+	ctx->cd.Xf[i] += sigma * gaussian ();
+	ctx->cd.Yf[i] += sigma * gaussian ();
+	if (outliers > 0 && uniform () < outliers) {
+	    ctx->cd.Xf[i] = truth->cp.Ncx * uniform ();
+	    ctx->cd.Yf[i] = 480 * uniform ();
+	}
+    }
+    return 1;
+}
+
+
+struct stage {
+    char     *name;
+    int     (*run) (struct tsai_context *ctx);
+};
+
+static struct stage coplanar_stages[] = {
+    {"cc_three_parm_optimization", cc_three_parm_optimization},
+    {"cc_five_parm_late", cc_five_parm_optimization_with_late_distortion_removal},
+    {"cc_five_parm_early", cc_five_parm_optimization_with_early_distortion_removal},
+    {"cc_nic_optimization", cc_nic_optimization},
+    {"cc_full_optimization", cc_full_optimization},
+    {"coplanar_extrinsic", coplanar_extrinsic_parameter_estimation},
+    {NULL, NULL}
+};
+
+static struct stage noncoplanar_stages[] = {
+    {"ncc_three_parm_optimization", ncc_three_parm_optimization},
+    {"ncc_nic_optimization", ncc_nic_optimization},
+    {"ncc_full_optimization", ncc_full_optimization},
+    {"noncoplanar_extrinsic", noncoplanar_extrinsic_parameter_estimation},
+    {NULL, NULL}
+};
+
+#define MAX_STAGES 8
+
+struct stage_result {
+    double    best;			/* [s]           */
+    long      nfev;
+    long      njev;
+    long      allocations;
+};
+
+
+/* pytsai: can fail; int return type is required. */
+static int run_pipeline (struct tsai_context *ctx, struct tsai_context *truth,
+			 struct stage *stages, int repeats, struct stage_result *result)
+{
+    int       r,
+              s;
+    long      nfev,
+              njev,
+              allocs;
+    double    start,
+              elapsed;
+
+    for (r = 0; r < repeats; r++) {
+	nominal_camera (ctx, truth);
+
+	for (s = 0; stages[s].name != NULL; s++) {
+	    nfev = ctx->nfev;
+	    njev = ctx->njev;
+	    allocs = allocations;
+
+	    start = seconds ();
+	    if (!stages[s].run (ctx)) {
+		fprintf (stderr, "%s: %s\n", stages[s].name, ctx->err.string);
+		return 0;
+	    }
+	    elapsed = seconds () - start;
+
+	    if (r == 0 || elapsed < result[s].best)
+		result[s].best = elapsed;
+	    result[s].nfev = ctx->nfev - nfev;
+	    result[s].njev = ctx->njev - njev;
+	    result[s].allocations = allocations - allocs;
+	}
+    }
+    return 1;
+}
+
+
+static void report (struct tsai_context *ctx, struct tsai_context *truth,
+		    char *target, struct stage *stages, struct stage_result *result)
+{
+    int       s;
+    double    mean,
+              stddev,
+              max,
+              sse,
+              total = 0;
+
+    for (s = 0; stages[s].name != NULL; s++) {
+	total += result[s].best;
+	printf ("%-12s %6d  %-28s %10.3f %6ld %6ld", target, ctx->cd.point_count,
+		stages[s].name, 1e3 * result[s].best, result[s].nfev, result[s].njev);
+	if (COUNTS_ALLOCATIONS)
+	    printf (" %6ld\n", result[s].allocations);
+	else
+	    printf ("    n/a\n");
+    }
+    printf ("%-12s %6d  %-28s %10.3f\n", target, ctx->cd.point_count, "total", 1e3 * total);
+
+    distorted_image_plane_error_stats (ctx, &mean, &stddev, &max, &sse);
+    printf ("  image plane error [pix]: mean %.4f  stddev %.4f  max %.4f\n",
+	    mean, stddev, max);
+    printf ("  ground truth error: f %.3g mm  Tz %.3g mm  kappa1 %.3g  "
+	    "Cx %.3g pix  Cy %.3g pix  sx %.3g\n",
+	    ctx->cc.f - truth->cc.f, ctx->cc.Tz - truth->cc.Tz,
+	    ctx->cc.kappa1 - truth->cc.kappa1, ctx->cp.Cx - truth->cp.Cx,
+	    ctx->cp.Cy - truth->cp.Cy, ctx->cp.sx - truth->cp.sx);
+}
+
+
+/* pytsai: can fail; int return type is required.
+ *
+ * Times the recalibration by warm start of the camera ctx has just been
+ * calibrated as, once it has drifted: the target is made again for the true
+ * camera moved by 0.5 mm and turned by 1 mrad, and calibrated from the
+ * camera parameters and calibration constants in ctx. */
+static int run_warm_start (struct tsai_context *ctx, struct tsai_context *truth,
+			   int coplanar, double sigma, double outliers, int repeats)
+{
+    static struct stage coplanar_warm_start[] = {
+	{"coplanar_warm_start", coplanar_calibration_with_warm_start},
+	{NULL, NULL}
+    };
+    static struct stage noncoplanar_warm_start[] = {
+	{"noncoplanar_warm_start", noncoplanar_calibration_with_warm_start},
+	{NULL, NULL}
+    };
+
+    struct stage *stages = coplanar ? coplanar_warm_start : noncoplanar_warm_start;
+    struct stage_result result[1];
+    struct tsai_context drifted = *truth;
+    struct camera_parameters cp = ctx->cp;
+    struct calibration_constants cc = ctx->cc;
+    int       r;
+    long      allocs;
+    double    start,
+              elapsed;
+
+    drifted.cc.Tz += 0.5;
+    drifted.cc.Rz += 1e-3;
+    apply_RPY_transform (&drifted);
+    if (!make_target (ctx, &drifted, ctx->cd.point_count, coplanar, sigma, outliers)) {
+	fprintf (stderr, "%s: %s\n", stages[0].name, ctx->err.string);
+	return 0;
+    }
+
+    for (r = 0; r < repeats; r++) {
+	ctx->cp = cp;
+	ctx->cc = cc;
+	ctx->nfev = ctx->njev = 0;
+	pytsai_clear (&ctx->err);
+	allocs = allocations;
+
+	start = seconds ();
+	if (!stages[0].run (ctx)) {
+	    fprintf (stderr, "%s: %s\n", stages[0].name, ctx->err.string);
+	    return 0;
+	}
+	elapsed = seconds () - start;
+
+	if (r == 0 || elapsed < result[0].best)
+	    result[0].best = elapsed;
+	result[0].nfev = ctx->nfev;
+	result[0].njev = ctx->njev;
+	result[0].allocations = allocations - allocs;
+    }
+
+    report (ctx, &drifted, coplanar ? "coplanar" : "noncoplanar", stages, result);
+    if (ctx->warm_start_fallback)
+	printf ("  the warm start diverged; calibrated from scratch\n");
+    return 1;
+}
+
+
+#define TRACKING_FRAMES 100
+
+/* pytsai: can fail; int return type is required.
+ *
+ * Times the pose tracking of the camera ctx has just been calibrated as, over
+ * TRACKING_FRAMES frames of the target through which the true camera moves
+ * by 0.5 mm and turns by 2 mrad a frame. */
+static int run_tracking (struct tsai_context *ctx, struct tsai_context *truth,
+			 int coplanar, double sigma, double outliers)
+{
+    struct tsai_context moving = *truth;
+    int       frame,
+              fallbacks = 0;
+    long      allocs = 0,
+              before;
+    double    start,
+              elapsed,
+              best = 0,
+              total = 0;
+
+    ctx->nfev = ctx->njev = 0;
+    for (frame = 0; frame < TRACKING_FRAMES; frame++) {
+	moving.cc.Tx += 0.5;
+	moving.cc.Rz += 2e-3;
+	apply_RPY_transform (&moving);
+	if (!make_target (ctx, &moving, ctx->cd.point_count, coplanar, sigma, outliers)) {
+	    fprintf (stderr, "pose_tracking: %s\n", ctx->err.string);
+	    return 0;
+	}
+
+	before = allocations;
+	start = seconds ();
+	if (!extrinsic_pose_tracking (ctx)) {
+	    fprintf (stderr, "pose_tracking: %s\n", ctx->err.string);
+	    return 0;
+	}
+	elapsed = seconds () - start;
+	allocs += allocations - before;
+
+	total += elapsed;
+	if (frame == 0 || elapsed < best)
+	    best = elapsed;
+	fallbacks += ctx->warm_start_fallback;
+    }
+
+    printf ("%-12s %6d  %-28s %10.3f %6ld %6ld", coplanar ? "coplanar" : "noncoplanar",
+	    ctx->cd.point_count, "pose_tracking (per frame)", 1e3 * total / TRACKING_FRAMES,
+	    ctx->nfev / TRACKING_FRAMES, ctx->njev / TRACKING_FRAMES);
+    if (COUNTS_ALLOCATIONS)
+	printf (" %6ld\n", allocs);
+    else
+	printf ("    n/a\n");
+    printf ("  best frame %.3f ms, pose estimated afresh in %d of %d frames\n",
+	    1e3 * best, fallbacks, TRACKING_FRAMES);
+    printf ("  ground truth error of the last pose: Rz %.3g rad  Tx %.3g mm  Tz %.3g mm\n",
+	    ctx->cc.Rz - moving.cc.Rz, ctx->cc.Tx - moving.cc.Tx, ctx->cc.Tz - moving.cc.Tz);
+    return 1;
+}
+
+
+#define BATCH_POINTS 1000000	/* most points of a batch */
+#define BATCH_FRAMES 1000	/* most frames of a batch */
+
+/* pytsai: can fail; int return type is required.
+ *
+ * Times the extrinsic parameter estimation of a batch of frames of the
+ * camera ctx has just been calibrated as, through which the true camera
+ * moves as for run_tracking(), both afresh and chained.  The frames are
+ * split into four blocks a thread of ctx's pool. */
+static int run_batch (struct tsai_context *ctx, struct tsai_context *truth,
+		      int coplanar, double sigma, double outliers)
+{
+    struct tsai_context moving = *truth,
+             *blocks,
+            **block;
+    struct tsai_frames frames;
+    double   *packed,
+             *pose,
+              start,
+              elapsed;
+    int       point_count = ctx->cd.point_count,
+              nframes = BATCH_POINTS / point_count,
+              nblocks = 4 * (ctx->pool != NULL ? pool_size (ctx->pool) : 1),
+              chain,
+              solved = 0,
+              b,
+              i,
+              k;
+    long      allocs,
+              nfev,
+              njev;
+
+    if (nframes > BATCH_FRAMES)
+	nframes = BATCH_FRAMES;
+    if (nblocks > nframes)
+	nblocks = nframes;
+    packed = (double *) malloc ((size_t) nframes * point_count * 5 * sizeof (double));
+    pose = (double *) malloc ((size_t) nframes * 6 * sizeof (double));
+    frames.offset = (ptrdiff_t *) malloc ((nframes + 1) * sizeof (ptrdiff_t));
+    blocks = (struct tsai_context *) calloc (nblocks, sizeof (struct tsai_context));
+    block = (struct tsai_context **) calloc (nblocks, sizeof (struct tsai_context *));
+
+    /* the frames, packed row by row as an N by 5 array */
+    for (i = 0; i < nframes; i++) {
+	moving.cc.Tx += 0.5;
+	moving.cc.Rz += 2e-3;
+	apply_RPY_transform (&moving);
+	if (!make_target (ctx, &moving, point_count, coplanar, sigma, outliers)) {
+	    fprintf (stderr, "extrinsic_batch: %s\n", ctx->err.string);
+	    return 0;
+	}
+	frames.offset[i] = (ptrdiff_t) i * point_count;
+	for (k = 0; k < point_count; k++) {
+	    packed[5 * (frames.offset[i] + k) + 0] = ctx->cd.xw[k];
+	    packed[5 * (frames.offset[i] + k) + 1] = ctx->cd.yw[k];
+	    packed[5 * (frames.offset[i] + k) + 2] = ctx->cd.zw[k];
+	    packed[5 * (frames.offset[i] + k) + 3] = ctx->cd.Xf[k];
+	    packed[5 * (frames.offset[i] + k) + 4] = ctx->cd.Yf[k];
+	}
+    }
+    frames.count = nframes;
+    frames.offset[nframes] = (ptrdiff_t) nframes * point_count;
+    frames.xw = packed;
+    frames.yw = packed + 1;
+    frames.zw = packed + 2;
+    frames.Xf = packed + 3;
+    frames.Yf = packed + 4;
+    frames.stride = 5;
+
+    for (chain = 0; chain <= 1; chain++) {
+	for (b = 0; b < nblocks; b++) {
+	    block[b] = blocks + b;
+	    block[b]->cp = ctx->cp;
+	    block[b]->cc = ctx->cc;
+	    block[b]->min_chunk = ctx->min_chunk;
+	    block[b]->jacobian = ctx->jacobian;
+	    block[b]->ransac_threshold = ctx->ransac_threshold;
+	    block[b]->loss = ctx->loss;
+	    block[b]->loss_scale = ctx->loss_scale;
+	    block[b]->nfev = block[b]->njev = 0;
+	}
+	block[0]->pool = ctx->pool;
+
+	allocs = allocations;
+	start = seconds ();
+	solved = extrinsic_parameter_estimation_batch (block, nblocks, &frames, chain, pose);
+	elapsed = seconds () - start;
+	allocs = allocations - allocs;
+	if (solved < 0) {
+	    fprintf (stderr, "extrinsic_batch: %s\n", block[0]->err.string);
+	    return 0;
+	}
+
+	nfev = njev = 0;
+	for (b = 0; b < nblocks; b++) {
+	    nfev += block[b]->nfev;
+	    njev += block[b]->njev;
+	}
+	printf ("%-12s %6d  %-28s %10.3f %6ld %6ld", coplanar ? "coplanar" : "noncoplanar",
+		point_count, chain ? "extrinsic_batch chained" : "extrinsic_batch (per frame)",
+		1e3 * elapsed / nframes, nfev / nframes, njev / nframes);
+	if (COUNTS_ALLOCATIONS)
+	    printf (" %6ld\n", allocs);
+	else
+	    printf ("    n/a\n");
+    }
+    printf ("  %d frames in %d blocks, %d solved; ground truth error of the last pose: "
+	    "Rz %.3g rad  Tx %.3g mm  Tz %.3g mm\n", nframes, nblocks, solved,
+	    pose[6 * (nframes - 1) + 2] - moving.cc.Rz, pose[6 * (nframes - 1) + 3] - moving.cc.Tx,
+	    pose[6 * (nframes - 1) + 5] - moving.cc.Tz);
+
+    for (b = 0; b < nblocks; b++)
+	tsai_context_release (blocks + b);
+    free (block);
+    free (blocks);
+    free (frames.offset);
+    free (pose);
+    free (packed);
+    return 1;
+}
+
+
+/* pytsai: can fail; int return type is required.
+ *
+ * Times the calibration of the true camera from nviews views in random poses
+ * of a coplanar target of point_count points each.  The views take their
+ * pool, min_chunk and jacobian from model. */
+static int run_views (struct tsai_context *model, int nviews, int point_count,
+		      double sigma, int repeats)
+{
+    struct tsai_context *views,
+             **view,
+              truth,
+              pose;
+    char      stage[32];
+    int       r,
+              v,
+              ok = 1;
+    long      allocs = 0;
+    double    start,
+              elapsed,
+              best = 0,
+              mean,
+              stddev,
+              max,
+              sse,
+              total = 0;
+
+    views = (struct tsai_context *) calloc (nviews, sizeof (struct tsai_context));
+    view = (struct tsai_context **) calloc (nviews, sizeof (struct tsai_context *));
+    memset (&truth, 0, sizeof truth);
+    random_state = 0x9e3779b97f4a7c15ULL + nviews;
+    true_camera (&truth, 1);
+
+    for (v = 0; v < nviews && ok; v++) {
+	pose = truth;
+	pose.cc.Rx = 0.8 * uniform () - 0.4;
+	pose.cc.Ry = 0.8 * uniform () - 0.4;
+	pose.cc.Rz = 0.6 * uniform () - 0.3;
+	pose.cc.Tx = 80 * uniform () - 40;
+	pose.cc.Ty = 80 * uniform () - 40;
+	pose.cc.Tz = 500 + 200 * uniform ();
+	apply_RPY_transform (&pose);
+
+	view[v] = views + v;
+	view[v]->min_chunk = model->min_chunk;
+	view[v]->jacobian = model->jacobian;
+	if (!make_target (view[v], &pose, point_count, 1, sigma, 0.0)) {
+	    fprintf (stderr, "views: %s\n", view[v]->err.string);
+	    ok = 0;
+	}
+    }
+    view[0]->pool = model->pool;
+
+    for (r = 0; r < repeats && ok; r++) {
+	for (v = 0; v < nviews; v++)
+	    nominal_camera (view[v], &truth);
+
+	allocs = allocations;
+	start = seconds ();
+	if (!coplanar_multi_view_calibration (view, nviews)) {
+	    for (v = 0; v < nviews; v++)
+		if (pytsai_haserror (&view[v]->err))
+		    fprintf (stderr, "views: view %d: %s\n", v, view[v]->err.string);
+	    ok = 0;
+	    break;
+	}
+	elapsed = seconds () - start;
+	allocs = allocations - allocs;
+	if (r == 0 || elapsed < best)
+	    best = elapsed;
+    }
+
+    if (ok) {
+	sprintf (stage, "multi_view (%d views)", nviews);
+	printf ("%-12s %6d  %-28s %10.3f %6ld %6ld", "coplanar",
+		nviews * point_count, stage, 1e3 * best, view[0]->nfev, view[0]->njev);
+	if (COUNTS_ALLOCATIONS)
+	    printf (" %6ld\n", allocs);
+	else
+	    printf ("    n/a\n");
+
+	for (v = 0; v < nviews; v++) {
+	    distorted_image_plane_error_stats (view[v], &mean, &stddev, &max, &sse);
+	    total += mean;
+	}
+	printf ("  image plane error [pix]: mean %.4f over the views\n", total / nviews);
+	printf ("  ground truth error: f %.3g mm  kappa1 %.3g  "
+		"Cx %.3g pix  Cy %.3g pix  sx %.3g\n",
+		view[0]->cc.f - truth.cc.f, view[0]->cc.kappa1 - truth.cc.kappa1,
+		view[0]->cp.Cx - truth.cp.Cx, view[0]->cp.Cy - truth.cp.Cy,
+		view[0]->cp.sx - truth.cp.sx);
+    }
+
+    view[0]->pool = NULL;
+    for (v = 0; v < nviews; v++)
+	tsai_context_release (views + v);
+    free (view);
+    free (views);
+    return ok;
+}
+
+
+/* pytsai: can fail; int return type is required.
+ *
+ * Times the calibration of a rig of ncameras cameras, each a little unlike
+ * the true camera, from their views of a noncoplanar target of point_count
+ * points in RIG_POSES random poses.  Every camera sees the first pose, and
+ * four in five of the others.  The views take their pool, min_chunk and
+ * jacobian from model. */
+#define RIG_POSES	10
+
+static int run_rig (struct tsai_context *model, int ncameras, int point_count,
+		    double sigma, int repeats)
+{
+    struct tsai_context *contexts,
+             **view,
+             *cameras,
+             *ctx,
+              pose;
+    char      stage[32];
+    int       r,
+              c,
+              k,
+              i,
+              nviews = 0,
+              ok = 1;
+    long      allocs = 0;
+    double   *extrinsics,
+             *poses,
+              start,
+              elapsed,
+              best = 0,
+              xw,
+              yw,
+              zw,
+              mean,
+              stddev,
+              max,
+              sse,
+              total = 0,
+              f_error = 0,
+              c_error = 0,
+              t_error = 0;
+
+    contexts = (struct tsai_context *) calloc (ncameras * RIG_POSES, sizeof (struct tsai_context));
+    view = (struct tsai_context **) calloc (ncameras * RIG_POSES, sizeof (struct tsai_context *));
+    cameras = (struct tsai_context *) calloc (ncameras, sizeof (struct tsai_context));
+    extrinsics = (double *) malloc ((ncameras + RIG_POSES) * 6 * sizeof (double));
+    poses = extrinsics + 6 * ncameras;
+    random_state = 0x9e3779b97f4a7c15ULL + ncameras;
+
+    for (c = 0; c < ncameras; c++) {
+	true_camera (cameras + c, 0);
+	cameras[c].cp.Cx += 10 * uniform () - 5;
+	cameras[c].cp.Cy += 10 * uniform () - 5;
+	cameras[c].cc.f += 1.0 * uniform () - 0.5;
+	cameras[c].cc.Rx = 0.7 * uniform () - 0.35;
+	cameras[c].cc.Ry = 0.7 * uniform () - 0.35;
+	cameras[c].cc.Rz = 0.4 * uniform () - 0.2;
+	cameras[c].cc.Tx = 80 * uniform () - 40;
+	cameras[c].cc.Ty = 80 * uniform () - 40;
+	cameras[c].cc.Tz = 550 + 100 * uniform ();
+	apply_RPY_transform (cameras + c);
+    }
+
+    for (k = 0; k < RIG_POSES && ok; k++) {
+	memset (&pose, 0, sizeof pose);
+	if (k > 0) {
+	    pose.cc.Rx = 0.3 * uniform () - 0.15;
+	    pose.cc.Ry = 0.3 * uniform () - 0.15;
+	    pose.cc.Rz = 0.3 * uniform () - 0.15;
+	    pose.cc.Tx = 60 * uniform () - 30;
+	    pose.cc.Ty = 60 * uniform () - 30;
+	    pose.cc.Tz = 60 * uniform () - 30;
+	}
+	apply_RPY_transform (&pose);
+
+	for (c = 0; c < ncameras && ok; c++) {
+	    if (k > 0 && uniform () < 0.2)
+		continue;
+	    ctx = view[c * RIG_POSES + k] = contexts + c * RIG_POSES + k;
+	    ctx->min_chunk = model->min_chunk;
+	    ctx->jacobian = model->jacobian;
+	    if (!tsai_context_reserve (ctx, point_count)) {
+		fprintf (stderr, "rig: %s\n", ctx->err.string);
+		ok = 0;
+		break;
+	    }
+	    for (i = 0; i < point_count; i++) {
+		ctx->cd.xw[i] = 250 * uniform () - 125;
+		ctx->cd.yw[i] = 250 * uniform () - 125;
+		ctx->cd.zw[i] = 100 * uniform ();
+		world_coord_to_camera_coord (&pose, ctx->cd.xw[i], ctx->cd.yw[i], ctx->cd.zw[i],
+					     &xw, &yw, &zw);
+		world_coord_to_image_coord (cameras + c, xw, yw, zw,
+					    &ctx->cd.Xf[i], &ctx->cd.Yf[i]);
+		ctx->cd.Xf[i] += sigma * gaussian ();
+		ctx->cd.Yf[i] += sigma * gaussian ();
+	    }
+	    nviews++;
+	}
+    }
+    for (i = 0; i < ncameras * RIG_POSES && ok; i++)
+	if (view[i] != NULL) {
+	    view[i]->pool = model->pool;
+	    break;
+	}
+
+    for (r = 0; r < repeats && ok; r++) {
+	for (i = 0; i < ncameras * RIG_POSES; i++)
+	    if (view[i] != NULL)
+		nominal_camera (view[i], cameras + i / RIG_POSES);
+
+	allocs = allocations;
+	start = seconds ();
+	if (!rig_calibration (view, ncameras, RIG_POSES, extrinsics, poses)) {
+	    for (i = 0; i < ncameras * RIG_POSES; i++)
+		if (view[i] != NULL && pytsai_haserror (&view[i]->err))
+		    fprintf (stderr, "rig: camera %d, pose %d: %s\n", i / RIG_POSES,
+			     i % RIG_POSES, view[i]->err.string);
+	    ok = 0;
+	    break;
+	}
+	elapsed = seconds () - start;
+	allocs = allocations - allocs;
+	if (r == 0 || elapsed < best)
+	    best = elapsed;
+    }
+
+    if (ok) {
+	sprintf (stage, "rig (%d cameras)", ncameras);
+	printf ("%-12s %6d  %-28s %10.3f %6ld %6ld", "noncoplanar",
+		nviews * point_count, stage, 1e3 * best, view[0]->nfev, view[0]->njev);
+	if (COUNTS_ALLOCATIONS)
+	    printf (" %6ld\n", allocs);
+	else
+	    printf ("    n/a\n");
+
+	for (i = 0; i < ncameras * RIG_POSES; i++) {
+	    if (view[i] == NULL)
+		continue;
+	    distorted_image_plane_error_stats (view[i], &mean, &stddev, &max, &sse);
+	    total += mean;
+	}
+	for (c = 0; c < ncameras; c++) {
+	    ctx = view[c * RIG_POSES];
+	    f_error = MAX (f_error, fabs (ctx->cc.f - cameras[c].cc.f));
+	    c_error = MAX (c_error, fabs (ctx->cp.Cx - cameras[c].cp.Cx));
+	    c_error = MAX (c_error, fabs (ctx->cp.Cy - cameras[c].cp.Cy));
+	    t_error = MAX (t_error, fabs (extrinsics[6 * c + 3] - cameras[c].cc.Tx));
+	    t_error = MAX (t_error, fabs (extrinsics[6 * c + 4] - cameras[c].cc.Ty));
+	    t_error = MAX (t_error, fabs (extrinsics[6 * c + 5] - cameras[c].cc.Tz));
+	}
+	printf ("  image plane error [pix]: mean %.4f over the views\n", total / nviews);
+	printf ("  ground truth error: f %.3g mm  Cx, Cy %.3g pix  Tx, Ty, Tz %.3g mm "
+		"(the largest over the cameras)\n", f_error, c_error, t_error);
+    }
+
+    for (i = 0; i < ncameras * RIG_POSES; i++) {
+	contexts[i].pool = NULL;
+	tsai_context_release (contexts + i);
+    }
+    free (extrinsics);
+    free (cameras);
+    free (view);
+    free (contexts);
+    return ok;
+}
+
+
+static void usage (char *program)
+{
+    fprintf (stderr, "usage: %s [-r repeats] [-s sigma] [-t threads] [-c min_chunk] "
+	     "[-j jacobian] [-o outliers] [-a threshold] [-l loss] [-v views] [-p points] "
+	     "[-m cameras] [points ...]\n", program);
+    exit (2);
+}
+
+
+int main (int argc, char **argv)
+{
+    static int default_sizes[] = {50, 500, 5000, 50000};
+
+    struct tsai_context *ctx,
+              truth;
+    struct stage_result result[MAX_STAGES];
+    int      *sizes = default_sizes,
+              nsizes = 4,
+              repeats = 3,
+              nthreads = 1,
+              min_chunk = 0,
+              streamed = 0,
+              max_views = 40,
+              view_points = 100,
+              max_cameras = 40,
+              coplanar,
+              i;
+    enum tsai_loss loss = TSAI_LOSS_SQUARED;
+    static char *loss_names[] = {"squared", "huber", "cauchy", "tukey"};
+    double    sigma = 0.1,
+              outliers = 0.0,
+              threshold = 0.0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+	if (i + 1 >= argc)
+	    usage (argv[0]);
+	if (strcmp (argv[i], "-r") == 0)
+	    repeats = atoi (argv[++i]);
+	else if (strcmp (argv[i], "-s") == 0)
+	    sigma = atof (argv[++i]);
+	else if (strcmp (argv[i], "-t") == 0)
+	    nthreads = atoi (argv[++i]);
+	else if (strcmp (argv[i], "-c") == 0)
+	    min_chunk = atoi (argv[++i]);
+	else if (strcmp (argv[i], "-o") == 0)
+	    outliers = atof (argv[++i]);
+	else if (strcmp (argv[i], "-a") == 0)
+	    threshold = atof (argv[++i]);
+	else if (strcmp (argv[i], "-v") == 0)
+	    max_views = atoi (argv[++i]);
+	else if (strcmp (argv[i], "-p") == 0)
+	    view_points = atoi (argv[++i]);
+	else if (strcmp (argv[i], "-m") == 0)
+	    max_cameras = atoi (argv[++i]);
+	else if (strcmp (argv[i], "-l") == 0) {
+	    for (loss = TSAI_LOSS_SQUARED; loss <= TSAI_LOSS_TUKEY; loss++)
+		if (strcmp (argv[i + 1], loss_names[loss]) == 0)
+		    break;
+	    if (loss > TSAI_LOSS_TUKEY)
+		usage (argv[0]);
+	    i++;
+	} else if (strcmp (argv[i], "-j") == 0 && strcmp (argv[i + 1], "dense") == 0)
+	    streamed = 0, i++;
+	else if (strcmp (argv[i], "-j") == 0 && strcmp (argv[i + 1], "streamed") == 0)
+	    streamed = 1, i++;
+	else
+	    usage (argv[0]);
+    }
+    if (repeats < 1 || min_chunk < 0 || max_views < 0 || view_points < 7 ||
+	max_cameras < 0 || outliers < 0 || outliers > 1 || threshold < 0)
+	usage (argv[0]);
+    if (nthreads < 1)
+	nthreads = pool_cpu_count ();
+    if (i < argc) {
+	nsizes = argc - i;
+	sizes = (int *) malloc (nsizes * sizeof (int));
+	for (nsizes = 0; i < argc; i++)
+	    if ((sizes[nsizes++] = atoi (argv[i])) < 7)
+		usage (argv[0]);
+    }
+
+    /* the context holds the per-point storage, so keep it off the stack */
+    ctx = (struct tsai_context *) calloc (1, sizeof (struct tsai_context));
+    memset (&truth, 0, sizeof truth);
+    if (nthreads > 1 && (ctx->pool = pool_new (nthreads)) == NULL) {
+	fprintf (stderr, "cannot start %d threads\n", nthreads);
+	return 1;
+    }
+    ctx->min_chunk = min_chunk;
+    ctx->jacobian = streamed ? TSAI_JACOBIAN_STREAMED : TSAI_JACOBIAN_DENSE;
+    ctx->ransac_threshold = threshold;
+    ctx->loss = loss;
+    printf ("threads %d, min_chunk %d, jacobian %s, kernels %s\n", nthreads,
+	    min_chunk > 0 ? min_chunk : TSAI_MIN_CHUNK,
+	    streamed ? "streamed" : "dense", tsai_simd_init ());
+    if (outliers > 0 || threshold > 0 || loss != TSAI_LOSS_SQUARED)
+	printf ("outliers %g, RANSAC threshold %g pix, loss %s\n", outliers,
+		threshold, loss_names[loss]);
+
+    printf ("%-12s %6s  %-28s %10s %6s %6s %6s\n",
+	    "target", "points", "stage", "best [ms]", "nfev", "njev", "allocs");
+
+    for (coplanar = 1; coplanar >= 0; coplanar--) {
+	for (i = 0; i < nsizes; i++) {
+	    struct stage *stages = coplanar ? coplanar_stages : noncoplanar_stages;
+	    char     *target = coplanar ? "coplanar" : "noncoplanar";
+
+	    random_state = 0x9e3779b97f4a7c15ULL + sizes[i];
+	    true_camera (&truth, coplanar);
+	    pytsai_clear (&ctx->err);
+	    if (!make_target (ctx, &truth, sizes[i], coplanar, sigma, outliers)) {
+		fprintf (stderr, "%s: %s\n", target, ctx->err.string);
+		return 1;
+	    }
+
+	    if (!run_pipeline (ctx, &truth, stages, repeats, result))
+		return 1;
+	    report (ctx, &truth, target, stages, result);
+
+	    if (!run_warm_start (ctx, &truth, coplanar, sigma, outliers, repeats))
+		return 1;
+
+	    if (!run_tracking (ctx, &truth, coplanar, sigma, outliers))
+		return 1;
+
+	    if (!run_batch (ctx, &truth, coplanar, sigma, outliers))
+		return 1;
+	}
+    }
+
+    for (i = 5; i <= max_views; i *= 2)
+	if (!run_views (ctx, i, view_points, sigma, repeats))
+	    return 1;
+
+    for (i = 5; i <= max_cameras; i *= 2)
+	if (!run_rig (ctx, i, view_points, sigma, repeats))
+	    return 1;
+
+    if (ctx->pool != NULL)
+	pool_free (ctx->pool);
+    tsai_context_release (ctx);
+    free (ctx);
+    if (sizes != default_sizes)
+	free (sizes);
+    return 0;
+}
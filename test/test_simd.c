@@ -0,0 +1,232 @@
+/**
+ * test_simd.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+ /***************************************************************************\
+ * Native test of the vector error kernels (cal_simd.c).                     *
+ *                                                                           *
+ * Every error_rows kernel built for this machine, up to the level that      *
+ * tsai_simd_init() picks for the processor, is run over 1 to 17 points,     *
+ * starting both on and off a vector boundary, from the image coordinates    *
+ * and from precomputed sensor coordinates (Xd, Yd).  Its errors must match  *
+ * error_rows_scalar() to within the last bits of the hypotenuse, and it     *
+ * must write nothing outside the range of points it was given.  So every    *
+ * length of the last, partial vector is covered for each kernel.            *
+ *                                                                           *
+ * Build and run from the top of the tree with something like:               *
+ *                                                                           *
+ *      cc -O2 -ffp-contract=off -o test_simd test/test_simd.c               *
+ *          src/errors.c src/tsai/cal_batch.c src/tsai/cal_cpu.c             *
+ *          src/tsai/cal_eval.c src/tsai/cal_jac.c src/tsai/cal_main.c       *
+ *          src/tsai/cal_ransac.c src/tsai/cal_rig.c src/tsai/cal_robust.c   *
+ *          src/tsai/cal_simd.c src/tsai/cal_tran.c src/tsai/cal_views.c     *
+ *          src/tsai/ecalmain.c src/matrix/matrix.c src/minpack/dpmpar.c     *
+ *          src/minpack/enorm.c src/minpack/fdjac2.c src/minpack/lmder.c     *
+ *          src/minpack/lmdif.c src/minpack/lmpar.c src/minpack/lmstr.c      *
+ *          src/minpack/qrfac.c src/minpack/qrsolv.c src/pool/pool.c         *
+ *          -lm -lpthread                                                    *
+ *      ./test_simd                                                          *
+ *                                                                           *
+ * It names the kernels it checked and exits with 0, or prints each mismatch *
+ * and exits with 1.  Set PYTSAI_SIMD to leave out the levels above one, as  *
+ * it does for the library.                                                  *
+ \***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "../src/tsai/cal_simd.h"
+
+#define MAX_POINTS	17
+#define MAX_BEGIN	3
+#define POINTS		(MAX_BEGIN + MAX_POINTS + 1)
+#define GUARD		(-1.0)		/* never an error */
+
+
+struct kernel {
+    char     *name;
+    enum tsai_simd_level level;
+    void    (*rows) (struct error_model *model, int begin, int end);
+};
+
+static struct kernel kernels[] = {
+#if defined (TSAI_X86_KERNELS)
+    {"sse2", TSAI_SIMD_SSE2, error_rows_sse2},
+    {"avx2", TSAI_SIMD_AVX2, error_rows_avx2},
+    {"avx512", TSAI_SIMD_AVX512, error_rows_avx512},
+#elif defined (TSAI_NEON_KERNELS)
+    {"neon", TSAI_SIMD_NEON, error_rows_neon},
+#endif
+    {NULL, TSAI_SIMD_SCALAR, NULL}
+};
+
+
+/* xorshift64*: the same sequence on every platform */
+static unsigned long long random_state = 88172645463325252ULL;
+
+static double uniform (void)
+{
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return ((random_state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/* A 640 x 480 camera 600 mm in front of a 250 x 250 x 100 mm target, and
+ * image points a pixel or two off its projections. */
+static int make_points (struct tsai_context *ctx, double *Xd, double *Yd)
+{
+    int       i;
+
+    ctx->cp.Ncx = ctx->cp.Nfx = 640;
+    ctx->cp.dx = ctx->cp.dy = ctx->cp.dpx = ctx->cp.dpy = 0.0074;
+    ctx->cp.Cx = 326.5;
+    ctx->cp.Cy = 235.75;
+    ctx->cp.sx = 1.002;
+    ctx->cc.f = 8.0;
+    ctx->cc.kappa1 = 2e-3;
+    ctx->cc.Rx = 0.35;
+    ctx->cc.Ry = -0.25;
+    ctx->cc.Rz = 0.1;
+    ctx->cc.Tx = -40;
+    ctx->cc.Ty = -30;
+    ctx->cc.Tz = 600;
+    apply_RPY_transform (ctx);
+
+    if (!tsai_context_reserve (ctx, POINTS))
+	return 0;
+    for (i = 0; i < POINTS; i++) {
+	ctx->cd.xw[i] = 250 * uniform () - 125;
+	ctx->cd.yw[i] = 250 * uniform () - 125;
+	ctx->cd.zw[i] = 100 * uniform ();
+	world_coord_to_image_coord (ctx, ctx->cd.xw[i], ctx->cd.yw[i], ctx->cd.zw[i],
+				    &ctx->cd.Xf[i], &ctx->cd.Yf[i]);
+	ctx->cd.Xf[i] += 4 * uniform () - 2;
+	ctx->cd.Yf[i] += 4 * uniform () - 2;
+	Xd[i] = ctx->cp.dpx * (ctx->cd.Xf[i] - ctx->cp.Cx) / ctx->cp.sx;
+	Yd[i] = ctx->cp.dpy * (ctx->cd.Yf[i] - ctx->cp.Cy);
+    }
+    return 1;
+}
+
+
+static void make_model (struct error_model *model, struct tsai_context *ctx)
+{
+    memset (model, 0, sizeof *model);
+    model->ctx = ctx;
+    model->r[0] = ctx->cc.r1;
+    model->r[1] = ctx->cc.r2;
+    model->r[2] = ctx->cc.r3;
+    model->r[3] = ctx->cc.r4;
+    model->r[4] = ctx->cc.r5;
+    model->r[5] = ctx->cc.r6;
+    model->r[6] = ctx->cc.r7;
+    model->r[7] = ctx->cc.r8;
+    model->r[8] = ctx->cc.r9;
+    model->value[TSAI_RX] = ctx->cc.Rx;
+    model->value[TSAI_RY] = ctx->cc.Ry;
+    model->value[TSAI_RZ] = ctx->cc.Rz;
+    model->value[TSAI_TX] = ctx->cc.Tx;
+    model->value[TSAI_TY] = ctx->cc.Ty;
+    model->value[TSAI_TZ] = ctx->cc.Tz;
+    model->value[TSAI_KAPPA1] = ctx->cc.kappa1;
+    model->value[TSAI_F] = ctx->cc.f;
+    model->value[TSAI_SX] = ctx->cp.sx;
+    model->value[TSAI_CX] = ctx->cp.Cx;
+    model->value[TSAI_CY] = ctx->cp.Cy;
+}
+
+
+/* pytsai: cannot fail.  The number of mismatches of kernel over [begin, end)
+ * against error_rows_scalar(). */
+static int check (struct kernel *kernel, struct error_model *model, double *Xd, double *Yd,
+		  int begin, int end)
+{
+    double    expected[POINTS],
+              actual[POINTS];
+
+    int       i,
+              failures = 0;
+
+    model->Xd = Xd;
+    model->Yd = Yd;
+    for (i = 0; i < POINTS; i++)
+	expected[i] = actual[i] = GUARD;
+    model->out = expected;
+    error_rows_scalar (model, begin, end);
+    model->out = actual;
+    kernel->rows (model, begin, end);
+
+    for (i = 0; i < POINTS; i++)
+	if (i < begin || i >= end ? actual[i] != GUARD :
+	    !(fabs (actual[i] - expected[i]) <= 4 * DBL_EPSILON * expected[i])) {
+	    printf ("%s, points %d to %d%s: error %d is %.17g, not %.17g\n",
+		    kernel->name, begin, end, Xd != NULL ? " (Xd, Yd)" : "",
+		    i, actual[i], i < begin || i >= end ? GUARD : expected[i]);
+	    failures++;
+	}
+    return failures;
+}
+
+
+int main (void)
+{
+    static struct tsai_context ctx;
+
+    struct error_model model;
+    struct kernel *kernel;
+    enum tsai_simd_level best;
+    double    Xd[POINTS],
+              Yd[POINTS];
+    int       begin,
+              n,
+              failures = 0;
+
+    tsai_simd_init ();
+    best = tsai_kernels.level;
+
+    if (!make_points (&ctx, Xd, Yd)) {
+	fprintf (stderr, "out of memory\n");
+	return 1;
+    }
+    make_model (&model, &ctx);
+
+    for (kernel = kernels; kernel->name != NULL; kernel++) {
+	if (kernel->level > best) {
+	    printf ("%s: above the level in use, skipped\n", kernel->name);
+	    continue;
+	}
+	for (begin = 0; begin <= MAX_BEGIN; begin += MAX_BEGIN)
+	    for (n = 1; n <= MAX_POINTS; n++) {
+		failures += check (kernel, &model, NULL, NULL, begin, begin + n);
+		failures += check (kernel, &model, Xd, Yd, begin, begin + n);
+	    }
+	printf ("%s: 1 to %d points checked\n", kernel->name, MAX_POINTS);
+    }
+
+    tsai_context_release (&ctx);
+    if (failures > 0) {
+	printf ("%d mismatches\n", failures);
+	return 1;
+    }
+    return 0;
+}